@@ -58,6 +58,8 @@ LOCAL_SRC_FILES = \
 	android/String8.cpp \
 	audiofilters/aac-eld-android.cpp \
 	audiofilters/alaw.c \
+	audiofilters/asyncfilerec.c \
+	audiofilters/audioplayout.c \
 	audiofilters/audiomixer.c \
 	audiofilters/devices.c \
 	audiofilters/dtmfgen.c \
@@ -74,10 +76,13 @@ LOCAL_SRC_FILES = \
 	audiofilters/msvolume.c \
 	audiofilters/tonedetector.c \
 	audiofilters/ulaw.c \
+	audiofilters/virtualsnd.c \
 	base/eventqueue.c \
+	base/msasynclog.c \
 	base/mscommon.c \
 	base/msfactory.c \
 	base/msfilter.c \
+	base/msmetrics.c \
 	base/msqueue.c \
 	base/mssndcard.c \
 	base/msticker.c \
@@ -93,13 +98,16 @@ LOCAL_SRC_FILES = \
 	otherfilters/tee.c \
 	otherfilters/void.c \
 	utils/audiodiff.c \
+	utils/audio_playout.c \
 	utils/dsptools.c \
 	utils/g722_decode.c \
 	utils/g722_encode.c \
+	utils/g722_qmf.c \
 	utils/kiss_fft.c \
 	utils/kiss_fftr.c \
 	utils/msjava.c \
 	utils/stream_regulator.c \
+	utils/tone_cache.c \
 	voip/audioconference.c \
 	voip/audiostream.c \
 	voip/bitratecontrol.c \
@@ -111,6 +119,7 @@ LOCAL_SRC_FILES = \
 	voip/qosanalyzer.c \
 	voip/qualityindicator.c \
 	voip/ringstream.c \
+	voip/streammanager.c \
 	voip/stun.c \
 	voip/stun_udp.c
 
@@ -143,6 +152,9 @@ LOCAL_SRC_FILES += \
 	voip/rfc3984.c \
 	voip/vp8rtpfmt.c \
 	voip/layouts.c \
+	utils/async_encoder.c \
+	utils/rtp_reorder_buffer.c \
+	utils/synthetic_frames.c \
 	utils/shaders.c \
 	utils/opengles_display.c \
 	utils/ffmpeg-priv.c \
@@ -150,11 +162,13 @@ LOCAL_SRC_FILES += \
 	videofilters/videodec.c \
 	videofilters/pixconv.c  \
 	videofilters/sizeconv.c \
+	videofilters/framerateconv.c \
 	videofilters/nowebcam.c \
 	videofilters/h264dec.c \
 	videofilters/mire.c \
 	videofilters/vp8.c \
 	videofilters/jpegwriter.c \
+	utils/jpeg_snapshot.c \
 	android/android-display.c \
 	android/android-display-bad.cpp \
 	android/androidvideo.cpp \
@@ -166,14 +180,16 @@ LOCAL_SRC_FILES+= \
 	voip/scaler.c.neon \
 	voip/scaler_arm.S.neon \
 	voip/msvideo.c \
-	voip/msvideo_neon.c.neon
+	voip/msvideo_neon.c.neon \
+	voip/msvideo_quality.c.neon
 else
 ifeq ($(TARGET_ARCH), x86)
 	LOCAL_CFLAGS += -DVIDEO_ENABLED
 endif
 LOCAL_SRC_FILES+= \
 	voip/scaler.c \
-	voip/msvideo.c
+	voip/msvideo.c \
+	voip/msvideo_quality.c
 endif
 
 ifeq ($(BUILD_MATROSKA), 1)
@@ -243,7 +259,8 @@ endif
 #if BUILD_SPEEX
 LOCAL_SRC_FILES += \
 	audiofilters/msspeex.c \
-	audiofilters/speexec.c
+	audiofilters/speexec.c \
+	utils/ec_service.c
 
 ##if BUILD_GSM
 LOCAL_SRC_FILES += audiofilters/gsm.c
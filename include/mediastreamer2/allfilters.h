@@ -146,7 +146,12 @@ typedef enum MSFilterId{
 	MS_MKV_PLAYER_ID,
 	MS_VAD_DTX_ID,
 	MS_BB10_DISPLAY_ID,
-	MS_BB10_CAPTURE_ID
+	MS_BB10_CAPTURE_ID,
+	MS_FRAME_RATE_CONV_ID,
+	MS_VIRTUAL_SND_READ_ID,
+	MS_VIRTUAL_SND_WRITE_ID,
+	MS_ASYNC_FILE_REC_ID,
+	MS_AUDIO_PLAYOUT_ID
 } MSFilterId;
 
 
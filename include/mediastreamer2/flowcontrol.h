@@ -37,6 +37,11 @@ extern "C"{
 
 MS2_PUBLIC void ms_audio_flow_controller_init(MSAudioFlowController *ctl);
 
+/**
+ * Set the number of samples to drop over the next total_samples samples, to compensate a clock drift.
+ * A negative samples_to_drop inserts samples instead, for a drift in the opposite direction.
+ * The samples are dropped or inserted where the signal is the smoothest, spread over the processed blocks.
+**/
 MS2_PUBLIC void ms_audio_flow_controller_set_target(MSAudioFlowController *ctl, int samples_to_drop, int total_samples);
 
 MS2_PUBLIC mblk_t *ms_audio_flow_controller_process(MSAudioFlowController *ctl, mblk_t *m);
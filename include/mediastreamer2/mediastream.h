@@ -139,6 +139,16 @@ struct _MediaStream {
 	int target_bitrate;
 	media_stream_process_rtcp_callback_t process_rtcp;
 	OrtpEvDispatcher *evd;
+	uint64_t start_time_ms;
+	uint64_t last_qi_update_time_ms;
+	struct _MSMediaStreamMetrics *metrics; /*published in the registry of msmetrics.h*/
+	char *mtu_destination; /*whose path mtu is requested to the service of msmtu.h*/
+	int applied_mtu;
+	volatile bool_t mtu_changed; /*set by the thread of the mtu discovery service*/
+	bool_t mtu_discovery_enabled;
+	struct _MSManagedStream *managed; /*its entry in the MSStreamManager managing it, if any*/
+	MSLogSite rtcp_received_log_site; /*rate limits the RTCP logs of this stream*/
+	MSLogSite rtcp_emitted_log_site;
 };
 
 MS2_PUBLIC void media_stream_init(MediaStream *stream);
@@ -170,6 +180,14 @@ MS2_PUBLIC void media_stream_set_adaptive_bitrate_algorithm(MediaStream *stream,
 
 MS2_PUBLIC void media_stream_enable_adaptive_jittcomp(MediaStream *stream, bool_t enabled);
 
+/**
+ * Discover the path MTU to the destination of the stream in the background (see msmtu.h), and set the max payload
+ * size of its encoder and MSRtpSend accordingly with MS_FILTER_SET_MTU, each time it changes. The destination is
+ * checked by media_stream_iterate(), so that a change of address, by ICE for example, is followed.
+ * The payloads are never made larger than ms_get_payload_max_size().
+**/
+MS2_PUBLIC void media_stream_enable_mtu_discovery(MediaStream *stream, bool_t enabled);
+
 /*
  * deprecated, use media_stream_set_srtp_recv_key and media_stream_set_srtp_send_key.
 **/
@@ -396,6 +414,8 @@ struct _AudioStream
 	bool_t eq_active;
 	bool_t use_ng;/*noise gate*/
 	bool_t is_ec_delay_set;
+	bool_t use_adaptive_playout;
+	MSFilter *playout; /*smoothes the playout delay changes of the rtp receiver*/
 };
 
 /**
@@ -652,6 +672,13 @@ MS2_PUBLIC void audio_stream_set_sound_card_output_gain(AudioStream *stream, flo
  */
 MS2_PUBLIC float audio_stream_get_sound_card_output_gain(const AudioStream *stream);
 
+/**
+ * enable adaptive playout, must be done before start(): the rtp receiver holds the packets for a delay
+ * following the jitter measured on them, instead of the jitter buffer of the RtpSession,
+ * and the decoded audio is time stretched to follow the changes of this delay.
+ * */
+MS2_PUBLIC void audio_stream_enable_adaptive_playout(AudioStream *stream, bool_t enabled);
+
 /**
  * enable noise gate, must be done before start()
  * */
@@ -0,0 +1,68 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef msasyncfilerec_h
+#define msasyncfilerec_h
+
+#include <mediastreamer2/msfilter.h>
+
+/**
+ * The asynchronous file recorder takes PCM audio like MSFileRec, implements the recorder interface,
+ * and chooses the format of the file from its extension when it is opened:
+ * - .wav: raw PCM in a wav file, appended to if the file exists,
+ * - .ogg or .opus: Opus in an Ogg file, which is overwritten,
+ * - .mkv or .mka: Opus or G.711 u-law (see MS_ASYNC_FILE_REC_SET_CODEC) in a Matroska file,
+ *   appended to if the file exists.
+ *
+ * The ticker only queues the audio: encoding and writing happen on a pool of writer tickers, one per CPU, shared by all the recorders.
+ * The queue is bounded, the audio arriving when it is full is dropped and accounted in the statistics.
+ * The headers of the file are written periodically so that a recording survives a crash.
+**/
+
+typedef struct _MSAsyncFileRecStats {
+	int queued;	/**< Duration of the audio waiting to be encoded, in milliseconds */
+	int max_queued;	/**< Highest value of queued since the file was opened */
+	int dropped;	/**< Duration of the audio dropped because the queue was full, in milliseconds */
+	unsigned int dropped_blocks;	/**< Number of blocks dropped because the queue was full */
+	int recorded;	/**< Duration of the audio handed to the encoder, in milliseconds */
+	unsigned int syncs;	/**< Number of times the headers of the file were written */
+} MSAsyncFileRecStats;
+
+/** Set the codec used in Matroska files, "opus" (default) or "pcmu". pcmu requires 8kHz mono audio. */
+#define MS_ASYNC_FILE_REC_SET_CODEC	MS_FILTER_METHOD(MS_ASYNC_FILE_REC_ID,0,const char)
+
+/** Set the maximum duration of audio waiting to be encoded, in milliseconds (default 2000) */
+#define MS_ASYNC_FILE_REC_SET_MAX_QUEUE	MS_FILTER_METHOD(MS_ASYNC_FILE_REC_ID,1,int)
+
+/** Set the interval between two writes of the headers of the file, in milliseconds (default 5000), 0 to disable */
+#define MS_ASYNC_FILE_REC_SET_SYNC_INTERVAL	MS_FILTER_METHOD(MS_ASYNC_FILE_REC_ID,2,int)
+
+#define MS_ASYNC_FILE_REC_GET_STATS	MS_FILTER_METHOD(MS_ASYNC_FILE_REC_ID,3,MSAsyncFileRecStats)
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+MS2_PUBLIC extern MSFilterDesc ms_async_file_rec_desc;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,66 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef MS_ASYNC_LOG_H
+#define MS_ASYNC_LOG_H
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * @brief The asynchronous log sink takes the place of the oRTP log handler, so that the threads logging, such as
+ * the tickers, only format their messages into a ring buffer of their own, without locking. A background thread
+ * empties the rings and gives the messages to the handler that was installed before, which does the writing.
+ *
+ * A thread logging faster than the writer loses the messages that do not fit in its ring. The number of lost
+ * messages is logged by the writer. Fatal messages are written synchronously, after the pending ones.
+**/
+
+typedef struct _MSAsyncLogStats {
+	uint64_t written;	/**< Number of messages given to the handler */
+	uint64_t dropped;	/**< Number of messages lost because a ring was full */
+} MSAsyncLogStats;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * @brief Install the asynchronous log sink in front of the current oRTP log handler.
+ * The handler must not be changed with ortp_set_log_handler() until ms_async_log_stop() is called.
+ * @return 0 if successful, -1 if the sink is already started.
+**/
+MS2_PUBLIC int ms_async_log_start(void);
+
+/**
+ * @brief Write the pending messages, stop the background thread and restore the previous log handler.
+**/
+MS2_PUBLIC void ms_async_log_stop(void);
+
+/**
+ * @brief Write the pending messages of all the threads before returning.
+**/
+MS2_PUBLIC void ms_async_log_flush(void);
+
+MS2_PUBLIC void ms_async_log_get_stats(MSAsyncLogStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
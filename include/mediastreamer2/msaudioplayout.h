@@ -0,0 +1,56 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef msaudioplayout_h
+#define msaudioplayout_h
+
+#include <mediastreamer2/msfilter.h>
+
+/**
+ * The audio playout filter takes the decoded audio of a stream whose MSRtpRecv does adaptive playout
+ * (see MS_RTP_RECV_SET_PLAYOUT_PARAMS), and outputs it at the pace of the ticker.
+ * It absorbs the changes of the playout delay without audible cuts:
+ * - when more audio is buffered than needed, because the delay was decreased or the decoder concealed
+ *   packets that finally arrived, it removes pitch periods from the audio (time compression),
+ *   and drops the concealment blocks (see mblk_get_plc_flag()) before real audio,
+ * - when audio is missing, because the delay was increased or packets were lost, it repeats the last
+ *   pitch period, fading out, and blends the audio back in when it resumes.
+**/
+
+typedef struct _MSAudioPlayoutStats {
+	int buffered;	/**< Duration of the audio waiting to be output, in milliseconds */
+	int accelerated;	/**< Duration of the audio removed by time compression, in milliseconds */
+	int expanded;	/**< Duration of the audio synthesized by repeating pitch periods, in milliseconds */
+	int concealment_dropped;	/**< Duration of the concealment blocks dropped, in milliseconds */
+	int overflow_dropped;	/**< Duration of the audio dropped because too much was buffered, in milliseconds */
+} MSAudioPlayoutStats;
+
+#define MS_AUDIO_PLAYOUT_GET_STATS	MS_FILTER_METHOD(MS_AUDIO_PLAYOUT_ID,0,MSAudioPlayoutStats)
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+MS2_PUBLIC extern MSFilterDesc ms_audio_playout_desc;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
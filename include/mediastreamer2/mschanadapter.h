@@ -21,7 +21,30 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <mediastreamer2/msfilter.h>
 
+/**
+ * The channel adapter converts between any numbers of channels up to MS_CHANNEL_ADAPTER_MAX_CHANNELS.
+ * Channels are expected in the Vorbis/Opus order:
+ * 1: mono, 2: L R, 3: L C R, 4: L R RL RR, 5: L C R RL RR, 6: L C R RL RR LFE,
+ * 7: L C R SL SR RC LFE, 8: L C R SL SR RL RR LFE.
+ * The default mapping copies a mono input to the center channel of the output, or to its left and right channels
+ * when it has no center, the other channels being silent. It folds the channels missing from the output into their
+ * nearest neighbours, scaled so that the downmix never clips. LFE is dropped when downmixing.
+ * Setting the number of input or output channels resets the mapping to its default.
+ */
+#define MS_CHANNEL_ADAPTER_MAX_CHANNELS 8
+
+/**
+ * A mapping matrix: output channel o is the sum over input channels i of coefs[o][i] times input channel i.
+ * Each coefficient must be greater than -2 and lower than 2, and the sum of the absolute values of the coefficients
+ * of a row must be lower than 4. Otherwise the matrix is rejected.
+ */
+typedef struct _MSChannelAdapterMatrix{
+	float coefs[MS_CHANNEL_ADAPTER_MAX_CHANNELS][MS_CHANNEL_ADAPTER_MAX_CHANNELS];
+}MSChannelAdapterMatrix;
+
 #define MS_CHANNEL_ADAPTER_SET_OUTPUT_NCHANNELS	MS_FILTER_METHOD(MS_CHANNEL_ADAPTER_ID,0,int)
 #define MS_CHANNEL_ADAPTER_GET_OUTPUT_NCHANNELS	MS_FILTER_METHOD(MS_CHANNEL_ADAPTER_ID,1,int)
+#define MS_CHANNEL_ADAPTER_SET_MATRIX	MS_FILTER_METHOD(MS_CHANNEL_ADAPTER_ID,2,MSChannelAdapterMatrix)
+#define MS_CHANNEL_ADAPTER_GET_MATRIX	MS_FILTER_METHOD(MS_CHANNEL_ADAPTER_ID,3,MSChannelAdapterMatrix)
 
 #endif
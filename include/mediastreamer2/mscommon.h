@@ -140,6 +140,19 @@ extern "C"{
 typedef struct { unsigned char octet[12]; }  UInt96;
 
 MS2_PUBLIC void ms_thread_exit(void* ret_val);
+
+/**
+ * Guard of a one time initialization, such as the one of the lock of a global object created on demand.
+ * It must be static and initialized to MS_ONCE_INIT.
+**/
+typedef long ms_once_t;
+#define MS_ONCE_INIT 0
+
+/**
+ * Call func the first time it is called with this guard. The threads calling it concurrently wait for func
+ * to return.
+**/
+MS2_PUBLIC void ms_once(ms_once_t *once, void (*func)(void));
 MS2_PUBLIC MSList * ms_list_append(MSList *elem, void * data);
 MS2_PUBLIC MSList *ms_list_append_link(MSList *elem, MSList *new_elem);
 MS2_PUBLIC MSList * ms_list_prepend(MSList *elem, void * data);
@@ -165,6 +178,61 @@ MS2_PUBLIC MSList *ms_list_copy_with_data(const MSList *list, void *(*copyfunc)(
 MS2_PUBLIC char * ms_tags_list_as_string(const MSList *list);
 MS2_PUBLIC bool_t ms_tags_list_contains_tag(const MSList *list, const char *tag);
 
+/**
+ * Test whether messages of a log level are output, before computing expensive arguments.
+**/
+#define ms_log_level_enabled	ortp_log_level_enabled
+
+/**
+ * State of a call site of ms_log_ratelimited() or ms_log_deduplicated().
+ * It is shared without locking by the threads going through the call site, so that concurrent calls may
+ * occasionally let one message more or less through.
+**/
+typedef struct _MSLogSite {
+	uint64_t last_time; /*ms*/
+	unsigned int suppressed;
+	int key;
+	bool_t initialized;
+} MSLogSite;
+
+MS2_PUBLIC bool_t ms_log_site_allow(MSLogSite *site, OrtpLogLevel level, int key, int interval_ms, const char *file, int line);
+
+/**
+ * Log a message through an explicit site, as ms_log_deduplicated() does with the site of its call site. It allows
+ * several call sites to share a site, or an object to keep its own site, so that it is not limited by the messages
+ * of the other objects. The site must be zeroed before its first use.
+**/
+#define ms_log_with_site(site, level, key, interval_ms, ...) do { \
+	if (ms_log_level_enabled(level) && ms_log_site_allow((site), (level), (int)(key), (interval_ms), __FILE__, __LINE__)) \
+		ortp_log((level), __VA_ARGS__); \
+} while (0)
+
+/**
+ * Log at most one message every interval_ms milliseconds from this call site.
+ * The arguments are neither evaluated nor formatted when the message is suppressed, and the number of suppressed
+ * messages is logged with the next one that is output.
+**/
+#define ms_log_ratelimited(level, interval_ms, ...) do { \
+	static MSLogSite _ms_log_site; \
+	ms_log_with_site(&_ms_log_site, level, 0, interval_ms, __VA_ARGS__); \
+} while (0)
+
+#define ms_message_ratelimited(interval_ms, ...)	ms_log_ratelimited(ORTP_MESSAGE, interval_ms, __VA_ARGS__)
+#define ms_warning_ratelimited(interval_ms, ...)	ms_log_ratelimited(ORTP_WARNING, interval_ms, __VA_ARGS__)
+
+/**
+ * Log a message from this call site only when key differs from the one of the previous message, or when
+ * interval_ms milliseconds have elapsed since it if interval_ms is positive. It suits states that flip often, such
+ * as an underrun that comes and goes.
+**/
+#define ms_log_deduplicated(level, key, interval_ms, ...) do { \
+	static MSLogSite _ms_log_site; \
+	ms_log_with_site(&_ms_log_site, level, key, interval_ms, __VA_ARGS__); \
+} while (0)
+
+#define ms_message_deduplicated(key, interval_ms, ...)	ms_log_deduplicated(ORTP_MESSAGE, key, interval_ms, __VA_ARGS__)
+#define ms_warning_deduplicated(key, interval_ms, ...)	ms_log_deduplicated(ORTP_WARNING, key, interval_ms, __VA_ARGS__)
+
 #undef MIN
 #define MIN(a,b)	((a)>(b) ? (b) : (a))
 #undef MAX
@@ -280,6 +348,8 @@ MS2_PUBLIC void ms_set_payload_max_size(int size);
  * Returns the network Max Transmission Unit to reach destination_host.
  * This will attempt to send one or more big packets to destination_host, to a random port.
  * Those packets are filled with zeroes.
+ * It waits for the path MTU discovery service (see msmtu.h), and returns at once when the MTU is cached.
+ * Prefer ms_mtu_discovery_request(), which does not block.
 **/
 MS2_PUBLIC int ms_discover_mtu(const char *destination_host);
 
@@ -35,6 +35,7 @@ struct _MSFactory{
 	struct _MSEventQueue *evq;
 	int max_payload_size;
 	int mtu;
+	int metrics_id;
 	bool_t statistics_enabled;
 	bool_t voip_initd;
 };
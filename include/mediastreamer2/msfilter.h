@@ -149,6 +149,8 @@ struct _MSFilterStats{
 	const char *name; /*<filter name*/
 	uint64_t elapsed; /*<cumulative number of nanoseconds elapsed */
 	unsigned int count; /*<number of time the filter is called for processing*/
+	struct _MSMetric *cpu_metric; /*<cumulative processing time exported in seconds, see msmetrics.h*/
+	struct _MSMetric *calls_metric; /*<number of calls exported, not reset by ms_factory_reset_statistics()*/
 };
 
 typedef struct _MSFilterStats MSFilterStats;
@@ -680,6 +682,11 @@ the method index (_cnt_) and the argument size */
 #define MS_FILTER_ADD_FMTP		MS_FILTER_BASE_METHOD(7,const char)
 
 #define MS_FILTER_ADD_ATTR		MS_FILTER_BASE_METHOD(8,const char)
+/**
+ * Set the max size of the RTP payloads output by an encoder or sent by MSRtpSend, which defaults to
+ * ms_get_payload_max_size(). Media streams set it from the path MTU to their destination, see
+ * media_stream_enable_mtu_discovery().
+**/
 #define MS_FILTER_SET_MTU		MS_FILTER_BASE_METHOD(9,int)
 #define MS_FILTER_GET_MTU		MS_FILTER_BASE_METHOD(10,int)
 /**Filters can return their latency in milliseconds (if known) using this method:*/
@@ -0,0 +1,49 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef msframerateconv_h
+#define msframerateconv_h
+
+#include <mediastreamer2/msfilter.h>
+
+/**
+ * The MSFrameRateConv filter lowers the frame rate of a YUV420P video stream to the one set with MS_FILTER_SET_FPS.
+ * Among the input frames, it forwards the ones the closest to a regular time grid, so that the output motion
+ * and the encoder load stay even when the camera delivers frames with jitter.
+**/
+
+typedef struct _MSFrameRateConvStats {
+	float input_fps;	/**< Average frame rate received by the filter */
+	float output_fps;	/**< Average frame rate forwarded by the filter */
+	unsigned int dropped_frames;	/**< Number of frames dropped to match the target frame rate */
+	unsigned int dropped_duplicates;	/**< Number of frames dropped because they were too similar to the previous output frame */
+} MSFrameRateConvStats;
+
+/**
+ * Set the threshold under which a frame is considered as a duplicate of the previous output frame, and dropped.
+ * It is expressed as the mean absolute difference of the luma samples. 0, the default, disables the detection.
+ * At least one frame per second is forwarded, and nothing is dropped as long as no frame rate is set.
+**/
+#define MS_FRAME_RATE_CONV_SET_DUPLICATE_THRESHOLD	MS_FILTER_METHOD(MS_FRAME_RATE_CONV_ID,0,float)
+
+/**get the input and output frame rates and the number of dropped frames.*/
+#define MS_FRAME_RATE_CONV_GET_STATS	MS_FILTER_METHOD(MS_FRAME_RATE_CONV_ID,1,MSFrameRateConvStats)
+
+#endif
@@ -55,6 +55,13 @@ struct _MSVideoDisplayDecodingSupport {
 	bool_t supported;	/**< Output telling whether the display supports decoding to the specified mime type */
 };
 
+typedef struct _MSVideoDisplayStats MSVideoDisplayStats;
+
+struct _MSVideoDisplayStats {
+	unsigned int rendered_frames;	/**< Number of frames blitted to the window */
+	unsigned int dropped_frames;	/**< Number of received frames that were not rendered, because a newer one replaced them or the display was late */
+};
+
 /** whether the video window should be resized to the stream's resolution*/
 #define MS_VIDEO_DISPLAY_ENABLE_AUTOFIT \
 	MS_FILTER_METHOD(MSFilterVideoDisplayInterface,0,int)
@@ -96,6 +103,10 @@ struct _MSVideoDisplayDecodingSupport {
 #define MS_VIDEO_DISPLAY_SET_DEVICE_ORIENTATION \
    MS_FILTER_METHOD(MSFilterVideoDisplayInterface,11,int)
 
+/**Get the number of rendered and dropped frames */
+#define MS_VIDEO_DISPLAY_GET_STATS \
+	MS_FILTER_METHOD(MSFilterVideoDisplayInterface,12,MSVideoDisplayStats)
+
 /**
   * Interface definitions for players
 **/
@@ -169,6 +180,10 @@ typedef enum _MSRecorderState MSRecorderState;
 #define MS_RECORDER_GET_STATE \
 	MS_FILTER_METHOD(MSFilterRecorderInterface,5,MSRecorderState)
 
+/**write the headers of the file so that what has been recorded so far remains playable if the file is never closed*/
+#define MS_RECORDER_SYNC \
+	MS_FILTER_METHOD_NO_ARG(MSFilterRecorderInterface,6)
+
 #define MS_RECORDER_NEEDS_FIR \
 	MS_FILTER_EVENT_NO_ARG(MSFilterRecorderInterface,0)
 
@@ -201,6 +216,14 @@ typedef enum _MSRecorderState MSRecorderState;
 #define MS_ECHO_CANCELLER_SET_STATE_STRING \
 	MS_FILTER_METHOD(MSFilterEchoCancellerInterface,6, const char)
 
+/** process the frames on the worker threads shared by all echo cancellers, adding one tick of latency*/
+#define MS_ECHO_CANCELLER_ENABLE_ASYNC \
+	MS_FILTER_METHOD(MSFilterEchoCancellerInterface,7,bool_t)
+
+/** get the estimated ratio between the sample rates of the reference and echo signals, 1 without clock skew */
+#define MS_ECHO_CANCELLER_GET_SKEW \
+	MS_FILTER_METHOD(MSFilterEchoCancellerInterface,8,float)
+
 
 
 /** Event definitions for video decoders */
@@ -228,6 +251,12 @@ typedef enum _MSRecorderState MSRecorderState;
 	MS_FILTER_EVENT_NO_ARG(MSFilterVideoDecoderInterface, 9)
 #define MS_VIDEO_DECODER_RESET \
 	MS_FILTER_METHOD_NO_ARG(MSFilterVideoDecoderInterface, 10)
+/* only decode the temporal layers up to the given one, dropping the others as a forwarding server would do. -1 decodes all layers*/
+#define MS_VIDEO_DECODER_SET_MAX_TEMPORAL_LAYER \
+	MS_FILTER_METHOD(MSFilterVideoDecoderInterface, 11, int)
+/* set the maximum time in milliseconds a missing packet is waited for before being considered lost, to tolerate reordering. 0 disables it*/
+#define MS_VIDEO_DECODER_SET_REORDERING_DELAY \
+	MS_FILTER_METHOD(MSFilterVideoDecoderInterface, 12, int)
 	
 
 
@@ -274,6 +303,21 @@ typedef enum _MSRecorderState MSRecorderState;
 	MS_FILTER_METHOD(MSFilterVideoEncoderInterface, 9, const MSVideoConfiguration *)
 #define MS_VIDEO_ENCODER_IS_HARDWARE_ACCELERATED \
 	MS_FILTER_METHOD(MSFilterVideoEncoderInterface, 10, bool_t)
+/* enable or disable encoding on a worker thread instead of the ticker thread, to be called before the filter is attached*/
+#define MS_VIDEO_ENCODER_ENABLE_ASYNC \
+	MS_FILTER_METHOD(MSFilterVideoEncoderInterface, 11, bool_t)
+/* set the number of temporal layers (1 to 3) of the encoded stream, signaled with TID/TL0PICIDX so that upper layers can be dropped without transcoding*/
+#define MS_VIDEO_ENCODER_SET_TEMPORAL_LAYERS \
+	MS_FILTER_METHOD(MSFilterVideoEncoderInterface, 12, int)
+#define MS_VIDEO_ENCODER_GET_TEMPORAL_LAYERS \
+	MS_FILTER_METHOD(MSFilterVideoEncoderInterface, 13, int)
+
+/* Counters of the times the sound card buffer ran empty or full, since the filter was created */
+struct _MSAudioXrunStats{
+	unsigned int underruns;
+	unsigned int overruns;
+};
+typedef struct _MSAudioXrunStats MSAudioXrunStats;
 
 /** Interface definitions for audio capture */
 /* Start numbering from the end for hacks */
@@ -281,6 +325,16 @@ typedef enum _MSRecorderState MSRecorderState;
 	MS_FILTER_METHOD(MSFilterAudioCaptureInterface, 0, float)
 #define MS_AUDIO_CAPTURE_GET_VOLUME_GAIN \
 	MS_FILTER_METHOD(MSFilterAudioCaptureInterface, 1, float)
+/* set the latency targeted by the sound card buffer in milliseconds, to be called before the filter is preprocessed*/
+#define MS_AUDIO_CAPTURE_SET_LATENCY \
+	MS_FILTER_METHOD(MSFilterAudioCaptureInterface, 2, int)
+#define MS_AUDIO_CAPTURE_GET_LATENCY \
+	MS_FILTER_METHOD(MSFilterAudioCaptureInterface, 3, int)
+/* set the size in milliseconds of the fragments handed by the sound card, 0 letting the driver choose*/
+#define MS_AUDIO_CAPTURE_SET_FRAGMENT_SIZE \
+	MS_FILTER_METHOD(MSFilterAudioCaptureInterface, 4, int)
+#define MS_AUDIO_CAPTURE_GET_XRUN_STATS \
+	MS_FILTER_METHOD(MSFilterAudioCaptureInterface, 5, MSAudioXrunStats)
 #define MS_AUDIO_CAPTURE_FORCE_SPEAKER_STATE \
 	MS_FILTER_METHOD(MSFilterAudioCaptureInterface, 255, bool_t)
 	
@@ -297,6 +351,16 @@ typedef enum _MSAudioRoute MSAudioRoute;
 	MS_FILTER_METHOD(MSFilterAudioPlaybackInterface, 1, float)
 #define MS_AUDIO_PLAYBACK_SET_ROUTE \
 	MS_FILTER_METHOD(MSFilterAudioPlaybackInterface, 2, MSAudioRoute)
+/* set the latency targeted by the sound card buffer in milliseconds, to be called before the filter is preprocessed*/
+#define MS_AUDIO_PLAYBACK_SET_LATENCY \
+	MS_FILTER_METHOD(MSFilterAudioPlaybackInterface, 3, int)
+#define MS_AUDIO_PLAYBACK_GET_LATENCY \
+	MS_FILTER_METHOD(MSFilterAudioPlaybackInterface, 4, int)
+/* set the size in milliseconds of the fragments requested by the sound card, 0 letting the driver choose*/
+#define MS_AUDIO_PLAYBACK_SET_FRAGMENT_SIZE \
+	MS_FILTER_METHOD(MSFilterAudioPlaybackInterface, 5, int)
+#define MS_AUDIO_PLAYBACK_GET_XRUN_STATS \
+	MS_FILTER_METHOD(MSFilterAudioPlaybackInterface, 6, MSAudioXrunStats)
 
 /** Interface definitions for audio encoder */
 #define MS_AUDIO_ENCODER_SET_PTIME \
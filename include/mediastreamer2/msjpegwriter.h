@@ -22,6 +22,24 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include <mediastreamer2/msfilter.h>
 
+typedef void (*MSJpegWriterDataCb)(void *user_data, const uint8_t *data, size_t size);
+
+/**
+ * Callback receiving the jpeg data of the snapshots, in addition to or instead of the file.
+ * It is called from the snapshot worker thread.
+**/
+typedef struct _MSJpegWriterDataCallback {
+	MSJpegWriterDataCb cb;
+	void *user_data;
+} MSJpegWriterDataCallback;
+
+/**take a snapshot to the given file. The filename can be NULL if a data callback is set.*/
 #define MS_JPEG_WRITER_TAKE_SNAPSHOT	MS_FILTER_METHOD(MS_JPEG_WRITER_ID,0,const char)
 
+/**take a snapshot every given number of seconds, to the last file given to MS_JPEG_WRITER_TAKE_SNAPSHOT and/or the data callback. 0 stops.*/
+#define MS_JPEG_WRITER_SET_INTERVAL	MS_FILTER_METHOD(MS_JPEG_WRITER_ID,1,int)
+
+/**set the callback receiving the jpeg data. A NULL cb removes it.*/
+#define MS_JPEG_WRITER_SET_DATA_CALLBACK	MS_FILTER_METHOD(MS_JPEG_WRITER_ID,2,MSJpegWriterDataCallback)
+
 #endif
@@ -0,0 +1,163 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef MS_METRICS_H
+#define MS_METRICS_H
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * @brief The metrics registry holds the counters, gauges and histograms published by the streams, the tickers and
+ * the filters of the process, and exports them in the OpenMetrics text format, to a callback or to the clients of a
+ * local unix socket.
+ *
+ * A metric is identified by the name of its family and by its labels, given preformatted, for instance
+ * 'type="audio",stream="3"'. The metrics of a family share its type, help text and histogram buckets.
+ * Updating a metric takes no lock, so that it can be done from ticker threads. All the update functions accept a
+ * NULL metric and do nothing.
+ *
+ * The metrics published by mediastreamer2 are:
+ * - ms2_rtp_sent_bytes, ms2_rtp_received_bytes, ms2_rtp_sent_packets, ms2_rtp_received_packets,
+ *   ms2_rtp_lost_packets, ms2_rtcp_received_packets (counters), ms2_stream_jitter_seconds,
+ *   ms2_stream_jitter_buffer_seconds, ms2_stream_quality_rating, ms2_stream_upload_bitrate,
+ *   ms2_stream_download_bitrate (gauges), ms2_stream_round_trip_seconds (histogram), labelled by stream type and id,
+ * - ms2_ticker_load_ratio (gauge), ms2_ticker_late_ticks (counter), ms2_ticker_tick_seconds (histogram), labelled
+ *   by ticker name and id,
+ * - ms2_filter_cpu_seconds and ms2_filter_calls (counters), labelled by filter name and factory id, when the
+ *   statistics of the factory are enabled with ms_factory_enable_statistics().
+**/
+typedef struct _MSMetric MSMetric;
+
+typedef enum _MSMetricType {
+	MSMetricCounter,	/**< A monotonic value, exported with the _total suffix */
+	MSMetricGauge,	/**< A value that goes up and down */
+	MSMetricHistogram	/**< Observations counted in buckets */
+} MSMetricType;
+
+/**
+ * @brief Function receiving the text of the metrics.
+ * @param user_data The pointer given to ms_metrics_export()
+ * @param text The metrics in the OpenMetrics text format, terminated by "# EOF"
+ * @param size The length of text
+**/
+typedef void (*MSMetricsExportFunc)(void *user_data, const char *text, size_t size);
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * @brief Create a metric and register it.
+ * @param name The name of the family, for instance "ms2_rtp_sent_bytes", without the _total suffix of counters
+ * @param type The type of the family
+ * @param help A text describing the family
+ * @param labels The labels of the metric, or NULL
+ * @return a new MSMetric, or NULL if the family exists with another type
+**/
+MS2_PUBLIC MSMetric *ms_metric_new(const char *name, MSMetricType type, const char *help, const char *labels);
+
+/**
+ * @brief Create a histogram metric and register it.
+ * @param name The name of the family
+ * @param help A text describing the family
+ * @param labels The labels of the metric, or NULL
+ * @param bounds The upper bounds of the buckets in increasing order, not including +Inf. They are only used if the
+ * family does not exist yet.
+ * @param nbounds The number of bounds
+ * @return a new MSMetric, or NULL if the family exists with another type
+**/
+MS2_PUBLIC MSMetric *ms_metric_new_histogram(const char *name, const char *help, const char *labels, const double *bounds, int nbounds);
+
+/**
+ * @brief Unregister a metric and destroy it.
+ * @param obj MSMetric
+**/
+MS2_PUBLIC void ms_metric_destroy(MSMetric *obj);
+
+/**
+ * @brief Change the labels of a metric.
+ * @param obj MSMetric
+ * @param labels The new labels, or NULL
+**/
+MS2_PUBLIC void ms_metric_set_labels(MSMetric *obj, const char *labels);
+
+/**
+ * @brief Add to a counter or a gauge.
+ * @param obj MSMetric
+ * @param value The value to add, which must not be negative for a counter
+**/
+MS2_PUBLIC void ms_metric_add(MSMetric *obj, double value);
+
+/**
+ * @brief Set a gauge, or a counter from a cumulated value maintained elsewhere.
+ * @param obj MSMetric
+ * @param value The new value
+**/
+MS2_PUBLIC void ms_metric_set(MSMetric *obj, double value);
+
+/**
+ * @brief Count an observation in a histogram.
+ * @param obj MSMetric
+ * @param value The observed value
+**/
+MS2_PUBLIC void ms_metric_observe(MSMetric *obj, double value);
+
+/**
+ * @brief Get the value of a counter or a gauge, or the sum of the observations of a histogram.
+ * @param obj MSMetric
+**/
+MS2_PUBLIC double ms_metric_get(const MSMetric *obj);
+
+/**
+ * @brief Get a number unique in the process, to label the metrics of objects that may share a name.
+**/
+MS2_PUBLIC int ms_metrics_new_id(void);
+
+/**
+ * @brief Format all the registered metrics in the OpenMetrics text format.
+ * @return The text, to be freed with ms_free()
+**/
+MS2_PUBLIC char *ms_metrics_to_text(void);
+
+/**
+ * @brief Give all the registered metrics in the OpenMetrics text format to a function.
+ * @param func The function called with the text
+ * @param user_data A pointer given to func
+**/
+MS2_PUBLIC void ms_metrics_export(MSMetricsExportFunc func, void *user_data);
+
+/**
+ * @brief Serve the metrics on a local unix socket, in a thread of its own. A client sending a HTTP GET request
+ * receives a HTTP response, so that the socket can be scraped by a Prometheus agent. Any other client receives the
+ * bare text.
+ * @param path The path of the socket, which is replaced if it exists
+ * @return 0 if successful, -1 otherwise
+**/
+MS2_PUBLIC int ms_metrics_start_server(const char *path);
+
+/**
+ * @brief Stop serving the metrics and remove the socket.
+**/
+MS2_PUBLIC void ms_metrics_stop_server(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef msmtu_h
+#define msmtu_h
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * The path MTU discovery service finds the MTU towards each destination in the background, without blocking
+ * the caller. A thread probes the destinations with datagrams not allowed to be fragmented, sized to the MTU
+ * being tested, and lowers it on the ICMP "fragmentation needed" / "packet too big" errors, or on the local
+ * errors when the kernel already knows a smaller MTU for the route. A probe answered by an ICMP "port
+ * unreachable", or not answered at all, confirms the MTU.
+ * The results are cached per destination, and refreshed periodically while someone is interested in them,
+ * since the path may change.
+**/
+
+/**
+ * Called when the MTU to a destination is determined, or when it changes. The mtu is -1 when it cannot be
+ * discovered. It is called from the thread of the service: it must return quickly, and must not call
+ * ms_mtu_discovery_cancel().
+**/
+typedef void (*MSMtuDiscoveryCallback)(void *user_data, const char *host, int mtu);
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Request the path MTU to a destination.
+ * @param host The destination, as an IP address or a host name. It is resolved by the service.
+ * @param cb Called when the MTU is determined and each time it changes, until ms_mtu_discovery_cancel(). May be NULL.
+ * @param user_data Passed to the callback.
+ * @return The cached MTU if it is known, 0 if it is being discovered, -1 if it could not be discovered.
+**/
+MS2_PUBLIC int ms_mtu_discovery_request(const char *host, MSMtuDiscoveryCallback cb, void *user_data);
+
+/**
+ * Stop notifying a callback given to ms_mtu_discovery_request(). Once this function returns, the callback is not
+ * called anymore.
+**/
+MS2_PUBLIC void ms_mtu_discovery_cancel(const char *host, MSMtuDiscoveryCallback cb, void *user_data);
+
+/**
+ * Get the cached MTU to a destination, without requesting a discovery.
+ * @return The MTU, 0 if it is unknown or being discovered, -1 if it could not be discovered.
+**/
+MS2_PUBLIC int ms_mtu_discovery_get(const char *host);
+
+/**
+ * Forget the cached MTUs, and stop the thread of the service. The callbacks are cancelled.
+ * It is called by ms_base_exit().
+**/
+MS2_PUBLIC void ms_mtu_discovery_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,6 +29,36 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define MS_RTP_RECV_RESET_JITTER_BUFFER		MS_FILTER_METHOD_NO_ARG(MS_RTP_RECV_ID,1)
 
+/**
+ * Parameters of the adaptive playout of MSRtpRecv. When enabled, the jitter buffer of the RtpSession is disabled,
+ * and the filter holds the packets itself until their playout time: their timestamp, plus the transit time of the
+ * fastest packet, plus a playout delay. The playout delay follows a quantile of the delays observed on the packets
+ * received: it is increased as soon as the quantile exceeds it, the decoder concealing the gap, and decreased
+ * progressively. The decoded audio shall go through a MSAudioPlayout filter, that smoothes these changes
+ * by time stretching.
+**/
+typedef struct _MSRtpRecvPlayoutParams {
+	bool_t enabled;
+	float quantile;	/**< Fraction of the packets that shall arrive before their playout time (default 0.95) */
+	int min_delay;	/**< Lowest playout delay, in milliseconds (default 0) */
+	int max_delay;	/**< Highest playout delay, in milliseconds (default 500) */
+} MSRtpRecvPlayoutParams;
+
+typedef struct _MSRtpRecvPlayoutStats {
+	int target_delay;	/**< Delay quantile estimated on the packets received, in milliseconds */
+	int current_delay;	/**< Playout delay applied to the packets, above the transit time of the fastest one, in milliseconds */
+	uint64_t packets;	/**< Packets received */
+	uint64_t late;	/**< Packets received after their playout time, dropped */
+	uint64_t early;	/**< Packets received more than the highest playout delay in advance, dropped */
+	uint64_t delay_increases;	/**< Times the playout delay was increased */
+	uint64_t delay_decreases;	/**< Times the playout delay was decreased */
+	uint64_t resyncs;	/**< Times the playout was restarted because of consecutive late or early packets */
+} MSRtpRecvPlayoutStats;
+
+#define MS_RTP_RECV_SET_PLAYOUT_PARAMS		MS_FILTER_METHOD(MS_RTP_RECV_ID,2,const MSRtpRecvPlayoutParams)
+
+#define MS_RTP_RECV_GET_PLAYOUT_STATS		MS_FILTER_METHOD(MS_RTP_RECV_ID,3,MSRtpRecvPlayoutStats)
+
 #define MS_RTP_RECV_GENERIC_CN_RECEIVED		MS_FILTER_EVENT(MS_RTP_RECV_ID,0, MSCngData)
 
 
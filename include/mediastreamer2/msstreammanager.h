@@ -0,0 +1,124 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef MS_STREAM_MANAGER_H
+#define MS_STREAM_MANAGER_H
+
+#include <mediastreamer2/mediastream.h>
+
+/**
+ * @brief The stream manager iterates many media streams in place of the application, each of them only when it
+ * has something to do, instead of the application polling all of them with audio_stream_iterate() or
+ * video_stream_iterate():
+ * - a stream is iterated every second, to update its quality indicator and bitrate controller,
+ * - every ICE pacing period while its ICE check list is running,
+ * - and as soon as a RTCP packet arrives on its socket, where the system allows to watch it (epoll on Linux).
+ *   The sessions using rtcp-mux are not watched, since every RTP packet would wake the manager: their RTCP
+ *   packets are processed at the next periodic iteration.
+ *
+ * The manager is used from the thread that would otherwise iterate the streams, usually the main loop of the
+ * application: either by calling ms_stream_manager_wait() then ms_stream_manager_iterate() in loop, or by
+ * watching the file descriptor given by ms_stream_manager_get_fd() and calling ms_stream_manager_iterate() when it
+ * is readable or when the delay it returned has elapsed.
+**/
+typedef struct _MSStreamManager MSStreamManager;
+
+typedef struct _MSStreamManagerStats {
+	uint64_t iterations;	/**< Number of times a stream was iterated */
+	uint64_t wakeups;	/**< Number of times ms_stream_manager_wait() returned before its timeout */
+	uint64_t rtcp_wakeups;	/**< Number of RTCP packets that made a stream iterated ahead of time */
+} MSStreamManagerStats;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * @brief Create a stream manager.
+ * @return a new MSStreamManager
+**/
+MS2_PUBLIC MSStreamManager *ms_stream_manager_new(void);
+
+/**
+ * @brief Destroy the manager. The streams it still manages are not destroyed.
+ * @param obj MSStreamManager
+**/
+MS2_PUBLIC void ms_stream_manager_destroy(MSStreamManager *obj);
+
+/**
+ * @brief Start managing a stream, which is iterated with the next call to ms_stream_manager_iterate().
+ * A stream is managed by one manager at most, and must be removed from it before it is destroyed.
+ * @param obj MSStreamManager
+ * @param stream An AudioStream or VideoStream
+**/
+MS2_PUBLIC void ms_stream_manager_add(MSStreamManager *obj, MediaStream *stream);
+
+/**
+ * @brief Stop managing a stream.
+ * @param obj MSStreamManager
+ * @param stream A stream given to ms_stream_manager_add()
+**/
+MS2_PUBLIC void ms_stream_manager_remove(MSStreamManager *obj, MediaStream *stream);
+
+/**
+ * @brief Have a stream iterated with the next call to ms_stream_manager_iterate(), for instance after ICE
+ * processing was started on it.
+ * @param obj MSStreamManager
+ * @param stream A stream given to ms_stream_manager_add()
+**/
+MS2_PUBLIC void ms_stream_manager_schedule(MSStreamManager *obj, MediaStream *stream);
+
+/**
+ * @brief Iterate the streams that are due.
+ * @param obj MSStreamManager
+ * @return The delay until the next stream is due in milliseconds, -1 if there is no stream.
+**/
+MS2_PUBLIC int ms_stream_manager_iterate(MSStreamManager *obj);
+
+/**
+ * @brief Wait until a stream is due, a RTCP packet arrives for a stream, ms_stream_manager_wakeup() is called,
+ * or the timeout elapses.
+ * @param obj MSStreamManager
+ * @param timeout_ms The maximum time to wait in milliseconds, -1 to wait until a stream is due.
+**/
+MS2_PUBLIC void ms_stream_manager_wait(MSStreamManager *obj, int timeout_ms);
+
+/**
+ * @brief Make ms_stream_manager_wait() return. This function may be called from any thread.
+ * @param obj MSStreamManager
+**/
+MS2_PUBLIC void ms_stream_manager_wakeup(MSStreamManager *obj);
+
+/**
+ * @brief Get a file descriptor that becomes readable when ms_stream_manager_iterate() has streams to iterate
+ * ahead of the delay it returned. It is drained by ms_stream_manager_iterate().
+ * @param obj MSStreamManager
+ * @return The file descriptor, or -1 where the system does not allow it.
+**/
+MS2_PUBLIC int ms_stream_manager_get_fd(const MSStreamManager *obj);
+
+MS2_PUBLIC const MSStreamManagerStats *ms_stream_manager_get_stats(const MSStreamManager *obj);
+
+MS2_PUBLIC int ms_stream_manager_get_stream_count(const MSStreamManager *obj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
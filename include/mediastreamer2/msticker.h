@@ -91,6 +91,10 @@ struct _MSTicker
 	void *wait_next_tick_data;
 	MSTickerLateEvent late_event;
 	unsigned long thread_id;
+	struct _MSMetric *load_metric; /* ratio of the interval spent processing, see msmetrics.h*/
+	struct _MSMetric *late_metric; /* number of ticks started later than one interval*/
+	struct _MSMetric *tick_metric; /* histogram of the processing time of ticks*/
+	int metrics_id; /* distinguishes the metrics of tickers having the same name*/
 	bool_t run;       /* flag to indicate whether the ticker must be run or not */
 };
 
@@ -240,7 +240,18 @@ typedef struct _MSPicture{
 
 typedef struct _MSPicture YuvBuf; /*for backward compatibility*/
 
-typedef msgb_allocator_t MSYuvBufAllocator;
+/**
+ * Allocates video frames from a pool shared by the whole process. Buffers are recycled when their last reference is released,
+ * the picture data is aligned on 32 bytes. Buffers may be released from any thread, and keep the pool alive until then.
+ * MSYuvBufAllocator used to be a typedef of msgb_allocator_t: it is now an opaque type, only usable through the functions below.
+**/
+typedef struct _MSYuvBufAllocator MSYuvBufAllocator;
+
+typedef struct _MSYuvBufAllocatorStats {
+	unsigned int hits; /**< number of frames served from recycled buffers */
+	unsigned int misses; /**< number of frames that required a new buffer */
+	size_t cached_bytes; /**< memory held by the pool for buffers not in use */
+} MSYuvBufAllocatorStats;
 
 #ifdef __cplusplus
 extern "C"{
@@ -271,9 +282,39 @@ MS2_PUBLIC void rgb24_copy_revert(uint8_t *dstbuf, int dstlsz,
 MS2_PUBLIC MSYuvBufAllocator *ms_yuv_buf_allocator_new(void);
 MS2_PUBLIC mblk_t *ms_yuv_buf_allocator_get(MSYuvBufAllocator *obj, MSPicture *buf, int w, int h);
 MS2_PUBLIC void ms_yuv_buf_allocator_free(MSYuvBufAllocator *obj);
+/**
+ * Get the hits and misses of an allocator, or of the whole pool if obj is NULL.
+**/
+MS2_PUBLIC void ms_yuv_buf_allocator_get_stats(const MSYuvBufAllocator *obj, MSYuvBufAllocatorStats *stats);
 
 MS2_PUBLIC void ms_rgb_to_yuv(const uint8_t rgb[3], uint8_t yuv[3]);
 
+/**
+ * Draws a sequence number and a timestamp in the top-left corner of a YUV420P picture, as black and white blocks
+ * that survive lossy encoding and scaling. This is used to measure the frame loss and the latency of a video stream.
+ * @return 0 if successful, -1 if the picture is too small to hold the tag.
+**/
+MS2_PUBLIC int ms_yuv_buf_write_tag(MSPicture *pic, uint32_t seq, uint32_t timestamp);
+
+/**
+ * Reads back the tag drawn by ms_yuv_buf_write_tag().
+ * @return 0 if successful, -1 if no valid tag is found in the picture.
+**/
+MS2_PUBLIC int ms_yuv_buf_read_tag(const MSPicture *pic, uint32_t *seq, uint32_t *timestamp);
+
+/**
+ * Computes the PSNR of the luma plane of a picture against a reference picture of the same size.
+ * @return the PSNR in dB, 100 for identical pictures, or -1 if the sizes differ.
+**/
+MS2_PUBLIC double ms_yuv_buf_psnr(const MSPicture *ref, const MSPicture *pic);
+
+/**
+ * Computes the mean SSIM of the luma plane of a picture against a reference picture of the same size,
+ * over 8x8 windows overlapping by half.
+ * @return the SSIM between 0 and 1, or -1 if the sizes differ or the pictures are too small.
+**/
+MS2_PUBLIC double ms_yuv_buf_ssim(const MSPicture *ref, const MSPicture *pic);
+
 
 #if defined(__arm__) || defined(__arm64__)
 MS2_PUBLIC void rotate_plane_neon_clockwise(int wDest, int hDest, int full_width, const uint8_t* src, uint8_t* dst);
@@ -0,0 +1,71 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+#ifndef msvirtualsnd_h
+#define msvirtualsnd_h
+
+#include <mediastreamer2/mssndcard.h>
+
+/**
+ * Virtual sound cards behave like real devices without any hardware behind them: their capture delivers
+ * a tone or the content of a wav file by periods following their own clock, and their playback consumes
+ * the samples at the pace of that clock, reporting underruns and overruns. The clock can be made to drift
+ * and to jitter, so that many of them can stand for independent devices in load tests.
+ *
+ * The driver is not registered by default, use
+ * ms_snd_card_manager_register_desc(ms_snd_card_manager_get(), &ms_virtual_snd_card_desc) to get a
+ * default virtual card, and ms_virtual_snd_card_new() with ms_snd_card_manager_add_card() for more.
+**/
+
+typedef struct _MSVirtualSndCardParams {
+	int sample_rate;	/**< Nominal sample rate of the card */
+	int nchannels;	/**< Number of channels of the card */
+	float clock_skew;	/**< Drift of the card clock from the ticker clock, in parts per million */
+	int jitter;	/**< Maximum random delay of the delivery of a captured period, in milliseconds */
+	int period;	/**< Duration of the periods the card captures and plays, in milliseconds */
+	const char *capture_file;	/**< Wav file looped as the captured signal, NULL to capture the tone */
+	int tone_frequency;	/**< Frequency of the captured tone in Hz, 0 for silence */
+	float tone_amplitude;	/**< Amplitude of the captured tone, from 0 to 1 */
+	const char *playback_file;	/**< Wav file recording what the card plays, or NULL */
+	unsigned int seed;	/**< Seed of the jitter generator */
+} MSVirtualSndCardParams;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+MS2_PUBLIC extern MSSndCardDesc ms_virtual_snd_card_desc;
+
+/**
+ * Fill the parameters of a 16kHz mono card capturing a 440Hz tone with a perfect clock.
+**/
+MS2_PUBLIC void ms_virtual_snd_card_params_init(MSVirtualSndCardParams *params);
+
+/**
+ * Create a virtual sound card. The parameters, including the file names, are copied.
+ * The capture file is loaded once per card, and shared by all the readers created from it.
+**/
+MS2_PUBLIC MSSndCard *ms_virtual_snd_card_new(const char *name, const MSVirtualSndCardParams *params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -231,6 +231,10 @@ MS2_PUBLIC const char *ms_static_image_get_default_image(void);
 #define MS_STATIC_IMAGE_SET_IMAGE \
 	MS_FILTER_METHOD(MS_STATIC_IMAGE_ID,0,const char)
 
+/** method for the "mire" filter: draw the frame number and the capture time in each frame, see ms_yuv_buf_read_tag()*/
+#define MS_MIRE_ENABLE_FRAME_TAGS \
+	MS_FILTER_METHOD(MS_MIRE_ID,0,int)
+
 #ifdef __cplusplus
 }
 #endif
@@ -50,6 +50,10 @@ void rfc3984_init(Rfc3984Context *ctx);
 
 MS2_PUBLIC void rfc3984_set_mode(Rfc3984Context *ctx, int mode);
 
+/* the packets output by rfc3984_pack() are not larger, ms_get_payload_max_size() by default.
+ * Encoders should call it on MS_FILTER_SET_MTU.*/
+MS2_PUBLIC void rfc3984_set_max_payload_size(Rfc3984Context *ctx, int size);
+
 /* some stupid phones don't decode STAP-A packets ...*/
 MS2_PUBLIC void rfc3984_enable_stap_a(Rfc3984Context *ctx, bool_t yesno);
 
@@ -38,8 +38,6 @@ void ms_alsa_card_set_forced_sample_rate(int samplerate){
 	forced_rate=samplerate;
 }
 
-//#define THREADED_VERSION
-
 /*in case of troubles with a particular driver, try incrementing ALSA_PERIOD_SIZE
 to 512, 1024, 2048, 4096...
 then try incrementing the number of periods*/
@@ -83,7 +81,7 @@ static void alsa_resume(snd_pcm_t *handle){
 	}
 }
 
-static int alsa_set_params(snd_pcm_t *pcm_handle, int rw, int bits, int stereo, int rate)
+static int alsa_set_params(snd_pcm_t *pcm_handle, int rw, int bits, int stereo, int rate, bool_t allow_mmap, bool_t *mmap)
 {
 	snd_pcm_hw_params_t *hwparams=NULL;
 	snd_pcm_sw_params_t *swparams=NULL;
@@ -106,7 +104,12 @@ static int alsa_set_params(snd_pcm_t *pcm_handle, int rw, int bits, int stereo,
 		return -1;
 	}
 
-	if (snd_pcm_hw_params_set_access(pcm_handle, hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+	/* prefer the mmap access, that lets the samples be copied straight from and to the ring buffer of the device */
+	if (allow_mmap && snd_pcm_hw_params_set_access(pcm_handle, hwparams, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0) {
+		*mmap=TRUE;
+	} else if (snd_pcm_hw_params_set_access(pcm_handle, hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) == 0) {
+		*mmap=FALSE;
+	} else {
 		ms_warning("alsa_set_params: Error setting access.");
 		return -1;
 	}
@@ -229,26 +232,17 @@ static void alsa_fill_w (snd_pcm_t *pcm_handle)
 }
 #endif
 
-static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate)
+static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate,bool_t allow_mmap,bool_t *mmap)
 {
 	snd_pcm_t *pcm_handle;
 	int err;
 
 	ms_message("alsa_open_r: opening %s at %iHz, bits=%i, stereo=%i",pcmdev,rate,bits,stereo);
 
-
-#ifndef THREADED_VERSION
 	if (snd_pcm_open(&pcm_handle, pcmdev,SND_PCM_STREAM_CAPTURE,SND_PCM_NONBLOCK) < 0) {
 		ms_warning("alsa_open_r: Error opening PCM device %s",pcmdev );
 		return NULL;
 	}
-#else
-	/* want blocking mode for threaded version */
-	if (snd_pcm_open(&pcm_handle, pcmdev,SND_PCM_STREAM_CAPTURE,0) < 0) {
-		ms_warning("alsa_open_r: Error opening PCM device %s",pcmdev );
-		return NULL;
-	}
-#endif
 	{
 	struct timeval tv1;
 	struct timeval tv2;
@@ -256,8 +250,8 @@ static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate)
 	int diff = 0;
 	err = gettimeofday(&tv1, &tz);
 	while (1) {
-		if (!(alsa_set_params(pcm_handle,0,bits,stereo,rate)<0)){
-			ms_message("alsa_open_r: Audio params set");
+		if (!(alsa_set_params(pcm_handle,0,bits,stereo,rate,allow_mmap,mmap)<0)){
+			ms_message("alsa_open_r: Audio params set, %s access",*mmap ? "mmap" : "read/write");
 			break;
 		}
 		if (!gettimeofday(&tv2, &tz) && !err) {
@@ -282,7 +276,7 @@ static snd_pcm_t * alsa_open_r(const char *pcmdev,int bits,int stereo,int rate)
 	return pcm_handle;
 }
 
-static snd_pcm_t * alsa_open_w(const char *pcmdev,int bits,int stereo,int rate)
+static snd_pcm_t * alsa_open_w(const char *pcmdev,int bits,int stereo,int rate,bool_t allow_mmap,bool_t *mmap)
 {
 	snd_pcm_t *pcm_handle;
 
@@ -301,8 +295,8 @@ static snd_pcm_t * alsa_open_w(const char *pcmdev,int bits,int stereo,int rate)
 	int err;
 	err = gettimeofday(&tv1, &tz);
 	while (1) {
-		if (!(alsa_set_params(pcm_handle,1,bits,stereo,rate)<0)){
-			ms_message("alsa_open_w: Audio params set");
+		if (!(alsa_set_params(pcm_handle,1,bits,stereo,rate,allow_mmap,mmap)<0)){
+			ms_message("alsa_open_w: Audio params set, %s access",*mmap ? "mmap" : "read/write");
 			break;
 		}
 		if (!gettimeofday(&tv2, &tz) && !err) {
@@ -323,10 +317,30 @@ static snd_pcm_t * alsa_open_w(const char *pcmdev,int bits,int stereo,int rate)
 	return pcm_handle;
 }
 
-static int alsa_can_read(snd_pcm_t *dev)
+/* Brings the device back to a running state after an xrun or a suspend, returns 0 on success */
+static int alsa_recover(snd_pcm_t *handle, int err, MSAudioXrunStats *xruns, bool_t capture)
+{
+	if (err==-EPIPE){
+		if (capture) xruns->overruns++;
+		else xruns->underruns++;
+	}
+	ms_warning("alsa: recovering from %s", snd_strerror(err));
+	err = snd_pcm_recover(handle, err, 1);
+	if (err<0){
+		ms_error("snd_pcm_recover() failed with err %d: %s", err, snd_strerror(err));
+		return -1;
+	}
+	/* a playback device starts again by itself once refilled up to the start threshold */
+	if (capture && (err = snd_pcm_start(handle))<0){
+		ms_error("snd_pcm_start() failed with err %d: %s", err, snd_strerror(err));
+		return -1;
+	}
+	return 0;
+}
+
+static int alsa_can_read(snd_pcm_t *dev, MSAudioXrunStats *xruns)
 {
 	snd_pcm_sframes_t avail;
-	int err;
 
 	alsa_resume(dev);
 	avail = snd_pcm_avail_update(dev);
@@ -334,33 +348,22 @@ static int alsa_can_read(snd_pcm_t *dev)
 	if (avail >= 0 && snd_pcm_state(dev) == SND_PCM_STATE_XRUN) avail=-EPIPE;
 	if (avail < 0) {
 		ms_error("snd_pcm_avail_update: %s", snd_strerror(avail));	// most probably -EPIPE
-		/* overrun occured, snd_pcm_state() would return SND_PCM_STATE_XRUN
-		 FIXME: handle other error conditions*/
-		ms_error("*** alsa_can_read fixup, trying to recover");
-		snd_pcm_drain(dev); /* Ignore possible error, at least -EAGAIN.*/
-		err = snd_pcm_recover(dev, avail, 0);
-		if (err){
-			ms_error("snd_pcm_recover() failed with err %d: %s", err, snd_strerror(err));
-			return -1;
-		}
-		err = snd_pcm_start(dev);
-		if (err){
-			ms_error("snd_pcm_start() failed with err %d: %s", err, snd_strerror(err));
-			return -1;
-		}
+		if (alsa_recover(dev, avail, xruns, TRUE)<0) return -1;
 		ms_message("Recovery done");
+		return 0;
 	}
 	return avail;
 }
 
 
-static int alsa_read(snd_pcm_t *handle,unsigned char *buf,int nsamples)
+static int alsa_read(snd_pcm_t *handle,unsigned char *buf,int nsamples,MSAudioXrunStats *xruns)
 {
 	int err;
 	err=snd_pcm_readi(handle,buf,nsamples);
 	if (err<0) {
 		ms_warning("alsa_read: snd_pcm_readi() returned %i",err);
 		if (err==-EPIPE){
+			xruns->overruns++;
 			snd_pcm_prepare(handle);
 			err=snd_pcm_readi(handle,buf,nsamples);
 			if (err<0) ms_warning("alsa_read: snd_pcm_readi() failed:%s.",snd_strerror(err));
@@ -376,11 +379,12 @@ static int alsa_read(snd_pcm_t *handle,unsigned char *buf,int nsamples)
 }
 
 
-static int alsa_write(snd_pcm_t *handle,unsigned char *buf,int nsamples)
+static int alsa_write(snd_pcm_t *handle,unsigned char *buf,int nsamples,MSAudioXrunStats *xruns)
 {
 	int err;
 	if ((err=snd_pcm_writei(handle,buf,nsamples))<0){
 		if (err==-EPIPE){
+			xruns->underruns++;
 			snd_pcm_prepare(handle);
 #ifdef EPIPE_BUGFIX
 			alsa_fill_w (handle);
@@ -398,6 +402,67 @@ static int alsa_write(snd_pcm_t *handle,unsigned char *buf,int nsamples)
 	return err;
 }
 
+/* the frames of the mmap area starting at offset, as the access is interleaved */
+static uint8_t *alsa_mmap_frames(const snd_pcm_channel_area_t *areas, snd_pcm_uframes_t offset)
+{
+	return (uint8_t*)areas[0].addr + areas[0].first/8 + offset*(areas[0].step/8);
+}
+
+/* Copies up to nframes captured frames out of the ring buffer of the device into the queue,
+returns the number of frames read, or a negative error if none could be */
+static int alsa_mmap_read(snd_pcm_t *handle, MSQueue *q, snd_pcm_uframes_t nframes, int frame_size)
+{
+	int total=0;
+	while (nframes>0){
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t offset, frames=nframes;
+		snd_pcm_sframes_t committed;
+		mblk_t *om;
+		int err;
+
+		if ((err=snd_pcm_mmap_begin(handle, &areas, &offset, &frames))<0) return total>0 ? total : err;
+		if (frames==0) break;
+		om=allocb(frames*frame_size,0);
+		memcpy(om->b_wptr, alsa_mmap_frames(areas, offset), frames*frame_size);
+		committed=snd_pcm_mmap_commit(handle, offset, frames);
+		if (committed<0){
+			freemsg(om);
+			return total>0 ? total : (int)committed;
+		}
+		om->b_wptr+=committed*frame_size;
+		ms_queue_put(q,om);
+		nframes-=committed;
+		total+=committed;
+	}
+	return total;
+}
+
+/* Copies as much of the message as fits into the ring buffer of the device,
+returns the number of frames written, or a negative error if none could be */
+static int alsa_mmap_write(snd_pcm_t *handle, mblk_t *im, int frame_size)
+{
+	snd_pcm_sframes_t avail=snd_pcm_avail_update(handle);
+	int total=0;
+
+	if (avail<0) return avail;
+	while (avail>0 && im->b_wptr-im->b_rptr>=frame_size){
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t offset, frames=MIN((snd_pcm_uframes_t)avail, (snd_pcm_uframes_t)((im->b_wptr-im->b_rptr)/frame_size));
+		snd_pcm_sframes_t committed;
+		int err;
+
+		if ((err=snd_pcm_mmap_begin(handle, &areas, &offset, &frames))<0) return total>0 ? total : err;
+		if (frames==0) break;
+		memcpy(alsa_mmap_frames(areas, offset), im->b_rptr, frames*frame_size);
+		committed=snd_pcm_mmap_commit(handle, offset, frames);
+		if (committed<0) return total>0 ? total : (int)committed;
+		im->b_rptr+=committed*frame_size;
+		avail-=committed;
+		total+=committed;
+	}
+	return total;
+}
+
 
 static snd_mixer_t *alsa_mixer_open(const char *mixdev){
 	snd_mixer_t *mixer=NULL;
@@ -788,14 +853,14 @@ struct _AlsaReadData{
 	int nchannels;
 	uint64_t read_samples;
 	MSTickerSynchronizer *ticker_synchronizer;
+	MSAudioXrunStats xruns;
+	uint64_t last_stats;
+	snd_pcm_uframes_t buffer_size;
+	snd_pcm_uframes_t period_size;
+	int latency;
 	bool_t read_started;
 	bool_t write_started;
-
-#ifdef THREADED_VERSION
-	ms_thread_t thread;
-	ms_mutex_t mutex;
-	MSBufferizer * bufferizer;
-#endif
+	bool_t mmap;
 };
 
 typedef struct _AlsaReadData AlsaReadData;
@@ -808,100 +873,21 @@ void alsa_read_init(MSFilter *obj){
 	ad->nchannels=1;
 	ad->ticker_synchronizer = ms_ticker_synchronizer_new();
 	obj->data=ad;
-
-#ifdef THREADED_VERSION
-	ad->read_started=FALSE;
-	ad->write_started=FALSE;
-	ad->bufferizer=ms_bufferizer_new();
-	ms_mutex_init(&ad->mutex,NULL);
-	ad->thread=0;
-#endif
 }
 
-#ifdef THREADED_VERSION
-
-static void * alsa_write_thread(void *p){
-	AlsaReadData *ad=(AlsaReadData*)p;
-	int samples=(160*ad->rate)/8000;
-	int err;
-	int count=0;
-	mblk_t *om=NULL;
-	struct timeval timeout;
-	if (ad->handle==NULL && ad->pcmdev!=NULL){
-		ad->handle=alsa_open_r(ad->pcmdev,16,ad->nchannels==2,ad->rate);
+/* Updates the delay between the application and the sound card, and logs it every five seconds */
+static void alsa_report_latency(AlsaReadData *ad, uint64_t time, const char *direction){
+	snd_pcm_sframes_t delay;
+	if (snd_pcm_delay(ad->handle, &delay)==0 && delay>=0){
+		ad->latency=(int)(delay*1000/ad->rate);
+	}
+	if (time - ad->last_stats < 5000) return;
+	ad->last_stats=time;
+	ms_message("alsa: %s latency is equal to %i ms", direction, ad->latency);
+	if (ad->xruns.underruns || ad->xruns.overruns){
+		ms_warning("alsa: %s had %u underruns and %u overruns so far", direction, ad->xruns.underruns, ad->xruns.overruns);
 	}
-	if (ad->handle==NULL) return NULL;
-
-	while (ad->read_started)
-	  {
-		count = alsa_can_read(ad->handle,samples);
-		if (count==24)
-		  { /* keep this value for this driver */ }
-		else if (count<=0)
-		  {
-		count = samples;
-		  }
-		else if (count>0)
-		  {
-		//ms_warning("%i count", count);
-		//count = samples;
-		  }
-
-		int size=count*2;
-		om=allocb(size,0);
-
-		if ((err=alsa_read(ad->handle,om->b_wptr,count))<=0)
-		  {
-		ms_warning("nothing to read");
-		//ms_warning("Fail to read samples %i", count);
-		freemsg(om); /* leak fixed */
-		continue;
-		  }
-		//ms_warning(" read %i", err);
-
-		size=err*2;
-		om->b_wptr+=size;
-
-		ms_mutex_lock(&ad->mutex);
-		ms_bufferizer_put(ad->bufferizer,om);
-		ms_mutex_unlock(&ad->mutex);
-
-		if (count==24)
-		  {
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 2000;
-		select(0, 0, NULL, NULL, &timeout );
-		  }
-		else
-		  {
-		/* select will be less active than locking on "read" */
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 5000;
-		select(0, 0, NULL, NULL, &timeout );
-		  }
-	  }
-
-	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
-	ad->handle=NULL;
-	return NULL;
-}
-
-static void alsa_start_r(AlsaReadData *d){
-	if (d->read_started==FALSE){
-		d->read_started=TRUE;
-		ms_thread_create(&d->thread,NULL,alsa_write_thread,d);
-	}else d->read_started=TRUE;
-}
-
-static void alsa_stop_r(AlsaReadData *d){
-	d->read_started=FALSE;
-	if (d->thread!=0)
-	  {
-		ms_thread_join(d->thread,NULL);
-		d->thread=0;
-	  }
 }
-#endif
 
 static void compute_timespec(AlsaReadData *d) {
 	static int count = 0;
@@ -915,94 +901,73 @@ static void compute_timespec(AlsaReadData *d) {
 		ms_message("sound/wall clock skew is average=%f ms", av_skew);
 }
 
-void alsa_read_preprocess(MSFilter *obj){
-#ifdef THREADED_VERSION
-	AlsaReadData *ad=(AlsaReadData*)obj->data;
-	alsa_start_r(ad);
-#endif
-}
-
-
 void alsa_read_postprocess(MSFilter *obj){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
-#ifdef THREADED_VERSION
-	alsa_stop_r(ad);
-#endif
 	ms_ticker_set_time_func(obj->ticker,NULL,NULL);
 	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
 	ad->read_started=FALSE;
+	ad->latency=0;
 	ad->handle=NULL;
 }
 
 void alsa_read_uninit(MSFilter *obj){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
-#ifdef THREADED_VERSION
-	alsa_stop_r(ad);
-#endif
 	if (ad->pcmdev!=NULL) ms_free(ad->pcmdev);
 	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
-#ifdef THREADED_VERSION
-	ms_bufferizer_destroy(ad->bufferizer);
-	ms_mutex_destroy(&ad->mutex);
-#endif
 	ms_ticker_synchronizer_destroy(ad->ticker_synchronizer);
 	ms_free(ad);
 }
 
-#ifndef THREADED_VERSION
 void alsa_read_process(MSFilter *obj){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
 	int samples=(128*ad->rate)/8000;
+	int frame_size=2*ad->nchannels;
+	int avail;
 	int err;
+	bool_t recovered=FALSE;
 	mblk_t *om=NULL;
 	if (ad->handle==NULL && ad->pcmdev!=NULL && !ad->read_started){
 		ad->read_started=TRUE;
-		ad->handle=alsa_open_r(ad->pcmdev,16,ad->nchannels==2,ad->rate);
+		ad->handle=alsa_open_r(ad->pcmdev,16,ad->nchannels==2,ad->rate,TRUE,&ad->mmap);
 		if (ad->handle){
 			ad->read_samples=0;
+			ad->last_stats=obj->ticker->time;
 			ms_ticker_set_time_func(obj->ticker,(uint64_t (*)(void*))ms_ticker_synchronizer_get_corrected_time, ad->ticker_synchronizer);
 		}
 	}
 	if (ad->handle==NULL) return;
-	while (alsa_can_read(ad->handle)>=samples){
-
-		int size=samples*2*ad->nchannels;
-		om=allocb(size,0);
-		if ((err=alsa_read(ad->handle,om->b_wptr,samples))<=0) {
-			ms_warning("Fail to read samples");
-			freemsg(om);
-			return;
+	if (ad->mmap){
+		/* take all the frames captured so far, rather than waiting for a whole block */
+		while ((avail=alsa_can_read(ad->handle,&ad->xruns))>0){
+			if ((err=alsa_mmap_read(ad->handle,obj->outputs[0],avail,frame_size))<=0) {
+				/* recover once per tick at most, so that a lasting error does not hold the ticker */
+				if (err==0 || recovered || alsa_recover(ad->handle,err,&ad->xruns,TRUE)<0) break;
+				recovered=TRUE;
+				continue;
+			}
+			ad->read_samples+=err;
+			compute_timespec(ad);
 		}
-		ad->read_samples+=err;
-		size=err*2*ad->nchannels;
-		om->b_wptr+=size;
-		compute_timespec(ad);
-
-		/*ms_message("alsa_read_process: Outputing %i bytes",size);*/
-		ms_queue_put(obj->outputs[0],om);
-	}
-}
-#endif
-
-#ifdef THREADED_VERSION
-void alsa_read_process(MSFilter *obj){
-	AlsaReadData *ad=(AlsaReadData*)obj->data;
-	mblk_t *om=NULL;
-	int samples=(160*ad->rate)/8000;
-	int size=samples*2*ad->nchannels;
-
-	ms_mutex_lock(&ad->mutex);
-	while (ms_bufferizer_get_avail(ad->bufferizer)>=size){
+	}else{
+		while (alsa_can_read(ad->handle,&ad->xruns)>=samples){
+			int size=samples*frame_size;
+			om=allocb(size,0);
+			if ((err=alsa_read(ad->handle,om->b_wptr,samples,&ad->xruns))<=0) {
+				ms_warning("Fail to read samples");
+				freemsg(om);
+				return;
+			}
+			ad->read_samples+=err;
+			size=err*frame_size;
+			om->b_wptr+=size;
+			compute_timespec(ad);
 
-	  om=allocb(size,0);
-	  ms_bufferizer_read(ad->bufferizer,om->b_wptr,size);
-	  om->b_wptr+=size;
-	  /*ms_message("alsa_read_process: Outputing %i bytes",size);*/
-	  ms_queue_put(obj->outputs[0],om);
+			/*ms_message("alsa_read_process: Outputing %i bytes",size);*/
+			ms_queue_put(obj->outputs[0],om);
+		}
 	}
-	ms_mutex_unlock(&ad->mutex);
+	alsa_report_latency(ad, obj->ticker->time, "capture");
 }
-#endif
 
 static int alsa_read_get_sample_rate(MSFilter *obj, void *param){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
@@ -1029,11 +994,26 @@ static int alsa_read_set_nchannels(MSFilter *obj, void *param){
 	return 0;
 }
 
+static int alsa_get_latency(MSFilter *obj, void *param){
+	AlsaReadData *ad=(AlsaReadData*)obj->data;
+	*((int*)param)=ad->latency;
+	return 0;
+}
+
+static int alsa_get_xrun_stats(MSFilter *obj, void *param){
+	AlsaReadData *ad=(AlsaReadData*)obj->data;
+	*((MSAudioXrunStats*)param)=ad->xruns;
+	return 0;
+}
+
 MSFilterMethod alsa_read_methods[]={
 	{MS_FILTER_GET_SAMPLE_RATE,	alsa_read_get_sample_rate},
 	{MS_FILTER_SET_SAMPLE_RATE, alsa_read_set_sample_rate},
 	{MS_FILTER_GET_NCHANNELS, alsa_read_get_nchannels},
 	{MS_FILTER_SET_NCHANNELS, alsa_read_set_nchannels},
+	{MS_FILTER_GET_LATENCY, alsa_get_latency},
+	{MS_AUDIO_CAPTURE_GET_LATENCY, alsa_get_latency},
+	{MS_AUDIO_CAPTURE_GET_XRUN_STATS, alsa_get_xrun_stats},
 	{0,NULL}
 };
 
@@ -1045,7 +1025,6 @@ MSFilterDesc alsa_read_desc={
 	.ninputs=0,
 	.noutputs=1,
 	.init=alsa_read_init,
-	.preprocess=alsa_read_preprocess,
 	.process=alsa_read_process,
 	.postprocess=alsa_read_postprocess,
 	.uninit=alsa_read_uninit,
@@ -1074,6 +1053,7 @@ void alsa_write_postprocess(MSFilter *obj){
 	AlsaReadData *ad=(AlsaReadData*)obj->data;
 	if (ad->handle!=NULL) snd_pcm_close(ad->handle);
 	ad->write_started=FALSE;
+	ad->latency=0;
 	ad->handle=NULL;
 }
 
@@ -1111,15 +1091,36 @@ int alsa_write_set_nchannels(MSFilter *obj, void *data){
 	return 0;
 }
 
+/* With the mmap access, the device has to be started once filled up to the start threshold */
+static void alsa_mmap_start(AlsaWriteData *ad){
+	snd_pcm_sframes_t avail;
+	int err;
+	if (snd_pcm_state(ad->handle)!=SND_PCM_STATE_PREPARED) return;
+	avail=snd_pcm_avail_update(ad->handle);
+	if (avail>=0 && ad->buffer_size-(snd_pcm_uframes_t)avail>=ad->period_size*2){
+		if ((err=snd_pcm_start(ad->handle))<0) ms_warning("snd_pcm_start() failed: %s", snd_strerror(err));
+	}
+}
+
 void alsa_write_process(MSFilter *obj){
 	AlsaWriteData *ad=(AlsaWriteData*)obj->data;
 	mblk_t *im=NULL;
+	int frame_size=2*ad->nchannels;
 	int size;
 	int samples;
 	int err;
+	bool_t recovered=FALSE;
 	if (ad->handle==NULL && ad->pcmdev!=NULL && !ad->write_started){
 		ad->write_started=TRUE;
-		ad->handle=alsa_open_w(ad->pcmdev,16,ad->nchannels==2,ad->rate);
+		ad->handle=alsa_open_w(ad->pcmdev,16,ad->nchannels==2,ad->rate,TRUE,&ad->mmap);
+		if (ad->handle && ad->mmap && snd_pcm_get_params(ad->handle,&ad->buffer_size,&ad->period_size)<0){
+			/* the start of an mmap device cannot be decided without its buffer geometry, and an mmap handle
+			 cannot be written with snd_pcm_writei(): reopen it with the read/write access */
+			ms_warning("alsa_write_process: cannot get the buffer size of %s, reopening it with the read/write access",ad->pcmdev);
+			snd_pcm_close(ad->handle);
+			ad->handle=alsa_open_w(ad->pcmdev,16,ad->nchannels==2,ad->rate,FALSE,&ad->mmap);
+		}
+		if (ad->handle) ad->last_stats=obj->ticker->time;
 #ifdef EPIPE_BUGFIX
 		alsa_fill_w (ad->pcmdev);
 #endif
@@ -1129,16 +1130,28 @@ void alsa_write_process(MSFilter *obj){
 		return;
 	}
 	while ((im=ms_queue_get(obj->inputs[0]))!=NULL){
-		while((size=im->b_wptr-im->b_rptr)>0){
-			samples=size/(2*ad->nchannels);
-			err=alsa_write(ad->handle,im->b_rptr,samples);
-			if (err>0) {
-				im->b_rptr+=err*(2*ad->nchannels);
+		while((size=im->b_wptr-im->b_rptr)>=frame_size){
+			if (ad->mmap){
+				/* the samples go straight from the queued message to the ring buffer of the device */
+				if ((err=alsa_mmap_write(ad->handle,im,frame_size))<0){
+					if (!recovered && alsa_recover(ad->handle,err,&ad->xruns,FALSE)==0){
+						recovered=TRUE;
+						continue;
+					}
+				}
+			}else{
+				samples=size/frame_size;
+				err=alsa_write(ad->handle,im->b_rptr,samples,&ad->xruns);
+				if (err>0) {
+					im->b_rptr+=err*frame_size;
+				}
 			}
-			else break;
+			if (err<=0) break;
 		}
 		freemsg(im);
 	}
+	if (ad->mmap) alsa_mmap_start(ad);
+	alsa_report_latency(ad, obj->ticker->time, "playback");
 }
 
 MSFilterMethod alsa_write_methods[]={
@@ -1146,6 +1159,9 @@ MSFilterMethod alsa_write_methods[]={
 	{MS_FILTER_SET_SAMPLE_RATE, alsa_write_set_sample_rate},
 	{MS_FILTER_GET_NCHANNELS, alsa_write_get_nchannels},
 	{MS_FILTER_SET_NCHANNELS, alsa_write_set_nchannels},
+	{MS_FILTER_GET_LATENCY, alsa_get_latency},
+	{MS_AUDIO_PLAYBACK_GET_LATENCY, alsa_get_latency},
+	{MS_AUDIO_PLAYBACK_GET_XRUN_STATS, alsa_get_xrun_stats},
 	{0,NULL}
 };
 
@@ -0,0 +1,797 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msasyncfilerec.h"
+#include "mediastreamer2/msfilerec.h"
+#include "mediastreamer2/msticker.h"
+#include "waveheader.h"
+
+/*
+ * The recorder filter only moves the audio it receives into a bounded queue. The queue is emptied
+ * by a feeder filter, which drives the encoder and the writer: MSFileRec for wav files, MSMKVRecorder
+ * for Matroska files, and the Ogg Opus writer below. The feeders of the open recorders are spread
+ * round-robin over a pool of refcounted tickers, one per CPU, so that many recordings neither cost one
+ * thread each nor wait for each other's encoding and file writes on a single thread.
+ */
+
+#define OGG_OPUS_PRE_SKIP 312 /*lookahead of the opus encoder at 48kHz*/
+#define OGG_OPUS_PAGE_DURATION 48000 /*a page is written at least every second*/
+
+/*********************************************************************************************
+ * Ogg Opus writer                                                                           *
+ *********************************************************************************************/
+
+typedef struct OggOpusWriter{
+	int fd;
+	int rate;
+	int nchannels;
+	uint32_t serial;
+	uint32_t page_seq;
+	uint64_t granule; /*48kHz samples at the end of the last packet, including the pre-skip*/
+	uint64_t page_granule; /*granule at the end of the last written page*/
+	uint8_t segments[255];
+	int nsegments;
+	uint8_t *body;
+	int body_size;
+	int body_alloc;
+} OggOpusWriter;
+
+static void ogg_put_le16(uint8_t *p, uint16_t v){
+	p[0]=v & 0xff;
+	p[1]=v >> 8;
+}
+
+static void ogg_put_le32(uint8_t *p, uint32_t v){
+	p[0]=v & 0xff;
+	p[1]=(v >> 8) & 0xff;
+	p[2]=(v >> 16) & 0xff;
+	p[3]=v >> 24;
+}
+
+static uint32_t ogg_crc(uint32_t crc, const uint8_t *data, int len){
+	int i,j;
+	for(i=0;i<len;i++){
+		crc^=(uint32_t)data[i] << 24;
+		for(j=0;j<8;j++){
+			crc=(crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+/*number of 48kHz samples in an opus packet, from its TOC byte (RFC6716, section 3.1)*/
+static int opus_packet_duration(const uint8_t *data, int len){
+	static const int silk_sizes[4]={480,960,1920,2880};
+	static const int celt_sizes[4]={120,240,480,960};
+	int config,frame_size,nframes;
+	if (len<1) return 0;
+	config=data[0] >> 3;
+	if (config<12) frame_size=silk_sizes[config & 3];
+	else if (config<16) frame_size=(config & 1) ? 960 : 480;
+	else frame_size=celt_sizes[config & 3];
+	switch(data[0] & 3){
+		case 0:
+			nframes=1;
+			break;
+		case 3:
+			if (len<2) return 0;
+			nframes=data[1] & 0x3f;
+			break;
+		default:
+			nframes=2;
+			break;
+	}
+	return frame_size*nframes;
+}
+
+static void ogg_opus_writer_write_page(OggOpusWriter *w, uint8_t flags){
+	int size=27+w->nsegments+w->body_size;
+	uint8_t *page=ms_malloc(size);
+	int err;
+
+	memcpy(page,"OggS",4);
+	page[4]=0;
+	page[5]=flags;
+	ogg_put_le32(page+6,(uint32_t)w->granule);
+	ogg_put_le32(page+10,(uint32_t)(w->granule >> 32));
+	ogg_put_le32(page+14,w->serial);
+	ogg_put_le32(page+18,w->page_seq++);
+	ogg_put_le32(page+22,0);
+	page[26]=w->nsegments;
+	memcpy(page+27,w->segments,w->nsegments);
+	memcpy(page+27+w->nsegments,w->body,w->body_size);
+	ogg_put_le32(page+22,ogg_crc(0,page,size));
+	if ((err=write(w->fd,page,size))!=size){
+		if (err<0) ms_warning("MSOggOpusWriter: fail to write %i bytes: %s",size,strerror(errno));
+	}
+	ms_free(page);
+	w->nsegments=0;
+	w->body_size=0;
+	w->page_granule=w->granule;
+}
+
+static void ogg_opus_writer_add_packet(OggOpusWriter *w, const uint8_t *data, int len){
+	int nsegments=len/255+1;
+	int i;
+
+	if (w->nsegments+nsegments>255) ogg_opus_writer_write_page(w,0);
+	for(i=0;i<nsegments-1;i++) w->segments[w->nsegments++]=255;
+	w->segments[w->nsegments++]=len%255;
+	if (w->body_size+len>w->body_alloc){
+		w->body_alloc=w->body_size+len+4096;
+		w->body=ms_realloc(w->body,w->body_alloc);
+	}
+	memcpy(w->body+w->body_size,data,len);
+	w->body_size+=len;
+}
+
+static void ogg_opus_writer_write_headers(OggOpusWriter *w){
+	static const char vendor[]="mediastreamer2";
+	uint8_t head[19];
+	uint8_t tags[8+4+sizeof(vendor)-1+4];
+
+	memcpy(head,"OpusHead",8);
+	head[8]=1;
+	head[9]=w->nchannels;
+	ogg_put_le16(head+10,OGG_OPUS_PRE_SKIP);
+	ogg_put_le32(head+12,w->rate);
+	ogg_put_le16(head+16,0);
+	head[18]=0;
+	ogg_opus_writer_add_packet(w,head,sizeof(head));
+	ogg_opus_writer_write_page(w,0x2);
+
+	memcpy(tags,"OpusTags",8);
+	ogg_put_le32(tags+8,sizeof(vendor)-1);
+	memcpy(tags+12,vendor,sizeof(vendor)-1);
+	ogg_put_le32(tags+12+sizeof(vendor)-1,0);
+	ogg_opus_writer_add_packet(w,tags,sizeof(tags));
+	ogg_opus_writer_write_page(w,0);
+}
+
+static void ogg_opus_writer_init(MSFilter *f){
+	OggOpusWriter *w=ms_new0(OggOpusWriter,1);
+	w->fd=-1;
+	w->rate=8000;
+	w->nchannels=1;
+	f->data=w;
+}
+
+static void ogg_opus_writer_process(MSFilter *f){
+	OggOpusWriter *w=(OggOpusWriter*)f->data;
+	mblk_t *m;
+
+	ms_filter_lock(f);
+	while((m=ms_queue_get(f->inputs[0]))!=NULL){
+		if (w->fd!=-1){
+			if (m->b_cont) msgpullup(m,-1);
+			ogg_opus_writer_add_packet(w,m->b_rptr,m->b_wptr-m->b_rptr);
+			w->granule+=opus_packet_duration(m->b_rptr,m->b_wptr-m->b_rptr);
+			if (w->granule-w->page_granule>=OGG_OPUS_PAGE_DURATION) ogg_opus_writer_write_page(w,0);
+		}
+		freemsg(m);
+	}
+	ms_filter_unlock(f);
+}
+
+static int ogg_opus_writer_close(MSFilter *f, void *arg){
+	OggOpusWriter *w=(OggOpusWriter*)f->data;
+	ms_filter_lock(f);
+	if (w->fd!=-1){
+		ogg_opus_writer_write_page(w,0x4);
+		close(w->fd);
+		w->fd=-1;
+	}
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int ogg_opus_writer_open(MSFilter *f, void *arg){
+	OggOpusWriter *w=(OggOpusWriter*)f->data;
+	const char *filename=(const char*)arg;
+
+	if (w->fd!=-1) ogg_opus_writer_close(f,NULL);
+	ms_filter_lock(f);
+	w->fd=open(filename,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,S_IRUSR|S_IWUSR);
+	if (w->fd==-1){
+		ms_filter_unlock(f);
+		ms_warning("Cannot open %s: %s",filename,strerror(errno));
+		return -1;
+	}
+	w->serial=ortp_random();
+	w->page_seq=0;
+	w->granule=0;
+	w->page_granule=0;
+	w->nsegments=0;
+	w->body_size=0;
+	ogg_opus_writer_write_headers(w);
+	ms_filter_unlock(f);
+	ms_message("MSOggOpusWriter: recording into %s",filename);
+	return 0;
+}
+
+/*pages are written whole, so a sync only has to flush the current one*/
+static int ogg_opus_writer_sync(MSFilter *f, void *arg){
+	OggOpusWriter *w=(OggOpusWriter*)f->data;
+	ms_filter_lock(f);
+	if (w->fd!=-1 && w->nsegments>0) ogg_opus_writer_write_page(w,0);
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int ogg_opus_writer_set_sr(MSFilter *f, void *arg){
+	OggOpusWriter *w=(OggOpusWriter*)f->data;
+	w->rate=*(int*)arg;
+	return 0;
+}
+
+static int ogg_opus_writer_set_nchannels(MSFilter *f, void *arg){
+	OggOpusWriter *w=(OggOpusWriter*)f->data;
+	w->nchannels=*(int*)arg;
+	return 0;
+}
+
+static void ogg_opus_writer_uninit(MSFilter *f){
+	OggOpusWriter *w=(OggOpusWriter*)f->data;
+	if (w->fd!=-1) ogg_opus_writer_close(f,NULL);
+	if (w->body) ms_free(w->body);
+	ms_free(w);
+}
+
+static MSFilterMethod ogg_opus_writer_methods[]={
+	{	MS_FILTER_SET_SAMPLE_RATE	,	ogg_opus_writer_set_sr	},
+	{	MS_FILTER_SET_NCHANNELS	,	ogg_opus_writer_set_nchannels	},
+	{	MS_RECORDER_OPEN	,	ogg_opus_writer_open	},
+	{	MS_RECORDER_CLOSE	,	ogg_opus_writer_close	},
+	{	MS_RECORDER_SYNC	,	ogg_opus_writer_sync	},
+	{	0	,	NULL	}
+};
+
+#ifdef _WIN32
+
+static MSFilterDesc ogg_opus_writer_desc={
+	MS_FILTER_PLUGIN_ID,
+	"MSOggOpusWriter",
+	"Ogg Opus file writer",
+	MS_FILTER_OTHER,
+	NULL,
+	1,
+	0,
+	ogg_opus_writer_init,
+	NULL,
+	ogg_opus_writer_process,
+	NULL,
+	ogg_opus_writer_uninit,
+	ogg_opus_writer_methods
+};
+
+#else
+
+static MSFilterDesc ogg_opus_writer_desc={
+	.id=MS_FILTER_PLUGIN_ID,
+	.name="MSOggOpusWriter",
+	.text="Ogg Opus file writer",
+	.category=MS_FILTER_OTHER,
+	.ninputs=1,
+	.noutputs=0,
+	.init=ogg_opus_writer_init,
+	.process=ogg_opus_writer_process,
+	.uninit=ogg_opus_writer_uninit,
+	.methods=ogg_opus_writer_methods
+};
+
+#endif
+
+/*********************************************************************************************
+ * Asynchronous file recorder                                                                *
+ *********************************************************************************************/
+
+typedef enum AsyncRecFormat{
+	AsyncRecWav,
+	AsyncRecOggOpus,
+	AsyncRecMatroska,
+	AsyncRecUnknown
+} AsyncRecFormat;
+
+typedef struct AsyncRecState{
+	ms_mutex_t lock; /*protects the queue and the statistics, shared with the feeder*/
+	ms_cond_t cond;
+	queue_t q;
+	uint64_t queued; /*statistics are kept in bytes*/
+	uint64_t max_queued;
+	uint64_t dropped;
+	uint64_t recorded;
+	unsigned int dropped_blocks;
+	unsigned int syncs;
+	uint64_t last_sync;
+	int rate;
+	int nchannels;
+	int bitrate;
+	int max_queue;
+	int sync_interval;
+	char *codec;
+	MSRecorderState state;
+	MSTicker *ticker; /*the writer ticker of the pool this recorder runs on, while the file is open*/
+	MSFilter *feeder;
+	MSFilter *encoder;
+	MSFilter *writer;
+} AsyncRecState;
+
+#define MAX_WRITER_TICKERS 16
+
+typedef struct _WriterTicker{
+	MSTicker *ticker;
+	int refcount;
+} WriterTicker;
+
+static WriterTicker writer_tickers[MAX_WRITER_TICKERS];
+static unsigned int writer_ticker_next=0;
+static ms_mutex_t writer_ticker_lock;
+static ms_once_t writer_ticker_once=MS_ONCE_INIT;
+
+static void writer_ticker_init_lock(void){
+	ms_mutex_init(&writer_ticker_lock,NULL);
+}
+
+static MSTicker *writer_ticker_ref(MSFactory *factory){
+	unsigned int count=factory ? ms_factory_get_cpu_count(factory) : ms_get_cpu_count();
+	WriterTicker *wt;
+	MSTicker *ticker;
+
+	if (count<1) count=1;
+	if (count>MAX_WRITER_TICKERS) count=MAX_WRITER_TICKERS;
+	ms_once(&writer_ticker_once,writer_ticker_init_lock);
+	ms_mutex_lock(&writer_ticker_lock);
+	wt=&writer_tickers[writer_ticker_next++ % count];
+	if (wt->ticker==NULL){
+		MSTickerParams params;
+		params.name="MSAsyncFileRec";
+		params.prio=MS_TICKER_PRIO_NORMAL;
+		wt->ticker=ms_ticker_new_with_params(&params);
+	}
+	wt->refcount++;
+	ticker=wt->ticker;
+	ms_mutex_unlock(&writer_ticker_lock);
+	return ticker;
+}
+
+static void writer_ticker_unref(MSTicker *ticker){
+	int i;
+	ms_mutex_lock(&writer_ticker_lock);
+	for(i=0;i<MAX_WRITER_TICKERS;i++){
+		WriterTicker *wt=&writer_tickers[i];
+		if (wt->ticker!=ticker) continue;
+		if (--wt->refcount>0) break;
+		wt->ticker=NULL;
+		ms_mutex_unlock(&writer_ticker_lock);
+		ms_ticker_destroy(ticker);
+		return;
+	}
+	ms_mutex_unlock(&writer_ticker_lock);
+}
+
+static int async_rec_close(MSFilter *f, void *arg);
+
+static int async_rec_bytes_to_ms(const AsyncRecState *s, uint64_t bytes){
+	return (int)(bytes*1000/(s->rate*2*s->nchannels));
+}
+
+static void async_rec_feeder_process(MSFilter *f){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	mblk_t *m;
+	bool_t sync=FALSE;
+
+	ms_mutex_lock(&s->lock);
+	while((m=getq(&s->q))!=NULL){
+		s->recorded+=msgdsize(m);
+		ms_queue_put(f->outputs[0],m);
+	}
+	s->queued=0;
+	ms_cond_signal(&s->cond);
+	if (s->sync_interval>0 && f->ticker->time>=s->last_sync+s->sync_interval){
+		s->last_sync=f->ticker->time;
+		sync=TRUE;
+	}
+	ms_mutex_unlock(&s->lock);
+
+	/*the writer got everything up to the previous tick*/
+	if (sync && ms_filter_call_method_noarg(s->writer,MS_RECORDER_SYNC)==0){
+		ms_mutex_lock(&s->lock);
+		s->syncs++;
+		ms_mutex_unlock(&s->lock);
+	}
+}
+
+#ifdef _WIN32
+
+static MSFilterDesc async_rec_feeder_desc={
+	MS_FILTER_PLUGIN_ID,
+	"MSAsyncFileRecFeeder",
+	"Feeds the encoder of the asynchronous file recorder",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	1,
+	NULL,
+	NULL,
+	async_rec_feeder_process,
+	NULL,
+	NULL,
+	NULL
+};
+
+#else
+
+static MSFilterDesc async_rec_feeder_desc={
+	.id=MS_FILTER_PLUGIN_ID,
+	.name="MSAsyncFileRecFeeder",
+	.text="Feeds the encoder of the asynchronous file recorder",
+	.category=MS_FILTER_OTHER,
+	.ninputs=0,
+	.noutputs=1,
+	.process=async_rec_feeder_process
+};
+
+#endif
+
+static void async_rec_init(MSFilter *f){
+	AsyncRecState *s=ms_new0(AsyncRecState,1);
+	ms_mutex_init(&s->lock,NULL);
+	ms_cond_init(&s->cond,NULL);
+	qinit(&s->q);
+	s->rate=8000;
+	s->nchannels=1;
+	s->max_queue=2000;
+	s->sync_interval=5000;
+	s->codec=ms_strdup("opus");
+	s->state=MSRecorderClosed;
+	f->data=s;
+}
+
+static void async_rec_process(MSFilter *f){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	mblk_t *m;
+
+	ms_mutex_lock(&f->lock);
+	if (s->state!=MSRecorderRunning){
+		ms_queue_flush(f->inputs[0]);
+	}else{
+		uint64_t max_bytes=(uint64_t)s->max_queue*s->rate*2*s->nchannels/1000;
+		ms_mutex_lock(&s->lock);
+		while((m=ms_queue_get(f->inputs[0]))!=NULL){
+			int len=msgdsize(m);
+			if (s->queued+len>max_bytes){
+				if (s->dropped_blocks==0)
+					ms_warning("MSAsyncFileRec: the encoder is late by more than %i ms, dropping audio",s->max_queue);
+				s->dropped+=len;
+				s->dropped_blocks++;
+				freemsg(m);
+			}else{
+				putq(&s->q,m);
+				s->queued+=len;
+				if (s->queued>s->max_queued) s->max_queued=s->queued;
+			}
+		}
+		ms_mutex_unlock(&s->lock);
+	}
+	ms_mutex_unlock(&f->lock);
+}
+
+static AsyncRecFormat async_rec_get_format(const char *filename){
+	const char *ext=strrchr(filename,'.');
+	if (ext==NULL) return AsyncRecUnknown;
+	if (strcasecmp(ext,".wav")==0) return AsyncRecWav;
+	if (strcasecmp(ext,".ogg")==0 || strcasecmp(ext,".opus")==0) return AsyncRecOggOpus;
+	if (strcasecmp(ext,".mkv")==0 || strcasecmp(ext,".mka")==0) return AsyncRecMatroska;
+	return AsyncRecUnknown;
+}
+
+static MSFilter *async_rec_create_encoder(MSFilter *f, const char *codec){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	MSFilter *encoder=ms_factory_create_encoder(f->factory,codec);
+	if (encoder==NULL){
+		ms_error("MSAsyncFileRec: no encoder for %s",codec);
+		return NULL;
+	}
+	ms_filter_call_method(encoder,MS_FILTER_SET_SAMPLE_RATE,&s->rate);
+	ms_filter_call_method(encoder,MS_FILTER_SET_NCHANNELS,&s->nchannels);
+	if (s->bitrate>0) ms_filter_call_method(encoder,MS_FILTER_SET_BITRATE,&s->bitrate);
+	return encoder;
+}
+
+static void async_rec_destroy_graph(AsyncRecState *s){
+	if (s->feeder){
+		if (s->encoder){
+			ms_filter_unlink(s->feeder,0,s->encoder,0);
+			ms_filter_unlink(s->encoder,0,s->writer,0);
+		}else if (s->writer){
+			ms_filter_unlink(s->feeder,0,s->writer,0);
+		}
+		ms_filter_destroy(s->feeder);
+		s->feeder=NULL;
+	}
+	if (s->encoder){
+		ms_filter_destroy(s->encoder);
+		s->encoder=NULL;
+	}
+	if (s->writer){
+		ms_filter_destroy(s->writer);
+		s->writer=NULL;
+	}
+}
+
+static int async_rec_create_graph(MSFilter *f, const char *filename){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	AsyncRecFormat format=async_rec_get_format(filename);
+	MSPinFormat pinfmt={0};
+	bool_t is_opus=strcasecmp(s->codec,"opus")==0;
+
+	switch(format){
+		case AsyncRecWav:
+			s->writer=ms_factory_create_filter(f->factory,MS_FILE_REC_ID);
+			break;
+		case AsyncRecOggOpus:
+			s->encoder=async_rec_create_encoder(f,"opus");
+			s->writer=ms_factory_create_filter_from_desc(f->factory,&ogg_opus_writer_desc);
+			break;
+		case AsyncRecMatroska:
+			if (!is_opus && (s->rate!=8000 || s->nchannels!=1)){
+				ms_error("MSAsyncFileRec: %s requires 8kHz mono audio",s->codec);
+				return -1;
+			}
+			s->encoder=async_rec_create_encoder(f,s->codec);
+			s->writer=ms_factory_create_filter(f->factory,MS_MKV_RECORDER_ID);
+			if (s->writer){
+				/*the timestamps of the opus encoder are always in 48kHz units*/
+				pinfmt.pin=0;
+				pinfmt.fmt=ms_factory_get_audio_format(f->factory,s->codec,is_opus ? 48000 : s->rate,s->nchannels,NULL);
+				ms_filter_call_method(s->writer,MS_FILTER_SET_INPUT_FMT,&pinfmt);
+			}
+			break;
+		case AsyncRecUnknown:
+			ms_error("MSAsyncFileRec: unsupported file extension for %s",filename);
+			return -1;
+	}
+	if (s->writer==NULL || (format!=AsyncRecWav && s->encoder==NULL)){
+		ms_error("MSAsyncFileRec: cannot record into %s",filename);
+		async_rec_destroy_graph(s);
+		return -1;
+	}
+	ms_filter_call_method(s->writer,MS_FILTER_SET_SAMPLE_RATE,&s->rate);
+	ms_filter_call_method(s->writer,MS_FILTER_SET_NCHANNELS,&s->nchannels);
+	if (ms_filter_call_method(s->writer,MS_RECORDER_OPEN,(void*)filename)!=0){
+		async_rec_destroy_graph(s);
+		return -1;
+	}
+	if (ms_filter_has_method(s->writer,MS_RECORDER_START)) ms_filter_call_method_noarg(s->writer,MS_RECORDER_START);
+
+	s->feeder=ms_factory_create_filter_from_desc(f->factory,&async_rec_feeder_desc);
+	s->feeder->data=s;
+	if (s->encoder){
+		ms_filter_link(s->feeder,0,s->encoder,0);
+		ms_filter_link(s->encoder,0,s->writer,0);
+	}else{
+		ms_filter_link(s->feeder,0,s->writer,0);
+	}
+	return 0;
+}
+
+static int async_rec_open(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	const char *filename=(const char*)arg;
+
+	if (s->state!=MSRecorderClosed) async_rec_close(f,NULL);
+	if (async_rec_create_graph(f,filename)!=0) return -1;
+
+	ms_mutex_lock(&s->lock);
+	s->queued=s->max_queued=s->dropped=s->recorded=0;
+	s->dropped_blocks=s->syncs=0;
+	s->last_sync=0;
+	ms_mutex_unlock(&s->lock);
+
+	s->ticker=writer_ticker_ref(f->factory);
+	ms_ticker_attach(s->ticker,s->feeder);
+	ms_message("MSAsyncFileRec: recording into %s",filename);
+	ms_mutex_lock(&f->lock);
+	s->state=MSRecorderPaused;
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int async_rec_start(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	if (s->state!=MSRecorderPaused){
+		ms_error("MSAsyncFileRec: cannot start, state=%i",s->state);
+		return -1;
+	}
+	ms_mutex_lock(&f->lock);
+	s->state=MSRecorderRunning;
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int async_rec_pause(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	ms_mutex_lock(&f->lock);
+	if (s->state==MSRecorderRunning) s->state=MSRecorderPaused;
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int async_rec_close(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+
+	ms_mutex_lock(&f->lock);
+	if (s->state==MSRecorderClosed){
+		ms_mutex_unlock(&f->lock);
+		return 0;
+	}
+	s->state=MSRecorderClosed;
+	ms_mutex_unlock(&f->lock);
+
+	/*let the feeder hand what is still queued to the encoder, the ticker finishes the tick before detaching*/
+	ms_mutex_lock(&s->lock);
+	while(s->queued>0) ms_cond_wait(&s->cond,&s->lock);
+	ms_mutex_unlock(&s->lock);
+	ms_ticker_detach(s->ticker,s->feeder);
+	writer_ticker_unref(s->ticker);
+	s->ticker=NULL;
+
+	ms_filter_call_method_noarg(s->writer,MS_RECORDER_CLOSE);
+	async_rec_destroy_graph(s);
+	ms_message("MSAsyncFileRec: closed, %i ms recorded, %i ms dropped, at most %i ms queued",
+		async_rec_bytes_to_ms(s,s->recorded),async_rec_bytes_to_ms(s,s->dropped),async_rec_bytes_to_ms(s,s->max_queued));
+	return 0;
+}
+
+static int async_rec_get_state(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	*(MSRecorderState*)arg=s->state;
+	return 0;
+}
+
+static int async_rec_get_stats(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	MSAsyncFileRecStats *stats=(MSAsyncFileRecStats*)arg;
+	ms_mutex_lock(&s->lock);
+	stats->queued=async_rec_bytes_to_ms(s,s->queued);
+	stats->max_queued=async_rec_bytes_to_ms(s,s->max_queued);
+	stats->dropped=async_rec_bytes_to_ms(s,s->dropped);
+	stats->dropped_blocks=s->dropped_blocks;
+	stats->recorded=async_rec_bytes_to_ms(s,s->recorded);
+	stats->syncs=s->syncs;
+	ms_mutex_unlock(&s->lock);
+	return 0;
+}
+
+static int async_rec_set_sr(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	ms_mutex_lock(&f->lock);
+	s->rate=*((int*)arg);
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int async_rec_set_nchannels(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	ms_mutex_lock(&f->lock);
+	s->nchannels=*((int*)arg);
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int async_rec_set_bitrate(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	s->bitrate=*((int*)arg);
+	return 0;
+}
+
+static int async_rec_set_codec(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	const char *codec=(const char*)arg;
+	if (strcasecmp(codec,"opus")!=0 && strcasecmp(codec,"pcmu")!=0){
+		ms_error("MSAsyncFileRec: %s cannot be recorded into Matroska files",codec);
+		return -1;
+	}
+	ms_free(s->codec);
+	s->codec=ms_strdup(codec);
+	return 0;
+}
+
+static int async_rec_set_max_queue(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	ms_mutex_lock(&f->lock);
+	s->max_queue=*((int*)arg);
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
+static int async_rec_set_sync_interval(MSFilter *f, void *arg){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	ms_mutex_lock(&s->lock);
+	s->sync_interval=*((int*)arg);
+	ms_mutex_unlock(&s->lock);
+	return 0;
+}
+
+static void async_rec_uninit(MSFilter *f){
+	AsyncRecState *s=(AsyncRecState*)f->data;
+	if (s->state!=MSRecorderClosed) async_rec_close(f,NULL);
+	flushq(&s->q,0);
+	ms_mutex_destroy(&s->lock);
+	ms_cond_destroy(&s->cond);
+	ms_free(s->codec);
+	ms_free(s);
+}
+
+static MSFilterMethod async_rec_methods[]={
+	{	MS_FILTER_SET_SAMPLE_RATE	,	async_rec_set_sr	},
+	{	MS_FILTER_SET_NCHANNELS	,	async_rec_set_nchannels	},
+	{	MS_FILTER_SET_BITRATE	,	async_rec_set_bitrate	},
+	{	MS_ASYNC_FILE_REC_SET_CODEC	,	async_rec_set_codec	},
+	{	MS_ASYNC_FILE_REC_SET_MAX_QUEUE	,	async_rec_set_max_queue	},
+	{	MS_ASYNC_FILE_REC_SET_SYNC_INTERVAL	,	async_rec_set_sync_interval	},
+	{	MS_ASYNC_FILE_REC_GET_STATS	,	async_rec_get_stats	},
+	{	MS_RECORDER_OPEN	,	async_rec_open	},
+	{	MS_RECORDER_START	,	async_rec_start	},
+	{	MS_RECORDER_PAUSE	,	async_rec_pause	},
+	{	MS_RECORDER_CLOSE	,	async_rec_close	},
+	{	MS_RECORDER_GET_STATE	,	async_rec_get_state	},
+	{	0	,	NULL	}
+};
+
+#ifdef _WIN32
+
+MSFilterDesc ms_async_file_rec_desc={
+	MS_ASYNC_FILE_REC_ID,
+	"MSAsyncFileRec",
+	N_("Audio file recorder encoding to wav, Ogg Opus or Matroska on its own thread"),
+	MS_FILTER_OTHER,
+	NULL,
+	1,
+	0,
+	async_rec_init,
+	NULL,
+	async_rec_process,
+	NULL,
+	async_rec_uninit,
+	async_rec_methods
+};
+
+#else
+
+MSFilterDesc ms_async_file_rec_desc={
+	.id=MS_ASYNC_FILE_REC_ID,
+	.name="MSAsyncFileRec",
+	.text=N_("Audio file recorder encoding to wav, Ogg Opus or Matroska on its own thread"),
+	.category=MS_FILTER_OTHER,
+	.ninputs=1,
+	.noutputs=0,
+	.init=async_rec_init,
+	.process=async_rec_process,
+	.uninit=async_rec_uninit,
+	.methods=async_rec_methods
+};
+
+#endif
+
+MS_FILTER_DESC_EXPORT(ms_async_file_rec_desc)
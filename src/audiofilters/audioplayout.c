@@ -0,0 +1,269 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msaudioplayout.h"
+#include "mediastreamer2/msticker.h"
+#include "audio_playout.h"
+
+#include <math.h>
+
+#define MAX_BUFFERED 300 /*ms, the oldest audio is dropped beyond*/
+#define MAX_EXPANSION 100 /*ms synthesized after the last real audio, before outputting nothing*/
+#define FADE_START 20 /*ms of expansion after which the repeated periods fade out*/
+#define FADE_HALF_LIFE 20 /*ms*/
+#define MIN_SIMILARITY 0.5f /*correlation under which a period is not removed*/
+
+typedef struct _AudioPlayout {
+	int16_t *buf; /*the audio already output, kept for the period searches, followed by the pending audio*/
+	int capacity; /*in samples per channel, as the fields below*/
+	int max_history;
+	int history;
+	int pending;
+	int chunk; /*largest block received*/
+	int expanded; /*synthesized since the last real audio*/
+	int period; /*repeated by the expansion*/
+	float gain; /*applied to each repetition of the period, once the expansion fades out*/
+	int rate;
+	int nchannels;
+	uint64_t accelerated;
+	uint64_t expanded_total;
+	uint64_t concealment_dropped;
+	uint64_t overflow_dropped;
+} AudioPlayout;
+
+static void audio_playout_init(MSFilter *f) {
+	AudioPlayout *s = ms_new0(AudioPlayout, 1);
+	s->rate = 8000;
+	s->nchannels = 1;
+	f->data = s;
+}
+
+static void audio_playout_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+static void audio_playout_preprocess(MSFilter *f) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	s->max_history = 2 * ms_audio_get_max_period(s->rate);
+	s->capacity = s->max_history + s->rate * (MAX_BUFFERED + 2 * f->ticker->interval) / 1000;
+	s->buf = ms_new0(int16_t, s->capacity * s->nchannels);
+	s->history = s->max_history; /*start with silence*/
+	s->pending = 0;
+	s->chunk = 0;
+	s->expanded = 0;
+}
+
+static void audio_playout_postprocess(MSFilter *f) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	ms_free(s->buf);
+	s->buf = NULL;
+}
+
+/* Forget the audio output before the last max_history samples. */
+static void compact(AudioPlayout *s) {
+	if (s->history <= s->max_history) return;
+	memmove(s->buf, s->buf + (s->history - s->max_history) * s->nchannels,
+		(s->max_history + s->pending) * s->nchannels * sizeof(int16_t));
+	s->history = s->max_history;
+}
+
+static void append(AudioPlayout *s, const uint8_t *data, int frames) {
+	int room = s->rate * MAX_BUFFERED / 1000;
+	int excess;
+	int16_t *p;
+
+	compact(s);
+	if (frames > room) {
+		s->overflow_dropped += frames - room;
+		data += (frames - room) * s->nchannels * sizeof(int16_t);
+		frames = room;
+	}
+	excess = s->pending + frames - room;
+	if (excess > 0) {
+		/*the oldest pending audio is dropped as if it were output*/
+		s->overflow_dropped += excess;
+		s->history += excess;
+		s->pending -= excess;
+		compact(s);
+	}
+	p = s->buf + (s->history + s->pending) * s->nchannels;
+	memcpy(p, data, frames * s->nchannels * sizeof(int16_t));
+	if (s->expanded > 0) {
+		/*blend the resuming audio with the continuation of the repeated period*/
+		int fade = MIN(s->period, frames);
+		ms_audio_crossfade(p, p - s->period * s->nchannels, p, fade, s->nchannels);
+		s->expanded = 0;
+	}
+	s->pending += frames;
+}
+
+/* Synthesize missing audio by repeating the last pitch period. */
+static void expand(AudioPlayout *s, int frames) {
+	int max_expansion = s->rate * MAX_EXPANSION / 1000;
+	int fade_start = s->rate * FADE_START / 1000;
+	int16_t *p;
+	int i, c;
+
+	if (s->chunk == 0 || s->expanded >= max_expansion) return;
+	if (s->expanded == 0) {
+		float similarity;
+		compact(s);
+		s->period = ms_audio_find_period(s->buf, s->history + s->pending, s->nchannels, s->rate, TRUE, &similarity);
+		if (s->period == 0) return;
+		s->gain = powf(0.5f, (float)s->period / (float)(s->rate * FADE_HALF_LIFE / 1000));
+	}
+	frames = MIN(frames, max_expansion - s->expanded);
+	p = s->buf + (s->history + s->pending) * s->nchannels;
+	for (i = 0; i < frames; i++, s->expanded++) {
+		float gain = s->expanded >= fade_start ? s->gain : 1.0f;
+		for (c = 0; c < s->nchannels; c++) {
+			int k = i * s->nchannels + c;
+			p[k] = (int16_t)(p[k - s->period * s->nchannels] * gain);
+		}
+	}
+	s->pending += frames;
+	s->expanded_total += frames;
+}
+
+static void audio_playout_process(MSFilter *f) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	int frame_size = s->nchannels * sizeof(int16_t);
+	int needed = s->rate * f->ticker->interval / 1000;
+	int count;
+	mblk_t *m;
+
+	while ((m = ms_queue_get(f->inputs[0])) != NULL) {
+		int frames = (int)(m->b_wptr - m->b_rptr) / frame_size;
+		if (mblk_get_plc_flag(m) && s->pending >= needed) {
+			/*there is real audio to output: the concealment would only add delay*/
+			s->concealment_dropped += frames;
+		} else if (frames > 0) {
+			if (frames > s->chunk) s->chunk = frames;
+			append(s, m->b_rptr, frames);
+		}
+		freemsg(m);
+	}
+	/*more audio pending than a block of the source: remove a period, at most one per tick*/
+	if (s->pending > s->chunk) {
+		int removed = ms_audio_accelerate(s->buf + s->history * s->nchannels, s->pending, s->nchannels, s->rate,
+			MIN_SIMILARITY, s->pending - s->chunk);
+		s->pending -= removed;
+		s->accelerated += removed;
+	}
+	if (s->pending < needed) expand(s, needed - s->pending);
+	count = MIN(s->pending, needed);
+	if (count > 0) {
+		m = allocb(count * frame_size, 0);
+		memcpy(m->b_wptr, s->buf + s->history * s->nchannels, count * frame_size);
+		m->b_wptr += count * frame_size;
+		ms_queue_put(f->outputs[0], m);
+		s->history += count;
+		s->pending -= count;
+		compact(s);
+	}
+}
+
+static int audio_playout_set_sr(MSFilter *f, void *arg) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	s->rate = *(int *)arg;
+	return 0;
+}
+
+static int audio_playout_get_sr(MSFilter *f, void *arg) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	*(int *)arg = s->rate;
+	return 0;
+}
+
+static int audio_playout_set_nchannels(MSFilter *f, void *arg) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	s->nchannels = *(int *)arg;
+	return 0;
+}
+
+static int audio_playout_get_nchannels(MSFilter *f, void *arg) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	*(int *)arg = s->nchannels;
+	return 0;
+}
+
+static int audio_playout_get_stats(MSFilter *f, void *arg) {
+	AudioPlayout *s = (AudioPlayout *)f->data;
+	MSAudioPlayoutStats *stats = (MSAudioPlayoutStats *)arg;
+	stats->buffered = (int)((uint64_t)s->pending * 1000 / s->rate);
+	stats->accelerated = (int)(s->accelerated * 1000 / s->rate);
+	stats->expanded = (int)(s->expanded_total * 1000 / s->rate);
+	stats->concealment_dropped = (int)(s->concealment_dropped * 1000 / s->rate);
+	stats->overflow_dropped = (int)(s->overflow_dropped * 1000 / s->rate);
+	return 0;
+}
+
+static MSFilterMethod audio_playout_methods[] = {
+	{	MS_FILTER_SET_SAMPLE_RATE	,	audio_playout_set_sr		},
+	{	MS_FILTER_GET_SAMPLE_RATE	,	audio_playout_get_sr		},
+	{	MS_FILTER_SET_NCHANNELS		,	audio_playout_set_nchannels	},
+	{	MS_FILTER_GET_NCHANNELS		,	audio_playout_get_nchannels	},
+	{	MS_AUDIO_PLAYOUT_GET_STATS	,	audio_playout_get_stats		},
+	{	0				,	NULL				}
+};
+
+#ifdef _MSC_VER
+
+MSFilterDesc ms_audio_playout_desc = {
+	MS_AUDIO_PLAYOUT_ID,
+	"MSAudioPlayout",
+	N_("Paces decoded audio, stretching it to follow the playout delay."),
+	MS_FILTER_OTHER,
+	NULL,
+	1,
+	1,
+	audio_playout_init,
+	audio_playout_preprocess,
+	audio_playout_process,
+	audio_playout_postprocess,
+	audio_playout_uninit,
+	audio_playout_methods,
+	MS_FILTER_IS_PUMP
+};
+
+#else
+
+MSFilterDesc ms_audio_playout_desc = {
+	.id = MS_AUDIO_PLAYOUT_ID,
+	.name = "MSAudioPlayout",
+	.text = N_("Paces decoded audio, stretching it to follow the playout delay."),
+	.category = MS_FILTER_OTHER,
+	.ninputs = 1,
+	.noutputs = 1,
+	.init = audio_playout_init,
+	.preprocess = audio_playout_preprocess,
+	.process = audio_playout_process,
+	.postprocess = audio_playout_postprocess,
+	.uninit = audio_playout_uninit,
+	.flags = MS_FILTER_IS_PUMP,
+	.methods = audio_playout_methods
+};
+
+#endif
+
+MS_FILTER_DESC_EXPORT(ms_audio_playout_desc)
@@ -20,19 +20,187 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/mschanadapter.h"
 
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /*
- This filter transforms stereo buffers to mono and vice versa.
+ This filter converts between any numbers of channels with a mapping matrix.
+ Blocks are deinterleaved by chunks into planes, the output planes are mixed from the input planes with fixed
+ point coefficients, then interleaved again. A block is converted in place when the number of channels
+ doesn't grow.
 */
 
+#define MAX_CHANNELS MS_CHANNEL_ADAPTER_MAX_CHANNELS
+#define CHUNK_FRAMES 128 /*must be a multiple of 8*/
+#define COEF_SHIFT 14
+#define COEF_ONE (1<<COEF_SHIFT)
+
+enum ChannelRole{
+	ROLE_L,
+	ROLE_R,
+	ROLE_C,
+	ROLE_LFE,
+	ROLE_SL,
+	ROLE_SR,
+	ROLE_RL,
+	ROLE_RR,
+	ROLE_RC,
+	ROLE_COUNT
+};
+
+static const int channel_roles[MAX_CHANNELS][MAX_CHANNELS]={
+	{ROLE_C},
+	{ROLE_L,ROLE_R},
+	{ROLE_L,ROLE_C,ROLE_R},
+	{ROLE_L,ROLE_R,ROLE_RL,ROLE_RR},
+	{ROLE_L,ROLE_C,ROLE_R,ROLE_RL,ROLE_RR},
+	{ROLE_L,ROLE_C,ROLE_R,ROLE_RL,ROLE_RR,ROLE_LFE},
+	{ROLE_L,ROLE_C,ROLE_R,ROLE_SL,ROLE_SR,ROLE_RC,ROLE_LFE},
+	{ROLE_L,ROLE_C,ROLE_R,ROLE_SL,ROLE_SR,ROLE_RL,ROLE_RR,ROLE_LFE}
+};
+
 typedef struct AdapterState{
 	int inputchans;
 	int outputchans;
+	MSChannelAdapterMatrix matrix;
+	int16_t coefs[MAX_CHANNELS][MAX_CHANNELS];
+	int16_t planes[MAX_CHANNELS][CHUNK_FRAMES];
+	int16_t mixed[MAX_CHANNELS][CHUNK_FRAMES];
+	int16_t zeroes[CHUNK_FRAMES];
+	bool_t passthrough;
 }AdapterState;
 
+static int find_role(int nchannels, int role){
+	int i;
+	for(i=0;i<nchannels;++i){
+		if (channel_roles[nchannels-1][i]==role) return i;
+	}
+	return -1;
+}
+
+/*spreads an input role missing from the output on its nearest neighbours*/
+static void fold_role(MSChannelAdapterMatrix *m, int outputchans, int input, int role, float gain){
+	int out=find_role(outputchans,role);
+	int a=-1,b=-1;
+	float ga=0,gb=0;
+
+	if (out!=-1){
+		m->coefs[out][input]+=gain;
+		return;
+	}
+	switch(role){
+		case ROLE_L:
+		case ROLE_R:
+			fold_role(m,outputchans,input,ROLE_C,gain);
+			return;
+		case ROLE_C:
+			fold_role(m,outputchans,input,ROLE_L,gain*0.7071f);
+			fold_role(m,outputchans,input,ROLE_R,gain*0.7071f);
+			return;
+		case ROLE_SL:
+		case ROLE_RL:
+			if ((a=find_role(outputchans,role==ROLE_SL ? ROLE_RL : ROLE_SL))!=-1) m->coefs[a][input]+=gain;
+			else fold_role(m,outputchans,input,ROLE_L,gain*0.7071f);
+			return;
+		case ROLE_SR:
+		case ROLE_RR:
+			if ((a=find_role(outputchans,role==ROLE_SR ? ROLE_RR : ROLE_SR))!=-1) m->coefs[a][input]+=gain;
+			else fold_role(m,outputchans,input,ROLE_R,gain*0.7071f);
+			return;
+		case ROLE_RC:
+			if ((a=find_role(outputchans,ROLE_RL))!=-1 && (b=find_role(outputchans,ROLE_RR))!=-1){
+				ga=gb=0.7071f;
+			}else if ((a=find_role(outputchans,ROLE_SL))!=-1 && (b=find_role(outputchans,ROLE_SR))!=-1){
+				ga=gb=0.7071f;
+			}else{
+				fold_role(m,outputchans,input,ROLE_L,gain*0.5f);
+				fold_role(m,outputchans,input,ROLE_R,gain*0.5f);
+				return;
+			}
+			m->coefs[a][input]+=gain*ga;
+			m->coefs[b][input]+=gain*gb;
+			return;
+		default:
+			/*the LFE is not reproduced by the other channels*/
+			return;
+	}
+}
+
+static void make_default_matrix(MSChannelAdapterMatrix *m, int inputchans, int outputchans){
+	int i,o;
+
+	memset(m,0,sizeof(*m));
+	if (inputchans==1){
+		int c=find_role(outputchans,ROLE_C);
+		if (c!=-1) m->coefs[c][0]=1;
+		else{
+			m->coefs[find_role(outputchans,ROLE_L)][0]=1;
+			m->coefs[find_role(outputchans,ROLE_R)][0]=1;
+		}
+		return;
+	}
+	for(i=0;i<inputchans;++i){
+		fold_role(m,outputchans,i,channel_roles[inputchans-1][i],1);
+	}
+	for(o=0;o<outputchans;++o){
+		float sum=0;
+		for(i=0;i<inputchans;++i) sum+=m->coefs[o][i];
+		if (sum>1){
+			for(i=0;i<inputchans;++i) m->coefs[o][i]/=sum;
+		}
+	}
+}
+
+static int apply_matrix(AdapterState *s, const MSChannelAdapterMatrix *m){
+	int i,o;
+
+	/*the coefficients are stored on 16 bits, and the mix is accumulated on 32 bits*/
+	for(o=0;o<s->outputchans;++o){
+		float sum=0;
+		for(i=0;i<s->inputchans;++i){
+			float coef=floorf(m->coefs[o][i]*COEF_ONE+0.5f);
+			if (coef<-32767 || coef>32767){
+				ms_error("MSChannelAdapter: coefficient [%i][%i]=%f is out of ]-2,2[",o,i,m->coefs[o][i]);
+				return -1;
+			}
+			sum+=fabsf(m->coefs[o][i]);
+		}
+		if (sum*COEF_ONE>=4*COEF_ONE-0.5f){
+			ms_error("MSChannelAdapter: coefficients of output channel %i are too large",o);
+			return -1;
+		}
+	}
+	s->matrix=*m;
+	s->passthrough=(s->inputchans==s->outputchans);
+	for(o=0;o<MAX_CHANNELS;++o){
+		for(i=0;i<MAX_CHANNELS;++i){
+			int coef=0;
+			if (o<s->outputchans && i<s->inputchans){
+				coef=(int)floorf(m->coefs[o][i]*COEF_ONE+0.5f);
+			}
+			s->coefs[o][i]=(int16_t)coef;
+			if (coef!=((o==i && o<s->outputchans) ? COEF_ONE : 0)) s->passthrough=FALSE;
+		}
+	}
+	return 0;
+}
+
+static void reset_matrix(AdapterState *s){
+	MSChannelAdapterMatrix m;
+	make_default_matrix(&m,s->inputchans,s->outputchans);
+	apply_matrix(s,&m);
+}
+
 static void adapter_init(MSFilter *f){
 	AdapterState *s=ms_new0(AdapterState,1);
 	s->inputchans=1;
 	s->outputchans=1;
+	reset_matrix(s);
 	f->data=s;
 }
 
@@ -40,38 +208,254 @@ static void adapter_uninit(MSFilter *f){
 	ms_free(f->data);
 }
 
+static void deinterleave(const int16_t *src, int nchannels, int16_t planes[][CHUNK_FRAMES], int nframes){
+	int n=0,c;
+#if defined(__SSE2__)
+	if (nchannels==2){
+		for(;n+8<=nframes;n+=8){
+			__m128i a=_mm_loadu_si128((const __m128i*)(src+2*n));
+			__m128i b=_mm_loadu_si128((const __m128i*)(src+2*n+8));
+			__m128i l=_mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a,16),16),_mm_srai_epi32(_mm_slli_epi32(b,16),16));
+			__m128i r=_mm_packs_epi32(_mm_srai_epi32(a,16),_mm_srai_epi32(b,16));
+			_mm_storeu_si128((__m128i*)(planes[0]+n),l);
+			_mm_storeu_si128((__m128i*)(planes[1]+n),r);
+		}
+	}else if (nchannels==4){
+		for(;n+8<=nframes;n+=8){
+			/*first split the frames into front and rear pairs, then each pair into its two channels*/
+			__m128i a=_mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src+4*n)),_MM_SHUFFLE(3,1,2,0));
+			__m128i b=_mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src+4*n+8)),_MM_SHUFFLE(3,1,2,0));
+			__m128i c=_mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src+4*n+16)),_MM_SHUFFLE(3,1,2,0));
+			__m128i d=_mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src+4*n+24)),_MM_SHUFFLE(3,1,2,0));
+			__m128i front0=_mm_unpacklo_epi64(a,b),front1=_mm_unpacklo_epi64(c,d);
+			__m128i rear0=_mm_unpackhi_epi64(a,b),rear1=_mm_unpackhi_epi64(c,d);
+			_mm_storeu_si128((__m128i*)(planes[0]+n),_mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(front0,16),16),_mm_srai_epi32(_mm_slli_epi32(front1,16),16)));
+			_mm_storeu_si128((__m128i*)(planes[1]+n),_mm_packs_epi32(_mm_srai_epi32(front0,16),_mm_srai_epi32(front1,16)));
+			_mm_storeu_si128((__m128i*)(planes[2]+n),_mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(rear0,16),16),_mm_srai_epi32(_mm_slli_epi32(rear1,16),16)));
+			_mm_storeu_si128((__m128i*)(planes[3]+n),_mm_packs_epi32(_mm_srai_epi32(rear0,16),_mm_srai_epi32(rear1,16)));
+		}
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	if (nchannels==2){
+		for(;n+8<=nframes;n+=8){
+			int16x8x2_t v=vld2q_s16(src+2*n);
+			vst1q_s16(planes[0]+n,v.val[0]);
+			vst1q_s16(planes[1]+n,v.val[1]);
+		}
+	}else if (nchannels==3){
+		for(;n+8<=nframes;n+=8){
+			int16x8x3_t v=vld3q_s16(src+3*n);
+			vst1q_s16(planes[0]+n,v.val[0]);
+			vst1q_s16(planes[1]+n,v.val[1]);
+			vst1q_s16(planes[2]+n,v.val[2]);
+		}
+	}else if (nchannels==4){
+		for(;n+8<=nframes;n+=8){
+			int16x8x4_t v=vld4q_s16(src+4*n);
+			vst1q_s16(planes[0]+n,v.val[0]);
+			vst1q_s16(planes[1]+n,v.val[1]);
+			vst1q_s16(planes[2]+n,v.val[2]);
+			vst1q_s16(planes[3]+n,v.val[3]);
+		}
+	}
+#endif
+	for(;n<nframes;++n){
+		for(c=0;c<nchannels;++c) planes[c][n]=src[n*nchannels+c];
+	}
+}
+
+static void interleave(int16_t *dst, int nchannels, const int16_t * const *planes, int nframes){
+	int n=0,c;
+
+	if (nchannels==1){
+		memmove(dst,planes[0],nframes*2);
+		return;
+	}
+#if defined(__SSE2__)
+	if (nchannels==2){
+		for(;n+8<=nframes;n+=8){
+			__m128i l=_mm_loadu_si128((const __m128i*)(planes[0]+n));
+			__m128i r=_mm_loadu_si128((const __m128i*)(planes[1]+n));
+			_mm_storeu_si128((__m128i*)(dst+2*n),_mm_unpacklo_epi16(l,r));
+			_mm_storeu_si128((__m128i*)(dst+2*n+8),_mm_unpackhi_epi16(l,r));
+		}
+	}else if (nchannels==4){
+		for(;n+8<=nframes;n+=8){
+			__m128i c0=_mm_loadu_si128((const __m128i*)(planes[0]+n));
+			__m128i c1=_mm_loadu_si128((const __m128i*)(planes[1]+n));
+			__m128i c2=_mm_loadu_si128((const __m128i*)(planes[2]+n));
+			__m128i c3=_mm_loadu_si128((const __m128i*)(planes[3]+n));
+			__m128i front0=_mm_unpacklo_epi16(c0,c1),front1=_mm_unpackhi_epi16(c0,c1);
+			__m128i rear0=_mm_unpacklo_epi16(c2,c3),rear1=_mm_unpackhi_epi16(c2,c3);
+			_mm_storeu_si128((__m128i*)(dst+4*n),_mm_unpacklo_epi32(front0,rear0));
+			_mm_storeu_si128((__m128i*)(dst+4*n+8),_mm_unpackhi_epi32(front0,rear0));
+			_mm_storeu_si128((__m128i*)(dst+4*n+16),_mm_unpacklo_epi32(front1,rear1));
+			_mm_storeu_si128((__m128i*)(dst+4*n+24),_mm_unpackhi_epi32(front1,rear1));
+		}
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	if (nchannels==2){
+		for(;n+8<=nframes;n+=8){
+			int16x8x2_t v;
+			v.val[0]=vld1q_s16(planes[0]+n);
+			v.val[1]=vld1q_s16(planes[1]+n);
+			vst2q_s16(dst+2*n,v);
+		}
+	}else if (nchannels==3){
+		for(;n+8<=nframes;n+=8){
+			int16x8x3_t v;
+			v.val[0]=vld1q_s16(planes[0]+n);
+			v.val[1]=vld1q_s16(planes[1]+n);
+			v.val[2]=vld1q_s16(planes[2]+n);
+			vst3q_s16(dst+3*n,v);
+		}
+	}else if (nchannels==4){
+		for(;n+8<=nframes;n+=8){
+			int16x8x4_t v;
+			v.val[0]=vld1q_s16(planes[0]+n);
+			v.val[1]=vld1q_s16(planes[1]+n);
+			v.val[2]=vld1q_s16(planes[2]+n);
+			v.val[3]=vld1q_s16(planes[3]+n);
+			vst4q_s16(dst+4*n,v);
+		}
+	}
+#endif
+	for(;n<nframes;++n){
+		for(c=0;c<nchannels;++c) dst[n*nchannels+c]=planes[c][n];
+	}
+}
+
+/*mixes one output plane from the input planes, with rounding and saturation*/
+static void mix_plane(const int16_t *coefs, int nchannels, const int16_t * const *planes, int16_t *out, int nframes){
+	int n=0,c;
+#if defined(__SSE2__)
+	for(;n+8<=nframes;n+=8){
+		__m128i acclo=_mm_set1_epi32(1<<(COEF_SHIFT-1));
+		__m128i acchi=acclo;
+		for(c=0;c<nchannels;++c){
+			__m128i x,coef,lo,hi;
+			if (coefs[c]==0) continue;
+			x=_mm_loadu_si128((const __m128i*)(planes[c]+n));
+			coef=_mm_set1_epi16(coefs[c]);
+			lo=_mm_mullo_epi16(x,coef);
+			hi=_mm_mulhi_epi16(x,coef);
+			acclo=_mm_add_epi32(acclo,_mm_unpacklo_epi16(lo,hi));
+			acchi=_mm_add_epi32(acchi,_mm_unpackhi_epi16(lo,hi));
+		}
+		_mm_storeu_si128((__m128i*)(out+n),_mm_packs_epi32(_mm_srai_epi32(acclo,COEF_SHIFT),_mm_srai_epi32(acchi,COEF_SHIFT)));
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	for(;n+8<=nframes;n+=8){
+		int32x4_t acclo=vdupq_n_s32(0);
+		int32x4_t acchi=vdupq_n_s32(0);
+		for(c=0;c<nchannels;++c){
+			int16x8_t x;
+			if (coefs[c]==0) continue;
+			x=vld1q_s16(planes[c]+n);
+			acclo=vmlal_n_s16(acclo,vget_low_s16(x),coefs[c]);
+			acchi=vmlal_n_s16(acchi,vget_high_s16(x),coefs[c]);
+		}
+		vst1q_s16(out+n,vcombine_s16(vqrshrn_n_s32(acclo,COEF_SHIFT),vqrshrn_n_s32(acchi,COEF_SHIFT)));
+	}
+#endif
+	for(;n<nframes;++n){
+		int acc=1<<(COEF_SHIFT-1);
+		for(c=0;c<nchannels;++c) acc+=coefs[c]*planes[c][n];
+		acc>>=COEF_SHIFT;
+		out[n]=(int16_t)MIN(MAX(acc,-32768),32767);
+	}
+}
+
+/*returns the plane holding output channel o for the current chunk, mixing it if needed*/
+static const int16_t *get_output_plane(AdapterState *s, const int16_t * const *inplanes, int o, int nframes){
+	const int16_t *coefs=s->coefs[o];
+	int i,nonzero=0,last=0;
+
+	for(i=0;i<s->inputchans;++i){
+		if (coefs[i]!=0){
+			nonzero++;
+			last=i;
+		}
+	}
+	if (nonzero==0) return s->zeroes;
+	if (nonzero==1 && coefs[last]==COEF_ONE) return inplanes[last];
+	mix_plane(coefs,s->inputchans,inplanes,s->mixed[o],nframes);
+	return s->mixed[o];
+}
+
+static mblk_t *adapter_convert(AdapterState *s, mblk_t *im){
+	int inframesize=2*s->inputchans;
+	int outframesize=2*s->outputchans;
+	int nframes,done;
+	mblk_t *om;
+
+	if (im->b_cont!=NULL) msgpullup(im,-1);
+	nframes=(int)(im->b_wptr-im->b_rptr)/inframesize;
+	if (s->outputchans<=s->inputchans && im->b_datap->db_ref==1){
+		om=im;
+	}else{
+		om=allocb(nframes*outframesize,0);
+		mblk_meta_copy(im,om);
+	}
+	for(done=0;done<nframes;done+=CHUNK_FRAMES){
+		const int16_t *src=(const int16_t*)(im->b_rptr+done*inframesize);
+		const int16_t *inplanes[MAX_CHANNELS];
+		const int16_t *outplanes[MAX_CHANNELS];
+		int n=MIN(CHUNK_FRAMES,nframes-done);
+		int c;
+
+		if (s->inputchans==1){
+			inplanes[0]=src;
+		}else{
+			deinterleave(src,s->inputchans,s->planes,n);
+			for(c=0;c<s->inputchans;++c) inplanes[c]=s->planes[c];
+		}
+		for(c=0;c<s->outputchans;++c){
+			outplanes[c]=get_output_plane(s,inplanes,c,n);
+		}
+		/*in place, the output of a chunk never goes beyond its input, which is already deinterleaved*/
+		interleave((int16_t*)(om->b_rptr+done*outframesize),s->outputchans,outplanes,n);
+	}
+	if (om==im){
+		om->b_wptr=om->b_rptr+nframes*outframesize;
+	}else{
+		om->b_wptr+=nframes*outframesize;
+		freemsg(im);
+	}
+	return om;
+}
+
 static void adapter_process(MSFilter *f){
 	AdapterState *s=(AdapterState*)f->data;
-	mblk_t *im,*om;
-	int msgsize;
-	
+	mblk_t *im;
+
+	ms_filter_lock(f);
 	while((im=ms_queue_get(f->inputs[0]))!=NULL){
-		if (s->inputchans==s->outputchans){
+		if (s->passthrough){
 			ms_queue_put(f->outputs[0],im);
-		}else if (s->inputchans==2){
-			msgsize=msgdsize(im)/2;
-			om=allocb(msgsize,0);
-			for (;im->b_rptr<im->b_wptr;im->b_rptr+=4,om->b_wptr+=2){
-				*(int16_t*)om->b_wptr=*(int16_t*)im->b_rptr;
-			}
-			ms_queue_put(f->outputs[0],om);
-			freemsg(im);
-		}else if (s->outputchans==2){
-			msgsize=msgdsize(im)*2;
-			om=allocb(msgsize,0);
-			for (;im->b_rptr<im->b_wptr;im->b_rptr+=2,om->b_wptr+=4){
-				((int16_t*)om->b_wptr)[0]=*(int16_t*)im->b_rptr;
-				((int16_t*)om->b_wptr)[1]=*(int16_t*)im->b_rptr;
-			}
-			ms_queue_put(f->outputs[0],om);
-			freemsg(im);
+		}else{
+			ms_queue_put(f->outputs[0],adapter_convert(s,im));
 		}
 	}
+	ms_filter_unlock(f);
+}
+
+static int check_nchannels(int nchannels){
+	if (nchannels<1 || nchannels>MAX_CHANNELS){
+		ms_error("MSChannelAdapter: unsupported number of channels %i",nchannels);
+		return -1;
+	}
+	return 0;
 }
 
 static int adapter_set_nchannels(MSFilter *f, void *data){
 	AdapterState *s=(AdapterState*)f->data;
-	s->inputchans=*(int*)data;
+	int nchannels=*(int*)data;
+	if (check_nchannels(nchannels)!=0) return -1;
+	ms_filter_lock(f);
+	s->inputchans=nchannels;
+	reset_matrix(s);
+	ms_filter_unlock(f);
 	return 0;
 }
 
@@ -83,7 +467,12 @@ static int adapter_get_nchannels(MSFilter *f, void *data){
 
 static int adapter_set_out_nchannels(MSFilter *f, void *data){
 	AdapterState *s=(AdapterState*)f->data;
-	s->outputchans=*(int*)data;
+	int nchannels=*(int*)data;
+	if (check_nchannels(nchannels)!=0) return -1;
+	ms_filter_lock(f);
+	s->outputchans=nchannels;
+	reset_matrix(s);
+	ms_filter_unlock(f);
 	return 0;
 }
 
@@ -93,11 +482,30 @@ static int adapter_get_out_nchannels(MSFilter *f, void *data){
 	return 0;
 }
 
+static int adapter_set_matrix(MSFilter *f, void *data){
+	AdapterState *s=(AdapterState*)f->data;
+	int err;
+	ms_filter_lock(f);
+	err=apply_matrix(s,(const MSChannelAdapterMatrix*)data);
+	ms_filter_unlock(f);
+	return err;
+}
+
+static int adapter_get_matrix(MSFilter *f, void *data){
+	AdapterState *s=(AdapterState*)f->data;
+	ms_filter_lock(f);
+	*(MSChannelAdapterMatrix*)data=s->matrix;
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static MSFilterMethod methods[]={
 	{	MS_FILTER_SET_NCHANNELS , adapter_set_nchannels },
 	{	MS_FILTER_GET_NCHANNELS, adapter_get_nchannels },
 	{	MS_CHANNEL_ADAPTER_SET_OUTPUT_NCHANNELS, adapter_set_out_nchannels },
 	{  MS_CHANNEL_ADAPTER_GET_OUTPUT_NCHANNELS, adapter_get_out_nchannels },
+	{	MS_CHANNEL_ADAPTER_SET_MATRIX, adapter_set_matrix },
+	{	MS_CHANNEL_ADAPTER_GET_MATRIX, adapter_get_matrix },
 	{ 0,	NULL }
 };
 
@@ -107,7 +515,7 @@ static MSFilterMethod methods[]={
 MSFilterDesc ms_channel_adapter_desc={
 	MS_CHANNEL_ADAPTER_ID,
 	"MSChannelAdapter",
-	N_("A filter that converts from mono to stereo and vice versa."),
+	N_("A filter that maps between any numbers of channels."),
 	MS_FILTER_OTHER,
 	NULL,
 	1,
@@ -125,7 +533,7 @@ MSFilterDesc ms_channel_adapter_desc={
 MSFilterDesc ms_channel_adapter_desc={
 	.id=MS_CHANNEL_ADAPTER_ID,
 	.name="MSChannelAdapter",
-	.text=N_("A filter that converts from mono to stereo and vice versa."),
+	.text=N_("A filter that maps between any numbers of channels."),
 	.category=MS_FILTER_OTHER,
 	.ninputs=1,
 	.noutputs=1,
@@ -19,14 +19,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "mediastreamer2/dtmfgen.h"
 #include "mediastreamer2/msticker.h"
+#include "tone_cache.h"
 
 
-#include <math.h>
-
-#ifndef M_PI
-#define M_PI       3.14159265358979323846
-#endif
-
 
 #define NO_SAMPLES_THRESHOLD 100 /*ms*/
 
@@ -42,8 +37,14 @@ struct DtmfGenState{
 	int nchannels;
 	int dur;
 	int pos;
-	float highfreq;
-	float lowfreq;
+	int highfreq; /*Hz*/
+	int lowfreq; /*Hz*/
+	MSToneOscillator lowosc;
+	MSToneOscillator highosc;
+	int osc_pos; /*the next sample of the oscillators*/
+	MSToneCache *cache;
+	mblk_t *tone; /*the cached samples of the current tone, if any*/
+	int tone_nchannels;
 	int nosamples_time;
 	int silence;
 	int amplitude;
@@ -66,11 +67,28 @@ static void dtmfgen_init(MSFilter *f){
 	s->default_amplitude=0.2;
 	s->amplitude=(s->default_amplitude*0.7*32767);
 	s->repeat_count=0;
+	s->cache=ms_tone_cache_ref();
 	f->data=s;
 }
 
 static void dtmfgen_uninit(MSFilter *f){
-	ms_free(f->data);
+	DtmfGenState *s=(DtmfGenState*)f->data;
+	if (s->tone) freemsg(s->tone);
+	ms_tone_cache_unref(s->cache);
+	ms_free(s);
+}
+
+/*the samples of tones are computed once for all the generators, as long as they are short enough to be cached*/
+static void dtmfgen_load_tone(DtmfGenState *s){
+	if (s->tone) freemsg(s->tone);
+	s->tone=ms_tone_cache_get_tone(s->cache,s->lowfreq,s->highfreq,s->amplitude,s->dur,s->rate,s->nchannels);
+	s->tone_nchannels=s->nchannels;
+	s->osc_pos=-1;
+}
+
+static int dtmfgen_cached_samples(DtmfGenState *s){
+	if (s->tone==NULL || s->tone_nchannels!=s->nchannels) return 0;
+	return MIN((int)(s->tone->b_wptr-s->tone->b_rptr)/(2*s->nchannels),s->dur);
 }
 
 static int dtmfgen_put(MSFilter *f, void *arg){
@@ -155,11 +173,10 @@ static int dtmfgen_put(MSFilter *f, void *arg){
 	}
 	ms_filter_lock(f);
 	s->pos=0;
-	s->lowfreq=s->lowfreq/s->rate;
-	s->highfreq=s->highfreq/s->rate;
 	s->dur=s->rate/10; /*100 ms duration */
 	s->silence=0;
 	s->amplitude=s->default_amplitude*32767*0.7;
+	dtmfgen_load_tone(s);
 	s->current_tone.tone_name[0]=dtmf[0];
 	s->current_tone.tone_name[1]=0;
 	s->current_tone.interval=0;
@@ -178,11 +195,12 @@ static int dtmfgen_play_tone(MSFilter *f, void *arg){
 	s->current_tone=*def;
 	s->pos=0;
 	s->dur=(s->rate*def->duration)/1000;
-	s->lowfreq=((float)def->frequencies[0])/(float)s->rate;
-	s->highfreq=((float)def->frequencies[1])/(float)s->rate;;
+	s->lowfreq=def->frequencies[0];
+	s->highfreq=def->frequencies[1];
 	s->silence=0;
 	s->amplitude=((float)def->amplitude)* 0.7*32767.0;
 	s->repeat_count=0;
+	dtmfgen_load_tone(s);
 	s->playing=TRUE;
 	ms_filter_unlock(f);
 	
@@ -241,21 +259,7 @@ static int dtmfgen_set_amp(MSFilter *f, void *arg){
 }
 
 
-static void write_dtmf(DtmfGenState *s , int16_t *sample, int nsamples){
-	int i, j;
-	int16_t dtmf_sample;
-	for (i=0;i<nsamples && s->pos<s->dur;i++,s->pos++){
-		dtmf_sample = (int16_t)(((float)s->amplitude)*sin(2*M_PI*(float)s->pos*s->lowfreq));
-		if (s->highfreq!=0) dtmf_sample += (int16_t)(((float)s->amplitude)*sin(2*M_PI*(float)s->pos*s->highfreq));
-		for (j = 0; j < s->nchannels; j++) {
-			sample[(i * s->nchannels) + j] = dtmf_sample;
-		}
-	}
-	for (;i<nsamples;++i){
-		for (j = 0; j < s->nchannels; j++) {
-			sample[(i * s->nchannels) + j] = 0;
-		}
-	}
+static void dtmfgen_check_end(DtmfGenState *s){
 	if (s->pos>=s->dur){
 		s->pos=0;
 		if (s->current_tone.interval > 0) {
@@ -271,6 +275,37 @@ static void write_dtmf(DtmfGenState *s , int16_t *sample, int nsamples){
 	}
 }
 
+static void write_dtmf(DtmfGenState *s , int16_t *sample, int nsamples){
+	int i=0, j;
+	int cached=dtmfgen_cached_samples(s);
+	int16_t dtmf_sample;
+	if (s->pos<cached){
+		i=MIN(nsamples,cached-s->pos);
+		memcpy(sample,s->tone->b_rptr+s->pos*s->nchannels*2,i*s->nchannels*2);
+		s->pos+=i;
+	}
+	if (i<nsamples && s->pos<s->dur){
+		if (s->osc_pos!=s->pos){
+			ms_tone_oscillator_init(&s->lowosc,s->lowfreq,s->rate,s->pos);
+			ms_tone_oscillator_init(&s->highosc,s->highfreq,s->rate,s->pos);
+		}
+		for (;i<nsamples && s->pos<s->dur;i++,s->pos++){
+			dtmf_sample = (int16_t)(s->amplitude*ms_tone_oscillator_next(&s->lowosc));
+			if (s->highfreq!=0) dtmf_sample += (int16_t)(s->amplitude*ms_tone_oscillator_next(&s->highosc));
+			for (j = 0; j < s->nchannels; j++) {
+				sample[(i * s->nchannels) + j] = dtmf_sample;
+			}
+		}
+		s->osc_pos=s->pos;
+	}
+	for (;i<nsamples;++i){
+		for (j = 0; j < s->nchannels; j++) {
+			sample[(i * s->nchannels) + j] = 0;
+		}
+	}
+	dtmfgen_check_end(s);
+}
+
 static void dtmfgen_process(MSFilter *f){
 	mblk_t *m;
 	DtmfGenState *s=(DtmfGenState*)f->data;
@@ -283,7 +318,6 @@ static void dtmfgen_process(MSFilter *f){
 			/*after 100 ms without stream we decide to generate our own sample
 			 instead of writing into incoming stream samples*/
 			nsamples=(f->ticker->interval*s->rate)/1000;
-			m=allocb(nsamples*s->nchannels*2,0);
 			if (s->silence==0){
 				if (s->pos==0){
 					MSDtmfGenEvent ev;
@@ -291,8 +325,17 @@ static void dtmfgen_process(MSFilter *f){
 					strncpy(ev.tone_name,s->current_tone.tone_name,sizeof(ev.tone_name));
 					ms_filter_notify(f,MS_DTMF_GEN_EVENT,&ev);
 				}
-				write_dtmf(s,(int16_t*)m->b_wptr,nsamples);
+				m=allocb(nsamples*s->nchannels*2,0);
+				if (s->pos+nsamples<=dtmfgen_cached_samples(s)){
+					/*copied, as the filters downstream may modify it in place*/
+					memcpy(m->b_wptr,s->tone->b_rptr+s->pos*s->nchannels*2,nsamples*s->nchannels*2);
+					s->pos+=nsamples;
+					dtmfgen_check_end(s);
+				}else{
+					write_dtmf(s,(int16_t*)m->b_wptr,nsamples);
+				}
 			}else{
+				m=allocb(nsamples*s->nchannels*2,0);
 				memset(m->b_wptr,0,nsamples*s->nchannels*2);
 				s->silence-=f->ticker->interval;
 				if (s->silence<0) s->silence=0;
@@ -314,6 +357,13 @@ static void dtmfgen_process(MSFilter *f){
 					strncpy(ev.tone_name,s->current_tone.tone_name,sizeof(ev.tone_name));
 					ms_filter_notify(f,MS_DTMF_GEN_EVENT,&ev);
 				}
+				if (m->b_datap->db_ref>1){
+					/*the samples are shared with other blocks, they must not be modified*/
+					mblk_t *copy=copyb(m);
+					mblk_meta_copy(m,copy);
+					freemsg(m);
+					m=copy;
+				}
 				nsamples=(m->b_wptr-m->b_rptr)/(2*s->nchannels);
 				write_dtmf(s, (int16_t*)m->b_rptr,nsamples);
 			}
@@ -21,6 +21,8 @@
 #include "mediastreamer2/mscommon.h"
 #include "mediastreamer2/flowcontrol.h"
 
+#include <limits.h>
+
 void ms_audio_flow_controller_init(MSAudioFlowController *ctl)
 {
 	ctl->target_samples = 0;
@@ -37,54 +39,174 @@ void ms_audio_flow_controller_set_target(MSAudioFlowController *ctl, int samples
 	ctl->current_dropped = 0;
 }
 
-static void discard_well_choosed_samples(mblk_t *m, int nsamples, int todrop)
-{
-	int i;
-	int16_t *samples = (int16_t *) m->b_rptr;
-	int min_diff = 32768;
-	int pos = 0;
-
+/*
+ * The samples are dropped or inserted where the signal is the smoothest, that is at the local minima of the
+ * difference between consecutive samples. The best points of a block are selected in a single scan, keeping
+ * the best candidates in a max-heap, then the block is compacted or expanded in a single pass.
+ */
+#define MAX_POINTS_PER_BLOCK 64
 
 #ifdef TWO_SAMPLES_CRITERIA
-	for (i = 0; i < nsamples - 1; ++i) {
-		int tmp = abs((int) samples[i] - (int) samples[i + 1]);
+#define POINT_OFFSET 0 /*the sample dropped or duplicated is at the position of the point*/
+#define NPOINTS(nsamples) ((nsamples) - 1)
+static MS2_INLINE int smoothness(const int16_t *samples, int i) {
+	return abs((int) samples[i] - (int) samples[i + 1]);
+}
 #else
-	for (i = 0; i < nsamples - 2; ++i) {
-		int tmp = abs((int) samples[i] - (int) samples[i + 1]) + abs((int) samples[i + 1] - (int) samples[i + 2]);
+#define POINT_OFFSET 1
+#define NPOINTS(nsamples) ((nsamples) - 2)
+static MS2_INLINE int smoothness(const int16_t *samples, int i) {
+	return abs((int) samples[i] - (int) samples[i + 1]) + abs((int) samples[i + 1] - (int) samples[i + 2]);
+}
 #endif
-		if (tmp <= min_diff) {
-			pos = i;
-			min_diff = tmp;
+
+typedef struct _SmoothPoint {
+	int diff;
+	int pos;
+} SmoothPoint;
+
+static void heap_sift_up(SmoothPoint *heap, int i) {
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		SmoothPoint tmp;
+		if (heap[parent].diff >= heap[i].diff) break;
+		tmp = heap[parent];
+		heap[parent] = heap[i];
+		heap[i] = tmp;
+		i = parent;
+	}
+}
+
+static void heap_sift_down(SmoothPoint *heap, int count, int i) {
+	for (;;) {
+		int largest = i;
+		int left = 2 * i + 1;
+		int right = left + 1;
+		SmoothPoint tmp;
+		if (left < count && heap[left].diff > heap[largest].diff) largest = left;
+		if (right < count && heap[right].diff > heap[largest].diff) largest = right;
+		if (largest == i) break;
+		tmp = heap[largest];
+		heap[largest] = heap[i];
+		heap[i] = tmp;
+		i = largest;
+	}
+}
+
+static int compare_int(const void *a, const void *b) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*returns the number of points written in ascending order into points, at most count*/
+static int select_smoothest_points(const int16_t *samples, int nsamples, int count, int *points) {
+	SmoothPoint heap[MAX_POINTS_PER_BLOCK];
+	int npoints = NPOINTS(nsamples);
+	int nheap = 0;
+	int last_candidate = -2;
+	int prev = INT_MAX;
+	int cur, i, selected, missing;
+
+	if (npoints <= 0 || count <= 0) return 0;
+	if (count == 1) {
+		/*the common case of a small drift, no need for the candidates bookkeeping*/
+		int min_diff = INT_MAX;
+		for (i = 0; i < npoints; ++i) {
+			int tmp = smoothness(samples, i);
+			if (tmp <= min_diff) {
+				points[0] = i;
+				min_diff = tmp;
+			}
 		}
+		return 1;
 	}
-	/*ms_message("min_diff=%i at pos %i",min_diff, pos);*/
-#ifdef TWO_SAMPLES_CRITERIA
-	memmove(samples + pos, samples + pos + 1, (nsamples - pos - 1) * 2);
-#else
-	memmove(samples + pos + 1, samples + pos + 2, (nsamples - pos - 2) * 2);
-#endif
+	cur = smoothness(samples, 0);
+	for (i = 0; i < npoints; ++i) {
+		int next = (i + 1 < npoints) ? smoothness(samples, i + 1) : INT_MAX;
+		/*only local minima are candidates, and never two neighbours, so that consecutive samples are not altered*/
+		if (cur <= prev && cur <= next && last_candidate != i - 1) {
+			if (nheap < count) {
+				heap[nheap].diff = cur;
+				heap[nheap].pos = i;
+				heap_sift_up(heap, nheap++);
+				last_candidate = i;
+			} else if (cur < heap[0].diff) {
+				heap[0].diff = cur;
+				heap[0].pos = i;
+				heap_sift_down(heap, nheap, 0);
+				last_candidate = i;
+			}
+		}
+		prev = cur;
+		cur = next;
+	}
+	for (i = 0; i < nheap; ++i) points[i] = heap[i].pos;
+	selected = nheap;
+	/*not enough local minima (monotonic signal): the missing points are spread evenly over the block*/
+	missing = count - nheap;
+	for (i = 0; i < missing; ++i) {
+		points[selected++] = (int)(((int64_t)(2 * i + 1) * npoints) / (2 * missing));
+	}
+	qsort(points, selected, sizeof(int), compare_int);
+	for (i = 1, count = 1; i < selected; ++i) {
+		if (points[i] != points[count - 1]) points[count++] = points[i];
+	}
+	return count;
+}
+
+static int discard_well_choosed_samples(mblk_t *m, int nsamples, int todrop) {
+	int16_t *samples = (int16_t *) m->b_rptr;
+	int points[MAX_POINTS_PER_BLOCK];
+	int count = select_smoothest_points(samples, nsamples, MIN(todrop, MAX_POINTS_PER_BLOCK), points);
+	int rpos = 0, wpos = 0;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		int dropped = points[i] + POINT_OFFSET;
+		if (wpos != rpos) memmove(samples + wpos, samples + rpos, (dropped - rpos) * 2);
+		wpos += dropped - rpos;
+		rpos = dropped + 1;
+	}
+	memmove(samples + wpos, samples + rpos, (nsamples - rpos) * 2);
+	m->b_wptr -= count * 2;
+	return count;
+}
+
+static mblk_t *insert_well_choosed_samples(mblk_t *m, int nsamples, int toinsert, int *inserted) {
+	int16_t *samples = (int16_t *) m->b_rptr;
+	int points[MAX_POINTS_PER_BLOCK];
+	int count = select_smoothest_points(samples, nsamples, MIN(toinsert, MAX_POINTS_PER_BLOCK), points);
+	mblk_t *om = allocb((nsamples + count) * 2, 0);
+	int16_t *out = (int16_t *) om->b_wptr;
+	int rpos = 0;
+	int i;
 
-	todrop--;
-	m->b_wptr -= 2;
-	nsamples--;
-	if (todrop > 0) {
-		/*repeat the same process again*/
-		discard_well_choosed_samples(m, nsamples, todrop);
+	for (i = 0; i < count; ++i) {
+		int dup = points[i] + POINT_OFFSET;
+		memcpy(out, samples + rpos, (dup + 1 - rpos) * 2);
+		out += dup + 1 - rpos;
+		*out++ = (int16_t)(((int) samples[dup] + (int) samples[dup + 1]) / 2);
+		rpos = dup + 1;
 	}
+	memcpy(out, samples + rpos, (nsamples - rpos) * 2);
+	om->b_wptr += (nsamples + count) * 2;
+	mblk_meta_copy(m, om);
+	freemsg(m);
+	*inserted = count;
+	return om;
 }
 
 mblk_t *ms_audio_flow_controller_process(MSAudioFlowController *ctl, mblk_t *m){
-	if (ctl->total_samples > 0 && ctl->target_samples > 0) {
+	if (ctl->total_samples > 0 && ctl->target_samples != 0) {
 		int nsamples = (m->b_wptr - m->b_rptr) / 2;
 		int th_dropped;
 		int todrop;
 
 		ctl->current_pos += nsamples;
-		th_dropped = (ctl->target_samples * ctl->current_pos) / ctl->total_samples;
+		th_dropped = (int)(((int64_t)ctl->target_samples * ctl->current_pos) / ctl->total_samples);
 		todrop = th_dropped - ctl->current_dropped;
 		if (todrop > 0) {
 			if (todrop*8<nsamples){
-				discard_well_choosed_samples(m, nsamples, todrop);
+				todrop = discard_well_choosed_samples(m, nsamples, todrop);
 			}else{
 				ms_warning("Too many samples to drop, dropping entire frame.");
 				freemsg(m);
@@ -93,6 +215,11 @@ mblk_t *ms_audio_flow_controller_process(MSAudioFlowController *ctl, mblk_t *m){
 			}
 			/*ms_message("th_dropped=%i, current_dropped=%i, %i samples dropped.",th_dropped,ctl->current_dropped,todrop);*/
 			ctl->current_dropped += todrop;
+		} else if (todrop < 0 && nsamples >= 8) {
+			int inserted = 0;
+			/*at most one sample in 8 is inserted, the remaining ones are inserted with the next blocks*/
+			m = insert_well_choosed_samples(m, nsamples, MIN(-todrop, nsamples / 8), &inserted);
+			ctl->current_dropped -= inserted;
 		}
 		if (ctl->current_pos >= ctl->total_samples) ctl->target_samples = 0; /*stop discarding*/
 	}
@@ -174,6 +174,19 @@ static int rec_close(MSFilter *f, void *arg){
 	return 0;
 }
 
+static int rec_sync(MSFilter *f, void *arg){
+	RecState *s=(RecState*)f->data;
+	ms_mutex_lock(&f->lock);
+	if (s->fd!=-1){
+		write_wav_header(s->fd, s->rate, s->nchannels, s->size);
+		if (lseek(s->fd,0,SEEK_END)==-1){
+			ms_error("MSFileRec: could not lseek to end of file: %s",strerror(errno));
+		}
+	}
+	ms_mutex_unlock(&f->lock);
+	return 0;
+}
+
 static int rec_get_state(MSFilter *f, void *arg){
 	RecState *s=(RecState*)f->data;
 	*(MSRecorderState*)arg=s->state;
@@ -212,6 +225,7 @@ static MSFilterMethod rec_methods[]={
 	{	MS_RECORDER_PAUSE	,	rec_stop	},
 	{	MS_RECORDER_CLOSE	,	rec_close	},
 	{	MS_RECORDER_GET_STATE	,	rec_get_state	},
+	{	MS_RECORDER_SYNC	,	rec_sync	},
 	{	0			,	NULL		}
 };
 
@@ -17,35 +17,50 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
-#ifdef _WIN32
-#include <malloc.h>  // for alloca
-#endif
-
 #include <mediastreamer2/msfilter.h>
 
 
 #ifdef HAVE_SPANDSP
 /*use the G722 version from spandsp, LGPL */
 #include <spandsp.h>
+/*the linear audio is scaled by the filters*/
+#define G722_OPTIONS 0
 #else
-/*otherwise use built-in version, forked from spandsp a long time ago and that has a public license.*/
+/*otherwise use built-in version, forked from spandsp a long time ago and that has a public license.
+ The scaling of the linear audio is done by its QMF.*/
 #include "g722.h"
+#define G722_OPTIONS G722_FULL_SCALE
 #endif
 
 struct EncState {
 	g722_encode_state_t *state;
 	uint32_t ts;
 	int   ptime;
+	int   chunksize; /*bytes of linear audio per packet*/
+	int   buf_ptime; /*the ptime buf was allocated for*/
+	uint8_t *buf; /*holds one packet of linear audio*/
 	MSBufferizer *bufferizer;
 };
 
+static void update_chunksize(struct EncState *s){
+	int frame_per_packet=s->ptime/10;
+
+	if(frame_per_packet<=0)
+		frame_per_packet=1;
+	s->chunksize=160*2*frame_per_packet; /*10 msec at 16KHZ = 320 bytes of data*/
+	if (s->buf) ms_free(s->buf);
+	s->buf=(uint8_t*)ms_malloc(s->chunksize);
+	s->buf_ptime=s->ptime;
+}
+
 static void enc_init(MSFilter *f)
 {
 	struct EncState *s=ms_new0(struct EncState,1);
-	s->state = g722_encode_init(NULL, 64000, 0);
+	s->state = g722_encode_init(NULL, 64000, G722_OPTIONS);
 	s->ts=0;
 	s->bufferizer=ms_bufferizer_new();
 	s->ptime = 20;
+	update_chunksize(s);
 	f->data=s;
 };
 
@@ -54,10 +69,12 @@ static void enc_uninit(MSFilter *f)
 	struct EncState *s=(struct EncState*)f->data;
 	g722_encode_release(s->state);
 	ms_bufferizer_destroy(s->bufferizer);
+	ms_free(s->buf);
 	ms_free(s);
 	f->data = 0;
 };
 
+#ifdef HAVE_SPANDSP
 static void scale_down(int16_t *samples, int count){
 	int i;
 	for (i=0;i<count;++i)
@@ -69,34 +86,29 @@ static void scale_up(int16_t *samples, int count){
 	for (i=0;i<count;++i)
 		samples[i]=samples[i]<<1;
 }
+#endif
 
 static void enc_process(MSFilter *f)
 {
 	struct EncState *s=(struct EncState*)f->data;
 	mblk_t *im;
-	int nbytes;
-	uint8_t *buf;
-	int frame_per_packet=1;
 	int chunksize;
-	
-	if(s->ptime>=10)
-		frame_per_packet = s->ptime/10;
-
-	if(frame_per_packet<=0)
-		frame_per_packet=1;
+	uint8_t *buf;
 
-	nbytes = 160*2;  //  10 Msec at 16KHZ  = 320 bytes of data
-	buf = (uint8_t*)alloca(nbytes*frame_per_packet);
+	if (s->buf_ptime!=s->ptime) update_chunksize(s);
+	chunksize=s->chunksize;
+	buf=s->buf;
 
 	while((im=ms_queue_get(f->inputs[0])))
 		ms_bufferizer_put(s->bufferizer,im);
 
-	chunksize = nbytes*frame_per_packet;
 	while(ms_bufferizer_read(s->bufferizer,buf, chunksize) == chunksize) {
-		mblk_t *om=allocb(nbytes*frame_per_packet,0);//too large...
+		mblk_t *om=allocb(chunksize/4,0); /*one byte per pair of samples at 64kbit/s*/
 		int k;
 		
+#ifdef HAVE_SPANDSP
 		scale_down((int16_t *)buf,chunksize/2);
+#endif
 		k = g722_encode(s->state, om->b_wptr, (int16_t *)buf, chunksize/2);		
 		om->b_wptr += k;
 		ms_bufferizer_fill_current_metas(s->bufferizer, om);
@@ -188,7 +200,7 @@ static void dec_init(MSFilter *f){
 	struct DecState *s=ms_new0(struct DecState,1);
 	f->data=s;
 
-	s->state = g722_decode_init(NULL, 64000, 0);
+	s->state = g722_decode_init(NULL, 64000, G722_OPTIONS);
 };
 
 static void dec_uninit(MSFilter *f)
@@ -215,7 +227,9 @@ static void dec_process(MSFilter *f)
 			ms_warning("g722_decode error!");
 			freemsg(om);
 		} else {
+#ifdef HAVE_SPANDSP
 			scale_up((int16_t *)om->b_wptr,declen);
+#endif
 			om->b_wptr  += declen*2;
 			ms_queue_put(f->outputs[0],om);
 		}
@@ -285,18 +285,28 @@ typedef enum _StreamType {
 	STREAM_TYPE_RECORD
 } StreamType;
 
+/*
+ * The samples are exchanged with the server from the callbacks of the mainloop thread, so that the
+ * ticker only takes the stream mutex, and the mainloop lock when the server waits for playback data.
+ */
 typedef struct _Stream{
 	ms_mutex_t mutex;
 	StreamType type;
 	pa_sample_spec sampleSpec;
 	pa_stream *stream;
 	pa_stream_state_t state;
-	MSBufferizer bufferizer;
+	MSBufferizer bufferizer; /* playback samples waiting for a write request of the server */
+	MSQueue queue; /* captured fragments waiting for the ticker */
+	size_t queued;
+	size_t requested; /* bytes the server asked for and did not get yet */
 	char *dev;
 	double init_volume;
+	int latency; /*ms*/
+	int fragment_size; /*ms, 0 when chosen by the server*/
 	uint64_t last_stats;
 	int underflow_notifs;
 	int overflow_notifs;
+	MSAudioXrunStats xruns;
 }Stream;
 
 static void stream_disconnect(Stream *s);
@@ -325,8 +335,10 @@ static Stream *stream_new(StreamType type) {
 	s->sampleSpec.rate=8000;
 	s->state = PA_STREAM_UNCONNECTED;
 	ms_bufferizer_init(&s->bufferizer);
+	ms_queue_init(&s->queue);
 	s->dev = NULL;
 	s->init_volume = -1.0;
+	s->latency = targeted_latency;
 	return s;
 }
 
@@ -338,39 +350,102 @@ static void stream_free(Stream *s) {
 		}
 	}
 	ms_bufferizer_uninit(&s->bufferizer);
+	ms_queue_flush(&s->queue);
 	ms_mutex_destroy(&s->mutex);
 	ms_free(s);
 }
 
-static size_t stream_play(Stream *s, size_t nbytes) {
-	if (nbytes == 0) return 0;
+/* Copies the pending samples straight into the memory of the server, with the mainloop lock and the stream mutex held */
+static void stream_play(Stream *s) {
+	size_t frame_size = pa_frame_size(&s->sampleSpec);
+	size_t nbytes = MIN(s->requested, (size_t)ms_bufferizer_get_avail(&s->bufferizer));
 
-	if (ms_bufferizer_get_avail(&s->bufferizer) >= nbytes){
-		uint8_t *data;
-		data = ms_new(uint8_t, nbytes);
-		ms_mutex_lock(&s->mutex);
-		ms_bufferizer_read(&s->bufferizer, data, nbytes);
-		ms_mutex_unlock(&s->mutex);
-		pa_stream_write(s->stream, data, nbytes, ms_free, 0, PA_SEEK_RELATIVE);
+	nbytes -= nbytes % frame_size;
+	while (nbytes > 0) {
+		void *data = NULL;
+		size_t chunk = nbytes;
+		if (pa_stream_begin_write(s->stream, &data, &chunk) < 0 || data == NULL) {
+			ms_error("pa_stream_begin_write() failed");
+			break;
+		}
+		chunk = MIN(chunk, nbytes);
+		chunk -= chunk % frame_size;
+		if (chunk == 0) {
+			pa_stream_cancel_write(s->stream);
+			break;
+		}
+		ms_bufferizer_read(&s->bufferizer, (uint8_t *)data, (int)chunk);
+		if (pa_stream_write(s->stream, data, chunk, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+			ms_error("pa_stream_write() failed");
+			break;
+		}
+		nbytes -= chunk;
+		s->requested -= chunk;
 	}
-		
-	
-	return nbytes;
 }
 
 static void stream_write_request_cb(pa_stream *p, size_t nbytes, void *user_data) {
 	Stream *s = (Stream *)user_data;
-	stream_play(s, nbytes);
+	ms_mutex_lock(&s->mutex);
+	s->requested = nbytes;
+	stream_play(s);
+	ms_mutex_unlock(&s->mutex);
+}
+
+/* Queues the captured fragments for the ticker. The server only lends a fragment until it is dropped, hence the copy. */
+static void stream_read_cb(pa_stream *p, size_t nbytes, void *user_data) {
+	Stream *s = (Stream *)user_data;
+	size_t max_queued = pa_usec_to_bytes((pa_usec_t)(s->latency * 4 + 100) * 1000, &s->sampleSpec);
+	const void *buffer;
+	mblk_t *om;
+
+	while (pa_stream_readable_size(p) > 0) {
+		if (pa_stream_peek(p, &buffer, &nbytes) < 0) {
+			ms_error("pa_stream_peek() failed");
+			break;
+		}
+		if (nbytes == 0) break;
+		om = allocb(nbytes, 0);
+		if (buffer != NULL) {
+			memcpy(om->b_wptr, buffer, nbytes);
+		} else {
+			/* a hole in the record buffer: the server overran it and lost these samples */
+			memset(om->b_wptr, 0, nbytes);
+		}
+		om->b_wptr += nbytes;
+		pa_stream_drop(p);
+
+		ms_mutex_lock(&s->mutex);
+		if (buffer == NULL) s->xruns.overruns++;
+		ms_queue_put(&s->queue, om);
+		s->queued += nbytes;
+		if (s->queued > max_queued) {
+			/* the ticker does not keep pace, drop the oldest samples rather than let the latency grow */
+			while (s->queued > max_queued / 2 && (om = ms_queue_get(&s->queue)) != NULL) {
+				s->queued -= msgdsize(om);
+				freemsg(om);
+			}
+			s->xruns.overruns++;
+			s->overflow_notifs++;
+		}
+		ms_mutex_unlock(&s->mutex);
+	}
 }
 
 static void stream_buffer_overflow_notification(pa_stream *p, void *user_data) {
 	Stream *st = (Stream*)user_data;
+	ms_mutex_lock(&st->mutex);
 	st->overflow_notifs++;
+	st->xruns.overruns++;
+	ms_mutex_unlock(&st->mutex);
 }
 
 static void stream_buffer_underflow_notification(pa_stream *p, void *user_data) {
 	Stream *st = (Stream*)user_data;
+	ms_mutex_lock(&st->mutex);
 	st->underflow_notifs++;
+	st->xruns.underruns++;
+	ms_mutex_unlock(&st->mutex);
 }
 
 static double volume_to_scale(pa_volume_t volume) {
@@ -387,10 +462,14 @@ static bool_t stream_connect(Stream *s) {
 	pa_cvolume volume, *volume_ptr = NULL;
 	
 	attr.maxlength = -1;
-	attr.fragsize = pa_usec_to_bytes(targeted_latency * 1000, &s->sampleSpec);
-	attr.tlength = attr.fragsize;
-	attr.minreq = -1;
+	attr.tlength = pa_usec_to_bytes((pa_usec_t)s->latency * 1000, &s->sampleSpec);
 	attr.prebuf = -1;
+	if (s->fragment_size > 0) {
+		attr.fragsize = attr.minreq = pa_usec_to_bytes((pa_usec_t)s->fragment_size * 1000, &s->sampleSpec);
+	} else {
+		attr.fragsize = attr.tlength;
+		attr.minreq = -1;
+	}
 	
 	if(s->init_volume >= 0.0) {
 		pa_volume_t value = scale_to_volume(s->init_volume);
@@ -420,6 +499,7 @@ static bool_t stream_connect(Stream *s) {
 			volume_ptr, 
 			NULL);
 	} else {
+		pa_stream_set_read_callback(s->stream, stream_read_cb, s);
 		err=pa_stream_connect_record(s->stream,s->dev,&attr, PA_STREAM_ADJUST_LATENCY);
 	}
 	pa_threaded_mainloop_unlock(pa_loop);
@@ -450,6 +530,12 @@ static void stream_disconnect(Stream *s) {
 		s->stream = NULL;
 		s->state = PA_STREAM_UNCONNECTED;
 		s->init_volume = -1.0;
+		ms_mutex_lock(&s->mutex);
+		ms_bufferizer_flush(&s->bufferizer);
+		ms_queue_flush(&s->queue);
+		s->queued = 0;
+		s->requested = 0;
+		ms_mutex_unlock(&s->mutex);
 	}
 }
 
@@ -548,31 +634,18 @@ static void pulse_read_preprocess(MSFilter *f) {
 
 static void pulse_read_process(MSFilter *f){
 	RecordStream *s=(RecordStream *)f->data;
-	const void *buffer=NULL;
-	size_t nbytes;
+	mblk_t *om;
 
 	if(s->stream == NULL) {
 		ms_error("Record stream not connected");
 		return;
 	}
-	pa_threaded_mainloop_lock(pa_loop);
-	while(pa_stream_readable_size(s->stream) > 0) {
-		if(pa_stream_peek(s->stream, &buffer, &nbytes) >= 0) {
-			if(buffer != NULL) {
-				mblk_t *om = allocb(nbytes, 0);
-				memcpy(om->b_wptr, buffer, nbytes);
-				om->b_wptr += nbytes;
-				ms_queue_put(f->outputs[0], om);
-			}
-			if(nbytes > 0) {
-				pa_stream_drop(s->stream);
-			}
-		} else {
-			ms_error("pa_stream_peek() failed");
-			break;
-		}
+	ms_mutex_lock(&s->mutex);
+	while((om = ms_queue_get(&s->queue)) != NULL) {
+		ms_queue_put(f->outputs[0], om);
 	}
-	pa_threaded_mainloop_unlock(pa_loop);
+	s->queued = 0;
+	ms_mutex_unlock(&s->mutex);
 }
 
 static void pulse_read_postprocess(MSFilter *f) {
@@ -620,6 +693,42 @@ static int pulse_read_get_nchannels(MSFilter *f, void *arg){
 	return 0;
 }
 
+static int pulse_read_set_latency(MSFilter *f, void *arg) {
+	Stream *s = (Stream *)f->data;
+
+	if(s->state == PA_STREAM_READY) {
+		ms_error("pulseaudio: cannot set latency: stream is connected");
+		return -1;
+	}
+	s->latency = *(int *)arg;
+	return 0;
+}
+
+static int pulse_read_get_latency(MSFilter *f, void *arg) {
+	Stream *s = (Stream *)f->data;
+	*(int *)arg = s->latency;
+	return 0;
+}
+
+static int pulse_read_set_fragment_size(MSFilter *f, void *arg) {
+	Stream *s = (Stream *)f->data;
+
+	if(s->state == PA_STREAM_READY) {
+		ms_error("pulseaudio: cannot set fragment size: stream is connected");
+		return -1;
+	}
+	s->fragment_size = *(int *)arg;
+	return 0;
+}
+
+static int pulse_read_get_xrun_stats(MSFilter *f, void *arg) {
+	Stream *s = (Stream *)f->data;
+	ms_mutex_lock(&s->mutex);
+	*(MSAudioXrunStats *)arg = s->xruns;
+	ms_mutex_unlock(&s->mutex);
+	return 0;
+}
+
 static int pulse_read_set_volume(MSFilter *f, void *arg) {
 	Stream *s = (Stream *)f->data;
 	const float *volume = (const float *)arg;
@@ -649,6 +758,10 @@ static MSFilterMethod pulse_read_methods[]={
 	{	MS_FILTER_GET_NCHANNELS	, pulse_read_get_nchannels },
 	{	MS_AUDIO_CAPTURE_SET_VOLUME_GAIN	, pulse_read_set_volume },
 	{	MS_AUDIO_CAPTURE_GET_VOLUME_GAIN	, pulse_read_get_volume },
+	{	MS_AUDIO_CAPTURE_SET_LATENCY	, pulse_read_set_latency },
+	{	MS_AUDIO_CAPTURE_GET_LATENCY	, pulse_read_get_latency },
+	{	MS_AUDIO_CAPTURE_SET_FRAGMENT_SIZE	, pulse_read_set_fragment_size },
+	{	MS_AUDIO_CAPTURE_GET_XRUN_STATS	, pulse_read_get_xrun_stats },
 	{	0	, NULL }
 };
 
@@ -688,17 +801,24 @@ static void pulse_write_preprocess(MSFilter *f) {
 
 static void pulse_write_process(MSFilter *f){
 	PlaybackStream *s=(PlaybackStream*)f->data;
-	size_t nwritable;
+	bool_t starving;
 
 	if(s->stream) {
 		ms_mutex_lock(&s->mutex);
 		ms_bufferizer_put_from_queue(&s->bufferizer,f->inputs[0]);
+		starving = s->requested > 0;
 		ms_mutex_unlock(&s->mutex);
-		
-		pa_threaded_mainloop_lock(pa_loop);
-		nwritable = pa_stream_writable_size(s->stream);
-		stream_play(s, nwritable);
-		pa_threaded_mainloop_unlock(pa_loop);
+
+		/* the write requests of the server are served by the mainloop thread, unless it already
+		 * came and found the buffer empty: only then take the mainloop lock to write from here */
+		if (starving) {
+			pa_threaded_mainloop_lock(pa_loop);
+			ms_mutex_lock(&s->mutex);
+			s->requested = pa_stream_writable_size(s->stream);
+			stream_play(s);
+			ms_mutex_unlock(&s->mutex);
+			pa_threaded_mainloop_unlock(pa_loop);
+		}
 		if (s->last_stats == (uint64_t)-1){
 			s->last_stats = f->ticker->time;
 		}else if (f->ticker->time - s->last_stats >= 5000) {
@@ -712,11 +832,13 @@ static void pulse_write_process(MSFilter *f){
 			if (err == 0 && !is_negative) {
 				ms_message("pulseaudio: latency is equal to %d ms", (int)(latency/1000L));
 			}
+			ms_mutex_lock(&s->mutex);
 			if (s->underflow_notifs || s->overflow_notifs){
 				ms_warning("pulseaudio: there were %i underflows and %i overflows over last 5 seconds", s->underflow_notifs, s->overflow_notifs);
 				s->underflow_notifs = 0;
 				s->overflow_notifs = 0;
 			}
+			ms_mutex_unlock(&s->mutex);
 		}
 	} else {
 		ms_queue_flush(f->inputs[0]);
@@ -739,6 +861,10 @@ static MSFilterMethod pulse_write_methods[]={
 	{	MS_FILTER_GET_NCHANNELS	, pulse_read_get_nchannels },
 	{	MS_AUDIO_PLAYBACK_SET_VOLUME_GAIN	, pulse_read_set_volume },
 	{	MS_AUDIO_PLAYBACK_GET_VOLUME_GAIN	, pulse_read_get_volume },
+	{	MS_AUDIO_PLAYBACK_SET_LATENCY	, pulse_read_set_latency },
+	{	MS_AUDIO_PLAYBACK_GET_LATENCY	, pulse_read_get_latency },
+	{	MS_AUDIO_PLAYBACK_SET_FRAGMENT_SIZE	, pulse_read_set_fragment_size },
+	{	MS_AUDIO_PLAYBACK_GET_XRUN_STATS	, pulse_read_get_xrun_stats },
 	{	0	, NULL }
 };
 
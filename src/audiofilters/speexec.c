@@ -27,6 +27,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <speex/speex_echo.h>
 #include <speex/speex_preprocess.h>
 #include "ortp/b64.h"
+#include "ec_service.h"
+#include <math.h>
 
 #ifdef HAVE_CONFIG_H
 #include "mediastreamer-config.h"
@@ -36,8 +38,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <malloc.h> /* for alloca */
 #endif
 
-#include "mediastreamer2/flowcontrol.h"
-
 
 //#define EC_DUMP 1
 #ifdef ANDROID
@@ -47,25 +47,40 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 static const int framesize=64;
-static const int flow_control_interval_ms=5000;
+static const int skew_interval_ms=1000;
+static const double max_skew=0.01; /*1% is far beyond the drift of any sound card*/
+static const int skew_history_s=60; /*the skew is estimated over the last minute*/
+static const double skew_log_threshold=0.0001; /*changes of the skew estimate logged as messages*/
 
 
 typedef struct SpeexECState{
 	SpeexEchoState *ecstate;
 	SpeexPreprocessState *den;
-	MSBufferizer delayed_ref;
-	MSBufferizer ref;
 	MSBufferizer echo;
+	int16_t *ref_ring; /*the reference signal, indexed by absolute sample position modulo ref_ring_size*/
+	int ref_ring_size;
+	uint64_t ref_written; /*absolute position of the next reference sample*/
+	double ref_read_pos; /*absolute position of the next reference sample given to the canceller*/
+	double ref_step; /*reference samples read per echo sample*/
+	double skew; /*estimated ratio between the reference and echo sample rates*/
+	double logged_skew;
+	double ref_total;
+	double echo_total;
+	uint64_t skew_time;
+	int nominal_lag;
+	int min_lag;
+	msgb_allocator_t allocator;
+	MSLogSite starving_log_site; /*per canceller, so that a starvation is not hidden by the ones of the others*/
+	MSEcService *service;
+	MSEcServiceJob job;
+	MSQueue job_frames; /*the echo and reference frames given to the job, one block per frame*/
+	MSQueue job_outputs; /*the blocks receiving the job results*/
 	int framesize;
 	int framesize_at_8000;
 	int filterlength;
 	int samplerate;
 	int delay_ms;
 	int tail_length_ms;
-	int nominal_ref_samples;
-	int min_ref_samples;
-	MSAudioFlowController afc;
-	uint64_t flow_control_time;
 	char *state_str;
 #ifdef EC_DUMP
 	FILE *echofile;
@@ -75,15 +90,14 @@ typedef struct SpeexECState{
 	bool_t echostarted;
 	bool_t bypass_mode;
 	bool_t using_zeroes;
+	bool_t async;
 }SpeexECState;
 
 static void speex_ec_init(MSFilter *f){
 	SpeexECState *s=ms_new0(SpeexECState,1);
 
 	s->samplerate=8000;
-	ms_bufferizer_init(&s->delayed_ref);
 	ms_bufferizer_init(&s->echo);
-	ms_bufferizer_init(&s->ref);
 	s->delay_ms=0;
 	s->tail_length_ms=250;
 	s->ecstate=NULL;
@@ -93,6 +107,8 @@ static void speex_ec_init(MSFilter *f){
 	s->using_zeroes=FALSE;
 	s->echostarted=FALSE;
 	s->bypass_mode=FALSE;
+	ms_queue_init(&s->job_frames);
+	ms_queue_init(&s->job_outputs);
 
 #ifdef EC_DUMP
 	{
@@ -114,7 +130,8 @@ static void speex_ec_init(MSFilter *f){
 static void speex_ec_uninit(MSFilter *f){
 	SpeexECState *s=(SpeexECState*)f->data;
 	if (s->state_str) ms_free(s->state_str);
-	ms_bufferizer_uninit(&s->delayed_ref);
+	ms_bufferizer_uninit(&s->echo);
+	if (s->service) ms_ec_service_unref(s->service);
 #ifdef EC_DUMP
 	if (s->echofile)
 		fclose(s->echofile);
@@ -188,7 +205,6 @@ static int adjust_framesize(int framesize, int samplerate){
 static void speex_ec_preprocess(MSFilter *f){
 	SpeexECState *s=(SpeexECState*)f->data;
 	int delay_samples=0;
-	mblk_t *m;
 
 	s->echostarted=FALSE;
 	s->filterlength=(s->tail_length_ms*s->samplerate)/1000;
@@ -201,14 +217,19 @@ static void speex_ec_preprocess(MSFilter *f){
 	s->den = speex_preprocess_state_init(s->framesize, s->samplerate);
 	speex_echo_ctl(s->ecstate, SPEEX_ECHO_SET_SAMPLING_RATE, &s->samplerate);
 	speex_preprocess_ctl(s->den, SPEEX_PREPROCESS_SET_ECHO_STATE, s->ecstate);
-	/* fill with zeroes for the time of the delay*/
-	m=allocb(delay_samples*2,0);
-	m->b_wptr+=delay_samples*2;
-	ms_bufferizer_put (&s->delayed_ref,m);
-	s->min_ref_samples=-1;
-	s->nominal_ref_samples=delay_samples;
-	ms_audio_flow_controller_init(&s->afc);
-	s->flow_control_time = f->ticker->time;
+	/*the reference is read one frame behind the configured delay, to absorb the jitter of its arrival*/
+	s->nominal_lag=delay_samples+s->framesize;
+	s->ref_ring_size=1;
+	while(s->ref_ring_size<s->nominal_lag+2*s->samplerate) s->ref_ring_size<<=1;
+	s->ref_ring=ms_new0(int16_t,s->ref_ring_size);
+	s->skew=1;
+	s->logged_skew=1;
+	s->ref_step=1;
+	s->ref_total=0;
+	s->echo_total=0;
+	s->min_lag=-1;
+	s->skew_time=f->ticker->time;
+	msgb_allocator_init(&s->allocator);
 #ifdef SPEEX_ECHO_GET_BLOB
 	apply_config(s);
 #else
@@ -216,17 +237,119 @@ static void speex_ec_preprocess(MSFilter *f){
 #endif
 }
 
+static void ref_ring_write(SpeexECState *s, const int16_t *samples, int nsamples){
+	int mask=s->ref_ring_size-1;
+	int pos=(int)(s->ref_written & mask);
+	int first=MIN(nsamples,s->ref_ring_size-pos);
+
+	memcpy(s->ref_ring+pos,samples,first*2);
+	memcpy(s->ref_ring,samples+first,(nsamples-first)*2);
+	s->ref_written+=nsamples;
+}
+
+/*reads nsamples of reference, resampled by ref_step with a linear interpolation. Returns FALSE if not enough reference was received.*/
+static bool_t ref_ring_read(SpeexECState *s, int16_t *samples, int nsamples){
+	int mask=s->ref_ring_size-1;
+	double pos=s->ref_read_pos;
+	int i;
+
+	if ((uint64_t)(pos+s->ref_step*(nsamples-1))+1>=s->ref_written) return FALSE;
+	for(i=0;i<nsamples;++i){
+		uint64_t ipos=(uint64_t)pos;
+		int frac=(int)((pos-ipos)*32768);
+		int a=s->ref_ring[ipos & mask];
+		int b=s->ref_ring[(ipos+1) & mask];
+		samples[i]=(int16_t)(a+(((b-a)*frac)>>15));
+		pos+=s->ref_step;
+	}
+	s->ref_read_pos=pos;
+	return TRUE;
+}
+
+/*
+ * The rates of the reference and echo signals are both measured on the ticker clock: their ratio is the clock skew
+ * between the playback and capture devices. The reference is resampled by this ratio, plus a small correction
+ * bringing the lag between the reference received and the reference used back to its nominal value.
+ */
+static void update_skew(SpeexECState *s){
+	double measured=s->ref_total/s->echo_total;
+	double correction=0;
+
+	if (measured>1-max_skew && measured<1+max_skew) s->skew=measured;
+	if (s->min_lag!=-1){
+		/*absorb the lag error in five intervals*/
+		correction=(double)(s->min_lag-s->nominal_lag)/((double)s->samplerate*skew_interval_ms*5/1000);
+	}
+	s->ref_step=MIN(MAX(s->skew+correction,1-max_skew),1+max_skew);
+	if (s->echo_total>(double)skew_history_s*s->samplerate){
+		s->ref_total/=2;
+		s->echo_total/=2;
+	}
+	if (fabs(s->skew-s->logged_skew)>=skew_log_threshold){
+		ms_message("echo canceller: skew=%f, min lag=%i samples (nominal %i), reading reference at %f",
+			s->skew,s->min_lag,s->nominal_lag,s->ref_step);
+		s->logged_skew=s->skew;
+	}else{
+		ms_debug("echo canceller: skew=%f, min lag=%i samples (nominal %i), reading reference at %f",
+			s->skew,s->min_lag,s->nominal_lag,s->ref_step);
+	}
+	s->min_lag=-1;
+}
+
+static void speex_ec_cancel(SpeexECState *s, const int16_t *echo, const int16_t *ref, int16_t *out){
+#ifdef EC_DUMP
+	if (s->reffile)
+		fwrite(ref,s->framesize*2,1,s->reffile);
+	if (s->echofile)
+		fwrite(echo,s->framesize*2,1,s->echofile);
+#endif
+	speex_echo_cancellation(s->ecstate,echo,ref,out);
+	speex_preprocess_run(s->den,out);
+#ifdef EC_DUMP
+	if (s->cleanfile)
+		fwrite(out,s->framesize*2,1,s->cleanfile);
+#endif
+}
+
+/*runs on a worker thread of the echo canceller service*/
+static void speex_ec_run_job(void *data){
+	SpeexECState *s=(SpeexECState*)data;
+	queue_t *frames=&s->job_frames.q;
+	queue_t *outputs=&s->job_outputs.q;
+	mblk_t *im,*om;
+
+	for(im=qbegin(frames),om=qbegin(outputs);!qend(frames,im);im=qnext(frames,im),om=qnext(outputs,om)){
+		const int16_t *echo=(const int16_t*)im->b_rptr;
+		speex_ec_cancel(s,echo,echo+s->framesize,(int16_t*)om->b_rptr);
+	}
+}
+
+/*delivers the frames processed by the workers during the previous tick*/
+static void speex_ec_collect(MSFilter *f){
+	SpeexECState *s=(SpeexECState*)f->data;
+	mblk_t *m;
+
+	/*the service may have been released since the job was submitted, the job is then already completed*/
+	if (s->service) ms_ec_service_wait(s->service,&s->job);
+	ms_queue_flush(&s->job_frames);
+	while((m=ms_queue_get(&s->job_outputs))!=NULL){
+		ms_queue_put(f->outputs[1],m);
+	}
+}
+
 /*	inputs[0]= reference signal from far end (sent to soundcard)
  *	inputs[1]= near speech & echo signal	(read from soundcard)
  *	outputs[0]=  is a copy of inputs[0] to be sent to soundcard
  *	outputs[1]=  near end speech, echo removed - towards far end
 */
-static void speex_ec_process(MSFilter *f){
+static void speex_ec_process_frames(MSFilter *f){
 	SpeexECState *s=(SpeexECState*)f->data;
 	int nbytes=s->framesize*2;
 	mblk_t *refm;
-	uint8_t *ref,*echo;
+	int16_t *ref,*echo;
+	bool_t starving;
 	
+	speex_ec_collect(f);
 	if (s->bypass_mode) {
 		while((refm=ms_queue_get(f->inputs[0]))!=NULL){
 			ms_queue_put(f->outputs[0],refm);
@@ -238,103 +361,101 @@ static void speex_ec_process(MSFilter *f){
 	}
 	
 	if (f->inputs[0]!=NULL){
-		if (s->echostarted){
-			while((refm=ms_queue_get(f->inputs[0]))!=NULL){
-				refm=ms_audio_flow_controller_process(&s->afc,refm);
-				if (refm){
-					mblk_t *cp=dupmsg(refm);
-					ms_bufferizer_put(&s->delayed_ref,cp);
-					ms_bufferizer_put(&s->ref,refm);
-				}
+		/*the reference goes to the soundcard untouched, only its samples are kept for the canceller*/
+		while((refm=ms_queue_get(f->inputs[0]))!=NULL){
+			if (s->echostarted){
+				int nsamples=(int)(refm->b_wptr-refm->b_rptr)/2;
+				ref_ring_write(s,(int16_t*)refm->b_rptr,nsamples);
+				s->ref_total+=nsamples;
 			}
-		}else{
-			ms_warning("Getting reference signal but no echo to synchronize on.");
-			ms_queue_flush(f->inputs[0]);
+			ms_queue_put(f->outputs[0],refm);
 		}
 	}
 
 	ms_bufferizer_put_from_queue(&s->echo,f->inputs[1]);
 	
-	ref=(uint8_t*)alloca(nbytes);
-	echo=(uint8_t*)alloca(nbytes);
-	while (ms_bufferizer_read(&s->echo,echo,nbytes)==nbytes){
-		mblk_t *oecho=allocb(nbytes,0);
-		int avail;
-		int avail_samples;
-
-		if (!s->echostarted) s->echostarted=TRUE;
-		if ((avail=ms_bufferizer_get_avail(&s->delayed_ref))<((s->nominal_ref_samples*2)+nbytes)){
-			/*we don't have enough to read in a reference signal buffer, inject silence instead*/
-			avail=nbytes;
-			refm=allocb(nbytes,0);
-			memset(refm->b_wptr,0,nbytes);
-			refm->b_wptr+=nbytes;
-			ms_bufferizer_put(&s->delayed_ref,refm);
-			ms_queue_put(f->outputs[0],dupmsg(refm));
-			if (!s->using_zeroes){
-				ms_warning("Not enough ref samples, using zeroes");
-				s->using_zeroes=TRUE;
-			}
-		}else{
-			if (s->using_zeroes){
-				ms_message("Samples are back.");
-				s->using_zeroes=FALSE;
-			}
-			/* read from our no-delay buffer and output */
-			refm=allocb(nbytes,0);
-			if (ms_bufferizer_read(&s->ref,refm->b_wptr,nbytes)==0){
-				ms_fatal("Should never happen");
-			}
-			refm->b_wptr+=nbytes;
-			ms_queue_put(f->outputs[0],refm);
+	ref=(int16_t*)alloca(nbytes);
+	echo=(int16_t*)alloca(nbytes);
+	while (ms_bufferizer_get_avail(&s->echo)>=nbytes){
+		mblk_t *oecho=msgb_allocator_alloc(&s->allocator,nbytes);
+		mblk_t *frame=NULL;
+		int lag;
+
+		if (s->async){
+			/*the echo and reference are kept side by side until a worker processes them*/
+			frame=msgb_allocator_alloc(&s->allocator,2*nbytes);
+			echo=(int16_t*)frame->b_rptr;
+			ref=echo+s->framesize;
 		}
+		ms_bufferizer_read(&s->echo,(uint8_t*)echo,nbytes);
 
-		/*now read a valid buffer of delayed ref samples*/
-		if (ms_bufferizer_read(&s->delayed_ref,ref,nbytes)==0){
-			ms_fatal("Should never happen");
+		if (!s->echostarted){
+			/*start with the nominal lag of silence*/
+			s->echostarted=TRUE;
+			s->ref_written=s->nominal_lag;
+			s->ref_read_pos=0;
 		}
-		avail-=nbytes;
-		avail_samples=avail/2;
-		/*ms_message("avail=%i",avail_samples);*/
-		if (avail_samples<s->min_ref_samples || s->min_ref_samples==-1){
-			s->min_ref_samples=avail_samples;
+		s->echo_total+=s->framesize;
+		lag=(int)(s->ref_written-(uint64_t)s->ref_read_pos);
+		if (lag<s->min_lag || s->min_lag==-1) s->min_lag=lag;
+		if (lag>s->ref_ring_size-2*s->framesize){
+			ms_warning("echo canceller: reference too far ahead (%i samples), resynchronizing",lag);
+			s->ref_read_pos=(double)(s->ref_written-s->nominal_lag);
 		}
-		
-#ifdef EC_DUMP
-		if (s->reffile)
-			fwrite(ref,nbytes,1,s->reffile);
-		if (s->echofile)
-			fwrite(echo,nbytes,1,s->echofile);
-#endif
-		speex_echo_cancellation(s->ecstate,(short*)echo,(short*)ref,(short*)oecho->b_wptr);
-		speex_preprocess_run(s->den, (short*)oecho->b_wptr);
-#ifdef EC_DUMP
-		if (s->cleanfile)
-			fwrite(oecho->b_wptr,nbytes,1,s->cleanfile);
-#endif
+		starving=!ref_ring_read(s,ref,s->framesize);
+		if (starving){
+			/*the playback is starving too: the reference is paused until it comes back*/
+			memset(ref,0,nbytes);
+		}
+		if (starving!=s->using_zeroes){
+			s->using_zeroes=starving;
+			/*a single site keyed by the state, so that a starvation and its end are never reported apart*/
+			ms_log_with_site(&s->starving_log_site,ORTP_WARNING,starving,0,
+				starving ? "Not enough ref samples, using zeroes" : "Samples are back.");
+		}
+
 		oecho->b_wptr+=nbytes;
-		ms_queue_put(f->outputs[1],oecho);
+		if (frame!=NULL){
+			frame->b_wptr+=2*nbytes;
+			ms_queue_put(&s->job_frames,frame);
+			ms_queue_put(&s->job_outputs,oecho);
+		}else{
+			speex_ec_cancel(s,echo,ref,(int16_t*)oecho->b_rptr);
+			ms_queue_put(f->outputs[1],oecho);
+		}
+	}
+	if (!ms_queue_empty(&s->job_frames)){
+		/*the cancelled frames are output on next tick, the jobs of all the echo cancellers of the ticker run meanwhile*/
+		s->job.func=speex_ec_run_job;
+		s->job.data=s;
+		ms_ec_service_submit(s->service,&s->job);
 	}
 	
-	/*verify our ref buffer does not become too big, meaning that we are receiving more samples than we are sending*/
-	if ((((uint32_t)(f->ticker->time - s->flow_control_time)) >= flow_control_interval_ms) && (s->min_ref_samples != -1)) {
-		int diff=s->min_ref_samples-s->nominal_ref_samples;
-		if (diff>(nbytes/2)){
-			int purge=diff-(nbytes/2);
-			ms_warning("echo canceller: we are accumulating too much reference signal, need to throw out %i samples",purge);
-			ms_audio_flow_controller_set_target(&s->afc,purge,(flow_control_interval_ms*s->samplerate)/1000);
-		}
-		s->min_ref_samples=-1;
-		s->flow_control_time = f->ticker->time;
+	if (s->echostarted && ((uint32_t)(f->ticker->time - s->skew_time)) >= skew_interval_ms && s->echo_total>0) {
+		update_skew(s);
+		s->skew_time = f->ticker->time;
 	}
 }
 
+static void speex_ec_process(MSFilter *f){
+	/*the lock keeps the canceller state away from speex_ec_get_state() while a job runs on a worker*/
+	ms_filter_lock(f);
+	speex_ec_process_frames(f);
+	ms_filter_unlock(f);
+}
+
 static void speex_ec_postprocess(MSFilter *f){
 	SpeexECState *s=(SpeexECState*)f->data;
 
-	ms_bufferizer_flush (&s->delayed_ref);
+	if (s->service) ms_ec_service_wait(s->service,&s->job);
+	ms_queue_flush(&s->job_frames);
+	ms_queue_flush(&s->job_outputs);
 	ms_bufferizer_flush (&s->echo);
-	ms_bufferizer_flush (&s->ref);
+	msgb_allocator_uninit(&s->allocator);
+	if (s->ref_ring!=NULL){
+		ms_free(s->ref_ring);
+		s->ref_ring=NULL;
+	}
 	if (s->ecstate!=NULL){
 		speex_echo_state_destroy(s->ecstate);
 		s->ecstate=NULL;
@@ -380,6 +501,32 @@ static int speex_ec_get_bypass_mode(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int speex_ec_enable_async(MSFilter *f, void *arg){
+	SpeexECState *s=(SpeexECState*)f->data;
+	bool_t enabled=*(bool_t*)arg;
+
+	ms_filter_lock(f);
+	if (enabled && s->service==NULL) s->service=ms_ec_service_ref();
+	else if (!enabled && s->service!=NULL){
+		/*the output of the last job is delivered on next tick by speex_ec_collect()*/
+		ms_ec_service_wait(s->service,&s->job);
+		ms_ec_service_unref(s->service);
+		s->service=NULL;
+	}
+	s->async=enabled;
+	ms_filter_unlock(f);
+	ms_message("MSSpeexEC[%p]: asynchronous processing %s",f,enabled ? "enabled" : "disabled");
+	return 0;
+}
+
+static int speex_ec_get_skew(MSFilter *f, void *arg){
+	SpeexECState *s=(SpeexECState*)f->data;
+	ms_filter_lock(f);
+	*(float*)arg=(float)s->skew;
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static int speex_ec_set_state(MSFilter *f, void *arg){
 	SpeexECState *s=(SpeexECState*)f->data;
 	s->state_str=ms_strdup((const char*)arg);
@@ -389,7 +536,10 @@ static int speex_ec_set_state(MSFilter *f, void *arg){
 static int speex_ec_get_state(MSFilter *f, void *arg){
 	SpeexECState *s=(SpeexECState*)f->data;
 #ifdef SPEEX_ECHO_GET_BLOB
+	ms_filter_lock(f);
+	if (s->service) ms_ec_service_wait(s->service,&s->job);
 	fetch_config(s);
+	ms_filter_unlock(f);
 #endif
 	*(char**)arg=s->state_str;
 	return 0;
@@ -404,6 +554,8 @@ static MSFilterMethod speex_ec_methods[]={
 	{	MS_ECHO_CANCELLER_GET_BYPASS_MODE	,	speex_ec_get_bypass_mode	},
 	{	MS_ECHO_CANCELLER_GET_STATE_STRING	,	speex_ec_get_state		},
 	{	MS_ECHO_CANCELLER_SET_STATE_STRING	,	speex_ec_set_state		},
+	{	MS_ECHO_CANCELLER_ENABLE_ASYNC		,	speex_ec_enable_async		},
+	{	MS_ECHO_CANCELLER_GET_SKEW		,	speex_ec_get_skew		},
 	{	0, 0 }
 };
 
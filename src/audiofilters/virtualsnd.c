@@ -0,0 +1,519 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#if defined(HAVE_CONFIG_H)
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msvirtualsnd.h"
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+#include "waveheader.h"
+
+#include <math.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*the device starts playing once that many periods are buffered, and drops what exceeds its buffer*/
+#define VIRTUAL_START_PERIODS 2
+#define VIRTUAL_BUFFER_PERIODS 20
+
+/*shared by the card and its filters, which may outlive it*/
+typedef struct _VirtualCard{
+	MSVirtualSndCardParams params;
+	int16_t *capture_samples; /*interleaved frames of the capture file*/
+	int capture_frames;
+	int refcount;
+	ms_mutex_t lock;
+} VirtualCard;
+
+static VirtualCard *virtual_card_ref(VirtualCard *vc){
+	ms_mutex_lock(&vc->lock);
+	vc->refcount++;
+	ms_mutex_unlock(&vc->lock);
+	return vc;
+}
+
+static void virtual_card_unref(VirtualCard *vc){
+	int refcount;
+	ms_mutex_lock(&vc->lock);
+	refcount=--vc->refcount;
+	ms_mutex_unlock(&vc->lock);
+	if (refcount>0) return;
+	if (vc->params.capture_file) ms_free((char*)vc->params.capture_file);
+	if (vc->params.playback_file) ms_free((char*)vc->params.playback_file);
+	if (vc->capture_samples) ms_free(vc->capture_samples);
+	ms_mutex_destroy(&vc->lock);
+	ms_free(vc);
+}
+
+void ms_virtual_snd_card_params_init(MSVirtualSndCardParams *params){
+	memset(params, 0, sizeof(*params));
+	params->sample_rate=16000;
+	params->nchannels=1;
+	params->period=10;
+	params->tone_frequency=440;
+	params->tone_amplitude=0.3f;
+	params->seed=1;
+}
+
+/*the ratio between the card clock and the ticker clock*/
+static double virtual_card_clock_ratio(const VirtualCard *vc){
+	return 1.0 + vc->params.clock_skew / 1e6;
+}
+
+static int virtual_card_period_frames(const VirtualCard *vc){
+	return vc->params.sample_rate * vc->params.period / 1000;
+}
+
+static void virtual_card_load_capture_file(VirtualCard *vc){
+	wave_header_t header;
+	struct stat st;
+	int fd;
+	int hsize;
+	int nbytes;
+
+	if ((fd=open(vc->params.capture_file,O_RDONLY|O_BINARY))==-1){
+		ms_error("Virtual sound card: cannot open %s: %s",vc->params.capture_file,strerror(errno));
+		return;
+	}
+	hsize=ms_read_wav_header_from_fd(&header,fd);
+	if (hsize<=0 || fstat(fd,&st)!=0 || wave_header_get_bpsmpl(&header)!=2*wave_header_get_channel(&header)){
+		ms_error("Virtual sound card: %s is not a 16 bits wav file",vc->params.capture_file);
+		close(fd);
+		return;
+	}
+	if ((int)wave_header_get_rate(&header)!=vc->params.sample_rate || wave_header_get_channel(&header)!=vc->params.nchannels){
+		ms_warning("Virtual sound card: %s is at %iHz with %i channels, it is captured as is at %iHz with %i channels",
+			vc->params.capture_file,wave_header_get_rate(&header),wave_header_get_channel(&header),
+			vc->params.sample_rate,vc->params.nchannels);
+	}
+	nbytes=(int)st.st_size-hsize;
+	nbytes-=nbytes%(2*vc->params.nchannels);
+	if (nbytes>0){
+		vc->capture_samples=(int16_t*)ms_malloc(nbytes);
+		if (read(fd,vc->capture_samples,nbytes)!=nbytes){
+			ms_error("Virtual sound card: cannot read %s",vc->params.capture_file);
+			ms_free(vc->capture_samples);
+			vc->capture_samples=NULL;
+		}else{
+#ifdef WORDS_BIGENDIAN
+			int i;
+			for(i=0;i<nbytes/2;i++) vc->capture_samples[i]=(int16_t)le_uint16((uint16_t)vc->capture_samples[i]);
+#endif
+			vc->capture_frames=nbytes/(2*vc->params.nchannels);
+		}
+	}
+	close(fd);
+}
+
+static void virtual_card_set_params(MSSndCard *card, const MSVirtualSndCardParams *params){
+	VirtualCard *vc=(VirtualCard*)card->data;
+	vc->params=*params;
+	if (vc->params.period<=0) vc->params.period=10;
+	if (vc->params.nchannels<=0) vc->params.nchannels=1;
+	vc->params.capture_file=params->capture_file ? ms_strdup(params->capture_file) : NULL;
+	vc->params.playback_file=params->playback_file ? ms_strdup(params->playback_file) : NULL;
+	if (vc->params.capture_file) virtual_card_load_capture_file(vc);
+}
+
+static void virtual_card_init(MSSndCard *card){
+	VirtualCard *vc=ms_new0(VirtualCard,1);
+	ms_mutex_init(&vc->lock,NULL);
+	vc->refcount=1;
+	card->data=vc;
+}
+
+static void virtual_card_uninit(MSSndCard *card){
+	virtual_card_unref((VirtualCard*)card->data);
+}
+
+static void virtual_card_detect(MSSndCardManager *m){
+	MSVirtualSndCardParams params;
+	ms_virtual_snd_card_params_init(&params);
+	ms_snd_card_manager_add_card(m,ms_virtual_snd_card_new("Virtual",&params));
+}
+
+static MSSndCard *virtual_card_duplicate(MSSndCard *card){
+	return ms_virtual_snd_card_new(card->name,&((VirtualCard*)card->data)->params);
+}
+
+static MSFilter *virtual_card_create_reader(MSSndCard *card);
+static MSFilter *virtual_card_create_writer(MSSndCard *card);
+
+#ifdef _MSC_VER
+
+MSSndCardDesc ms_virtual_snd_card_desc={
+	"Virtual",
+	virtual_card_detect,
+	virtual_card_init,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	virtual_card_create_reader,
+	virtual_card_create_writer,
+	virtual_card_uninit,
+	virtual_card_duplicate
+};
+
+#else
+
+MSSndCardDesc ms_virtual_snd_card_desc={
+	.driver_type="Virtual",
+	.detect=virtual_card_detect,
+	.init=virtual_card_init,
+	.create_reader=virtual_card_create_reader,
+	.create_writer=virtual_card_create_writer,
+	.uninit=virtual_card_uninit,
+	.duplicate=virtual_card_duplicate
+};
+
+#endif
+
+MSSndCard *ms_virtual_snd_card_new(const char *name, const MSVirtualSndCardParams *params){
+	MSSndCard *card=ms_snd_card_new_with_name(&ms_virtual_snd_card_desc,name);
+	virtual_card_set_params(card,params);
+	card->preferred_sample_rate=params->sample_rate;
+	card->latency=VIRTUAL_START_PERIODS*params->period;
+	return card;
+}
+
+
+typedef struct _VirtualRead{
+	VirtualCard *card; /*first, so that the methods common to both filters find it*/
+	uint64_t start_time;
+	uint64_t next_delivery; /*ticker time of the next period delivery, relative to start_time*/
+	uint64_t periods;
+	int pos; /*in the capture file, in frames*/
+	double phase;
+	unsigned int seed;
+} VirtualRead;
+
+static void virtual_read_init(MSFilter *f){
+	f->data=ms_new0(VirtualRead,1);
+}
+
+static void virtual_read_uninit(MSFilter *f){
+	VirtualRead *d=(VirtualRead*)f->data;
+	virtual_card_unref(d->card);
+	ms_free(d);
+}
+
+static void virtual_read_preprocess(MSFilter *f){
+	VirtualRead *d=(VirtualRead*)f->data;
+	d->start_time=f->ticker->time;
+	d->periods=0;
+	d->next_delivery=(uint64_t)(d->card->params.period/virtual_card_clock_ratio(d->card));
+	d->seed=d->card->params.seed;
+}
+
+static void virtual_read_fill(VirtualRead *d, int16_t *samples, int nframes){
+	const MSVirtualSndCardParams *p=&d->card->params;
+	int i,c;
+
+	if (d->card->capture_samples){
+		for(i=0;i<nframes;i++){
+			memcpy(samples+i*p->nchannels,d->card->capture_samples+d->pos*p->nchannels,2*p->nchannels);
+			if (++d->pos==d->card->capture_frames) d->pos=0;
+		}
+	}else if (p->tone_frequency>0){
+		double step=2*M_PI*p->tone_frequency/p->sample_rate;
+		double amplitude=32767*p->tone_amplitude;
+		for(i=0;i<nframes;i++){
+			int16_t v=(int16_t)(amplitude*sin(d->phase));
+			for(c=0;c<p->nchannels;c++) samples[i*p->nchannels+c]=v;
+			d->phase+=step;
+			if (d->phase>2*M_PI) d->phase-=2*M_PI;
+		}
+	}else memset(samples,0,nframes*2*p->nchannels);
+}
+
+/* Each period is delivered once the card clock reaches its end, late by a random part of the jitter. */
+static void virtual_read_process(MSFilter *f){
+	VirtualRead *d=(VirtualRead*)f->data;
+	const MSVirtualSndCardParams *p=&d->card->params;
+	int period_frames=virtual_card_period_frames(d->card);
+	double ratio=virtual_card_clock_ratio(d->card);
+	uint64_t now=f->ticker->time-d->start_time;
+
+	while (d->next_delivery<=now){
+		mblk_t *om=allocb(period_frames*2*p->nchannels,0);
+		virtual_read_fill(d,(int16_t*)om->b_wptr,period_frames);
+		om->b_wptr+=period_frames*2*p->nchannels;
+		ms_queue_put(f->outputs[0],om);
+		d->periods++;
+		d->next_delivery=(uint64_t)((d->periods+1)*p->period/ratio);
+		if (p->jitter>0){
+			d->seed=d->seed*1103515245+12345;
+			d->next_delivery+=(d->seed>>16)%(p->jitter+1);
+		}
+	}
+}
+
+static int virtual_get_sample_rate(MSFilter *f, void *arg){
+	VirtualCard **vc=(VirtualCard**)f->data;
+	*(int*)arg=(*vc)->params.sample_rate;
+	return 0;
+}
+
+/*like a real device, the card only works at its own rate*/
+static int virtual_set_sample_rate(MSFilter *f, void *arg){
+	VirtualCard **vc=(VirtualCard**)f->data;
+	return *(int*)arg==(*vc)->params.sample_rate ? 0 : -1;
+}
+
+static int virtual_get_nchannels(MSFilter *f, void *arg){
+	VirtualCard **vc=(VirtualCard**)f->data;
+	*(int*)arg=(*vc)->params.nchannels;
+	return 0;
+}
+
+static int virtual_set_nchannels(MSFilter *f, void *arg){
+	VirtualCard **vc=(VirtualCard**)f->data;
+	return *(int*)arg==(*vc)->params.nchannels ? 0 : -1;
+}
+
+static MSFilterMethod virtual_read_methods[]={
+	{	MS_FILTER_GET_SAMPLE_RATE	,	virtual_get_sample_rate	},
+	{	MS_FILTER_SET_SAMPLE_RATE	,	virtual_set_sample_rate	},
+	{	MS_FILTER_GET_NCHANNELS	,	virtual_get_nchannels	},
+	{	MS_FILTER_SET_NCHANNELS	,	virtual_set_nchannels	},
+	{	0	,	NULL	}
+};
+
+#ifdef _MSC_VER
+
+static MSFilterDesc virtual_read_desc={
+	MS_VIRTUAL_SND_READ_ID,
+	"MSVirtualSndRead",
+	"Sound capture of a virtual sound card",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	1,
+	virtual_read_init,
+	virtual_read_preprocess,
+	virtual_read_process,
+	NULL,
+	virtual_read_uninit,
+	virtual_read_methods
+};
+
+#else
+
+static MSFilterDesc virtual_read_desc={
+	.id=MS_VIRTUAL_SND_READ_ID,
+	.name="MSVirtualSndRead",
+	.text="Sound capture of a virtual sound card",
+	.category=MS_FILTER_OTHER,
+	.ninputs=0,
+	.noutputs=1,
+	.init=virtual_read_init,
+	.preprocess=virtual_read_preprocess,
+	.process=virtual_read_process,
+	.uninit=virtual_read_uninit,
+	.methods=virtual_read_methods
+};
+
+#endif
+
+
+typedef struct _VirtualWrite{
+	VirtualCard *card; /*first, as for VirtualRead*/
+	MSBufferizer buffer;
+	uint8_t *period_buf;
+	uint64_t start_time;
+	uint64_t played; /*frames since start_time*/
+	int fd;
+	int size;
+	bool_t started;
+	MSAudioXrunStats xruns;
+} VirtualWrite;
+
+static void virtual_write_init(MSFilter *f){
+	VirtualWrite *d=ms_new0(VirtualWrite,1);
+	ms_bufferizer_init(&d->buffer);
+	d->fd=-1;
+	f->data=d;
+}
+
+static void virtual_write_uninit(MSFilter *f){
+	VirtualWrite *d=(VirtualWrite*)f->data;
+	ms_bufferizer_uninit(&d->buffer);
+	if (d->period_buf) ms_free(d->period_buf);
+	virtual_card_unref(d->card);
+	ms_free(d);
+}
+
+static void virtual_write_wav_header(VirtualWrite *d){
+	const MSVirtualSndCardParams *p=&d->card->params;
+	wave_header_t header;
+	memcpy(&header.riff_chunk.riff,"RIFF",4);
+	header.riff_chunk.len=le_uint32(d->size+32);
+	memcpy(&header.riff_chunk.wave,"WAVE",4);
+	memcpy(&header.format_chunk.fmt,"fmt ",4);
+	header.format_chunk.len=le_uint32(0x10);
+	header.format_chunk.type=le_uint16(0x1);
+	header.format_chunk.channel=le_uint16(p->nchannels);
+	header.format_chunk.rate=le_uint32(p->sample_rate);
+	header.format_chunk.bps=le_uint32(p->sample_rate*2*p->nchannels);
+	header.format_chunk.blockalign=le_uint16(2*p->nchannels);
+	header.format_chunk.bitpspl=le_uint16(16);
+	memcpy(&header.data_chunk.data,"data",4);
+	header.data_chunk.len=le_uint32(d->size);
+	lseek(d->fd,0,SEEK_SET);
+	if (write(d->fd,&header,sizeof(header))!=sizeof(header)){
+		ms_warning("Virtual sound card: fail to write wav header.");
+	}
+}
+
+static void virtual_write_preprocess(MSFilter *f){
+	VirtualWrite *d=(VirtualWrite*)f->data;
+	const MSVirtualSndCardParams *p=&d->card->params;
+	if (d->period_buf==NULL) d->period_buf=ms_malloc(virtual_card_period_frames(d->card)*2*p->nchannels);
+	d->started=FALSE;
+	if (p->playback_file){
+		d->fd=open(p->playback_file,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,S_IRUSR|S_IWUSR);
+		if (d->fd==-1){
+			ms_error("Virtual sound card: cannot open %s: %s",p->playback_file,strerror(errno));
+		}else{
+			d->size=0;
+			virtual_write_wav_header(d);
+		}
+	}
+}
+
+static void virtual_write_postprocess(MSFilter *f){
+	VirtualWrite *d=(VirtualWrite*)f->data;
+	if (d->fd!=-1){
+		virtual_write_wav_header(d);
+		close(d->fd);
+		d->fd=-1;
+	}
+	ms_bufferizer_flush(&d->buffer);
+}
+
+/* Consumes a period of samples each time the card clock reaches its end. Running out of samples
+stops the card until it is filled up again, as a real device does after an underrun. */
+static void virtual_write_process(MSFilter *f){
+	VirtualWrite *d=(VirtualWrite*)f->data;
+	const MSVirtualSndCardParams *p=&d->card->params;
+	int period_frames=virtual_card_period_frames(d->card);
+	int period_bytes=period_frames*2*p->nchannels;
+	int avail;
+
+	ms_bufferizer_put_from_queue(&d->buffer,f->inputs[0]);
+	avail=(int)ms_bufferizer_get_avail(&d->buffer);
+	if (avail>VIRTUAL_BUFFER_PERIODS*period_bytes){
+		ms_bufferizer_skip_bytes(&d->buffer,avail-VIRTUAL_BUFFER_PERIODS*period_bytes);
+		d->xruns.overruns++;
+	}
+	if (!d->started){
+		if (ms_bufferizer_get_avail(&d->buffer)<(size_t)(VIRTUAL_START_PERIODS*period_bytes)) return;
+		d->started=TRUE;
+		d->start_time=f->ticker->time;
+		d->played=0;
+	}
+	while ((d->played+period_frames)*1000<=(uint64_t)((f->ticker->time-d->start_time)*virtual_card_clock_ratio(d->card)*p->sample_rate)){
+		if (ms_bufferizer_read(&d->buffer,d->period_buf,period_bytes)!=period_bytes){
+			d->xruns.underruns++;
+			d->started=FALSE;
+			break;
+		}
+		d->played+=period_frames;
+		if (d->fd!=-1){
+			if (write(d->fd,d->period_buf,period_bytes)==period_bytes) d->size+=period_bytes;
+			else ms_warning("Virtual sound card: fail to write %s",p->playback_file);
+		}
+	}
+}
+
+static int virtual_write_get_xrun_stats(MSFilter *f, void *arg){
+	VirtualWrite *d=(VirtualWrite*)f->data;
+	*(MSAudioXrunStats*)arg=d->xruns;
+	return 0;
+}
+
+static MSFilterMethod virtual_write_methods[]={
+	{	MS_FILTER_GET_SAMPLE_RATE	,	virtual_get_sample_rate	},
+	{	MS_FILTER_SET_SAMPLE_RATE	,	virtual_set_sample_rate	},
+	{	MS_FILTER_GET_NCHANNELS	,	virtual_get_nchannels	},
+	{	MS_FILTER_SET_NCHANNELS	,	virtual_set_nchannels	},
+	{	MS_AUDIO_PLAYBACK_GET_XRUN_STATS	,	virtual_write_get_xrun_stats	},
+	{	0	,	NULL	}
+};
+
+#ifdef _MSC_VER
+
+static MSFilterDesc virtual_write_desc={
+	MS_VIRTUAL_SND_WRITE_ID,
+	"MSVirtualSndWrite",
+	"Sound playback of a virtual sound card",
+	MS_FILTER_OTHER,
+	NULL,
+	1,
+	0,
+	virtual_write_init,
+	virtual_write_preprocess,
+	virtual_write_process,
+	virtual_write_postprocess,
+	virtual_write_uninit,
+	virtual_write_methods
+};
+
+#else
+
+static MSFilterDesc virtual_write_desc={
+	.id=MS_VIRTUAL_SND_WRITE_ID,
+	.name="MSVirtualSndWrite",
+	.text="Sound playback of a virtual sound card",
+	.category=MS_FILTER_OTHER,
+	.ninputs=1,
+	.noutputs=0,
+	.init=virtual_write_init,
+	.preprocess=virtual_write_preprocess,
+	.process=virtual_write_process,
+	.postprocess=virtual_write_postprocess,
+	.uninit=virtual_write_uninit,
+	.methods=virtual_write_methods
+};
+
+#endif
+
+static MSFilter *virtual_card_create_reader(MSSndCard *card){
+	MSFilter *f=ms_filter_new_from_desc(&virtual_read_desc);
+	((VirtualRead*)f->data)->card=virtual_card_ref((VirtualCard*)card->data);
+	return f;
+}
+
+static MSFilter *virtual_card_create_writer(MSSndCard *card){
+	MSFilter *f=ms_filter_new_from_desc(&virtual_write_desc);
+	((VirtualWrite*)f->data)->card=virtual_card_ref((VirtualCard*)card->data);
+	return f;
+}
@@ -0,0 +1,281 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msasynclog.h"
+
+#include <stdarg.h>
+
+#ifndef va_copy
+#define va_copy(dst, src) ((dst) = (src))
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define RING_SIZE 65536 /*bytes for each thread, a power of 2*/
+#define MAX_MESSAGE_SIZE (RING_SIZE / 4)
+#define LINE_SIZE 512 /*messages are formatted on the stack, longer ones are allocated*/
+#define WRITER_INTERVAL 10 /*ms*/
+
+/*
+ * Each thread writes its messages in a ring of its own, that only the writer reads: the head is only moved by the
+ * thread, the tail only by the writer, and the records are published with a release store of the head.
+ */
+#ifdef _MSC_VER
+static uint64_t load_acquire(volatile uint64_t *p) {
+	return (uint64_t)InterlockedCompareExchange64((volatile LONGLONG *)p, 0, 0);
+}
+
+static void store_release(volatile uint64_t *p, uint64_t v) {
+	InterlockedExchange64((volatile LONGLONG *)p, (LONGLONG)v);
+}
+#else
+static uint64_t load_acquire(volatile uint64_t *p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(volatile uint64_t *p, uint64_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#endif
+
+typedef struct _MSLogRecord {
+	uint32_t size; /*of the record with its header, aligned on 8 bytes*/
+	int32_t level; /*0 for the padding up to the end of the ring*/
+} MSLogRecord;
+
+typedef struct _MSLogRing {
+	char *buf;
+	volatile uint64_t head;
+	volatile uint64_t tail;
+	volatile uint64_t dropped; /*only incremented by the thread owning the ring*/
+	uint64_t reported_dropped;
+} MSLogRing;
+
+typedef struct _MSAsyncLogSink {
+	ms_mutex_t lock; /*protects the list of rings and their reading*/
+	MSList *rings;
+	OrtpLogFunc handler; /*the handler installed before the sink*/
+	ms_thread_t thread;
+	MSAsyncLogStats stats;
+	volatile bool_t run;
+	bool_t initialized;
+#ifdef _WIN32
+	DWORD key;
+#else
+	pthread_key_t key;
+#endif
+} MSAsyncLogSink;
+
+static MSAsyncLogSink sink = {0};
+
+static void call_handler(OrtpLogLevel level, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	sink.handler(level, fmt, args);
+	va_end(args);
+}
+
+static bool_t ring_write(MSLogRing *ring, OrtpLogLevel level, const char *text, size_t len) {
+	uint32_t need = (uint32_t)((sizeof(MSLogRecord) + len + 1 + 7) & ~7);
+	uint64_t head = ring->head;
+	uint64_t tail = load_acquire(&ring->tail);
+	size_t pos = head & (RING_SIZE - 1);
+	size_t contig = RING_SIZE - pos;
+	MSLogRecord *rec;
+
+	if (RING_SIZE - (head - tail) < (contig < need ? contig + need : need)) return FALSE;
+	if (contig < need) {
+		rec = (MSLogRecord *)(ring->buf + pos);
+		rec->size = (uint32_t)contig;
+		rec->level = 0;
+		head += contig;
+		pos = 0;
+	}
+	rec = (MSLogRecord *)(ring->buf + pos);
+	rec->size = need;
+	rec->level = level;
+	memcpy(rec + 1, text, len);
+	((char *)(rec + 1))[len] = '\0';
+	store_release(&ring->head, head + need);
+	return TRUE;
+}
+
+/* Gives the messages of a ring to the handler. Must be called with the lock held. */
+static void ring_drain(MSLogRing *ring) {
+	uint64_t tail = ring->tail;
+	uint64_t head = load_acquire(&ring->head);
+	uint64_t dropped;
+
+	while (tail < head) {
+		MSLogRecord *rec = (MSLogRecord *)(ring->buf + (tail & (RING_SIZE - 1)));
+		if (rec->level != 0) {
+			call_handler(rec->level, "%s", (const char *)(rec + 1));
+			sink.stats.written++;
+		}
+		tail += rec->size;
+	}
+	store_release(&ring->tail, tail);
+	dropped = ring->dropped;
+	if (dropped != ring->reported_dropped) {
+		sink.stats.dropped += dropped - ring->reported_dropped;
+		if (ortp_log_level_enabled(ORTP_WARNING)) {
+			call_handler(ORTP_WARNING, "MSAsyncLog: %u messages dropped by a thread logging too fast",
+				(unsigned int)(dropped - ring->reported_dropped));
+		}
+		ring->reported_dropped = dropped;
+	}
+}
+
+static void ring_destroy(MSLogRing *ring) {
+	ms_free(ring->buf);
+	ms_free(ring);
+}
+
+/* Called when a thread exits, with its ring. */
+static void ring_release(void *data) {
+	MSLogRing *ring = (MSLogRing *)data;
+	if (ring == NULL) return;
+	ms_mutex_lock(&sink.lock);
+	ring_drain(ring);
+	sink.rings = ms_list_remove(sink.rings, ring);
+	ms_mutex_unlock(&sink.lock);
+	ring_destroy(ring);
+}
+
+#ifdef _WIN32
+static void WINAPI ring_release_fls(void *data) {
+	ring_release(data);
+}
+#endif
+
+static MSLogRing *get_ring(void) {
+	MSLogRing *ring;
+#ifdef _WIN32
+	ring = (MSLogRing *)FlsGetValue(sink.key);
+#else
+	ring = (MSLogRing *)pthread_getspecific(sink.key);
+#endif
+	if (ring == NULL) {
+		ring = ms_new0(MSLogRing, 1);
+		ring->buf = ms_malloc(RING_SIZE);
+#ifdef _WIN32
+		FlsSetValue(sink.key, ring);
+#else
+		pthread_setspecific(sink.key, ring);
+#endif
+		ms_mutex_lock(&sink.lock);
+		sink.rings = ms_list_append(sink.rings, ring);
+		ms_mutex_unlock(&sink.lock);
+	}
+	return ring;
+}
+
+static void async_log_handler(OrtpLogLevel level, const char *fmt, va_list args) {
+	char line[LINE_SIZE];
+	char *text = line;
+	va_list copy;
+	MSLogRing *ring;
+	int len;
+
+	if (level == ORTP_FATAL) {
+		/*the process aborts when the handler returns*/
+		ms_async_log_flush();
+		sink.handler(level, fmt, args);
+		return;
+	}
+	va_copy(copy, args);
+	len = vsnprintf(line, sizeof(line), fmt, copy);
+	va_end(copy);
+	if (len < 0) return;
+	if (len >= (int)sizeof(line)) {
+		text = ortp_strdup_vprintf(fmt, args);
+		if (len > MAX_MESSAGE_SIZE) {
+			len = MAX_MESSAGE_SIZE;
+			text[len] = '\0';
+		}
+	}
+	ring = get_ring();
+	if (!ring_write(ring, level, text, len)) ring->dropped++;
+	if (text != line) ortp_free(text);
+}
+
+static void *async_log_writer_run(void *arg) {
+	while (sink.run) {
+		ms_async_log_flush();
+		ms_usleep(WRITER_INTERVAL * 1000);
+	}
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+int ms_async_log_start(void) {
+	if (sink.run || ortp_logv_out == NULL) return -1;
+	if (!sink.initialized) {
+		ms_mutex_init(&sink.lock, NULL);
+#ifdef _WIN32
+		sink.key = FlsAlloc(ring_release_fls);
+#else
+		pthread_key_create(&sink.key, ring_release);
+#endif
+		sink.initialized = TRUE;
+	}
+	sink.handler = ortp_logv_out;
+	sink.run = TRUE;
+	ms_thread_create(&sink.thread, NULL, async_log_writer_run, NULL);
+	ortp_set_log_handler(async_log_handler);
+	return 0;
+}
+
+void ms_async_log_stop(void) {
+	if (!sink.run) return;
+	sink.run = FALSE;
+	ms_thread_join(sink.thread, NULL);
+	ortp_set_log_handler(sink.handler);
+	/*the rings stay attached to their threads, for them to log again if the sink is restarted*/
+	ms_async_log_flush();
+}
+
+void ms_async_log_flush(void) {
+	MSList *elem;
+
+	if (!sink.initialized) return;
+	ms_mutex_lock(&sink.lock);
+	for (elem = sink.rings; elem != NULL; elem = elem->next) {
+		ring_drain((MSLogRing *)elem->data);
+	}
+	ms_mutex_unlock(&sink.lock);
+}
+
+void ms_async_log_get_stats(MSAsyncLogStats *stats) {
+	if (!sink.initialized) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	ms_mutex_lock(&sink.lock);
+	*stats = sink.stats;
+	ms_mutex_unlock(&sink.lock);
+}
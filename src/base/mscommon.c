@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/mscommon.h"
 #include "mediastreamer2/mscodecutils.h"
 #include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msmtu.h"
 
 #if !defined(_WIN32_WCE)
 #include <sys/types.h>
@@ -300,6 +301,22 @@ bool_t ms_tags_list_contains_tag(const MSList *list, const char *tag) {
 	return FALSE;
 }
 
+bool_t ms_log_site_allow(MSLogSite *site, OrtpLogLevel level, int key, int interval_ms, const char *file, int line){
+	uint64_t now=ms_get_cur_time_ms();
+	if (site->initialized && key==site->key && (interval_ms<=0 || now-site->last_time<(uint64_t)interval_ms)){
+		site->suppressed++;
+		return FALSE;
+	}
+	if (site->suppressed>0){
+		ortp_log(level,"%u similar messages suppressed at %s:%i",site->suppressed,file,line);
+		site->suppressed=0;
+	}
+	site->key=key;
+	site->last_time=now;
+	site->initialized=TRUE;
+	return TRUE;
+}
+
 int ms_load_plugins(const char *dir){
 	return ms_factory_load_plugins(ms_factory_get_fallback(),dir);
 }
@@ -323,6 +340,7 @@ void ms_base_exit(){
 		ms_message ("Skiping ms_base_exit, still [%i] ref",ms_base_ref);
 		return;
 	}
+	ms_mtu_discovery_stop();
 	ms_factory_destroy(ms_factory_get_fallback());
 }
 
@@ -400,6 +418,30 @@ void ms_set_payload_max_size(int size){
 
 extern void _android_key_cleanup(void*);
 
+#define MS_ONCE_RUNNING 1
+#define MS_ONCE_DONE 2
+
+static long ms_once_compare_and_swap(ms_once_t *once, long expected, long desired) {
+#ifdef _WIN32
+	return InterlockedCompareExchange((volatile LONG *)once, desired, expected);
+#else
+	return __sync_val_compare_and_swap(once, expected, desired);
+#endif
+}
+
+void ms_once(ms_once_t *once, void (*func)(void)) {
+	long state = ms_once_compare_and_swap(once, MS_ONCE_INIT, MS_ONCE_RUNNING);
+	if (state == MS_ONCE_INIT) {
+		func();
+		ms_once_compare_and_swap(once, MS_ONCE_RUNNING, MS_ONCE_DONE);
+		return;
+	}
+	while (state != MS_ONCE_DONE) {
+		ms_usleep(1000);
+		state = ms_once_compare_and_swap(once, MS_ONCE_DONE, MS_ONCE_DONE);
+	}
+}
+
 void ms_thread_exit(void* ref_val) {
 #ifdef ANDROID
 	// due to a bug in old Bionic version
@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/mseventqueue.h"
+#include "mediastreamer2/msmetrics.h"
 #include "basedescs.h"
 
 #if !defined(_WIN32_WCE)
@@ -131,12 +132,24 @@ static int compare_stats_with_name(const MSFilterStats *stat, const char *name){
 	return strcmp(stat->name,name);
 }
 
+static void filter_stats_destroy(MSFilterStats *stats){
+	ms_metric_destroy(stats->cpu_metric);
+	ms_metric_destroy(stats->calls_metric);
+	ms_free(stats);
+}
+
 static MSFilterStats *find_or_create_stats(MSFactory *factory, MSFilterDesc *desc){
 	MSList *elem=ms_list_find_custom(factory->stats_list,(MSCompareFunc)compare_stats_with_name,desc->name);
 	MSFilterStats *ret=NULL;
 	if (elem==NULL){
+		char *labels;
+		if (factory->metrics_id==0) factory->metrics_id=ms_metrics_new_id();
+		labels=ms_strdup_printf("filter=\"%s\",factory=\"%i\"",desc->name,factory->metrics_id);
 		ret=ms_new0(MSFilterStats,1);
 		ret->name=desc->name;
+		ret->cpu_metric=ms_metric_new("ms2_filter_cpu_seconds",MSMetricCounter,"Time spent in the processing of filters.",labels);
+		ret->calls_metric=ms_metric_new("ms2_filter_calls",MSMetricCounter,"Calls to the processing of filters.",labels);
+		ms_free(labels);
 		factory->stats_list=ms_list_append(factory->stats_list,ret);
 	}else ret=(MSFilterStats*)elem->data;
 	return ret;
@@ -249,8 +262,7 @@ void ms_factory_destroy(MSFactory *factory){
 	if (factory->evq) ms_event_queue_destroy(factory->evq);
 	factory->formats=ms_list_free_with_data(factory->formats,(void(*)(void*))ms_fmt_descriptor_destroy);
 	factory->desc_list=ms_list_free(factory->desc_list);
-	ms_list_for_each(factory->stats_list,ms_free);
-	factory->stats_list=ms_list_free(factory->stats_list);
+	factory->stats_list=ms_list_free_with_data(factory->stats_list,(void(*)(void*))filter_stats_destroy);
 	ms_list_for_each(factory->platform_tags, ms_free);
 	factory->platform_tags = ms_list_free(factory->platform_tags);
 	if (factory->plugins_dir) ms_free(factory->plugins_dir);
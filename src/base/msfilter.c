@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msmetrics.h"
 
 #define MS_FILTER_METHOD_GET_FID(id)	(((id)>>16) & 0xFFFF)
 #define MS_FILTER_METHOD_GET_INDEX(id) ( ((id)>>8) & 0XFF)
@@ -186,6 +187,14 @@ void ms_filter_destroy(MSFilter *f){
 	ms_free(f);
 }
 
+static void update_stats(MSFilterStats *stats, const MSTimeSpec *start, const MSTimeSpec *stop){
+	uint64_t elapsed=(stop->tv_sec-start->tv_sec)*1000000000LL + (stop->tv_nsec-start->tv_nsec);
+	stats->count++;
+	stats->elapsed+=elapsed;
+	ms_metric_add(stats->cpu_metric,elapsed*1e-9);
+	ms_metric_add(stats->calls_metric,1);
+}
+
 void ms_filter_process(MSFilter *f){
 	MSTimeSpec start,stop;
 	ms_debug("Executing process of filter %s:%p",f->desc->name,f);
@@ -196,8 +205,7 @@ void ms_filter_process(MSFilter *f){
 	f->desc->process(f);
 	if (f->stats){
 		ms_get_cur_time(&stop);
-		f->stats->count++;
-		f->stats->elapsed+=(stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
+		update_stats(f->stats,&start,&stop);
 	}
 
 }
@@ -213,8 +221,7 @@ void ms_filter_task_process(MSFilterTask *task){
 	task->taskfunc(f);
 	if (f->stats){
 		ms_get_cur_time(&stop);
-		f->stats->count++;
-		f->stats->elapsed+=(stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
+		update_stats(f->stats,&start,&stop);
 	}
 	f->postponed_task--;
 }
@@ -0,0 +1,453 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msmetrics.h"
+
+#include <stdarg.h>
+
+#ifndef va_copy
+#define va_copy(dst, src) ((dst) = (src))
+#endif
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+
+#define SERVER_POLL_INTERVAL 200 /*ms, the delay to notice that the server is stopped*/
+#define SERVER_REQUEST_TIMEOUT 100 /*ms, the time given to a client to send its request*/
+
+/*
+ * The values are kept as the bits of doubles in 64 bits integers, read and written atomically. Additions are done
+ * with a compare and swap loop, which never blocks the ticker threads.
+ */
+#ifdef _MSC_VER
+static int64_t atomic_load64(volatile int64_t *p) {
+	return InterlockedCompareExchange64((volatile LONGLONG *)p, 0, 0);
+}
+
+static void atomic_store64(volatile int64_t *p, int64_t v) {
+	InterlockedExchange64((volatile LONGLONG *)p, v);
+}
+
+static bool_t atomic_cas64(volatile int64_t *p, int64_t expected, int64_t desired) {
+	return InterlockedCompareExchange64((volatile LONGLONG *)p, desired, expected) == expected;
+}
+
+static void atomic_inc64(volatile int64_t *p) {
+	InterlockedIncrement64((volatile LONGLONG *)p);
+}
+#else
+static int64_t atomic_load64(volatile int64_t *p) {
+	return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void atomic_store64(volatile int64_t *p, int64_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+static bool_t atomic_cas64(volatile int64_t *p, int64_t expected, int64_t desired) {
+	return __atomic_compare_exchange_n(p, &expected, desired, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void atomic_inc64(volatile int64_t *p) {
+	__atomic_fetch_add(p, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+static int64_t double_to_bits(double d) {
+	int64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	return bits;
+}
+
+static double bits_to_double(int64_t bits) {
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+static void atomic_add_double(volatile int64_t *p, double value) {
+	int64_t old;
+	do {
+		old = atomic_load64(p);
+	} while (!atomic_cas64(p, old, double_to_bits(bits_to_double(old) + value)));
+}
+
+typedef struct _MSMetricFamily {
+	char *name;
+	char *help;
+	MSMetricType type;
+	double *bounds;
+	int nbounds;
+	MSList *metrics;
+} MSMetricFamily;
+
+struct _MSMetric {
+	MSMetricFamily *family;
+	char *labels;
+	volatile int64_t value; /*the value of counters and gauges, the sum of the observations of histograms*/
+	volatile int64_t *buckets; /*the number of observations in each bucket of histograms, the last one is +Inf*/
+};
+
+typedef struct _MSMetricsText {
+	char *buf;
+	size_t len;
+	size_t size;
+} MSMetricsText;
+
+typedef struct _MSMetricsServer {
+	int fd;
+	char *path;
+	ms_thread_t thread;
+	volatile bool_t run;
+} MSMetricsServer;
+
+static MSList *families = NULL;
+static ms_mutex_t metrics_lock;
+static ms_once_t metrics_lock_once = MS_ONCE_INIT;
+static int last_id = 0;
+static MSMetricsServer server = {-1, NULL, 0, FALSE};
+
+static void metrics_lock_init(void) {
+	ms_mutex_init(&metrics_lock, NULL);
+}
+
+static void metrics_lock_acquire(void) {
+	ms_once(&metrics_lock_once, metrics_lock_init);
+	ms_mutex_lock(&metrics_lock);
+}
+
+int ms_metrics_new_id(void) {
+	int id;
+	metrics_lock_acquire();
+	id = ++last_id;
+	ms_mutex_unlock(&metrics_lock);
+	return id;
+}
+
+static MSMetricFamily *metric_family_find(const char *name) {
+	MSList *elem;
+	for (elem = families; elem != NULL; elem = elem->next) {
+		MSMetricFamily *family = (MSMetricFamily *)elem->data;
+		if (strcmp(family->name, name) == 0) return family;
+	}
+	return NULL;
+}
+
+static void metric_family_destroy(MSMetricFamily *family) {
+	ms_free(family->name);
+	ms_free(family->help);
+	if (family->bounds) ms_free(family->bounds);
+	ms_free(family);
+}
+
+static MSMetric *metric_new(const char *name, MSMetricType type, const char *help, const char *labels, const double *bounds, int nbounds) {
+	MSMetricFamily *family;
+	MSMetric *obj = NULL;
+
+	metrics_lock_acquire();
+	family = metric_family_find(name);
+	if (family == NULL) {
+		family = ms_new0(MSMetricFamily, 1);
+		family->name = ms_strdup(name);
+		family->help = ms_strdup(help ? help : "");
+		family->type = type;
+		if (type == MSMetricHistogram && nbounds > 0) {
+			family->bounds = ms_new(double, nbounds);
+			memcpy(family->bounds, bounds, nbounds * sizeof(double));
+			family->nbounds = nbounds;
+		}
+		families = ms_list_append(families, family);
+	} else if (family->type != type) {
+		ms_error("Metric family [%s] already exists with another type", name);
+		family = NULL;
+	}
+	if (family != NULL) {
+		obj = ms_new0(MSMetric, 1);
+		obj->family = family;
+		obj->labels = labels ? ms_strdup(labels) : NULL;
+		obj->value = double_to_bits(0);
+		if (type == MSMetricHistogram) obj->buckets = ms_new0(int64_t, family->nbounds + 1);
+		family->metrics = ms_list_append(family->metrics, obj);
+	}
+	ms_mutex_unlock(&metrics_lock);
+	return obj;
+}
+
+MSMetric *ms_metric_new(const char *name, MSMetricType type, const char *help, const char *labels) {
+	return metric_new(name, type, help, labels, NULL, 0);
+}
+
+MSMetric *ms_metric_new_histogram(const char *name, const char *help, const char *labels, const double *bounds, int nbounds) {
+	return metric_new(name, MSMetricHistogram, help, labels, bounds, nbounds);
+}
+
+void ms_metric_destroy(MSMetric *obj) {
+	MSMetricFamily *family;
+
+	if (obj == NULL) return;
+	family = obj->family;
+	metrics_lock_acquire();
+	family->metrics = ms_list_remove(family->metrics, obj);
+	if (family->metrics == NULL) {
+		families = ms_list_remove(families, family);
+		metric_family_destroy(family);
+	}
+	ms_mutex_unlock(&metrics_lock);
+	if (obj->labels) ms_free(obj->labels);
+	if (obj->buckets) ms_free((void *)obj->buckets);
+	ms_free(obj);
+}
+
+void ms_metric_set_labels(MSMetric *obj, const char *labels) {
+	if (obj == NULL) return;
+	/*the labels are only read while exporting, with the lock held*/
+	metrics_lock_acquire();
+	if (obj->labels) ms_free(obj->labels);
+	obj->labels = labels ? ms_strdup(labels) : NULL;
+	ms_mutex_unlock(&metrics_lock);
+}
+
+void ms_metric_add(MSMetric *obj, double value) {
+	if (obj == NULL) return;
+	atomic_add_double(&obj->value, value);
+}
+
+void ms_metric_set(MSMetric *obj, double value) {
+	if (obj == NULL) return;
+	atomic_store64(&obj->value, double_to_bits(value));
+}
+
+void ms_metric_observe(MSMetric *obj, double value) {
+	MSMetricFamily *family;
+	int i;
+
+	if (obj == NULL || obj->buckets == NULL) return;
+	family = obj->family;
+	for (i = 0; i < family->nbounds && value > family->bounds[i]; i++);
+	atomic_inc64(&obj->buckets[i]);
+	atomic_add_double(&obj->value, value);
+}
+
+double ms_metric_get(const MSMetric *obj) {
+	if (obj == NULL) return 0;
+	return bits_to_double(atomic_load64((volatile int64_t *)&obj->value));
+}
+
+static void metrics_text_printf(MSMetricsText *text, const char *fmt, ...) {
+	va_list args, copy;
+	int n;
+
+	va_start(args, fmt);
+	for (;;) {
+		va_copy(copy, args);
+		n = vsnprintf(text->buf + text->len, text->size - text->len, fmt, copy);
+		va_end(copy);
+		if (n >= 0 && (size_t)n < text->size - text->len) break;
+		text->size = text->size * 2 + (n > 0 ? n : 0);
+		text->buf = ms_realloc(text->buf, text->size);
+	}
+	va_end(args);
+	text->len += n;
+}
+
+static void metrics_text_sample(MSMetricsText *text, const char *name, const char *suffix, const char *labels, const char *le, double value) {
+	bool_t has_labels = labels != NULL && labels[0] != '\0';
+
+	metrics_text_printf(text, "%s%s", name, suffix);
+	if (has_labels || le) {
+		metrics_text_printf(text, "{%s%s", has_labels ? labels : "", has_labels && le ? "," : "");
+		if (le) metrics_text_printf(text, "le=\"%s\"", le);
+		metrics_text_printf(text, "}");
+	}
+	metrics_text_printf(text, " %.15g\n", value);
+}
+
+static void metrics_text_histogram(MSMetricsText *text, const MSMetricFamily *family, MSMetric *metric) {
+	char le[32];
+	int64_t count = 0;
+	int i;
+
+	for (i = 0; i <= family->nbounds; i++) {
+		count += atomic_load64(&metric->buckets[i]);
+		if (i < family->nbounds) snprintf(le, sizeof(le), "%.15g", family->bounds[i]);
+		else snprintf(le, sizeof(le), "+Inf");
+		metrics_text_sample(text, family->name, "_bucket", metric->labels, le, (double)count);
+	}
+	metrics_text_sample(text, family->name, "_count", metric->labels, NULL, (double)count);
+	metrics_text_sample(text, family->name, "_sum", metric->labels, NULL, ms_metric_get(metric));
+}
+
+char *ms_metrics_to_text(void) {
+	static const char *type_names[] = {"counter", "gauge", "histogram"};
+	MSMetricsText text = {0};
+	MSList *elem, *it;
+
+	text.size = 4096;
+	text.buf = ms_malloc(text.size);
+	text.buf[0] = '\0';
+	metrics_lock_acquire();
+	for (elem = families; elem != NULL; elem = elem->next) {
+		MSMetricFamily *family = (MSMetricFamily *)elem->data;
+		metrics_text_printf(&text, "# TYPE %s %s\n", family->name, type_names[family->type]);
+		if (family->help[0] != '\0') metrics_text_printf(&text, "# HELP %s %s\n", family->name, family->help);
+		for (it = family->metrics; it != NULL; it = it->next) {
+			MSMetric *metric = (MSMetric *)it->data;
+			if (family->type == MSMetricHistogram) metrics_text_histogram(&text, family, metric);
+			else metrics_text_sample(&text, family->name, family->type == MSMetricCounter ? "_total" : "", metric->labels, NULL, ms_metric_get(metric));
+		}
+	}
+	ms_mutex_unlock(&metrics_lock);
+	metrics_text_printf(&text, "# EOF\n");
+	return text.buf;
+}
+
+void ms_metrics_export(MSMetricsExportFunc func, void *user_data) {
+	char *text = ms_metrics_to_text();
+	func(user_data, text, strlen(text));
+	ms_free(text);
+}
+
+#ifndef _WIN32
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static void metrics_server_send(int fd, const char *buf, size_t size) {
+	while (size > 0) {
+		ssize_t n = send(fd, buf, size, MSG_NOSIGNAL);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) continue;
+			return;
+		}
+		buf += n;
+		size -= n;
+	}
+}
+
+static void metrics_server_answer(int fd) {
+	struct pollfd pfd;
+	char request[1024];
+	bool_t http = FALSE;
+	char *text;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, SERVER_REQUEST_TIMEOUT) > 0) {
+		ssize_t n = recv(fd, request, sizeof(request) - 1, 0);
+		http = n >= 4 && strncmp(request, "GET ", 4) == 0;
+	}
+	text = ms_metrics_to_text();
+	if (http) {
+		char *header = ms_strdup_printf("HTTP/1.0 200 OK\r\n"
+			"Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+			"Content-Length: %u\r\n\r\n", (unsigned int)strlen(text));
+		metrics_server_send(fd, header, strlen(header));
+		ms_free(header);
+	}
+	metrics_server_send(fd, text, strlen(text));
+	ms_free(text);
+}
+
+static void *metrics_server_run(void *arg) {
+	while (server.run) {
+		struct pollfd pfd;
+		int fd;
+
+		pfd.fd = server.fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, SERVER_POLL_INTERVAL) <= 0) continue;
+		fd = accept(server.fd, NULL, NULL);
+		if (fd == -1) continue;
+		metrics_server_answer(fd);
+		close(fd);
+	}
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+int ms_metrics_start_server(const char *path) {
+	struct sockaddr_un addr;
+
+	if (server.run) {
+		ms_warning("Metrics server is already running on [%s]", server.path);
+		return -1;
+	}
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		ms_error("Metrics server: path [%s] is too long", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	server.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server.fd == -1) {
+		ms_error("Metrics server: cannot create socket: %s", strerror(errno));
+		return -1;
+	}
+	unlink(path);
+	if (bind(server.fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server.fd, 8) != 0) {
+		ms_error("Metrics server: cannot listen on [%s]: %s", path, strerror(errno));
+		close(server.fd);
+		server.fd = -1;
+		return -1;
+	}
+	server.path = ms_strdup(path);
+	server.run = TRUE;
+	ms_thread_create(&server.thread, NULL, metrics_server_run, NULL);
+	ms_message("Metrics served on [%s]", path);
+	return 0;
+}
+
+void ms_metrics_stop_server(void) {
+	if (!server.run) return;
+	server.run = FALSE;
+	ms_thread_join(server.thread, NULL);
+	close(server.fd);
+	server.fd = -1;
+	unlink(server.path);
+	ms_free(server.path);
+	server.path = NULL;
+}
+
+#else
+
+int ms_metrics_start_server(const char *path) {
+	ms_error("Metrics server: unix sockets are not supported on this platform, use ms_metrics_export()");
+	return -1;
+}
+
+void ms_metrics_stop_server(void) {
+}
+
+#endif
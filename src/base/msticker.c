@@ -18,6 +18,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msmetrics.h"
 
 #ifndef _WIN32
 #include <sys/time.h>
@@ -47,6 +48,29 @@ static uint64_t get_cur_time_ms(void *);
 static int wait_next_tick(void *, uint64_t virt_ticker_time);
 static void remove_tasks_for_filter(MSTicker *ticker, MSFilter *f);
 
+static const double tick_bounds[]={0.001,0.002,0.005,0.01,0.02,0.05,0.1}; /*seconds*/
+
+static char *ticker_metric_labels(MSTicker *ticker){
+	return ms_strdup_printf("ticker=\"%s\",id=\"%i\"",ticker->name,ticker->metrics_id);
+}
+
+static void ticker_create_metrics(MSTicker *ticker){
+	char *labels;
+	ticker->metrics_id=ms_metrics_new_id();
+	labels=ticker_metric_labels(ticker);
+	ticker->load_metric=ms_metric_new("ms2_ticker_load_ratio",MSMetricGauge,"Average ratio of the tick interval spent processing.",labels);
+	ticker->late_metric=ms_metric_new("ms2_ticker_late_ticks",MSMetricCounter,"Ticks started later than one interval.",labels);
+	ticker->tick_metric=ms_metric_new_histogram("ms2_ticker_tick_seconds","Processing time of ticks.",labels,
+		tick_bounds,sizeof(tick_bounds)/sizeof(tick_bounds[0]));
+	ms_free(labels);
+}
+
+static void ticker_destroy_metrics(MSTicker *ticker){
+	ms_metric_destroy(ticker->load_metric);
+	ms_metric_destroy(ticker->late_metric);
+	ms_metric_destroy(ticker->tick_metric);
+}
+
 static void ms_ticker_start(MSTicker *s){
 	s->run=TRUE;
 	ms_thread_create(&s->thread,NULL,ms_ticker_run,s);
@@ -72,6 +96,7 @@ static void ms_ticker_init(MSTicker *ticker, const MSTickerParams *params)
 	ticker->late_event.lateMs = 0;
 	ticker->late_event.time = 0;
 	ticker->late_event.current_late_ms = 0;
+	ticker_create_metrics(ticker);
 	ms_ticker_start(ticker);
 }
 
@@ -97,8 +122,14 @@ static void ms_ticker_stop(MSTicker *s){
 }
 
 void ms_ticker_set_name(MSTicker *s, const char *name){
+	char *labels;
 	if (s->name) ms_free(s->name);
 	s->name=ms_strdup(name);
+	labels=ticker_metric_labels(s);
+	ms_metric_set_labels(s->load_metric,labels);
+	ms_metric_set_labels(s->late_metric,labels);
+	ms_metric_set_labels(s->tick_metric,labels);
+	ms_free(labels);
 }
 
 void ms_ticker_set_priority(MSTicker *ticker, MSTickerPrio prio){
@@ -108,6 +139,7 @@ void ms_ticker_set_priority(MSTicker *ticker, MSTickerPrio prio){
 static void ms_ticker_uninit(MSTicker *ticker)
 {
 	ms_ticker_stop(ticker);
+	ticker_destroy_metrics(ticker);
 	ms_free(ticker->name);
 	ms_mutex_destroy(&ticker->lock);
 }
@@ -428,7 +460,7 @@ void * ms_ticker_run(void *arg)
 		{
 #if TICKER_MEASUREMENTS
 			MSTimeSpec begin,end;/*used to measure time spent in processing one tick*/
-			double iload;
+			double elapsed,iload;
 
 			ms_get_cur_time(&begin);
 #endif
@@ -436,8 +468,11 @@ void * ms_ticker_run(void *arg)
 			run_graphs(s,s->execution_list,FALSE);
 #if TICKER_MEASUREMENTS
 			ms_get_cur_time(&end);
-			iload=100*((end.tv_sec-begin.tv_sec)*1000.0 + (end.tv_nsec-begin.tv_nsec)/1000000.0)/(double)s->interval;
+			elapsed=(end.tv_sec-begin.tv_sec)*1000.0 + (end.tv_nsec-begin.tv_nsec)/1000000.0;
+			iload=100*elapsed/(double)s->interval;
 			s->av_load=(smooth_coef*s->av_load)+((1.0-smooth_coef)*iload);
+			ms_metric_set(s->load_metric,s->av_load/100);
+			ms_metric_observe(s->tick_metric,elapsed/1000);
 #endif
 		}
 		ms_mutex_unlock(&s->lock);
@@ -448,6 +483,7 @@ void * ms_ticker_run(void *arg)
 			ms_warning("%s: We are late of %d miliseconds.",s->name,late);
 			late_tick_time=ms_get_cur_time_ms();
 		}
+		if (late>s->interval) ms_metric_add(s->late_metric,1);
 		lastlate=late;
 		ms_mutex_lock(&s->lock);
 		if (late_tick_time){
@@ -21,12 +21,52 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 /* mtu.c : discover the mtu automatically */
 
 
-#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msmtu.h"
 
 #define UDP_HEADER_SIZE   8
 #define IPV4_HEADER_SIZE 20
 #define IPV6_HEADER_SIZE 40
 
+#define MS_MTU_DEFAULT 1500
+
+#define PROBE_TIMEOUT 500 /*ms waited for an icmp error after a probe*/
+#define MAX_PROBES 10 /*per discovery*/
+#define REFRESH_INTERVAL 600000 /*ms before discovering again, as the path may have changed (RFC 1191)*/
+#define RETRY_INTERVAL 30000 /*ms before discovering again after a failure*/
+#define POLL_INTERVAL 100 /*ms, the delay to notice a new request*/
+#define SYNC_TIMEOUT (MAX_PROBES * PROBE_TIMEOUT + 1000) /*ms waited by ms_discover_mtu()*/
+
+typedef enum _MtuState {
+	MtuIdle, /*to be discovered at next_time*/
+	MtuProbing, /*a probe was sent, next_time is its timeout*/
+	MtuDone, /*to be refreshed at next_time*/
+	MtuFailed /*to be retried at next_time*/
+} MtuState;
+
+typedef struct _MtuListener {
+	MSMtuDiscoveryCallback cb;
+	void *user_data;
+} MtuListener;
+
+/*
+ * The host, the listeners and the result are protected by the lock of the service, the other fields belong to its
+ * thread, which is the only one to destroy destinations.
+ */
+typedef struct _MtuDestination {
+	char *host;
+	MSList *listeners;
+	int result; /*as returned by ms_mtu_discovery_get()*/
+	int mtu; /*being tested while probing*/
+	int probes;
+	int sock;
+	int family;
+	MtuState state;
+	uint64_t next_time;
+} MtuDestination;
+
+static void destination_confirm(MtuDestination *d, uint64_t now);
+static void destination_fail(MtuDestination *d, uint64_t now);
+
 #if defined(_WIN32) && !defined(_WIN32_WCE) && defined(MS2_WINDOWS_DESKTOP)
 
 HINSTANCE m_IcmpInst = NULL;
@@ -67,7 +107,8 @@ static int mtus[] = {
   0
 };
 
-int ms_discover_mtu(const char *host)
+/* Blocking, called by the thread of the service. */
+static int probe_mtu(const char *host)
 {
   int i;
 
@@ -159,6 +200,19 @@ int ms_discover_mtu(const char *host)
   return -1;
 }
 
+static void destination_timer(MtuDestination *d, uint64_t now) {
+	d->mtu = probe_mtu(d->host);
+	if (d->mtu > 0) destination_confirm(d, now);
+	else destination_fail(d, now);
+}
+
+static void destination_close(MtuDestination *d) {
+}
+
+static void service_wait(MSList *destinations, int timeout) {
+	ms_usleep(timeout * 1000);
+}
+
 #elif defined(__linux)
 
 #include <sys/types.h>
@@ -168,113 +222,248 @@ int ms_discover_mtu(const char *host)
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
 
 #ifndef IP_MTU
 #define IP_MTU 14
 #endif
 
-int ms_discover_mtu(const char *host){
-	int sock;
-	int err,mtu=0,new_mtu;
-	socklen_t optlen;
+static int destination_header_size(MtuDestination *d) {
+	return UDP_HEADER_SIZE + ((d->family == PF_INET6) ? IPV6_HEADER_SIZE : IPV4_HEADER_SIZE);
+}
+
+/* The smallest mtu the links must support: below, the datagrams are fragmented by the sender. */
+static int destination_min_mtu(MtuDestination *d) {
+	return (d->family == PF_INET6) ? 1280 : 576;
+}
+
+static int destination_open(MtuDestination *d) {
+	int err,val;
 	char port[10];
 	struct addrinfo hints,*ai=NULL;
-	int family = PF_INET;
 	int rand_port;
-	int retry=0;
 	struct timeval tv;
 
-	/* Try to get the address family of the host (PF_INET or PF_INET6). */
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = PF_UNSPEC;
-	hints.ai_flags = AI_NUMERICHOST;
-	err = getaddrinfo(host, NULL, &hints, &ai);
-	if (err == 0) family = ai->ai_family;
-
 	memset(&hints,0,sizeof(hints));
-	hints.ai_family = family;
+	hints.ai_family = PF_UNSPEC;
 	hints.ai_socktype = SOCK_DGRAM;
-	
-	gettimeofday(&tv,NULL);	
+
+	gettimeofday(&tv,NULL);
 	srandom(tv.tv_usec);
 	rand_port=random() & 0xFFFF;
 	if (rand_port<1000) rand_port+=1000;
 	snprintf(port,sizeof(port),"%i",rand_port);
-	err=getaddrinfo(host,port,&hints,&ai);
+	err=getaddrinfo(d->host,port,&hints,&ai);
 	if (err!=0){
-		ms_error("getaddrinfo(): %s\n",gai_strerror(err));
+		ms_error("getaddrinfo(): %s",gai_strerror(err));
 		return -1;
 	}
-	sock=socket(family,SOCK_DGRAM,0);
-	if(sock < 0)
-	{
+	d->family=ai->ai_family;
+	d->sock=socket(d->family,SOCK_DGRAM,0);
+	if (d->sock<0){
 		ms_error("socket(): %s",strerror(errno));
-		return sock;
-	}
-	mtu = (family == PF_INET6) ? IPV6_PMTUDISC_DO: IP_PMTUDISC_DO;
-	optlen=sizeof(mtu);
-	err=setsockopt(sock,(family == PF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP,(family == PF_INET6) ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER,&mtu,optlen);
-	if (err!=0){
-		ms_error("setsockopt(): %s",strerror(errno));
-		err = close(sock);
-		if (err!=0)
-			ms_error("close(): %s", strerror(errno));
+		freeaddrinfo(ai);
 		return -1;
 	}
-	err=connect(sock,ai->ai_addr,ai->ai_addrlen);
+	/*the probes must not be fragmented, and the icmp errors they cause are queued on the socket*/
+	val = (d->family == PF_INET6) ? IPV6_PMTUDISC_DO : IP_PMTUDISC_DO;
+	err=setsockopt(d->sock,(d->family == PF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP,(d->family == PF_INET6) ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER,&val,sizeof(val));
+	if (err==0){
+		val=1;
+		err=setsockopt(d->sock,(d->family == PF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP,(d->family == PF_INET6) ? IPV6_RECVERR : IP_RECVERR,&val,sizeof(val));
+	}
+	if (err!=0) ms_error("setsockopt(): %s",strerror(errno));
+	else{
+		err=connect(d->sock,ai->ai_addr,ai->ai_addrlen);
+		if (err!=0) ms_error("connect(): %s",strerror(errno));
+	}
 	freeaddrinfo(ai);
 	if (err!=0){
-		ms_error("connect(): %s",strerror(errno));
-		err = close(sock);
-		if (err !=0)
-			ms_error("close(): %s", strerror(errno));
+		close(d->sock);
+		d->sock=-1;
 		return -1;
 	}
-	mtu=1500;
-	do{
-		int send_returned;
-		int datasize = mtu - (UDP_HEADER_SIZE + ((family == PF_INET6) ? IPV6_HEADER_SIZE : IPV4_HEADER_SIZE));	/*minus IP+UDP overhead*/
-		char *buf=ms_malloc0(datasize);
+	return 0;
+}
+
+static void destination_close(MtuDestination *d) {
+	if (d->sock==-1) return;
+	if (close(d->sock)!=0) ms_error("close(): %s", strerror(errno));
+	d->sock=-1;
+}
 
-		send_returned = send(sock,buf,datasize,0);
-		if (send_returned==-1){
-			/*ignore*/
+/* The mtu the kernel knows for the route. */
+static int destination_get_route_mtu(MtuDestination *d) {
+	int mtu=0;
+	socklen_t optlen=sizeof(mtu);
+	if (getsockopt(d->sock,(d->family == PF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP,(d->family == PF_INET6) ? IPV6_MTU : IP_MTU,&mtu,&optlen)!=0){
+		ms_error("getsockopt(): %s",strerror(errno));
+		return -1;
+	}
+	return mtu;
+}
+
+static void destination_lower(MtuDestination *d, int mtu, uint64_t now);
+
+static void destination_send_probe(MtuDestination *d, uint64_t now) {
+	char buf[MS_MTU_DEFAULT];
+	int datasize = d->mtu - destination_header_size(d);
+	int attempts = 0;
+	ssize_t err;
+
+	if (d->probes++ >= MAX_PROBES){
+		ms_warning("Path MTU to [%s] still not confirmed after %i probes",d->host,MAX_PROBES);
+		destination_confirm(d, now);
+		return;
+	}
+	memset(buf, 0, datasize);
+	do{
+		/*an icmp error received on a connected socket fails the next send once*/
+		err=send(d->sock,buf,datasize,MSG_DONTWAIT);
+	}while(err==-1 && errno==ECONNREFUSED && ++attempts<2);
+	if (err==-1){
+		if (errno==EMSGSIZE){
+			/*the kernel already knows a smaller mtu*/
+			int mtu=destination_get_route_mtu(d);
+			if (mtu<=0 || mtu>=d->mtu) destination_fail(d, now);
+			else destination_lower(d, mtu, now);
+			return;
+		}else if (errno!=EAGAIN && errno!=EWOULDBLOCK){
+			ms_error("send(): %s",strerror(errno));
+			destination_fail(d, now);
+			return;
 		}
-		ms_free(buf);
-		usleep(500000);/*wait for an icmp message come back */
-		err=getsockopt(sock,(family == PF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP,(family == PF_INET6) ? IPV6_MTU : IP_MTU,&new_mtu,&optlen);
-		if (err!=0){
-			ms_error("getsockopt(): %s",strerror(errno));
-			err = close(sock);
-			if (err!=0)
-				ms_error("close(): %s", strerror(errno));
-			return -1;
-		}else{
-			ms_message("Partial MTU discovered : %i",new_mtu);
-			if (new_mtu==mtu) break;
-			else mtu=new_mtu;
+	}
+	d->state=MtuProbing;
+	d->next_time=now+PROBE_TIMEOUT;
+}
+
+static void destination_lower(MtuDestination *d, int mtu, uint64_t now) {
+	if (mtu<=0 || mtu>=d->mtu) return;
+	ms_message("Partial MTU discovered for [%s]: %i",d->host,mtu);
+	if (mtu<=destination_min_mtu(d)){
+		d->mtu=destination_min_mtu(d);
+		destination_confirm(d, now);
+		return;
+	}
+	d->mtu=mtu;
+	destination_send_probe(d, now);
+}
+
+static void destination_read_errors(MtuDestination *d, uint64_t now) {
+	char data[MS_MTU_DEFAULT];
+	char control[512];
+	struct sockaddr_storage from;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	for (;;){
+		iov.iov_base=data;
+		iov.iov_len=sizeof(data);
+		memset(&msg,0,sizeof(msg));
+		msg.msg_name=&from;
+		msg.msg_namelen=sizeof(from);
+		msg.msg_iov=&iov;
+		msg.msg_iovlen=1;
+		msg.msg_control=control;
+		msg.msg_controllen=sizeof(control);
+		if (recvmsg(d->sock,&msg,MSG_ERRQUEUE|MSG_DONTWAIT)<0) return;
+		for (cmsg=CMSG_FIRSTHDR(&msg); cmsg!=NULL; cmsg=CMSG_NXTHDR(&msg,cmsg)){
+			struct sock_extended_err *ee;
+			if (!((cmsg->cmsg_level==IPPROTO_IP && cmsg->cmsg_type==IP_RECVERR)
+				|| (cmsg->cmsg_level==IPPROTO_IPV6 && cmsg->cmsg_type==IPV6_RECVERR))) continue;
+			ee=(struct sock_extended_err *)CMSG_DATA(cmsg);
+			if (ee->ee_errno==EMSGSIZE){
+				/*icmp fragmentation needed or packet too big, or local error: ee_info is the next hop mtu*/
+				destination_lower(d, (int)ee->ee_info, now);
+			}else if (d->state!=MtuProbing){
+				continue;
+			}else if (ee->ee_errno==ECONNREFUSED){
+				/*port unreachable: the probe reached the host*/
+				destination_confirm(d, now);
+			}else{
+				ms_warning("Path MTU discovery to [%s]: %s",d->host,strerror(ee->ee_errno));
+				destination_fail(d, now);
+			}
 		}
-		retry++;
-	}while(retry<10);
-	
-	ms_message("mtu to %s is %i",host,mtu);
+	}
+}
 
-	err = close(sock);
-	if (err!=0)
-		ms_error("close() %s", strerror(errno));
-	return mtu;
+static void destination_timer(MtuDestination *d, uint64_t now) {
+	if (d->state==MtuProbing){
+		uint64_t deadline=d->next_time;
+		/*an error may have been queued after the last poll, it may lower the mtu and send a new probe*/
+		destination_read_errors(d, now);
+		/*no error came back: the probe went through*/
+		if (d->state==MtuProbing && d->next_time==deadline) destination_confirm(d, now);
+		return;
+	}
+	if (d->sock==-1 && destination_open(d)!=0){
+		destination_fail(d, now);
+		return;
+	}
+	d->mtu=MS_MTU_DEFAULT;
+	d->probes=0;
+	destination_send_probe(d, now);
+}
+
+static void service_wait(MSList *destinations, int timeout) {
+	int count=ms_list_size(destinations);
+	struct pollfd *pfds;
+	MtuDestination **ds;
+	uint64_t now;
+	int n=0,i;
+	MSList *elem;
+
+	if (count==0){
+		ms_usleep(timeout*1000);
+		return;
+	}
+	pfds=ms_new0(struct pollfd,count);
+	ds=ms_new0(MtuDestination*,count);
+	for (elem=destinations; elem!=NULL; elem=elem->next){
+		MtuDestination *d=(MtuDestination *)elem->data;
+		if (d->sock==-1) continue;
+		/*errors are always polled*/
+		pfds[n].fd=d->sock;
+		pfds[n].events=0;
+		pfds[n].revents=0;
+		ds[n++]=d;
+	}
+	if (poll(pfds,n,timeout)>0){
+		now=ms_get_cur_time_ms();
+		for (i=0;i<n;i++){
+			if (pfds[i].revents & POLLERR) destination_read_errors(ds[i], now);
+		}
+	}
+	ms_free(pfds);
+	ms_free(ds);
 }
 
 #else
 
-int ms_discover_mtu(const char*host){
+static int probe_mtu(const char*host){
 	ms_warning("mtu discovery not implemented.");
 	return -1;
 }
 
-#endif
+static void destination_timer(MtuDestination *d, uint64_t now) {
+	d->mtu = probe_mtu(d->host);
+	if (d->mtu > 0) destination_confirm(d, now);
+	else destination_fail(d, now);
+}
 
-#define MS_MTU_DEFAULT 1500
+static void destination_close(MtuDestination *d) {
+}
+
+static void service_wait(MSList *destinations, int timeout) {
+	ms_usleep(timeout * 1000);
+}
+
+#endif
 
 static int ms_mtu=MS_MTU_DEFAULT;
 
@@ -295,3 +484,200 @@ int ms_get_mtu(void){
 	return ms_mtu;
 }
 
+
+static struct {
+	MSList *destinations;
+	ms_mutex_t lock;
+	ms_mutex_t notify_lock; /*held while the callbacks are called*/
+	ms_thread_t thread;
+	volatile bool_t run;
+} service = {NULL};
+
+static ms_once_t service_once = MS_ONCE_INIT;
+
+static void service_init_locks(void) {
+	ms_mutex_init(&service.lock, NULL);
+	ms_mutex_init(&service.notify_lock, NULL);
+}
+
+static void service_lock(void) {
+	ms_once(&service_once, service_init_locks);
+	ms_mutex_lock(&service.lock);
+}
+
+static void service_unlock(void) {
+	ms_mutex_unlock(&service.lock);
+}
+
+static MtuDestination *destination_find(const char *host) {
+	MSList *elem;
+	for (elem = service.destinations; elem != NULL; elem = elem->next) {
+		MtuDestination *d = (MtuDestination *)elem->data;
+		if (strcmp(d->host, host) == 0) return d;
+	}
+	return NULL;
+}
+
+static void destination_destroy(MtuDestination *d) {
+	destination_close(d);
+	ms_list_for_each(d->listeners, ms_free);
+	ms_list_free(d->listeners);
+	ms_free(d->host);
+	ms_free(d);
+}
+
+static void destination_set_result(MtuDestination *d, int result) {
+	MSList *listeners = NULL;
+	MSList *elem;
+
+	ms_mutex_lock(&service.notify_lock);
+	service_lock();
+	if (d->result != result) {
+		d->result = result;
+		listeners = ms_list_copy(d->listeners);
+	}
+	service_unlock();
+	/*the listeners are not freed while the notify lock is held*/
+	for (elem = listeners; elem != NULL; elem = elem->next) {
+		MtuListener *l = (MtuListener *)elem->data;
+		l->cb(l->user_data, d->host, result);
+	}
+	ms_mutex_unlock(&service.notify_lock);
+	ms_list_free(listeners);
+}
+
+static void destination_confirm(MtuDestination *d, uint64_t now) {
+	ms_message("mtu to %s is %i", d->host, d->mtu);
+	d->state = MtuDone;
+	d->next_time = now + REFRESH_INTERVAL;
+	destination_set_result(d, d->mtu);
+}
+
+static void destination_fail(MtuDestination *d, uint64_t now) {
+	ms_warning("Cannot discover the mtu to %s, retrying in %i seconds", d->host, RETRY_INTERVAL / 1000);
+	destination_close(d);
+	d->state = MtuFailed;
+	d->next_time = now + RETRY_INTERVAL;
+	destination_set_result(d, -1);
+}
+
+/* Take the destinations to process, and forget those that nobody listens to when they should be refreshed. */
+static MSList *service_get_destinations(uint64_t now) {
+	MSList *destinations = NULL;
+	MSList *elem, *next;
+
+	service_lock();
+	for (elem = service.destinations; elem != NULL; elem = next) {
+		MtuDestination *d = (MtuDestination *)elem->data;
+		next = elem->next;
+		if (d->listeners == NULL && (d->state == MtuDone || d->state == MtuFailed) && now >= d->next_time) {
+			service.destinations = ms_list_remove_link(service.destinations, elem);
+			destination_destroy(d);
+		} else {
+			destinations = ms_list_append(destinations, d);
+		}
+	}
+	service_unlock();
+	return destinations;
+}
+
+static void *service_run(void *arg) {
+	while (service.run) {
+		uint64_t now = ms_get_cur_time_ms();
+		MSList *destinations = service_get_destinations(now);
+		int timeout = POLL_INTERVAL;
+		MSList *elem;
+
+		for (elem = destinations; elem != NULL; elem = elem->next) {
+			MtuDestination *d = (MtuDestination *)elem->data;
+			if (now >= d->next_time) destination_timer(d, now);
+			if (d->next_time > now) timeout = (int)MIN((uint64_t)timeout, d->next_time - now);
+		}
+		service_wait(destinations, MAX(timeout, 1));
+		ms_list_free(destinations);
+	}
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+int ms_mtu_discovery_request(const char *host, MSMtuDiscoveryCallback cb, void *user_data) {
+	MtuDestination *d;
+	int result;
+
+	service_lock();
+	d = destination_find(host);
+	if (d == NULL) {
+		d = ms_new0(MtuDestination, 1);
+		d->host = ms_strdup(host);
+		d->sock = -1;
+		d->state = MtuIdle;
+		service.destinations = ms_list_append(service.destinations, d);
+	}
+	if (cb != NULL) {
+		MtuListener *l = ms_new0(MtuListener, 1);
+		l->cb = cb;
+		l->user_data = user_data;
+		d->listeners = ms_list_append(d->listeners, l);
+	}
+	result = d->result;
+	if (!service.run) {
+		service.run = TRUE;
+		ms_thread_create(&service.thread, NULL, service_run, NULL);
+	}
+	service_unlock();
+	return result;
+}
+
+void ms_mtu_discovery_cancel(const char *host, MSMtuDiscoveryCallback cb, void *user_data) {
+	MtuDestination *d;
+	MSList *elem;
+
+	ms_once(&service_once, service_init_locks);
+	ms_mutex_lock(&service.notify_lock);
+	service_lock();
+	d = destination_find(host);
+	for (elem = d ? d->listeners : NULL; elem != NULL; elem = elem->next) {
+		MtuListener *l = (MtuListener *)elem->data;
+		if (l->cb == cb && l->user_data == user_data) {
+			d->listeners = ms_list_remove_link(d->listeners, elem);
+			ms_free(l);
+			break;
+		}
+	}
+	service_unlock();
+	ms_mutex_unlock(&service.notify_lock);
+}
+
+int ms_mtu_discovery_get(const char *host) {
+	MtuDestination *d;
+	int result;
+
+	service_lock();
+	d = destination_find(host);
+	result = d ? d->result : 0;
+	service_unlock();
+	return result;
+}
+
+void ms_mtu_discovery_stop(void) {
+	if (service.run) {
+		service.run = FALSE;
+		ms_thread_join(service.thread, NULL);
+	}
+	service_lock();
+	ms_list_for_each(service.destinations, (void (*)(void *))destination_destroy);
+	ms_list_free(service.destinations);
+	service.destinations = NULL;
+	service_unlock();
+}
+
+int ms_discover_mtu(const char *host) {
+	uint64_t deadline = ms_get_cur_time_ms() + SYNC_TIMEOUT;
+	int mtu = ms_mtu_discovery_request(host, NULL, NULL);
+
+	while (mtu == 0 && ms_get_cur_time_ms() < deadline) {
+		ms_usleep(10000);
+		mtu = ms_mtu_discovery_get(host);
+	}
+	return mtu > 0 ? mtu : -1;
+}
@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 #include "ortp/b64.h"
 #include "mediastreamer2/stun.h"
+#include "audio_playout.h"
 
 static const int default_dtmf_duration_ms=100; /*in milliseconds*/
 
@@ -40,6 +41,8 @@ struct SenderData {
 	int rate;
 	int dtmf_duration;
 	int dtmf_ts_step;
+	int max_payload_size; /*from the path mtu, 0 if unknown*/
+	int oversized; /*packets sent larger than max_payload_size, that the network fragments*/
 	uint32_t dtmf_ts_cur;
 	char relay_session_id[64];
 	int relay_session_id_size;
@@ -179,6 +182,21 @@ static int sender_set_relay_session_id(MSFilter *f, void*arg){
 	return 0;
 }
 
+static int sender_set_mtu(MSFilter *f, void *arg){
+	SenderData *d = (SenderData *) f->data;
+	ms_filter_lock(f);
+	d->max_payload_size=*(int*)arg;
+	d->oversized=0;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int sender_get_mtu(MSFilter *f, void *arg){
+	SenderData *d = (SenderData *) f->data;
+	*(int*)arg=d->max_payload_size>0 ? d->max_payload_size : ms_get_payload_max_size();
+	return 0;
+}
+
 static int sender_get_sr(MSFilter *f, void *arg){
 	SenderData *d = (SenderData *) f->data;
 	PayloadType *pt;
@@ -416,6 +434,11 @@ static void _sender_process(MSFilter * f)
 		}
 		if (im){
 			if (d->skip == FALSE && d->mute==FALSE){
+				if (d->max_payload_size>0 && (int)msgdsize(im)>d->max_payload_size){
+					d->oversized++;
+					ms_warning_ratelimited(10000,"MSRtpSend[%p]: %i packets larger than the %i bytes allowed by the path mtu, they are fragmented",
+						f,d->oversized,d->max_payload_size);
+				}
 				header = rtp_session_create_packet(s, 12, NULL, 0);
 				rtp_set_markbit(header, mblk_get_marker_info(im));
 				header->b_cont = im;
@@ -474,6 +497,8 @@ static MSFilterMethod sender_methods[] = {
 	{MS_FILTER_GET_NCHANNELS, sender_get_ch },
 	{MS_RTP_SEND_SET_DTMF_DURATION, sender_set_dtmf_duration },
 	{MS_RTP_SEND_SEND_GENERIC_CN, sender_send_generic_cn },
+	{MS_FILTER_SET_MTU, sender_set_mtu },
+	{MS_FILTER_GET_MTU, sender_get_mtu },
 	{0, NULL}
 };
 
@@ -514,8 +539,39 @@ MSFilterDesc ms_rtp_send_desc = {
 
 #endif
 
+#define PLAYOUT_DEFAULT_QUANTILE 0.95f
+#define PLAYOUT_DEFAULT_MAX_DELAY 500 /*ms*/
+#define PLAYOUT_RESOLUTION 5 /*ms, of the delay quantile*/
+#define PLAYOUT_MEMORY 500 /*packets, 10 seconds of 20ms packets*/
+#define PLAYOUT_TRANSIT_WINDOW 10000 /*ms, during which the minimum transit time is searched*/
+#define PLAYOUT_DELAY_STEP 10 /*ms*/
+#define PLAYOUT_DECREASE_INTERVAL 500 /*ms between two decreases of the delay*/
+#define PLAYOUT_MAX_MISSES 10 /*consecutive late or early packets before restarting the playout*/
+
+/*
+ * Adaptive playout: the packets are held until ts + min_transit + current_delay, where min_transit is the shortest
+ * transit time (arrival time minus timestamp) observed on the two last windows, and current_delay follows the quantile
+ * of the transit times above it.
+ */
+typedef struct _AdaptivePlayout {
+	MSRtpRecvPlayoutParams params;
+	MSRtpRecvPlayoutStats stats;
+	MSDelayEstimator *estimator;
+	queue_t q; /*packets waiting for their playout time, in timestamp order*/
+	uint32_t last_ts;
+	int64_t last_ext_ts; /*unwrapped timestamp of the last packet received*/
+	int64_t played_ts; /*unwrapped timestamp of the last packet output*/
+	int64_t min_transit[2]; /*of the current and of the previous window, in ms*/
+	uint64_t window_start;
+	uint64_t last_decrease;
+	int misses;
+	bool_t receiving;
+	bool_t playing;
+} AdaptivePlayout;
+
 struct ReceiverData {
 	RtpSession *session;
+	AdaptivePlayout *playout;
 	int current_pt;
 	int rate;
 	bool_t starting;
@@ -524,6 +580,140 @@ struct ReceiverData {
 
 typedef struct ReceiverData ReceiverData;
 
+static void playout_reset(AdaptivePlayout *ap) {
+	flushq(&ap->q, 0);
+	ms_delay_estimator_reset(ap->estimator);
+	ap->min_transit[0] = ap->min_transit[1] = INT64_MAX;
+	ap->receiving = FALSE;
+	ap->playing = FALSE;
+	ap->misses = 0;
+}
+
+static AdaptivePlayout *playout_new(const MSRtpRecvPlayoutParams *params) {
+	AdaptivePlayout *ap = ms_new0(AdaptivePlayout, 1);
+	ap->params = *params;
+	if (ap->params.quantile <= 0 || ap->params.quantile >= 1) ap->params.quantile = PLAYOUT_DEFAULT_QUANTILE;
+	if (ap->params.max_delay <= 0) ap->params.max_delay = PLAYOUT_DEFAULT_MAX_DELAY;
+	ap->params.min_delay = MAX(0, MIN(ap->params.min_delay, ap->params.max_delay));
+	ap->estimator = ms_delay_estimator_new(ap->params.max_delay, PLAYOUT_RESOLUTION, PLAYOUT_MEMORY);
+	qinit(&ap->q);
+	playout_reset(ap);
+	return ap;
+}
+
+static void playout_destroy(AdaptivePlayout *ap) {
+	flushq(&ap->q, 0);
+	ms_delay_estimator_destroy(ap->estimator);
+	ms_free(ap);
+}
+
+static int64_t playout_unwrap(AdaptivePlayout *ap, uint32_t ts) {
+	return ap->last_ext_ts + (int32_t)(ts - ap->last_ts);
+}
+
+static int64_t playout_min_transit(AdaptivePlayout *ap) {
+	return MIN(ap->min_transit[0], ap->min_transit[1]);
+}
+
+/* Counts a late or early packet, and restarts the playout when they follow each other, as after a timestamp jump. */
+static void playout_miss(AdaptivePlayout *ap, mblk_t *m) {
+	freemsg(m);
+	if (++ap->misses >= PLAYOUT_MAX_MISSES) {
+		ms_warning("MSRtpRecv: %i consecutive packets out of the playout window, restarting adaptive playout", ap->misses);
+		playout_reset(ap);
+		ap->stats.resyncs++;
+	}
+}
+
+static int64_t playout_time(AdaptivePlayout *ap, int64_t ext_ts, int rate) {
+	return ext_ts * 1000 / rate + playout_min_transit(ap) + ap->stats.current_delay;
+}
+
+/* Called with the packets received during the last tick of the given interval. */
+static void playout_put(AdaptivePlayout *ap, mblk_t *m, int rate, uint64_t now, int interval) {
+	uint32_t ts = rtp_get_timestamp(m);
+	int64_t ext_ts, transit;
+	mblk_t *it;
+
+	if (!ap->receiving) {
+		ap->last_ts = ts;
+		ap->last_ext_ts = ts;
+		ap->window_start = now;
+		ap->receiving = TRUE;
+	}
+	ext_ts = playout_unwrap(ap, ts);
+	if (ext_ts > ap->last_ext_ts) {
+		ap->last_ts = ts;
+		ap->last_ext_ts = ext_ts;
+	}
+	ap->stats.packets++;
+	transit = (int64_t)now - ext_ts * 1000 / rate;
+	if (ap->playing && playout_min_transit(ap) - transit > ap->params.max_delay) {
+		/*faster than the fastest packet by more than the highest delay: the timestamps jumped ahead*/
+		ap->stats.early++;
+		playout_miss(ap, m);
+		return;
+	}
+	if (now - ap->window_start >= PLAYOUT_TRANSIT_WINDOW) {
+		ap->min_transit[1] = ap->min_transit[0];
+		ap->min_transit[0] = INT64_MAX;
+		ap->window_start = now;
+	}
+	ap->min_transit[0] = MIN(ap->min_transit[0], transit);
+	ms_delay_estimator_add(ap->estimator, (int)MIN(transit - playout_min_transit(ap), ap->params.max_delay));
+	if (ap->playing && (ext_ts <= ap->played_ts || playout_time(ap, ext_ts, rate) <= (int64_t)now - interval)) {
+		/*its playout time has passed, the decoder concealed it*/
+		ap->stats.late++;
+		playout_miss(ap, m);
+		return;
+	}
+	ap->misses = 0;
+	/*insert in timestamp order, from the end since the packets mostly arrive in order*/
+	for (it = qlast(&ap->q); it != NULL && !qend(&ap->q, it); it = it->b_prev) {
+		int32_t diff = (int32_t)(ts - rtp_get_timestamp(it));
+		if (diff == 0) {
+			freemsg(m); /*duplicate*/
+			return;
+		}
+		if (diff > 0) break;
+	}
+	if (it == NULL) putq(&ap->q, m);
+	else insq(&ap->q, it->b_next, m);
+}
+
+static void playout_update_delay(AdaptivePlayout *ap, uint64_t now) {
+	int target = ms_delay_estimator_get_quantile(ap->estimator, ap->params.quantile);
+
+	target = MAX(ap->params.min_delay, MIN(target, ap->params.max_delay));
+	ap->stats.target_delay = target;
+	if (!ap->playing) {
+		ap->stats.current_delay = target;
+	} else if (target > ap->stats.current_delay) {
+		/*the decoder conceals the gap, and the playout filter blends it*/
+		ap->stats.current_delay = target;
+		ap->stats.delay_increases++;
+	} else if (ap->stats.current_delay - target >= PLAYOUT_DELAY_STEP && now - ap->last_decrease >= PLAYOUT_DECREASE_INTERVAL) {
+		/*the packets come earlier than their decoded audio is played, the playout filter compresses it*/
+		ap->stats.current_delay -= PLAYOUT_DELAY_STEP;
+		ap->stats.delay_decreases++;
+		ap->last_decrease = now;
+	}
+}
+
+static mblk_t *playout_get(AdaptivePlayout *ap, int rate, uint64_t now) {
+	mblk_t *m = qbegin(&ap->q);
+	int64_t ext_ts;
+
+	if (qend(&ap->q, m)) return NULL;
+	ext_ts = playout_unwrap(ap, rtp_get_timestamp(m));
+	if (playout_time(ap, ext_ts, rate) > (int64_t)now) return NULL;
+	if (!ap->playing) ap->last_decrease = now;
+	ap->played_ts = ext_ts;
+	ap->playing = TRUE;
+	remq(&ap->q, m);
+	return m;
+}
+
 static void receiver_init(MSFilter * f)
 {
 	ReceiverData *d = (ReceiverData *)ms_new0(ReceiverData, 1);
@@ -538,6 +728,7 @@ static void receiver_postprocess(MSFilter * f){
 
 static void receiver_uninit(MSFilter * f){
 	ReceiverData *d = (ReceiverData *) f->data;
+	if (d->playout) playout_destroy(d->playout);
 	ms_free(d);
 }
 
@@ -555,6 +746,7 @@ static int receiver_set_session(MSFilter * f, void *arg)
 		    rtp_session_get_recv_payload_type(s));
 	}
 	d->session = s;
+	if (d->playout) rtp_session_enable_jitter_buffer(s, FALSE);
 
 	return 0;
 }
@@ -601,6 +793,38 @@ static int receiver_reset_jitter_buffer(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int receiver_set_playout_params(MSFilter *f, void *arg) {
+	ReceiverData *d = (ReceiverData *)f->data;
+	const MSRtpRecvPlayoutParams *params = (const MSRtpRecvPlayoutParams *)arg;
+
+	ms_filter_lock(f);
+	if (d->playout) {
+		playout_destroy(d->playout);
+		d->playout = NULL;
+	}
+	if (params->enabled) {
+		d->playout = playout_new(params);
+		ms_message("MSRtpRecv: adaptive playout enabled, quantile=%f, delay between %i and %i ms",
+			d->playout->params.quantile, d->playout->params.min_delay, d->playout->params.max_delay);
+	}
+	if (d->session) rtp_session_enable_jitter_buffer(d->session, !params->enabled);
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int receiver_get_playout_stats(MSFilter *f, void *arg) {
+	ReceiverData *d = (ReceiverData *)f->data;
+	int err = -1;
+
+	ms_filter_lock(f);
+	if (d->playout) {
+		*(MSRtpRecvPlayoutStats *)arg = d->playout->stats;
+		err = 0;
+	}
+	ms_filter_unlock(f);
+	return err;
+}
+
 
 static void receiver_preprocess(MSFilter * f){
 	ReceiverData *d = (ReceiverData *) f->data;
@@ -636,6 +860,33 @@ static bool_t receiver_check_payload_type(MSFilter *f, ReceiverData *d, mblk_t *
 	return TRUE;
 }
 
+static void receiver_output(MSFilter *f, mblk_t *m) {
+	mblk_set_timestamp_info(m, rtp_get_timestamp(m));
+	mblk_set_marker_info(m, rtp_get_markbit(m));
+	mblk_set_cseq(m, rtp_get_seqnumber(m));
+	rtp_get_payload(m,&m->b_rptr);
+	ms_queue_put(f->outputs[0], m);
+}
+
+static void receiver_process_adaptive(MSFilter *f, ReceiverData *d) {
+	uint64_t now = f->ticker->time;
+	uint32_t timestamp = (uint32_t) (now * (d->rate/1000));
+	mblk_t *m;
+
+	/*without jitter buffer, the session gives the packets as soon as they are received*/
+	while ((m = rtp_session_recvm_with_ts(d->session, timestamp)) != NULL) {
+		if (receiver_check_payload_type(f, d, m)){
+			playout_put(d->playout, m, d->rate, now, f->ticker->interval);
+		}else{
+			freemsg(m);
+		}
+	}
+	playout_update_delay(d->playout, now);
+	while ((m = playout_get(d->playout, d->rate, now)) != NULL) {
+		receiver_output(f, m);
+	}
+}
+
 static void receiver_process(MSFilter * f)
 {
 	ReceiverData *d = (ReceiverData *) f->data;
@@ -645,9 +896,11 @@ static void receiver_process(MSFilter * f)
 	if (d->session == NULL)
 		return;
 	
+	ms_filter_lock(f);
 	if (d->reset_jb){
 		ms_message("Reseting jitter buffer");
 		rtp_session_resync(d->session);
+		if (d->playout) playout_reset(d->playout);
 		d->reset_jb=FALSE;
 	}
 
@@ -660,18 +913,19 @@ static void receiver_process(MSFilter * f)
 		d->starting=FALSE;
 	}
 
-	timestamp = (uint32_t) (f->ticker->time * (d->rate/1000));
-	while ((m = rtp_session_recvm_with_ts(d->session, timestamp)) != NULL) {
-		if (receiver_check_payload_type(f, d, m)){
-			mblk_set_timestamp_info(m, rtp_get_timestamp(m));
-			mblk_set_marker_info(m, rtp_get_markbit(m));
-			mblk_set_cseq(m, rtp_get_seqnumber(m));
-			rtp_get_payload(m,&m->b_rptr);
-			ms_queue_put(f->outputs[0], m);
-		}else{
-			freemsg(m);
+	if (d->playout){
+		receiver_process_adaptive(f, d);
+	}else{
+		timestamp = (uint32_t) (f->ticker->time * (d->rate/1000));
+		while ((m = rtp_session_recvm_with_ts(d->session, timestamp)) != NULL) {
+			if (receiver_check_payload_type(f, d, m)){
+				receiver_output(f, m);
+			}else{
+				freemsg(m);
+			}
 		}
 	}
+	ms_filter_unlock(f);
 	/*every second compute recv bandwidth*/
 	if (f->ticker->time % 1000 == 0)
 		rtp_session_compute_recv_bandwidth(d->session);
@@ -680,6 +934,8 @@ static void receiver_process(MSFilter * f)
 static MSFilterMethod receiver_methods[] = {
 	{	MS_RTP_RECV_SET_SESSION	, receiver_set_session	},
 	{	MS_RTP_RECV_RESET_JITTER_BUFFER, receiver_reset_jitter_buffer },
+	{	MS_RTP_RECV_SET_PLAYOUT_PARAMS, receiver_set_playout_params },
+	{	MS_RTP_RECV_GET_PLAYOUT_STATS, receiver_get_playout_stats },
 	{	MS_FILTER_GET_SAMPLE_RATE	, receiver_get_sr		},
 	{	MS_FILTER_GET_NCHANNELS	,	receiver_get_ch	},
 	{	0, NULL}
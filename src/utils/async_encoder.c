@@ -0,0 +1,189 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "async_encoder.h"
+
+typedef struct _MSAsyncEncoderFrame {
+	mblk_t *frame;
+	uint64_t frame_time;
+} MSAsyncEncoderFrame;
+
+struct _MSAsyncEncoder {
+	MSFilter *filter;
+	MSAsyncEncoderProcessFunc func;
+	MSAsyncEncoderFrame *pending;
+	int max_pending;
+	int first;
+	int count;
+	MSQueue output;
+	ms_mutex_t lock;
+	ms_cond_t cond;
+	ms_thread_t thread;
+	unsigned int dropped_frames;
+	bool_t enabled;
+	bool_t running;
+};
+
+MSAsyncEncoder *ms_async_encoder_new(MSFilter *f, MSAsyncEncoderProcessFunc func, int max_pending) {
+	MSAsyncEncoder *obj = (MSAsyncEncoder *)ms_new0(MSAsyncEncoder, 1);
+	obj->filter = f;
+	obj->func = func;
+	obj->max_pending = (max_pending > 0) ? max_pending : 1;
+	obj->pending = (MSAsyncEncoderFrame *)ms_new0(MSAsyncEncoderFrame, obj->max_pending);
+	obj->enabled = TRUE;
+	ms_queue_init(&obj->output);
+	ms_mutex_init(&obj->lock, NULL);
+	ms_cond_init(&obj->cond, NULL);
+	return obj;
+}
+
+static void ms_async_encoder_flush(MSAsyncEncoder *obj) {
+	while (obj->count > 0) {
+		freemsg(obj->pending[obj->first].frame);
+		obj->pending[obj->first].frame = NULL;
+		obj->first = (obj->first + 1) % obj->max_pending;
+		obj->count--;
+	}
+	obj->first = 0;
+	ms_queue_flush(&obj->output);
+}
+
+void ms_async_encoder_destroy(MSAsyncEncoder *obj) {
+	if (obj->running) ms_async_encoder_stop(obj);
+	ms_async_encoder_flush(obj);
+	ms_cond_destroy(&obj->cond);
+	ms_mutex_destroy(&obj->lock);
+	ms_free(obj->pending);
+	ms_free(obj);
+}
+
+void ms_async_encoder_enable(MSAsyncEncoder *obj, bool_t enabled) {
+	if (obj->running) {
+		ms_error("MSAsyncEncoder [%p]: cannot change mode while running.", obj);
+		return;
+	}
+	obj->enabled = enabled;
+}
+
+bool_t ms_async_encoder_enabled(const MSAsyncEncoder *obj) {
+	return obj->enabled;
+}
+
+static void *ms_async_encoder_thread(void *arg) {
+	MSAsyncEncoder *obj = (MSAsyncEncoder *)arg;
+	MSAsyncEncoderFrame entry;
+	MSQueue produced;
+	mblk_t *m;
+
+	ms_queue_init(&produced);
+	ms_mutex_lock(&obj->lock);
+	while (obj->running) {
+		if (obj->count == 0) {
+			ms_cond_wait(&obj->cond, &obj->lock);
+			continue;
+		}
+		entry = obj->pending[obj->first];
+		obj->pending[obj->first].frame = NULL;
+		obj->first = (obj->first + 1) % obj->max_pending;
+		obj->count--;
+		ms_mutex_unlock(&obj->lock);
+
+		ms_filter_lock(obj->filter);
+		obj->func(obj->filter, entry.frame, entry.frame_time, &produced);
+		ms_filter_unlock(obj->filter);
+		freemsg(entry.frame);
+
+		ms_mutex_lock(&obj->lock);
+		while ((m = ms_queue_get(&produced)) != NULL) {
+			ms_queue_put(&obj->output, m);
+		}
+	}
+	ms_mutex_unlock(&obj->lock);
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+void ms_async_encoder_start(MSAsyncEncoder *obj) {
+	if (!obj->enabled || obj->running) return;
+	obj->running = TRUE;
+	obj->dropped_frames = 0;
+	ms_thread_create(&obj->thread, NULL, ms_async_encoder_thread, obj);
+}
+
+void ms_async_encoder_stop(MSAsyncEncoder *obj) {
+	if (!obj->running) return;
+	ms_mutex_lock(&obj->lock);
+	obj->running = FALSE;
+	ms_cond_signal(&obj->cond);
+	ms_mutex_unlock(&obj->lock);
+	ms_thread_join(obj->thread, NULL);
+	ms_async_encoder_flush(obj);
+	if (obj->dropped_frames > 0) {
+		ms_message("MSAsyncEncoder [%p]: %u frames dropped because encoder could not keep up.", obj, obj->dropped_frames);
+	}
+}
+
+void ms_async_encoder_push(MSAsyncEncoder *obj, mblk_t *frame, uint64_t frame_time) {
+	int index;
+
+	if (!obj->running) {
+		MSQueue produced;
+		mblk_t *m;
+		ms_queue_init(&produced);
+		ms_filter_lock(obj->filter);
+		obj->func(obj->filter, frame, frame_time, &produced);
+		ms_filter_unlock(obj->filter);
+		freemsg(frame);
+		ms_mutex_lock(&obj->lock);
+		while ((m = ms_queue_get(&produced)) != NULL) {
+			ms_queue_put(&obj->output, m);
+		}
+		ms_mutex_unlock(&obj->lock);
+		return;
+	}
+
+	ms_mutex_lock(&obj->lock);
+	if (obj->count == obj->max_pending) {
+		/* The encoder is late, drop the oldest frame: the most recent one is the one that matters. */
+		freemsg(obj->pending[obj->first].frame);
+		obj->pending[obj->first].frame = NULL;
+		obj->first = (obj->first + 1) % obj->max_pending;
+		obj->count--;
+		obj->dropped_frames++;
+	}
+	index = (obj->first + obj->count) % obj->max_pending;
+	obj->pending[index].frame = frame;
+	obj->pending[index].frame_time = frame_time;
+	obj->count++;
+	ms_cond_signal(&obj->cond);
+	ms_mutex_unlock(&obj->lock);
+}
+
+void ms_async_encoder_fetch(MSAsyncEncoder *obj, MSQueue *output) {
+	mblk_t *m;
+	ms_mutex_lock(&obj->lock);
+	while ((m = ms_queue_get(&obj->output)) != NULL) {
+		ms_queue_put(output, m);
+	}
+	ms_mutex_unlock(&obj->lock);
+}
+
+unsigned int ms_async_encoder_get_dropped_frames(const MSAsyncEncoder *obj) {
+	return obj->dropped_frames;
+}
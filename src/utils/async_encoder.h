@@ -0,0 +1,104 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef ASYNC_ENCODER_H
+#define ASYNC_ENCODER_H
+
+#include "mediastreamer2/msfilter.h"
+
+/**
+ * @brief MSAsyncEncoder runs the encoding function of a video encoder filter on a dedicated worker thread,
+ * so that a slow frame (typically a keyframe) does not stall the ticker that drives the whole graph.
+ * Frames pushed from the process() function are queued in a bounded queue (oldest frames are dropped when full),
+ * encoded in order by the worker with the filter lock held, and the resulting packets are fetched back into the
+ * filter output on the next tick.
+ */
+typedef struct _MSAsyncEncoder MSAsyncEncoder;
+
+/**
+ * @brief Encoding function, called with the filter lock held.
+ * @param f The encoder filter
+ * @param frame The frame to encode. It remains owned by the caller.
+ * @param frame_time The ticker time (in milliseconds) at which the frame was pushed, to be used for RTP timestamps.
+ * @param output The queue where the packets resulting from the encoding shall be put.
+ */
+typedef void (*MSAsyncEncoderProcessFunc)(MSFilter *f, mblk_t *frame, uint64_t frame_time, MSQueue *output);
+
+/**
+ * @brief Create an MSAsyncEncoder
+ * @param f The encoder filter
+ * @param func The encoding function
+ * @param max_pending Maximum number of frames waiting to be encoded
+ * @return The pointer on the created MSAsyncEncoder
+ */
+extern MSAsyncEncoder *ms_async_encoder_new(MSFilter *f, MSAsyncEncoderProcessFunc func, int max_pending);
+
+/**
+ * @brief Destroy an MSAsyncEncoder. The worker thread must have been stopped.
+ * @param obj MSAsyncEncoder
+ */
+extern void ms_async_encoder_destroy(MSAsyncEncoder *obj);
+
+/**
+ * @brief Enable or disable the worker thread. When disabled, frames are encoded synchronously in
+ * ms_async_encoder_push(). It must be called while the encoder is stopped.
+ * @param obj MSAsyncEncoder
+ * @param enabled TRUE to encode on the worker thread
+ */
+extern void ms_async_encoder_enable(MSAsyncEncoder *obj, bool_t enabled);
+
+/**
+ * @brief Tell whether encoding is done on the worker thread.
+ */
+extern bool_t ms_async_encoder_enabled(const MSAsyncEncoder *obj);
+
+/**
+ * @brief Start the worker thread, typically from the preprocess() function of the filter.
+ * @param obj MSAsyncEncoder
+ */
+extern void ms_async_encoder_start(MSAsyncEncoder *obj);
+
+/**
+ * @brief Stop the worker thread, typically from the postprocess() function of the filter.
+ * Pending frames and packets not yet fetched are dropped. It must not be called with the filter lock held.
+ * @param obj MSAsyncEncoder
+ */
+extern void ms_async_encoder_stop(MSAsyncEncoder *obj);
+
+/**
+ * @brief Queue a frame for encoding. It must not be called with the filter lock held.
+ * @param obj MSAsyncEncoder
+ * @param frame The frame to encode. Ownership is transfered to the MSAsyncEncoder.
+ * @param frame_time The current ticker time.
+ */
+extern void ms_async_encoder_push(MSAsyncEncoder *obj, mblk_t *frame, uint64_t frame_time);
+
+/**
+ * @brief Move the packets produced since the last call to the output queue.
+ * @param obj MSAsyncEncoder
+ * @param output The output queue of the filter.
+ */
+extern void ms_async_encoder_fetch(MSAsyncEncoder *obj, MSQueue *output);
+
+/**
+ * @brief Get the number of frames dropped because the encoder could not keep up.
+ */
+extern unsigned int ms_async_encoder_get_dropped_frames(const MSAsyncEncoder *obj);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "audio_playout.h"
+
+#include <math.h>
+
+#define SILENCE_LEVEL 32 /*mean amplitude under which two segments are considered similar*/
+#define MAX_CANDIDATES 128 /*periods compared by the coarse search, 2.5 to 12.5ms at 8kHz*/
+#define PEAK_TOLERANCE 0.05
+
+struct _MSDelayEstimator {
+	float *bins;
+	float total;
+	float forget;
+	int nbins;
+	int resolution;
+	int max_delay;
+};
+
+MSDelayEstimator *ms_delay_estimator_new(int max_delay, int resolution, int memory) {
+	MSDelayEstimator *obj = ms_new0(MSDelayEstimator, 1);
+	obj->resolution = MAX(resolution, 1);
+	obj->max_delay = MAX(max_delay, obj->resolution);
+	obj->nbins = obj->max_delay / obj->resolution + 1;
+	obj->bins = ms_new0(float, obj->nbins);
+	obj->forget = expf(-1.0f / (float)MAX(memory, 1));
+	return obj;
+}
+
+void ms_delay_estimator_destroy(MSDelayEstimator *obj) {
+	ms_free(obj->bins);
+	ms_free(obj);
+}
+
+void ms_delay_estimator_reset(MSDelayEstimator *obj) {
+	memset(obj->bins, 0, obj->nbins * sizeof(float));
+	obj->total = 0;
+}
+
+void ms_delay_estimator_add(MSDelayEstimator *obj, int delay) {
+	int index = delay / obj->resolution;
+	int i;
+
+	if (index < 0) index = 0;
+	else if (index >= obj->nbins) index = obj->nbins - 1;
+	for (i = 0; i < obj->nbins; i++) {
+		obj->bins[i] *= obj->forget;
+	}
+	obj->bins[index] += 1.0f;
+	obj->total = obj->total * obj->forget + 1.0f;
+}
+
+int ms_delay_estimator_get_quantile(const MSDelayEstimator *obj, float quantile) {
+	float threshold = quantile * obj->total;
+	float sum = 0;
+	int i;
+
+	if (obj->total <= 0) return 0;
+	for (i = 0; i < obj->nbins - 1; i++) {
+		sum += obj->bins[i];
+		if (sum >= threshold) break;
+	}
+	return MIN((i + 1) * obj->resolution, obj->max_delay);
+}
+
+/* Correlation of two segments, on the sum of the channels, taking one sample every step. */
+static double segment_similarity(const int16_t *a, const int16_t *b, int nframes, int nchannels, int step) {
+	double ab = 0, aa = 0, bb = 0;
+	double silence = (double)SILENCE_LEVEL * SILENCE_LEVEL * nchannels * nchannels * ((nframes + step - 1) / step);
+	int i, c;
+
+	for (i = 0; i < nframes; i += step) {
+		int va = 0, vb = 0;
+		for (c = 0; c < nchannels; c++) {
+			va += a[i * nchannels + c];
+			vb += b[i * nchannels + c];
+		}
+		ab += (double)va * vb;
+		aa += (double)va * va;
+		bb += (double)vb * vb;
+	}
+	if (aa < silence && bb < silence) return 1;
+	if (aa == 0 || bb == 0) return 0;
+	return ab / sqrt(aa * bb);
+}
+
+static double period_similarity(const int16_t *samples, int nframes, int nchannels, int period, bool_t from_end, int step) {
+	const int16_t *a = from_end ? samples + (nframes - 2 * period) * nchannels : samples;
+	return segment_similarity(a, a + period * nchannels, period, nchannels, step);
+}
+
+int ms_audio_find_period(const int16_t *samples, int nframes, int nchannels, int rate, bool_t from_end, float *similarity) {
+	int min_period = rate / 400; /*2.5ms*/
+	int max_period = ms_audio_get_max_period(rate);
+	int step = MAX(rate / 8000, 1);
+	double coarse[MAX_CANDIDATES];
+	double max_similarity = -2, best_similarity = -2;
+	int ncandidates = 0;
+	int best = 0;
+	int i, period, first, last;
+
+	*similarity = 0;
+	if (nframes < 2 * max_period || min_period == 0) return 0;
+	/*coarse search on a signal decimated to 8kHz*/
+	for (period = min_period; period <= max_period && ncandidates < MAX_CANDIDATES; period += step) {
+		coarse[ncandidates] = period_similarity(samples, nframes, nchannels, period, from_end, step);
+		max_similarity = MAX(max_similarity, coarse[ncandidates]);
+		ncandidates++;
+	}
+	/*the first peak nearly as good as the best one is the period, the next ones are its multiples*/
+	for (i = 0; i < ncandidates; i++) {
+		if (coarse[i] >= max_similarity - PEAK_TOLERANCE && (i + 1 == ncandidates || coarse[i] >= coarse[i + 1])) {
+			best = min_period + i * step;
+			best_similarity = coarse[i];
+			break;
+		}
+	}
+	if (step > 1) {
+		/*refined around the peak on all the samples*/
+		first = MAX(min_period, best - step + 1);
+		last = MIN(max_period, best + step - 1);
+		best_similarity = -2;
+		for (period = first; period <= last; period++) {
+			double s = period_similarity(samples, nframes, nchannels, period, from_end, 1);
+			if (s > best_similarity) {
+				best_similarity = s;
+				best = period;
+			}
+		}
+	}
+	*similarity = (float)best_similarity;
+	return best;
+}
+
+void ms_audio_crossfade(int16_t *out, const int16_t *fade_out, const int16_t *fade_in, int nframes, int nchannels) {
+	int i, c;
+
+	for (i = 0; i < nframes; i++) {
+		float w = (float)(i + 1) / (float)(nframes + 1);
+		for (c = 0; c < nchannels; c++) {
+			int k = i * nchannels + c;
+			out[k] = (int16_t)((float)fade_out[k] * (1.0f - w) + (float)fade_in[k] * w);
+		}
+	}
+}
+
+int ms_audio_accelerate(int16_t *samples, int nframes, int nchannels, int rate, float min_similarity, int max_removed) {
+	float similarity;
+	int period = ms_audio_find_period(samples, nframes, nchannels, rate, FALSE, &similarity);
+
+	if (period == 0 || period > max_removed || similarity < min_similarity) return 0;
+	ms_audio_crossfade(samples, samples, samples + period * nchannels, period, nchannels);
+	memmove(samples + period * nchannels, samples + 2 * period * nchannels, (nframes - 2 * period) * nchannels * sizeof(int16_t));
+	return period;
+}
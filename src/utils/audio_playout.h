@@ -0,0 +1,103 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef AUDIO_PLAYOUT_H
+#define AUDIO_PLAYOUT_H
+
+#include "mediastreamer2/mscommon.h"
+
+/**
+ * @brief MSDelayEstimator tracks a quantile of the delays of the received packets, with a histogram whose
+ * old observations are progressively forgotten, so that the estimate follows the changes of the network.
+ */
+typedef struct _MSDelayEstimator MSDelayEstimator;
+
+/**
+ * @brief Create a delay estimator.
+ * @param max_delay The largest delay tracked, in ms. Longer delays are counted as this one.
+ * @param resolution The width of the histogram bins, in ms.
+ * @param memory The number of observations after which an observation weighs 1/e of a new one.
+ * @return The estimator.
+ */
+MS2_PUBLIC MSDelayEstimator *ms_delay_estimator_new(int max_delay, int resolution, int memory);
+
+MS2_PUBLIC void ms_delay_estimator_destroy(MSDelayEstimator *obj);
+
+/**
+ * @brief Forget all the observations.
+ * @param obj MSDelayEstimator
+ */
+MS2_PUBLIC void ms_delay_estimator_reset(MSDelayEstimator *obj);
+
+/**
+ * @brief Add the delay of a packet.
+ * @param obj MSDelayEstimator
+ * @param delay The delay, in ms, relative to the fastest packet.
+ */
+MS2_PUBLIC void ms_delay_estimator_add(MSDelayEstimator *obj, int delay);
+
+/**
+ * @brief Get the delay that the given fraction of the packets do not exceed.
+ * @param obj MSDelayEstimator
+ * @param quantile The fraction, between 0 and 1.
+ * @return The delay in ms, rounded up to the resolution, 0 if nothing was observed.
+ */
+MS2_PUBLIC int ms_delay_estimator_get_quantile(const MSDelayEstimator *obj, float quantile);
+
+/**
+ * @brief Longest pitch period searched by the time stretching functions, in samples.
+ * Their buffers must hold at least two of them.
+ */
+static MS2_INLINE int ms_audio_get_max_period(int rate) {
+	return rate / 80; /*12.5ms*/
+}
+
+/**
+ * @brief Find the pitch period of interleaved 16 bits samples, by normalized cross-correlation of two
+ * consecutive segments.
+ * @param samples The samples.
+ * @param nframes The number of samples per channel, at least twice ms_audio_get_max_period().
+ * @param nchannels The number of channels.
+ * @param rate The sampling rate, in Hz.
+ * @param from_end TRUE to compare the two last periods of the samples, FALSE for the two first ones.
+ * @param similarity Set to the correlation of the two periods, between -1 and 1. Silence is fully similar.
+ * @return The period in samples per channel, 0 if there are not enough samples.
+ */
+MS2_PUBLIC int ms_audio_find_period(const int16_t *samples, int nframes, int nchannels, int rate, bool_t from_end, float *similarity);
+
+/**
+ * @brief Overlap-add two sequences of interleaved samples: the first one fades out while the second one fades in.
+ * @param out The result, that may be one of the two sequences.
+ */
+MS2_PUBLIC void ms_audio_crossfade(int16_t *out, const int16_t *fade_out, const int16_t *fade_in, int nframes, int nchannels);
+
+/**
+ * @brief Shorten interleaved samples by one pitch period, overlap-added with the next one at their start.
+ * @param samples The samples, modified in place.
+ * @param nframes The number of samples per channel.
+ * @param nchannels The number of channels.
+ * @param rate The sampling rate, in Hz.
+ * @param min_similarity The correlation the two periods must have, not to alter a transient.
+ * @param max_removed The longest period that may be removed, in samples per channel.
+ * @return The number of samples per channel removed, 0 if there are not enough samples, they are not periodic
+ * or their period is longer than max_removed.
+ */
+MS2_PUBLIC int ms_audio_accelerate(int16_t *samples, int nframes, int nchannels, int rate, float min_similarity, int max_removed);
+
+#endif
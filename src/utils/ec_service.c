@@ -0,0 +1,175 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "ec_service.h"
+
+#define MAX_WORKERS 16
+
+struct _MSEcService {
+	MSEcServiceJob *first;
+	MSEcServiceJob *last;
+	ms_mutex_t lock;
+	ms_cond_t cond; /*signaled when a job is queued*/
+	ms_cond_t done_cond; /*signaled when a job is completed*/
+	ms_thread_t workers[MAX_WORKERS];
+	int nworkers;
+	int refcount;
+	bool_t running;
+};
+
+static MSEcService *ec_service = NULL;
+static ms_mutex_t ec_service_lock;
+static ms_once_t ec_service_once = MS_ONCE_INIT;
+
+static void ec_service_init_lock(void) {
+	ms_mutex_init(&ec_service_lock, NULL);
+}
+
+static MSEcServiceJob *ec_service_pop(MSEcService *obj) {
+	MSEcServiceJob *job = obj->first;
+	obj->first = job->next;
+	if (obj->first == NULL) obj->last = NULL;
+	job->next = NULL;
+	return job;
+}
+
+/* Removes a job that is still queued. Returns FALSE if a worker already took it. */
+static bool_t ec_service_remove(MSEcService *obj, MSEcServiceJob *job) {
+	MSEcServiceJob *prev = NULL, *it;
+
+	for (it = obj->first; it != NULL; prev = it, it = it->next) {
+		if (it != job) continue;
+		if (prev) prev->next = it->next;
+		else obj->first = it->next;
+		if (obj->last == it) obj->last = prev;
+		it->next = NULL;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static void *ec_service_thread(void *arg) {
+	MSEcService *obj = (MSEcService *)arg;
+	MSEcServiceJob *job;
+
+	ms_mutex_lock(&obj->lock);
+	while (obj->running) {
+		if (obj->first == NULL) {
+			ms_cond_wait(&obj->cond, &obj->lock);
+			continue;
+		}
+		job = ec_service_pop(obj);
+		job->started = TRUE;
+		ms_mutex_unlock(&obj->lock);
+		job->func(job->data);
+		ms_mutex_lock(&obj->lock);
+		job->pending = FALSE;
+		ms_cond_broadcast(&obj->done_cond);
+	}
+	ms_mutex_unlock(&obj->lock);
+	return NULL;
+}
+
+MSEcService *ms_ec_service_ref(void) {
+	MSEcService *obj;
+	int i;
+
+	/* The echo cancellers are configured from the application threads. */
+	ms_once(&ec_service_once, ec_service_init_lock);
+	ms_mutex_lock(&ec_service_lock);
+	obj = ec_service;
+	if (obj != NULL) {
+		obj->refcount++;
+		ms_mutex_unlock(&ec_service_lock);
+		return obj;
+	}
+	obj = ms_new0(MSEcService, 1);
+	obj->nworkers = MIN(MAX((int)ms_get_cpu_count(), 1), MAX_WORKERS);
+	obj->refcount = 1;
+	obj->running = TRUE;
+	ms_mutex_init(&obj->lock, NULL);
+	ms_cond_init(&obj->cond, NULL);
+	ms_cond_init(&obj->done_cond, NULL);
+	for (i = 0; i < obj->nworkers; i++) {
+		ms_thread_create(&obj->workers[i], NULL, ec_service_thread, obj);
+	}
+	ms_message("Echo canceller service started with %i worker threads", obj->nworkers);
+	ec_service = obj;
+	ms_mutex_unlock(&ec_service_lock);
+	return obj;
+}
+
+void ms_ec_service_unref(MSEcService *obj) {
+	int i;
+
+	ms_mutex_lock(&ec_service_lock);
+	if (--obj->refcount > 0) {
+		ms_mutex_unlock(&ec_service_lock);
+		return;
+	}
+	ec_service = NULL;
+	ms_mutex_unlock(&ec_service_lock);
+	ms_mutex_lock(&obj->lock);
+	obj->running = FALSE;
+	ms_cond_broadcast(&obj->cond);
+	ms_mutex_unlock(&obj->lock);
+	for (i = 0; i < obj->nworkers; i++) {
+		ms_thread_join(obj->workers[i], NULL);
+	}
+	/* The owners of the remaining jobs are gone with their references, there is nothing left to run. */
+	ms_cond_destroy(&obj->done_cond);
+	ms_cond_destroy(&obj->cond);
+	ms_mutex_destroy(&obj->lock);
+	ms_free(obj);
+}
+
+void ms_ec_service_submit(MSEcService *obj, MSEcServiceJob *job) {
+	ms_mutex_lock(&obj->lock);
+	job->pending = TRUE;
+	job->started = FALSE;
+	job->next = NULL;
+	if (obj->last) obj->last->next = job;
+	else obj->first = job;
+	obj->last = job;
+	ms_cond_signal(&obj->cond);
+	ms_mutex_unlock(&obj->lock);
+}
+
+void ms_ec_service_wait(MSEcService *obj, MSEcServiceJob *job) {
+	ms_mutex_lock(&obj->lock);
+	if (job->pending && !job->started && ec_service_remove(obj, job)) {
+		/* All the workers are busy: rather than waiting for one, run the job here. */
+		ms_mutex_unlock(&obj->lock);
+		job->func(job->data);
+		job->pending = FALSE;
+		return;
+	}
+	while (job->pending) {
+		ms_cond_wait(&obj->done_cond, &obj->lock);
+	}
+	ms_mutex_unlock(&obj->lock);
+}
+
+int ms_ec_service_get_worker_count(const MSEcService *obj) {
+	return obj->nworkers;
+}
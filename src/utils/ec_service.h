@@ -0,0 +1,81 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef EC_SERVICE_H
+#define EC_SERVICE_H
+
+#include "mediastreamer2/mscommon.h"
+
+/**
+ * @brief MSEcService is a pool of worker threads shared by the echo cancellers of the process.
+ * The echo cancellers running on the same ticker submit the frames of the current tick as one job each,
+ * so that the jobs of all the legs of a conference are processed in parallel, while the ticker goes on
+ * with the rest of the graph. An echo canceller collects the result of its job on the next tick.
+ */
+typedef struct _MSEcService MSEcService;
+
+typedef void (*MSEcServiceFunc)(void *data);
+
+/**
+ * @brief A unit of work for the service. It is owned by the submitter, usually embedded in the filter state,
+ * and must not be modified nor freed while pending.
+ */
+typedef struct _MSEcServiceJob {
+	MSEcServiceFunc func;
+	void *data;
+	struct _MSEcServiceJob *next;
+	bool_t pending;
+	bool_t started;
+} MSEcServiceJob;
+
+/**
+ * @brief Get a reference on the service, creating it and starting its worker threads if needed.
+ * There is one worker thread per cpu.
+ * @return The echo canceller service.
+ */
+extern MSEcService *ms_ec_service_ref(void);
+
+/**
+ * @brief Release a reference on the service. The worker threads are stopped with the last reference.
+ * @param obj MSEcService
+ */
+extern void ms_ec_service_unref(MSEcService *obj);
+
+/**
+ * @brief Queue a job, to be run by the first free worker thread.
+ * @param obj MSEcService
+ * @param job The job, with its func and data set. It shall not be pending already.
+ */
+extern void ms_ec_service_submit(MSEcService *obj, MSEcServiceJob *job);
+
+/**
+ * @brief Wait for a job to complete. Returns immediately if the job is not pending.
+ * A job that no worker has started yet is run by the calling thread.
+ * @param obj MSEcService
+ * @param job A job given to ms_ec_service_submit().
+ */
+extern void ms_ec_service_wait(MSEcService *obj, MSEcServiceJob *job);
+
+/**
+ * @brief Get the number of worker threads of the service.
+ * @param obj MSEcService
+ */
+extern int ms_ec_service_get_worker_count(const MSEcService *obj);
+
+#endif
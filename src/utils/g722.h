@@ -43,9 +43,14 @@ codec is considerably faster, and still fully compatible with wideband terminals
 enum
 {
 	G722_SAMPLE_RATE_8000 = 0x0001,
-	G722_PACKED = 0x0002
+	G722_PACKED = 0x0002,
+	/* The linear audio uses the full 16 bits range: it is halved before encoding and doubled after decoding. */
+	G722_FULL_SCALE = 0x0004
 };
 
+/* Number of sample pairs filtered at once by the QMF */
+#define G722_QMF_BLOCK 160
+
 #ifndef INT16_MAX
 #define INT16_MAX       32767
 #endif
@@ -89,6 +94,9 @@ struct g722_encode_state {
 	int in_bits;
 	unsigned int out_buffer;
 	int out_bits;
+
+	// 1 if the linear audio is halved before encoding, 0 otherwise.
+	int shift;
 };
 
 typedef struct g722_encode_state g722_encode_state_t;
@@ -129,6 +137,9 @@ struct g722_decode_state {
 	int in_bits;
 	unsigned int out_buffer;
 	int out_bits;
+
+	// 1 if the linear audio is doubled after decoding, 0 otherwise.
+	int shift;
 };
 
 typedef struct g722_decode_state g722_decode_state_t;
@@ -145,6 +156,15 @@ struct g722_decode_state *g722_decode_init(struct g722_decode_state *s, int rate
 int g722_decode_release(struct g722_decode_state *s);
 int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_data[], int len);
 
+/* Transmit QMF: x[] holds the 22 last samples of the previous block followed by 2*pairs new samples.
+   The low and high band samples are written interleaved to bands[]. */
+void g722_qmf_analysis(const int16_t x[], int pairs, int bands[]);
+
+/* Receive QMF: x[] holds the 22 last values of the previous block followed by 2*pairs new values,
+   which are the sum and difference of the low and high band samples. The output is shifted left by shift bits,
+   wrapping to 16 bits. */
+void g722_qmf_synthesis(const int16_t x[], int pairs, int16_t amp[], int shift);
+
 #ifdef __cplusplus
 }
 #endif
@@ -170,6 +170,8 @@ struct g722_decode_state *g722_decode_init(struct g722_decode_state *s, int rate
         s->packed = TRUE;
     else
         s->packed = FALSE;
+    if ((options & G722_FULL_SCALE))
+        s->shift = 1;
     s->band[0].det = 32;
     s->band[1].det = 8;
     return s;
@@ -235,18 +237,12 @@ int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_d
            1688,   1360,   1040,    728,
             432,    136,   -432,   -136
     };
-    static const int qmf_coeffs[12] =
-    {
-           3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
-    };
 
     int dlowt;
     int rlow;
     int ihigh;
     int dhigh;
     int rhigh;
-    int xout1;
-    int xout2;
     int wd1;
     int wd2;
     int wd3;
@@ -254,9 +250,15 @@ int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_d
     int outlen;
     int i;
     int j;
+    /* The QMF input history followed by a block of band samples */
+    int16_t qmf_x[22 + 2*G722_QMF_BLOCK];
+    int qmf_pairs;
 
     outlen = 0;
     rhigh = 0;
+    qmf_pairs = 0;
+    for (i = 0;  i < 22;  i++)
+        qmf_x[i] = (int16_t) s->x[i + 2];
     for (j = 0;  j < len;  )
     {
         if (s->packed)
@@ -363,35 +365,43 @@ int g722_decode(struct g722_decode_state *s, int16_t amp[], const uint8_t g722_d
 
         if (s->itu_test_mode)
         {
-            amp[outlen++] = (int16_t) (rlow << 1);
-            amp[outlen++] = (int16_t) (rhigh << 1);
+            amp[outlen++] = (int16_t) ((rlow << 1) << s->shift);
+            amp[outlen++] = (int16_t) ((rhigh << 1) << s->shift);
         }
         else
         {
             if (s->eight_k)
             {
-                amp[outlen++] = (int16_t) rlow;
+                amp[outlen++] = (int16_t) (rlow << s->shift);
             }
             else
             {
-                /* Apply the receive QMF */
-                for (i = 0;  i < 22;  i++)
-                    s->x[i] = s->x[i + 2];
-                s->x[22] = rlow + rhigh;
-                s->x[23] = rlow - rhigh;
-
-                xout1 = 0;
-                xout2 = 0;
-                for (i = 0;  i < 12;  i++)
+                /* Queue the bands for the receive QMF, applied to a whole block */
+                qmf_x[22 + 2*qmf_pairs] = (int16_t) (rlow + rhigh);
+                qmf_x[23 + 2*qmf_pairs] = (int16_t) (rlow - rhigh);
+                if (++qmf_pairs == G722_QMF_BLOCK)
                 {
-                    xout2 += s->x[2*i]*qmf_coeffs[i];
-                    xout1 += s->x[2*i + 1]*qmf_coeffs[11 - i];
+                    g722_qmf_synthesis(qmf_x, qmf_pairs, amp + outlen, s->shift);
+                    outlen += 2*qmf_pairs;
+                    for (i = 0;  i < 22;  i++)
+                        qmf_x[i] = qmf_x[2*qmf_pairs + i];
+                    qmf_pairs = 0;
                 }
-                amp[outlen++] = (int16_t) (xout1 >> 12);
-                amp[outlen++] = (int16_t) (xout2 >> 12);
             }
         }
     }
+    if (qmf_pairs > 0)
+    {
+        g722_qmf_synthesis(qmf_x, qmf_pairs, amp + outlen, s->shift);
+        outlen += 2*qmf_pairs;
+        for (i = 0;  i < 22;  i++)
+            qmf_x[i] = qmf_x[2*qmf_pairs + i];
+    }
+    if (!s->itu_test_mode  &&  !s->eight_k)
+    {
+        for (i = 0;  i < 22;  i++)
+            s->x[i + 2] = qmf_x[i];
+    }
     return outlen;
 }
 /*- End of function --------------------------------------------------------*/
@@ -169,6 +169,8 @@ struct g722_encode_state *g722_encode_init(struct g722_encode_state *s, int rate
         s->packed = TRUE;
     else
         s->packed = FALSE;
+    if ((options & G722_FULL_SCALE))
+        s->shift = 1;
     s->band[0].det = 32;
     s->band[1].det = 8;
     return s;
@@ -232,10 +234,6 @@ int g722_encode(struct g722_encode_state *s, uint8_t g722_data[], const int16_t
     {
         -7408,  -1616,   7408,   1616
     };
-    static const int qmf_coeffs[12] =
-    {
-           3,  -11,   12,   32, -210,  951, 3876, -805,  362, -156,   53,  -11,
-    };
     static const int ihn[3] = {0, 1, 0};
     static const int ihp[3] = {0, 3, 2};
     static const int wh[3] = {0, -214, 798};
@@ -259,47 +257,55 @@ int g722_encode(struct g722_encode_state *s, uint8_t g722_data[], const int16_t
     int xlow;
     int xhigh;
     int g722_bytes;
-    /* Even and odd tap accumulators */
-    int sumeven;
-    int sumodd;
     int ihigh;
     int ilow;
     int code;
+    /* The QMF input history followed by a block of samples, and its output */
+    int16_t qmf_x[22 + 2*G722_QMF_BLOCK];
+    int qmf_bands[2*G722_QMF_BLOCK];
+    int qmf_pairs;
+    int qmf_pos;
 
     g722_bytes = 0;
     xhigh = 0;
+    qmf_pairs = 0;
+    qmf_pos = 0;
     for (j = 0;  j < len;  )
     {
         if (s->itu_test_mode)
         {
             xlow =
-            xhigh = amp[j++] >> 1;
+            xhigh = (amp[j++] >> s->shift) >> 1;
         }
         else
         {
             if (s->eight_k)
             {
-                xlow = amp[j++];
+                xlow = amp[j++] >> s->shift;
             }
             else
             {
-                /* Apply the transmit QMF */
-                /* Shuffle the buffer down */
-                for (i = 0;  i < 22;  i++)
-                    s->x[i] = s->x[i + 2];
-                s->x[22] = amp[j++];
-                s->x[23] = amp[j++];
-    
-                /* Discard every other QMF output */
-                sumeven = 0;
-                sumodd = 0;
-                for (i = 0;  i < 12;  i++)
+                if (qmf_pos == qmf_pairs)
                 {
-                    sumodd += s->x[2*i]*qmf_coeffs[i];
-                    sumeven += s->x[2*i + 1]*qmf_coeffs[11 - i];
+                    /* Apply the transmit QMF to the next block, scaling the samples on the way */
+                    qmf_pairs = (len - j)/2;
+                    if (qmf_pairs > G722_QMF_BLOCK)
+                        qmf_pairs = G722_QMF_BLOCK;
+                    if (qmf_pairs == 0)
+                        break;
+                    for (i = 0;  i < 22;  i++)
+                        qmf_x[i] = (int16_t) s->x[i + 2];
+                    for (i = 0;  i < 2*qmf_pairs;  i++)
+                        qmf_x[22 + i] = amp[j + i] >> s->shift;
+                    for (i = 0;  i < 22;  i++)
+                        s->x[i + 2] = qmf_x[2*qmf_pairs + i];
+                    g722_qmf_analysis(qmf_x, qmf_pairs, qmf_bands);
+                    qmf_pos = 0;
                 }
-                xlow = (sumeven + sumodd) >> 13;
-                xhigh = (sumeven - sumodd) >> 13;
+                xlow = qmf_bands[2*qmf_pos];
+                xhigh = qmf_bands[2*qmf_pos + 1];
+                qmf_pos++;
+                j += 2;
             }
         }
         /* Block 1L, SUBTRA */
@@ -0,0 +1,195 @@
+/*
+ * SpanDSP - a series of DSP components for telephony
+ *
+ * g722_qmf.c - The ITU G.722 codec, band splitting and merging filters.
+ *
+ * The QMF of g722_encode.c and g722_decode.c, applied to a whole block of samples
+ * at once so that it can use vector instructions. The results are bit exact.
+ */
+
+/*! \file */
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include <stdint.h>
+
+#include "g722.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Over a window of 24 samples, the odd taps of the QMF are x[2i]*qmf_coeffs[i],
+ * and its even taps are x[2i + 1]*qmf_coeffs[11 - i].
+ */
+static const int16_t qmf_odd_taps[24] =
+{
+       3,    0,  -11,    0,   12,    0,   32,    0, -210,    0,  951,    0,
+    3876,    0, -805,    0,  362,    0, -156,    0,   53,    0,  -11,    0
+};
+static const int16_t qmf_even_taps[24] =
+{
+       0,  -11,    0,   53,    0, -156,    0,  362,    0, -805,    0, 3876,
+       0,  951,    0, -210,    0,   32,    0,   12,    0,  -11,    0,    3
+};
+/* even + odd, and even - odd taps, giving the low and high bands in one pass */
+static const int16_t qmf_low_taps[24] =
+{
+       3,  -11,  -11,   53,   12, -156,   32,  362, -210, -805,  951, 3876,
+    3876,  951, -805, -210,  362,   32, -156,   12,   53,  -11,  -11,    3
+};
+static const int16_t qmf_high_taps[24] =
+{
+      -3,  -11,   11,   53,  -12, -156,  -32,  362,  210, -805, -951, 3876,
+   -3876,  951,  805, -210, -362,   32,  156,   12,  -53,  -11,   11,    3
+};
+
+#if defined(__SSE2__)
+
+/* Returns the two dot products of the window w with the taps k1 and k2, for two consecutive windows:
+   {w.k1, w.k2, (w + 2).k1, (w + 2).k2} */
+static __m128i qmf_dot2(const int16_t *w, const __m128i k1[3], const __m128i k2[3])
+{
+    __m128i a0 = _mm_loadu_si128((const __m128i *) w);
+    __m128i a1 = _mm_loadu_si128((const __m128i *) (w + 8));
+    __m128i a2 = _mm_loadu_si128((const __m128i *) (w + 16));
+    __m128i b0 = _mm_loadu_si128((const __m128i *) (w + 2));
+    __m128i b1 = _mm_loadu_si128((const __m128i *) (w + 10));
+    __m128i b2 = _mm_loadu_si128((const __m128i *) (w + 18));
+    __m128i a_k1 = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(a0, k1[0]), _mm_madd_epi16(a1, k1[1])), _mm_madd_epi16(a2, k1[2]));
+    __m128i a_k2 = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(a0, k2[0]), _mm_madd_epi16(a1, k2[1])), _mm_madd_epi16(a2, k2[2]));
+    __m128i b_k1 = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(b0, k1[0]), _mm_madd_epi16(b1, k1[1])), _mm_madd_epi16(b2, k1[2]));
+    __m128i b_k2 = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(b0, k2[0]), _mm_madd_epi16(b1, k2[1])), _mm_madd_epi16(b2, k2[2]));
+    __m128i ta = _mm_add_epi32(_mm_unpacklo_epi32(a_k1, a_k2), _mm_unpackhi_epi32(a_k1, a_k2));
+    __m128i tb = _mm_add_epi32(_mm_unpacklo_epi32(b_k1, b_k2), _mm_unpackhi_epi32(b_k1, b_k2));
+
+    return _mm_add_epi32(_mm_unpacklo_epi64(ta, tb), _mm_unpackhi_epi64(ta, tb));
+}
+
+static void load_taps(__m128i k[3], const int16_t taps[24])
+{
+    k[0] = _mm_loadu_si128((const __m128i *) taps);
+    k[1] = _mm_loadu_si128((const __m128i *) (taps + 8));
+    k[2] = _mm_loadu_si128((const __m128i *) (taps + 16));
+}
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+/* Returns {w.k1, w.k2} */
+static int32x2_t qmf_dot(const int16_t *w, const int16x8_t k1[3], const int16x8_t k2[3])
+{
+    int16x8_t x0 = vld1q_s16(w);
+    int16x8_t x1 = vld1q_s16(w + 8);
+    int16x8_t x2 = vld1q_s16(w + 16);
+    int32x4_t acc1 = vmull_s16(vget_low_s16(x0), vget_low_s16(k1[0]));
+    int32x4_t acc2 = vmull_s16(vget_low_s16(x0), vget_low_s16(k2[0]));
+
+    acc1 = vmlal_s16(acc1, vget_high_s16(x0), vget_high_s16(k1[0]));
+    acc2 = vmlal_s16(acc2, vget_high_s16(x0), vget_high_s16(k2[0]));
+    acc1 = vmlal_s16(acc1, vget_low_s16(x1), vget_low_s16(k1[1]));
+    acc2 = vmlal_s16(acc2, vget_low_s16(x1), vget_low_s16(k2[1]));
+    acc1 = vmlal_s16(acc1, vget_high_s16(x1), vget_high_s16(k1[1]));
+    acc2 = vmlal_s16(acc2, vget_high_s16(x1), vget_high_s16(k2[1]));
+    acc1 = vmlal_s16(acc1, vget_low_s16(x2), vget_low_s16(k1[2]));
+    acc2 = vmlal_s16(acc2, vget_low_s16(x2), vget_low_s16(k2[2]));
+    acc1 = vmlal_s16(acc1, vget_high_s16(x2), vget_high_s16(k1[2]));
+    acc2 = vmlal_s16(acc2, vget_high_s16(x2), vget_high_s16(k2[2]));
+    return vpadd_s32(vadd_s32(vget_low_s32(acc1), vget_high_s32(acc1)), vadd_s32(vget_low_s32(acc2), vget_high_s32(acc2)));
+}
+
+static void load_taps(int16x8_t k[3], const int16_t taps[24])
+{
+    k[0] = vld1q_s16(taps);
+    k[1] = vld1q_s16(taps + 8);
+    k[2] = vld1q_s16(taps + 16);
+}
+
+#endif
+
+static int dot24(const int16_t *w, const int16_t taps[24])
+{
+    int sum = 0;
+    int i;
+
+    for (i = 0;  i < 24;  i++)
+        sum += w[i]*taps[i];
+    return sum;
+}
+/*- End of function --------------------------------------------------------*/
+
+void g722_qmf_analysis(const int16_t x[], int pairs, int bands[])
+{
+    int p = 0;
+
+#if defined(__SSE2__)
+    __m128i low[3];
+    __m128i high[3];
+
+    load_taps(low, qmf_low_taps);
+    load_taps(high, qmf_high_taps);
+    for (  ;  p + 2 <= pairs;  p += 2)
+        _mm_storeu_si128((__m128i *) (bands + 2*p), _mm_srai_epi32(qmf_dot2(x + 2*p, low, high), 13));
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    int16x8_t low[3];
+    int16x8_t high[3];
+
+    load_taps(low, qmf_low_taps);
+    load_taps(high, qmf_high_taps);
+    for (  ;  p < pairs;  p++)
+        vst1_s32(bands + 2*p, vshr_n_s32(qmf_dot(x + 2*p, low, high), 13));
+#endif
+    for (  ;  p < pairs;  p++)
+    {
+        bands[2*p] = dot24(x + 2*p, qmf_low_taps) >> 13;
+        bands[2*p + 1] = dot24(x + 2*p, qmf_high_taps) >> 13;
+    }
+}
+/*- End of function --------------------------------------------------------*/
+
+void g722_qmf_synthesis(const int16_t x[], int pairs, int16_t amp[], int shift)
+{
+    int p = 0;
+
+#if defined(__SSE2__)
+    __m128i even[3];
+    __m128i odd[3];
+    __m128i count = _mm_cvtsi32_si128(16 + shift);
+
+    load_taps(even, qmf_even_taps);
+    load_taps(odd, qmf_odd_taps);
+    for (  ;  p + 4 <= pairs;  p += 4)
+    {
+        __m128i a = _mm_srai_epi32(qmf_dot2(x + 2*p, even, odd), 12);
+        __m128i b = _mm_srai_epi32(qmf_dot2(x + 2*p + 4, even, odd), 12);
+        /* Keep the 16 low bits after the shift, as a cast to int16_t does */
+        a = _mm_srai_epi32(_mm_sll_epi32(a, count), 16);
+        b = _mm_srai_epi32(_mm_sll_epi32(b, count), 16);
+        _mm_storeu_si128((__m128i *) (amp + 2*p), _mm_packs_epi32(a, b));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    int16x8_t even[3];
+    int16x8_t odd[3];
+    int32x4_t count = vdupq_n_s32(shift);
+
+    load_taps(even, qmf_even_taps);
+    load_taps(odd, qmf_odd_taps);
+    for (  ;  p + 2 <= pairs;  p += 2)
+    {
+        int32x4_t v = vcombine_s32(qmf_dot(x + 2*p, even, odd), qmf_dot(x + 2*p + 2, even, odd));
+        /* vmovn keeps the 16 low bits, as a cast to int16_t does */
+        vst1_s16(amp + 2*p, vmovn_s32(vshlq_s32(vshrq_n_s32(v, 12), count)));
+    }
+#endif
+    for (  ;  p < pairs;  p++)
+    {
+        amp[2*p] = (int16_t) ((dot24(x + 2*p, qmf_even_taps) >> 12)*(1 << shift));
+        amp[2*p + 1] = (int16_t) ((dot24(x + 2*p, qmf_odd_taps) >> 12)*(1 << shift));
+    }
+}
+/*- End of function --------------------------------------------------------*/
+/*- End of file ------------------------------------------------------------*/
@@ -0,0 +1,359 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "jpeg_snapshot.h"
+#include "mediastreamer2/msvideo.h"
+#include "ffmpeg-priv.h"
+
+#define MAX_CACHED_ENCODERS 4
+#define MAX_PENDING_SNAPSHOTS 32
+
+typedef struct _JpegSnapshotJob {
+	const void *owner;
+	mblk_t *frame;
+	char *filename;
+	MSJpegWriterDataCallback cb;
+} JpegSnapshotJob;
+
+typedef struct _JpegEncoder {
+	AVCodecContext *avctx;
+	struct SwsContext *sws_ctx;
+	mblk_t *yuvjpeg_msg;
+	MSPicture yuvjpeg;
+	uint8_t *comp_buf;
+	int comp_buf_sz;
+	uint64_t last_use;
+} JpegEncoder;
+
+struct _MSJpegSnapshotService {
+	AVCodec *codec;
+	AVFrame *pict;
+	MSList *jobs;
+	int nb_jobs;
+	JpegEncoder *encoders[MAX_CACHED_ENCODERS];
+	uint64_t use_count;
+	const void *current_owner;
+	ms_mutex_t lock;
+	ms_cond_t cond;
+	ms_thread_t thread;
+	int refcount;
+	bool_t running;
+};
+
+static MSJpegSnapshotService *snapshot_service = NULL;
+static ms_mutex_t snapshot_service_lock;
+static ms_once_t snapshot_service_once = MS_ONCE_INIT;
+
+static void snapshot_service_init_lock(void) {
+	ms_mutex_init(&snapshot_service_lock, NULL);
+}
+
+static void jpeg_snapshot_job_free(JpegSnapshotJob *job) {
+	if (job->frame) freemsg(job->frame);
+	if (job->filename) ms_free(job->filename);
+	ms_free(job);
+}
+
+static void jpeg_encoder_destroy(JpegEncoder *enc) {
+	if (enc->sws_ctx) sws_freeContext(enc->sws_ctx);
+	if (enc->avctx) {
+		avcodec_close(enc->avctx);
+		av_free(enc->avctx);
+	}
+	if (enc->yuvjpeg_msg) freemsg(enc->yuvjpeg_msg);
+	if (enc->comp_buf) ms_free(enc->comp_buf);
+	ms_free(enc);
+}
+
+static JpegEncoder *jpeg_encoder_new(AVCodec *codec, int width, int height) {
+	JpegEncoder *enc = ms_new0(JpegEncoder, 1);
+	int error;
+
+	enc->avctx = avcodec_alloc_context3(codec);
+	enc->avctx->width = width;
+	enc->avctx->height = height;
+	enc->avctx->time_base.num = 1;
+	enc->avctx->time_base.den = 1;
+	enc->avctx->pix_fmt = PIX_FMT_YUVJ420P;
+	error = avcodec_open2(enc->avctx, codec, NULL);
+	if (error != 0) {
+		ms_error("avcodec_open() failed: %i", error);
+		av_free(enc->avctx);
+		enc->avctx = NULL;
+		jpeg_encoder_destroy(enc);
+		return NULL;
+	}
+	enc->sws_ctx = sws_getContext(width, height, PIX_FMT_YUV420P, width, height, enc->avctx->pix_fmt, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+	if (enc->sws_ctx == NULL) {
+		ms_error("sws_getContext() failed.");
+		jpeg_encoder_destroy(enc);
+		return NULL;
+	}
+	enc->yuvjpeg_msg = ms_yuv_buf_alloc(&enc->yuvjpeg, width, height);
+	/* A jpeg picture is never bigger than the raw picture. */
+	enc->comp_buf_sz = (width * height * 3) / 2;
+	enc->comp_buf = (uint8_t *)ms_malloc0(enc->comp_buf_sz);
+	ms_message("MSJpegSnapshotService: opened MJPEG encoder for %ix%i", width, height);
+	return enc;
+}
+
+/* Get the encoder for the given size, replacing the least recently used one if none is opened for this size. */
+static JpegEncoder *get_encoder(MSJpegSnapshotService *obj, int width, int height) {
+	JpegEncoder *enc;
+	int i;
+	int lru = 0;
+
+	for (i = 0; i < MAX_CACHED_ENCODERS; i++) {
+		enc = obj->encoders[i];
+		if (enc == NULL) {
+			lru = i;
+			break;
+		}
+		if ((enc->avctx->width == width) && (enc->avctx->height == height)) {
+			enc->last_use = ++obj->use_count;
+			return enc;
+		}
+		if (enc->last_use < obj->encoders[lru]->last_use) lru = i;
+	}
+	if (obj->encoders[lru] != NULL) {
+		jpeg_encoder_destroy(obj->encoders[lru]);
+		obj->encoders[lru] = NULL;
+	}
+	enc = jpeg_encoder_new(obj->codec, width, height);
+	if (enc == NULL) return NULL;
+	enc->last_use = ++obj->use_count;
+	obj->encoders[lru] = enc;
+	return enc;
+}
+
+static void write_file(const char *filename, const uint8_t *data, int size) {
+	char *tmp_filename = ms_strdup_printf("%s.part", filename);
+	FILE *file = fopen(tmp_filename, "wb");
+	bool_t written = FALSE;
+
+	if (file == NULL) {
+		ms_error("Could not open %s for write", tmp_filename);
+		ms_free(tmp_filename);
+		return;
+	}
+	if (fwrite(data, size, 1, file) > 0) {
+		written = TRUE;
+	} else {
+		ms_error("Error writing snapshot.");
+	}
+	fclose(file);
+	if (written) {
+		if (rename(tmp_filename, filename) != 0) {
+			ms_error("Could not rename %s into %s", tmp_filename, filename);
+		} else {
+			ms_message("Snapshot done");
+		}
+	}
+	ms_free(tmp_filename);
+}
+
+static void process_job(MSJpegSnapshotService *obj, JpegSnapshotJob *job) {
+	MSPicture yuvbuf;
+	JpegEncoder *enc;
+	struct AVPacket packet;
+	int error, got_pict = 0;
+
+	if (ms_yuv_buf_init_from_mblk(&yuvbuf, job->frame) != 0) return;
+	enc = get_encoder(obj, yuvbuf.w, yuvbuf.h);
+	if (enc == NULL) return;
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(0,9,0)
+	if (sws_scale(enc->sws_ctx, (const uint8_t *const*)yuvbuf.planes, yuvbuf.strides, 0, yuvbuf.h, enc->yuvjpeg.planes, enc->yuvjpeg.strides) < 0) {
+#else
+	if (sws_scale(enc->sws_ctx, (uint8_t **)yuvbuf.planes, yuvbuf.strides, 0, yuvbuf.h, enc->yuvjpeg.planes, enc->yuvjpeg.strides) < 0) {
+#endif
+		ms_error("sws_scale() failed.");
+		return;
+	}
+	/* The source frame is not needed anymore, release it early. */
+	freemsg(job->frame);
+	job->frame = NULL;
+
+	av_frame_unref(obj->pict);
+	avpicture_fill((AVPicture *)obj->pict, (uint8_t *)enc->yuvjpeg_msg->b_rptr, enc->avctx->pix_fmt, enc->avctx->width, enc->avctx->height);
+	memset(&packet, 0, sizeof(packet));
+	packet.data = enc->comp_buf;
+	packet.size = enc->comp_buf_sz;
+	error = avcodec_encode_video2(enc->avctx, &packet, obj->pict, &got_pict);
+	if ((error < 0) || !got_pict) {
+		ms_error("Could not encode jpeg picture.");
+		return;
+	}
+	if (job->filename) write_file(job->filename, packet.data, packet.size);
+	if (job->cb.cb) job->cb.cb(job->cb.user_data, packet.data, packet.size);
+}
+
+static void *snapshot_service_thread(void *arg) {
+	MSJpegSnapshotService *obj = (MSJpegSnapshotService *)arg;
+	JpegSnapshotJob *job;
+
+	ms_mutex_lock(&obj->lock);
+	while (obj->running) {
+		if (obj->jobs == NULL) {
+			ms_cond_wait(&obj->cond, &obj->lock);
+			continue;
+		}
+		job = (JpegSnapshotJob *)obj->jobs->data;
+		obj->jobs = ms_list_remove_link(obj->jobs, obj->jobs);
+		obj->nb_jobs--;
+		obj->current_owner = job->owner;
+		ms_mutex_unlock(&obj->lock);
+
+		process_job(obj, job);
+		jpeg_snapshot_job_free(job);
+
+		ms_mutex_lock(&obj->lock);
+		obj->current_owner = NULL;
+		/* Wake up a canceller waiting for this job. */
+		ms_cond_broadcast(&obj->cond);
+	}
+	ms_mutex_unlock(&obj->lock);
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+MSJpegSnapshotService *ms_jpeg_snapshot_service_ref(void) {
+	MSJpegSnapshotService *obj;
+	AVCodec *codec;
+
+	/* The jpeg writers may be created and destroyed from several threads. */
+	ms_once(&snapshot_service_once, snapshot_service_init_lock);
+	ms_mutex_lock(&snapshot_service_lock);
+	obj = snapshot_service;
+	if (obj != NULL) {
+		obj->refcount++;
+		ms_mutex_unlock(&snapshot_service_lock);
+		return obj;
+	}
+	codec = avcodec_find_encoder(CODEC_ID_MJPEG);
+	if (codec == NULL) {
+		ms_mutex_unlock(&snapshot_service_lock);
+		ms_error("Could not find CODEC_ID_MJPEG !");
+		return NULL;
+	}
+	obj = ms_new0(MSJpegSnapshotService, 1);
+	obj->codec = codec;
+	obj->pict = av_frame_alloc();
+	obj->refcount = 1;
+	obj->running = TRUE;
+	ms_mutex_init(&obj->lock, NULL);
+	ms_cond_init(&obj->cond, NULL);
+	ms_thread_create(&obj->thread, NULL, snapshot_service_thread, obj);
+	snapshot_service = obj;
+	ms_mutex_unlock(&snapshot_service_lock);
+	return obj;
+}
+
+void ms_jpeg_snapshot_service_unref(MSJpegSnapshotService *obj) {
+	int i;
+
+	ms_mutex_lock(&snapshot_service_lock);
+	if (--obj->refcount > 0) {
+		ms_mutex_unlock(&snapshot_service_lock);
+		return;
+	}
+	snapshot_service = NULL;
+	ms_mutex_unlock(&snapshot_service_lock);
+
+	ms_mutex_lock(&obj->lock);
+	obj->running = FALSE;
+	ms_cond_broadcast(&obj->cond);
+	ms_mutex_unlock(&obj->lock);
+	ms_thread_join(obj->thread, NULL);
+
+	ms_list_for_each(obj->jobs, (void (*)(void *))jpeg_snapshot_job_free);
+	ms_list_free(obj->jobs);
+	for (i = 0; i < MAX_CACHED_ENCODERS; i++) {
+		if (obj->encoders[i]) jpeg_encoder_destroy(obj->encoders[i]);
+	}
+	av_frame_free(&obj->pict);
+	ms_cond_destroy(&obj->cond);
+	ms_mutex_destroy(&obj->lock);
+	ms_free(obj);
+}
+
+void ms_jpeg_snapshot_service_submit(MSJpegSnapshotService *obj, const void *owner, mblk_t *frame, const char *filename, const MSJpegWriterDataCallback *cb) {
+	JpegSnapshotJob *job = ms_new0(JpegSnapshotJob, 1);
+
+	job->owner = owner;
+	job->frame = frame;
+	if (filename) job->filename = ms_strdup(filename);
+	if (cb) job->cb = *cb;
+
+	ms_mutex_lock(&obj->lock);
+	if (obj->nb_jobs >= MAX_PENDING_SNAPSHOTS) {
+		ms_mutex_unlock(&obj->lock);
+		ms_warning("MSJpegSnapshotService: too many pending snapshots, dropping the one of [%p]", owner);
+		jpeg_snapshot_job_free(job);
+		return;
+	}
+	obj->jobs = ms_list_append(obj->jobs, job);
+	obj->nb_jobs++;
+	ms_cond_broadcast(&obj->cond);
+	ms_mutex_unlock(&obj->lock);
+}
+
+void ms_jpeg_snapshot_service_cancel(MSJpegSnapshotService *obj, const void *owner) {
+	MSList *elem, *next;
+
+	ms_mutex_lock(&obj->lock);
+	for (elem = obj->jobs; elem != NULL; elem = next) {
+		JpegSnapshotJob *job = (JpegSnapshotJob *)elem->data;
+		next = elem->next;
+		if (job->owner == owner) {
+			jpeg_snapshot_job_free(job);
+			obj->jobs = ms_list_remove_link(obj->jobs, elem);
+			obj->nb_jobs--;
+		}
+	}
+	while (obj->current_owner == owner) {
+		ms_cond_wait(&obj->cond, &obj->lock);
+	}
+	ms_mutex_unlock(&obj->lock);
+}
+
+void ms_jpeg_snapshot_service_remove_callback(MSJpegSnapshotService *obj, const void *owner) {
+	MSList *elem, *next;
+
+	ms_mutex_lock(&obj->lock);
+	for (elem = obj->jobs; elem != NULL; elem = next) {
+		JpegSnapshotJob *job = (JpegSnapshotJob *)elem->data;
+		next = elem->next;
+		if (job->owner != owner) continue;
+		job->cb.cb = NULL;
+		if (job->filename == NULL) {
+			/* Nothing left to do for this one. */
+			jpeg_snapshot_job_free(job);
+			obj->jobs = ms_list_remove_link(obj->jobs, elem);
+			obj->nb_jobs--;
+		}
+	}
+	while (obj->current_owner == owner) {
+		ms_cond_wait(&obj->cond, &obj->lock);
+	}
+	ms_mutex_unlock(&obj->lock);
+}
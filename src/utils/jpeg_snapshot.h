@@ -0,0 +1,70 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef JPEG_SNAPSHOT_H
+#define JPEG_SNAPSHOT_H
+
+#include "mediastreamer2/msjpegwriter.h"
+
+/**
+ * @brief MSJpegSnapshotService is shared by all the jpeg writers of the process. It encodes the snapshots
+ * on a single worker thread, keeping the MJPEG codec and scaler contexts opened for the last used resolutions,
+ * so that taking a snapshot only costs a reference on the frame to the ticker thread.
+ */
+typedef struct _MSJpegSnapshotService MSJpegSnapshotService;
+
+/**
+ * @brief Get a reference on the snapshot service, creating it and starting its worker thread if needed.
+ * @return The snapshot service, or NULL if no MJPEG encoder is available.
+ */
+extern MSJpegSnapshotService *ms_jpeg_snapshot_service_ref(void);
+
+/**
+ * @brief Release a reference on the snapshot service. The worker thread is stopped with the last reference.
+ * @param obj MSJpegSnapshotService
+ */
+extern void ms_jpeg_snapshot_service_unref(MSJpegSnapshotService *obj);
+
+/**
+ * @brief Queue a snapshot request.
+ * @param obj MSJpegSnapshotService
+ * @param owner Identifies the requester, to cancel its pending requests with ms_jpeg_snapshot_service_cancel().
+ * @param frame A YUV420P frame. Ownership is transfered to the service, it shall be a reference obtained with dupmsg().
+ * @param filename The file to write the jpeg to, or NULL.
+ * @param cb The callback receiving the jpeg data, called from the worker thread. Can be NULL.
+ */
+extern void ms_jpeg_snapshot_service_submit(MSJpegSnapshotService *obj, const void *owner, mblk_t *frame, const char *filename, const MSJpegWriterDataCallback *cb);
+
+/**
+ * @brief Drop the pending requests of an owner, and wait for the one being encoded to complete.
+ * After this call, no callback of this owner is called anymore.
+ * @param obj MSJpegSnapshotService
+ * @param owner The requester given to ms_jpeg_snapshot_service_submit().
+ */
+extern void ms_jpeg_snapshot_service_cancel(MSJpegSnapshotService *obj, const void *owner);
+
+/**
+ * @brief Remove the callback from the pending requests of an owner, and wait for the one being encoded to complete.
+ * The files are still written. After this call, no callback of this owner is called anymore.
+ * @param obj MSJpegSnapshotService
+ * @param owner The requester given to ms_jpeg_snapshot_service_submit().
+ */
+extern void ms_jpeg_snapshot_service_remove_callback(MSJpegSnapshotService *obj, const void *owner);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "rtp_reorder_buffer.h"
+#include "mediastreamer2/mscommon.h"
+
+#define CSEQ_DIFF(a, b) ((int16_t)((uint16_t)(a) - (uint16_t)(b)))
+
+struct _MSRtpReorderBuffer {
+	queue_t q; /*packets sorted by sequence number*/
+	uint64_t gap_time; /*time at which the gap at the head of the queue was seen*/
+	int max_delay;
+	int max_packets;
+	unsigned int reordered_packets;
+	unsigned int late_packets;
+	uint16_t next_cseq;
+	bool_t initialized;
+	bool_t gap_pending; /*whether a gap is being waited for since gap_time*/
+};
+
+MSRtpReorderBuffer *ms_rtp_reorder_buffer_new(int max_delay, int max_packets) {
+	MSRtpReorderBuffer *obj = (MSRtpReorderBuffer *)ms_new0(MSRtpReorderBuffer, 1);
+	qinit(&obj->q);
+	obj->max_delay = max_delay;
+	obj->max_packets = max_packets;
+	return obj;
+}
+
+void ms_rtp_reorder_buffer_destroy(MSRtpReorderBuffer *obj) {
+	flushq(&obj->q, 0);
+	if (obj->late_packets > 0) {
+		ms_message("MSRtpReorderBuffer [%p]: %u packets reordered, %u packets arrived too late.", obj, obj->reordered_packets, obj->late_packets);
+	}
+	ms_free(obj);
+}
+
+void ms_rtp_reorder_buffer_set_max_delay(MSRtpReorderBuffer *obj, int max_delay) {
+	obj->max_delay = max_delay;
+}
+
+void ms_rtp_reorder_buffer_put(MSRtpReorderBuffer *obj, mblk_t *m, uint64_t curtime) {
+	uint16_t cseq = mblk_get_cseq(m);
+	mblk_t *it;
+
+	if (!obj->initialized) {
+		obj->initialized = TRUE;
+		obj->next_cseq = cseq;
+	}
+	if (CSEQ_DIFF(cseq, obj->next_cseq) < -obj->max_packets) {
+		ms_warning("MSRtpReorderBuffer [%p]: sequence number discontinuity, resynchronizing.", obj);
+		obj->next_cseq = cseq;
+	} else if (CSEQ_DIFF(cseq, obj->next_cseq) < 0) {
+		/* Its successors have already been given to the depacketizer, it is a loss for it anyway. */
+		obj->late_packets++;
+		freemsg(m);
+		return;
+	}
+	/*
+	 * Search the insertion point from the tail, as packets mostly arrive in order. The walk starts from the queue
+	 * stopper's predecessor, which is the stopper itself when the queue is empty.
+	 */
+	for (it = obj->q._q_stopper.b_prev; !qend(&obj->q, it); it = it->b_prev) {
+		int diff = CSEQ_DIFF(cseq, mblk_get_cseq(it));
+		if (diff == 0) {
+			freemsg(m);
+			return;
+		}
+		if (diff > 0) break;
+	}
+	/* Insert after it, which is the queue stopper if m is the oldest packet. */
+	insq(&obj->q, it->b_next, m);
+	if (m != qlast(&obj->q)) obj->reordered_packets++;
+}
+
+/* A complete frame is a run of consecutive packets, starting right after a marker bit and ending with a marker bit. */
+static bool_t has_complete_frame(MSRtpReorderBuffer *obj) {
+	mblk_t *it;
+	mblk_t *prev = NULL;
+	bool_t started = FALSE;
+
+	for (it = qbegin(&obj->q); !qend(&obj->q, it); it = qnext(&obj->q, it)) {
+		if (prev != NULL && (uint16_t)(mblk_get_cseq(prev) + 1) == mblk_get_cseq(it)) {
+			if (mblk_get_marker_info(prev)) started = TRUE;
+		} else {
+			started = FALSE;
+		}
+		if (started && mblk_get_marker_info(it)) return TRUE;
+		prev = it;
+	}
+	return FALSE;
+}
+
+void ms_rtp_reorder_buffer_get(MSRtpReorderBuffer *obj, MSQueue *out, uint64_t curtime) {
+	mblk_t *m;
+
+	while ((m = peekq(&obj->q)) != NULL) {
+		int diff = CSEQ_DIFF(mblk_get_cseq(m), obj->next_cseq);
+		if (diff > 0) {
+			if (!obj->gap_pending) {
+				obj->gap_pending = TRUE;
+				obj->gap_time = curtime;
+			}
+			if ((curtime - obj->gap_time < (uint64_t)obj->max_delay) && (obj->q.q_mcount < obj->max_packets)
+				&& !has_complete_frame(obj)) {
+				/* Wait for the missing packets. */
+				break;
+			}
+			/* Give up: the depacketizer will see the gap as a loss. */
+		}
+		m = getq(&obj->q);
+		obj->next_cseq = mblk_get_cseq(m) + 1;
+		obj->gap_pending = FALSE;
+		ms_queue_put(out, m);
+	}
+}
+
+void ms_rtp_reorder_buffer_flush(MSRtpReorderBuffer *obj, MSQueue *out) {
+	mblk_t *m;
+	while ((m = getq(&obj->q)) != NULL) {
+		ms_queue_put(out, m);
+	}
+	obj->gap_pending = FALSE;
+	obj->initialized = FALSE;
+}
+
+unsigned int ms_rtp_reorder_buffer_get_reordered_packets(const MSRtpReorderBuffer *obj) {
+	return obj->reordered_packets;
+}
@@ -0,0 +1,88 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef RTP_REORDER_BUFFER_H
+#define RTP_REORDER_BUFFER_H
+
+#include "ortp/str_utils.h"
+#include "mediastreamer2/msqueue.h"
+
+/**
+ * @brief MSRtpReorderBuffer puts back in sequence number order the RTP packets of a video stream
+ * before they are given to a depacketizer, so that packets reordered by the network are not taken for losses.
+ * A gap in the sequence numbers is waited for at most max_delay milliseconds, and not at all
+ * once a complete frame (all the packets between two marker bits) is waiting behind it.
+ */
+typedef struct _MSRtpReorderBuffer MSRtpReorderBuffer;
+
+/* Reordering on multipath links is in the order of a few milliseconds. */
+#define MS_RTP_REORDER_BUFFER_DEFAULT_DELAY 30
+#define MS_RTP_REORDER_BUFFER_DEFAULT_MAX_PACKETS 256
+
+/**
+ * @brief Create an MSRtpReorderBuffer
+ * @param max_delay Maximum time in milliseconds a gap in the sequence numbers is waited for. 0 disables reordering.
+ * @param max_packets Maximum number of packets held while waiting for a gap
+ * @return The pointer on the created MSRtpReorderBuffer
+ */
+MS2_PUBLIC MSRtpReorderBuffer *ms_rtp_reorder_buffer_new(int max_delay, int max_packets);
+
+/**
+ * @brief Destroy an MSRtpReorderBuffer, dropping the packets it holds.
+ * @param obj MSRtpReorderBuffer
+ */
+MS2_PUBLIC void ms_rtp_reorder_buffer_destroy(MSRtpReorderBuffer *obj);
+
+/**
+ * @brief Change the maximum time a gap in the sequence numbers is waited for.
+ * @param obj MSRtpReorderBuffer
+ * @param max_delay Delay in milliseconds, 0 disables reordering.
+ */
+MS2_PUBLIC void ms_rtp_reorder_buffer_set_max_delay(MSRtpReorderBuffer *obj, int max_delay);
+
+/**
+ * @brief Put a received packet in the buffer. Duplicated packets and packets arriving after
+ * their successors have been released are dropped.
+ * @param obj MSRtpReorderBuffer
+ * @param m The RTP payload, with its sequence number set with mblk_set_cseq()
+ * @param curtime The current time in milliseconds
+ */
+MS2_PUBLIC void ms_rtp_reorder_buffer_put(MSRtpReorderBuffer *obj, mblk_t *m, uint64_t curtime);
+
+/**
+ * @brief Release the packets that can be given to the depacketizer, in sequence number order.
+ * @param obj MSRtpReorderBuffer
+ * @param out The queue to put the packets in
+ * @param curtime The current time in milliseconds
+ */
+MS2_PUBLIC void ms_rtp_reorder_buffer_get(MSRtpReorderBuffer *obj, MSQueue *out, uint64_t curtime);
+
+/**
+ * @brief Release all the packets held, and restart from the next packet put in the buffer.
+ * @param obj MSRtpReorderBuffer
+ * @param out The queue to put the packets in
+ */
+MS2_PUBLIC void ms_rtp_reorder_buffer_flush(MSRtpReorderBuffer *obj, MSQueue *out);
+
+/**
+ * @brief Get the number of packets put back in order since the creation of the buffer.
+ */
+MS2_PUBLIC unsigned int ms_rtp_reorder_buffer_get_reordered_packets(const MSRtpReorderBuffer *obj);
+
+#endif
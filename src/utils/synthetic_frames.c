@@ -0,0 +1,167 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "synthetic_frames.h"
+
+struct _MSSyntheticFrames {
+	char *key;
+	MSVideoSize requested_size;
+	MSVideoSize vsize;
+	float fps;
+	int count;
+	int refcount;
+	mblk_t **frames;
+};
+
+struct _MSSyntheticFramesCache {
+	ms_mutex_t lock;
+	MSList *sequences;
+	int refcount;
+};
+
+static MSSyntheticFramesCache *frames_cache = NULL;
+static ms_mutex_t frames_cache_lock;
+static ms_once_t frames_cache_once = MS_ONCE_INIT;
+
+static void frames_cache_init_lock(void) {
+	ms_mutex_init(&frames_cache_lock, NULL);
+}
+
+MSSyntheticFramesCache *ms_synthetic_frames_cache_ref(void) {
+	MSSyntheticFramesCache *obj;
+	ms_once(&frames_cache_once, frames_cache_init_lock);
+	ms_mutex_lock(&frames_cache_lock);
+	if (frames_cache == NULL) {
+		frames_cache = ms_new0(MSSyntheticFramesCache, 1);
+		ms_mutex_init(&frames_cache->lock, NULL);
+	}
+	frames_cache->refcount++;
+	obj = frames_cache;
+	ms_mutex_unlock(&frames_cache_lock);
+	return obj;
+}
+
+void ms_synthetic_frames_cache_unref(MSSyntheticFramesCache *obj) {
+	ms_mutex_lock(&frames_cache_lock);
+	if (--obj->refcount > 0) {
+		ms_mutex_unlock(&frames_cache_lock);
+		return;
+	}
+	frames_cache = NULL;
+	ms_mutex_unlock(&frames_cache_lock);
+	if (obj->sequences != NULL) {
+		ms_error("MSSyntheticFramesCache: %i sequences still in use.", ms_list_size(obj->sequences));
+	}
+	ms_mutex_destroy(&obj->lock);
+	ms_free(obj);
+}
+
+static void synthetic_frames_free(MSSyntheticFrames *obj) {
+	int i;
+	for (i = 0; i < obj->count; i++) {
+		if (obj->frames[i]) freemsg(obj->frames[i]);
+	}
+	ms_free(obj->frames);
+	ms_free(obj->key);
+	ms_free(obj);
+}
+
+static MSSyntheticFrames *synthetic_frames_new(const char *key, MSVideoSize vsize, float fps, int count,
+	MSSyntheticFramesGenerator generator, void *user_data) {
+	MSSyntheticFrames *obj = ms_new0(MSSyntheticFrames, 1);
+	uint64_t begin = ms_get_cur_time_ms();
+	int i;
+
+	obj->key = ms_strdup(key);
+	obj->requested_size = vsize;
+	obj->fps = fps;
+	obj->count = count;
+	obj->frames = ms_new0(mblk_t *, count);
+	for (i = 0; i < count; i++) {
+		MSVideoSize fsize = vsize;
+		obj->frames[i] = generator(user_data, i, count, &fsize);
+		if (obj->frames[i] == NULL) {
+			ms_error("MSSyntheticFramesCache: could not generate frame %i of [%s]", i, key);
+			synthetic_frames_free(obj);
+			return NULL;
+		}
+		obj->vsize = fsize;
+	}
+	ms_message("MSSyntheticFramesCache: generated %i frames of %ix%i for [%s] in %i ms", count, obj->vsize.width,
+		obj->vsize.height, key, (int)(ms_get_cur_time_ms() - begin));
+	return obj;
+}
+
+MSSyntheticFrames *ms_synthetic_frames_cache_get(MSSyntheticFramesCache *obj, const char *key, MSVideoSize vsize, float fps, int count,
+	MSSyntheticFramesGenerator generator, void *user_data) {
+	MSSyntheticFrames *frames = NULL;
+	MSList *elem;
+
+	ms_mutex_lock(&obj->lock);
+	for (elem = obj->sequences; elem != NULL; elem = elem->next) {
+		MSSyntheticFrames *it = (MSSyntheticFrames *)elem->data;
+		if (strcmp(it->key, key) == 0 && ms_video_size_equal(it->requested_size, vsize) && it->fps == fps && it->count == count) {
+			frames = it;
+			break;
+		}
+	}
+	if (frames == NULL) {
+		/* generated with the lock held, so that the instances starting together do not all generate the sequence */
+		frames = synthetic_frames_new(key, vsize, fps, count, generator, user_data);
+		if (frames) obj->sequences = ms_list_append(obj->sequences, frames);
+	}
+	if (frames) frames->refcount++;
+	ms_mutex_unlock(&obj->lock);
+	return frames;
+}
+
+void ms_synthetic_frames_cache_release(MSSyntheticFramesCache *obj, MSSyntheticFrames *frames) {
+	ms_mutex_lock(&obj->lock);
+	if (--frames->refcount == 0) {
+		obj->sequences = ms_list_remove(obj->sequences, frames);
+		synthetic_frames_free(frames);
+	}
+	ms_mutex_unlock(&obj->lock);
+}
+
+int ms_synthetic_frames_get_count(const MSSyntheticFrames *obj) {
+	return obj->count;
+}
+
+MSVideoSize ms_synthetic_frames_get_size(const MSSyntheticFrames *obj) {
+	return obj->vsize;
+}
+
+mblk_t *ms_synthetic_frames_get_frame(const MSSyntheticFrames *obj, int index, MSYuvBufAllocator *allocator) {
+	MSPicture src, dst;
+	MSVideoSize roi;
+	mblk_t *m;
+
+	/* The frames are shared: the filters downstream may modify theirs in place, so each one gets a copy. */
+	ms_yuv_buf_init_from_mblk(&src, obj->frames[index % obj->count]);
+	roi.width = src.w;
+	roi.height = src.h;
+	m = ms_yuv_buf_allocator_get(allocator, &dst, src.w, src.h);
+	ms_yuv_buf_copy(src.planes, src.strides, dst.planes, dst.strides, roi);
+	return m;
+}
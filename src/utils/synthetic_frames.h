@@ -0,0 +1,106 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef SYNTHETIC_FRAMES_H
+#define SYNTHETIC_FRAMES_H
+
+#include "mediastreamer2/msvideo.h"
+
+/**
+ * @brief MSSyntheticFramesCache holds the frames produced by the synthetic video sources (test pattern, static image),
+ * so that they are generated once per key, size and frame rate and shared, read-only, by all the filter instances.
+ * The instances get copies of the frames in buffers recycled by a MSYuvBufAllocator, which costs much less than
+ * generating them, and lets the filters downstream modify their input in place.
+ */
+typedef struct _MSSyntheticFramesCache MSSyntheticFramesCache;
+
+/**
+ * @brief A sequence of frames shared through the MSSyntheticFramesCache.
+ */
+typedef struct _MSSyntheticFrames MSSyntheticFrames;
+
+/**
+ * @brief Function generating the frame of a given index in a sequence.
+ * @param user_data The user data given to ms_synthetic_frames_cache_get().
+ * @param index The index of the frame, between 0 and count-1.
+ * @param count The number of frames of the sequence.
+ * @param vsize The requested size, which the generator can change to the actual size of the frame.
+ * @return The frame, or NULL in case of failure.
+ */
+typedef mblk_t *(*MSSyntheticFramesGenerator)(void *user_data, int index, int count, MSVideoSize *vsize);
+
+/**
+ * @brief Get a reference on the cache, creating it if needed.
+ * @return The cache.
+ */
+extern MSSyntheticFramesCache *ms_synthetic_frames_cache_ref(void);
+
+/**
+ * @brief Release a reference on the cache.
+ * @param obj MSSyntheticFramesCache
+ */
+extern void ms_synthetic_frames_cache_unref(MSSyntheticFramesCache *obj);
+
+/**
+ * @brief Get the frames of a sequence, generating them if no other filter uses them yet.
+ * The sequence shall be released with ms_synthetic_frames_cache_release().
+ * @param obj MSSyntheticFramesCache
+ * @param key Identifies the content of the sequence.
+ * @param vsize The size of the frames.
+ * @param fps The frame rate the sequence is generated for, or 0 if irrelevant.
+ * @param count The number of frames of the sequence.
+ * @param generator The function generating the frames.
+ * @param user_data Given to the generator.
+ * @return The sequence, or NULL if the generator failed.
+ */
+extern MSSyntheticFrames *ms_synthetic_frames_cache_get(MSSyntheticFramesCache *obj, const char *key, MSVideoSize vsize, float fps, int count,
+	MSSyntheticFramesGenerator generator, void *user_data);
+
+/**
+ * @brief Release a sequence obtained with ms_synthetic_frames_cache_get(). It is freed when no other filter uses it.
+ * The frames returned by ms_synthetic_frames_get_frame() remain valid.
+ * @param obj MSSyntheticFramesCache
+ * @param frames MSSyntheticFrames
+ */
+extern void ms_synthetic_frames_cache_release(MSSyntheticFramesCache *obj, MSSyntheticFrames *frames);
+
+/**
+ * @brief Get the number of frames of a sequence.
+ * @param obj MSSyntheticFrames
+ * @return The number of frames.
+ */
+extern int ms_synthetic_frames_get_count(const MSSyntheticFrames *obj);
+
+/**
+ * @brief Get the actual size of the frames of a sequence.
+ * @param obj MSSyntheticFrames
+ * @return The size of the frames.
+ */
+extern MSVideoSize ms_synthetic_frames_get_size(const MSSyntheticFrames *obj);
+
+/**
+ * @brief Get a copy of a frame of a sequence.
+ * @param obj MSSyntheticFrames
+ * @param index The index of the frame, modulo the number of frames of the sequence.
+ * @param allocator The allocator of the copy.
+ * @return A copy of the frame, owned by the caller.
+ */
+extern mblk_t *ms_synthetic_frames_get_frame(const MSSyntheticFrames *obj, int index, MSYuvBufAllocator *allocator);
+
+#endif
@@ -0,0 +1,339 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msfilter.h"
+#include "tone_cache.h"
+#include "waveheader.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI       3.14159265358979323846
+#endif
+
+#define MAX_CACHE_SIZE (8*1024*1024) /*bytes*/
+#define MAX_TONE_DURATION 2000 /*ms*/
+
+typedef struct _MSToneCacheEntry {
+	char *file; /*NULL for a tone*/
+	time_t mtime;
+	bool_t native; /*the PCM is in the format of the file*/
+	int frequencies[2];
+	int amplitude;
+	int nsamples;
+	int rate;
+	int nchannels;
+	mblk_t *pcm;
+	uint64_t last_use;
+} MSToneCacheEntry;
+
+struct _MSToneCache {
+	MSList *entries;
+	ms_mutex_t lock;
+	size_t size;
+	uint64_t use_count;
+	int refcount;
+};
+
+static MSToneCache *tone_cache = NULL;
+static ms_mutex_t tone_cache_lock; /*protects tone_cache and its refcount*/
+static ms_once_t tone_cache_once = MS_ONCE_INIT;
+
+static void tone_cache_init_lock(void) {
+	ms_mutex_init(&tone_cache_lock, NULL);
+}
+
+void ms_tone_oscillator_init(MSToneOscillator *osc, int freq, int rate, int pos) {
+	double w = 2 * M_PI * (double)freq / (double)rate;
+	osc->coef = 2 * cos(w);
+	osc->y1 = sin(w * (pos - 1));
+	osc->y2 = sin(w * (pos - 2));
+}
+
+static size_t entry_size(const MSToneCacheEntry *entry) {
+	return entry->pcm->b_wptr - entry->pcm->b_rptr;
+}
+
+static void entry_destroy(MSToneCacheEntry *entry) {
+	if (entry->file) ms_free(entry->file);
+	freemsg(entry->pcm);
+	ms_free(entry);
+}
+
+static void tone_cache_remove(MSToneCache *obj, MSList *elem) {
+	MSToneCacheEntry *entry = (MSToneCacheEntry *)elem->data;
+	obj->size -= entry_size(entry);
+	obj->entries = ms_list_remove_link(obj->entries, elem);
+	entry_destroy(entry);
+}
+
+/* Evicts the least recently used entries until size more bytes fit in the cache. */
+static bool_t tone_cache_make_room(MSToneCache *obj, size_t size) {
+	if (size > MAX_CACHE_SIZE) return FALSE;
+	while (obj->entries != NULL && obj->size + size > MAX_CACHE_SIZE) {
+		MSList *it, *oldest = obj->entries;
+		for (it = obj->entries; it != NULL; it = it->next) {
+			if (((MSToneCacheEntry *)it->data)->last_use < ((MSToneCacheEntry *)oldest->data)->last_use) oldest = it;
+		}
+		tone_cache_remove(obj, oldest);
+	}
+	return TRUE;
+}
+
+/* Takes ownership of the entry, which is destroyed if it does not fit in the cache. */
+static bool_t tone_cache_add(MSToneCache *obj, MSToneCacheEntry *entry) {
+	if (!tone_cache_make_room(obj, entry_size(entry))) {
+		entry_destroy(entry);
+		return FALSE;
+	}
+	entry->last_use = ++obj->use_count;
+	obj->size += entry_size(entry);
+	obj->entries = ms_list_prepend(obj->entries, entry);
+	return TRUE;
+}
+
+MSToneCache *ms_tone_cache_ref(void) {
+	MSToneCache *obj;
+
+	ms_once(&tone_cache_once, tone_cache_init_lock);
+	ms_mutex_lock(&tone_cache_lock);
+	obj = tone_cache;
+	if (obj != NULL) {
+		obj->refcount++;
+	} else {
+		obj = ms_new0(MSToneCache, 1);
+		obj->refcount = 1;
+		ms_mutex_init(&obj->lock, NULL);
+		tone_cache = obj;
+	}
+	ms_mutex_unlock(&tone_cache_lock);
+	return obj;
+}
+
+void ms_tone_cache_unref(MSToneCache *obj) {
+	ms_mutex_lock(&tone_cache_lock);
+	if (--obj->refcount > 0) {
+		ms_mutex_unlock(&tone_cache_lock);
+		return;
+	}
+	tone_cache = NULL;
+	ms_mutex_unlock(&tone_cache_lock);
+	while (obj->entries != NULL) {
+		tone_cache_remove(obj, obj->entries);
+	}
+	ms_mutex_destroy(&obj->lock);
+	ms_free(obj);
+}
+
+static mblk_t *make_tone(int lowfreq, int highfreq, int amplitude, int nsamples, int rate, int nchannels) {
+	mblk_t *m = allocb(nsamples * nchannels * 2, 0);
+	int16_t *samples = (int16_t *)m->b_wptr;
+	MSToneOscillator low, high;
+	int16_t sample;
+	int i, j;
+
+	ms_tone_oscillator_init(&low, lowfreq, rate, 0);
+	ms_tone_oscillator_init(&high, highfreq, rate, 0);
+	for (i = 0; i < nsamples; i++) {
+		sample = (int16_t)(amplitude * ms_tone_oscillator_next(&low));
+		if (highfreq != 0) sample += (int16_t)(amplitude * ms_tone_oscillator_next(&high));
+		for (j = 0; j < nchannels; j++) {
+			*samples++ = sample;
+		}
+	}
+	m->b_wptr += nsamples * nchannels * 2;
+	return m;
+}
+
+mblk_t *ms_tone_cache_get_tone(MSToneCache *obj, int lowfreq, int highfreq, int amplitude, int nsamples, int rate,
+	int nchannels) {
+	MSToneCacheEntry *entry;
+	mblk_t *ret = NULL;
+	MSList *it;
+
+	if (nsamples <= 0 || nsamples > (rate * MAX_TONE_DURATION) / 1000) return NULL;
+	ms_mutex_lock(&obj->lock);
+	for (it = obj->entries; it != NULL; it = it->next) {
+		entry = (MSToneCacheEntry *)it->data;
+		if (entry->file == NULL && entry->frequencies[0] == lowfreq && entry->frequencies[1] == highfreq
+			&& entry->amplitude == amplitude && entry->nsamples == nsamples && entry->rate == rate
+			&& entry->nchannels == nchannels) {
+			entry->last_use = ++obj->use_count;
+			ret = dupb(entry->pcm);
+			break;
+		}
+	}
+	if (ret == NULL) {
+		entry = ms_new0(MSToneCacheEntry, 1);
+		entry->frequencies[0] = lowfreq;
+		entry->frequencies[1] = highfreq;
+		entry->amplitude = amplitude;
+		entry->nsamples = nsamples;
+		entry->rate = rate;
+		entry->nchannels = nchannels;
+		entry->pcm = make_tone(lowfreq, highfreq, amplitude, nsamples, rate, nchannels);
+		if (tone_cache_add(obj, entry)) ret = dupb(entry->pcm);
+	}
+	ms_mutex_unlock(&obj->lock);
+	return ret;
+}
+
+static MSToneCacheEntry *read_wav_file(const char *file, time_t mtime, off_t file_size) {
+	MSToneCacheEntry *entry = NULL;
+	wave_header_t header;
+	int fd, hsize, nchannels, frame_size, size;
+	mblk_t *m;
+
+	if ((fd = open(file, O_RDONLY | O_BINARY)) == -1) {
+		ms_warning("MSToneCache: cannot open %s: %s", file, strerror(errno));
+		return NULL;
+	}
+	hsize = ms_read_wav_header_from_fd(&header, fd);
+	if (hsize <= 0) goto end;
+	nchannels = wave_header_get_channel(&header);
+	if (wave_header_get_format_type(&header) != 1 || nchannels == 0
+		|| wave_header_get_bpsmpl(&header) != nchannels * 2) {
+		ms_message("MSToneCache: %s is not made of 16 bits PCM, not cached", file);
+		goto end;
+	}
+	frame_size = nchannels * 2;
+	size = (int)(file_size - hsize);
+	if (le_uint32(header.data_chunk.len) > 0 && (int)le_uint32(header.data_chunk.len) < size) size = le_uint32(header.data_chunk.len);
+	if (size > MAX_CACHE_SIZE) size = MAX_CACHE_SIZE;
+	size -= size % frame_size;
+	if (size <= 0 || lseek(fd, hsize, SEEK_SET) == -1) goto end;
+	m = allocb(size, 0);
+	size = read(fd, m->b_wptr, size);
+	if (size <= 0) {
+		ms_warning("MSToneCache: cannot read %s", file);
+		freemsg(m);
+		goto end;
+	}
+	size -= size % frame_size;
+#ifdef WORDS_BIGENDIAN
+	{
+		int i;
+		for (i = 0; i < size; i += 2) {
+			uint8_t tmp = m->b_wptr[i];
+			m->b_wptr[i] = m->b_wptr[i + 1];
+			m->b_wptr[i + 1] = tmp;
+		}
+	}
+#endif
+	m->b_wptr += size;
+	entry = ms_new0(MSToneCacheEntry, 1);
+	entry->file = ms_strdup(file);
+	entry->mtime = mtime;
+	entry->native = TRUE;
+	entry->rate = wave_header_get_rate(&header);
+	entry->nchannels = nchannels;
+	entry->nsamples = size / frame_size;
+	entry->pcm = m;
+end:
+	close(fd);
+	return entry;
+}
+
+/* Converts the PCM of the file with a resampler processed out of any graph. */
+static MSToneCacheEntry *convert_wav(const MSToneCacheEntry *orig, int rate, int nchannels) {
+	MSToneCacheEntry *entry = NULL;
+	MSFilter *resampler = ms_filter_new(MS_RESAMPLE_ID);
+	MSQueue inq, outq;
+	mblk_t *m;
+
+	if (resampler == NULL) {
+		ms_warning("MSToneCache: no resampler to convert %s", orig->file);
+		return NULL;
+	}
+	ms_filter_call_method(resampler, MS_FILTER_SET_SAMPLE_RATE, (void *)&orig->rate);
+	ms_filter_call_method(resampler, MS_FILTER_SET_NCHANNELS, (void *)&orig->nchannels);
+	ms_filter_call_method(resampler, MS_FILTER_SET_OUTPUT_SAMPLE_RATE, &rate);
+	ms_filter_call_method(resampler, MS_FILTER_SET_OUTPUT_NCHANNELS, &nchannels);
+	ms_queue_init(&inq);
+	ms_queue_init(&outq);
+	resampler->inputs[0] = &inq;
+	resampler->outputs[0] = &outq;
+	ms_queue_put(&inq, dupb(orig->pcm));
+	ms_filter_process(resampler);
+	if ((m = ms_queue_get(&outq)) != NULL) {
+		entry = ms_new0(MSToneCacheEntry, 1);
+		entry->file = ms_strdup(orig->file);
+		entry->mtime = orig->mtime;
+		entry->rate = rate;
+		entry->nchannels = nchannels;
+		entry->nsamples = (m->b_wptr - m->b_rptr) / (nchannels * 2);
+		entry->pcm = m;
+	}
+	ms_queue_flush(&inq);
+	ms_queue_flush(&outq);
+	resampler->inputs[0] = NULL;
+	resampler->outputs[0] = NULL;
+	ms_filter_destroy(resampler);
+	return entry;
+}
+
+mblk_t *ms_tone_cache_get_file(MSToneCache *obj, const char *file, int *rate, int *nchannels) {
+	MSToneCacheEntry *entry, *found = NULL, *native = NULL;
+	struct stat statbuf;
+	MSList *it, *next;
+
+	if (stat(file, &statbuf) != 0) {
+		ms_warning("MSToneCache: cannot stat %s: %s", file, strerror(errno));
+		return NULL;
+	}
+	ms_mutex_lock(&obj->lock);
+	for (it = obj->entries; it != NULL; it = next) {
+		next = it->next;
+		entry = (MSToneCacheEntry *)it->data;
+		if (entry->file == NULL || strcmp(entry->file, file) != 0) continue;
+		if (entry->mtime != statbuf.st_mtime) {
+			/*the file was modified since it was cached*/
+			tone_cache_remove(obj, it);
+			continue;
+		}
+		if (entry->native) native = entry;
+		if (found == NULL && (*rate == 0 || entry->rate == *rate) && (*nchannels == 0 || entry->nchannels == *nchannels))
+			found = entry;
+	}
+	if (found == NULL) {
+		if (native == NULL && (native = read_wav_file(file, statbuf.st_mtime, statbuf.st_size)) != NULL) {
+			ms_message("MSToneCache: %s loaded, rate=%i, nchannels=%i", file, native->rate, native->nchannels);
+			if (!tone_cache_add(obj, native)) native = NULL;
+		}
+		if (native != NULL) {
+			if ((*rate == 0 || native->rate == *rate) && (*nchannels == 0 || native->nchannels == *nchannels)) {
+				found = native;
+			} else if ((entry = convert_wav(native, *rate ? *rate : native->rate, *nchannels ? *nchannels : native->nchannels)) != NULL
+				&& tone_cache_add(obj, entry)) {
+				found = entry;
+			}
+		}
+	}
+	if (found != NULL) {
+		found->last_use = ++obj->use_count;
+		*rate = found->rate;
+		*nchannels = found->nchannels;
+	}
+	ms_mutex_unlock(&obj->lock);
+	return found ? dupb(found->pcm) : NULL;
+}
@@ -0,0 +1,98 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifndef TONE_CACHE_H
+#define TONE_CACHE_H
+
+#include "mediastreamer2/mscommon.h"
+
+/**
+ * @brief MSToneCache keeps the PCM of the tones and of the prompt files played by the filters of the process,
+ * once per format. The PCM is handed out as blocks made with dupb(), which share the cached data:
+ * they must be read only. Since the filters downstream may modify the blocks they receive in place (MSVolume
+ * for example), the filters output copies of the parts they play, and never the shared blocks.
+ * The blocks remain valid after the entry they come from is evicted, or the cache destroyed.
+ */
+typedef struct _MSToneCache MSToneCache;
+
+/**
+ * @brief Sine oscillator computed by recursion, y[n]=2cos(w)y[n-1]-y[n-2], which costs a multiplication
+ * and a subtraction per sample instead of a sin().
+ */
+typedef struct _MSToneOscillator {
+	double coef;
+	double y1;
+	double y2;
+} MSToneOscillator;
+
+/**
+ * @brief Initialize an oscillator so that its next value is sin(2*pi*freq*pos/rate).
+ * @param osc The oscillator.
+ * @param freq The frequency, in Hz.
+ * @param rate The sampling rate, in Hz.
+ * @param pos Index of the next sample.
+ */
+extern void ms_tone_oscillator_init(MSToneOscillator *osc, int freq, int rate, int pos);
+
+static MS2_INLINE double ms_tone_oscillator_next(MSToneOscillator *osc) {
+	double y = osc->coef * osc->y1 - osc->y2;
+	osc->y2 = osc->y1;
+	osc->y1 = y;
+	return y;
+}
+
+/**
+ * @brief Get a reference on the cache, creating it if needed.
+ * @return The tone cache.
+ */
+extern MSToneCache *ms_tone_cache_ref(void);
+
+/**
+ * @brief Release a reference on the cache. The cached PCM is freed with the last reference.
+ * @param obj MSToneCache
+ */
+extern void ms_tone_cache_unref(MSToneCache *obj);
+
+/**
+ * @brief Get the PCM of a tone made of one or two frequencies. The channels of a sample are all equal.
+ * @param obj MSToneCache
+ * @param lowfreq The first frequency, in Hz.
+ * @param highfreq The second frequency, in Hz, 0 for a single frequency tone.
+ * @param amplitude The peak amplitude of each frequency.
+ * @param nsamples The duration of the tone, in samples.
+ * @param rate The sampling rate, in Hz.
+ * @param nchannels The number of channels.
+ * @return A block to be freed with freemsg(), or NULL if the tone is too long to be cached.
+ */
+extern mblk_t *ms_tone_cache_get_tone(MSToneCache *obj, int lowfreq, int highfreq, int amplitude, int nsamples, int rate, int nchannels);
+
+/**
+ * @brief Get the PCM of a wav file, converted to the requested format. The file is read once,
+ * the conversions are made once per format with the MSResample filter.
+ * @param obj MSToneCache
+ * @param file The path of a wav file of 16 bits samples.
+ * @param rate The requested sampling rate, 0 for the rate of the file. Set to the rate of the PCM on return.
+ * @param nchannels The requested number of channels, 0 for the channels of the file. Set to the number of channels
+ * of the PCM on return.
+ * @return A block to be freed with freemsg(), or NULL if the file cannot be read, is too large to be cached,
+ * or cannot be converted.
+ */
+extern mblk_t *ms_tone_cache_get_file(MSToneCache *obj, const char *file, int *rate, int *nchannels);
+
+#endif
@@ -0,0 +1,326 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msvideo.h"
+#include "mediastreamer2/msframerateconv.h"
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * The output frames are chosen on a regular grid of period 1/fps starting with the first received frame:
+ * each input frame is assigned to the closest grid slot, and the frame the closest to the slot time is forwarded.
+ * A candidate is held until no later frame can be closer to its slot, that is at most half a period.
+ * The frames are placed on the grid by their 90kHz capture timestamp, so that the jitter of their delivery to the
+ * filter does not change the choice. Frames not stamped by their source (timestamp 0) are placed at their arrival.
+ */
+typedef struct FrameRateConvState{
+	float fps;
+	float duplicate_threshold;
+	int64_t clock; /*90kHz, the timestamp of the last frame unwrapped to 64 bits*/
+	uint32_t last_timestamp;
+	uint64_t last_arrival; /*ticker time at which the last frame was received*/
+	bool_t clock_started;
+	uint64_t grid_origin;
+	int last_slot;
+	mblk_t *candidate;
+	uint64_t candidate_time;
+	int candidate_slot;
+	uint8_t *last_luma; /*luma plane of the last forwarded frame, for duplicate detection*/
+	MSVideoSize last_luma_size;
+	int consecutive_duplicates;
+	MSAverageFPS input_fps;
+	MSAverageFPS output_fps;
+	unsigned int dropped_frames;
+	unsigned int dropped_duplicates;
+} FrameRateConvState;
+
+static void frame_rate_conv_reset(FrameRateConvState *s){
+	if (s->candidate){
+		freemsg(s->candidate);
+		s->candidate=NULL;
+	}
+	s->last_slot=-1;
+	s->consecutive_duplicates=0;
+	s->clock_started=FALSE;
+}
+
+static void frame_rate_conv_init(MSFilter *f){
+	FrameRateConvState *s=ms_new0(FrameRateConvState,1);
+	s->fps=-1; /* default to forward ALL frames */
+	s->last_slot=-1;
+	ms_average_fps_init(&s->input_fps,"MSFrameRateConv: input fps=%f");
+	ms_average_fps_init(&s->output_fps,"MSFrameRateConv: output fps=%f");
+	f->data=s;
+}
+
+static void frame_rate_conv_uninit(MSFilter *f){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	frame_rate_conv_reset(s);
+	if (s->last_luma) ms_free(s->last_luma);
+	ms_free(s);
+}
+
+static void frame_rate_conv_postprocess(MSFilter *f){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	frame_rate_conv_reset(s);
+	if (s->dropped_frames>0 || s->dropped_duplicates>0){
+		ms_message("MSFrameRateConv: %u frames dropped to match %f fps, %u duplicate frames dropped.",
+			s->dropped_frames,s->fps,s->dropped_duplicates);
+	}
+}
+
+static unsigned int luma_row_sad(const uint8_t *a, const uint8_t *b, int n){
+	unsigned int sum=0;
+	int i=0;
+#if defined(__SSE2__)
+	__m128i acc=_mm_setzero_si128();
+	for(;i+16<=n;i+=16){
+		__m128i va=_mm_loadu_si128((const __m128i*)(a+i));
+		__m128i vb=_mm_loadu_si128((const __m128i*)(b+i));
+		acc=_mm_add_epi64(acc,_mm_sad_epu8(va,vb));
+	}
+	sum=_mm_cvtsi128_si32(acc)+_mm_cvtsi128_si32(_mm_srli_si128(acc,8));
+#elif defined(__ARM_NEON__)
+	uint32x4_t acc=vdupq_n_u32(0);
+	uint64x2_t acc64;
+	for(;i+16<=n;i+=16){
+		uint8x16_t d=vabdq_u8(vld1q_u8(a+i),vld1q_u8(b+i));
+		acc=vpadalq_u16(acc,vpaddlq_u8(d));
+	}
+	acc64=vpaddlq_u32(acc);
+	sum=(unsigned int)(vgetq_lane_u64(acc64,0)+vgetq_lane_u64(acc64,1));
+#endif
+	for(;i<n;++i){
+		sum+=abs((int)a[i]-(int)b[i]);
+	}
+	return sum;
+}
+
+/*compare the luma with the one of the last forwarded frame, giving up as soon as the threshold is exceeded*/
+static bool_t frame_rate_conv_is_duplicate(FrameRateConvState *s, const MSPicture *pic){
+	uint64_t limit=(uint64_t)(s->duplicate_threshold*pic->w*pic->h);
+	uint64_t sum=0;
+	int i;
+
+	if (s->last_luma==NULL || s->last_luma_size.width!=pic->w || s->last_luma_size.height!=pic->h) return FALSE;
+	for(i=0;i<pic->h;++i){
+		sum+=luma_row_sad(pic->planes[0]+i*pic->strides[0],s->last_luma+i*pic->w,pic->w);
+		if (sum>limit) return FALSE;
+	}
+	return TRUE;
+}
+
+static void frame_rate_conv_save_luma(FrameRateConvState *s, const MSPicture *pic){
+	int i;
+	if (s->last_luma==NULL || s->last_luma_size.width!=pic->w || s->last_luma_size.height!=pic->h){
+		if (s->last_luma) ms_free(s->last_luma);
+		s->last_luma=ms_malloc(pic->w*pic->h);
+		s->last_luma_size.width=pic->w;
+		s->last_luma_size.height=pic->h;
+	}
+	for(i=0;i<pic->h;++i){
+		memcpy(s->last_luma+i*pic->w,pic->planes[0]+i*pic->strides[0],pic->w);
+	}
+}
+
+static void frame_rate_conv_output(MSFilter *f, mblk_t *im){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	MSPicture pic;
+
+	if (s->duplicate_threshold>0 && ms_yuv_buf_init_from_mblk(&pic,im)==0){
+		/*forward at least one frame per second, so that the stream never looks interrupted*/
+		if (s->consecutive_duplicates<(int)s->fps && frame_rate_conv_is_duplicate(s,&pic)){
+			s->consecutive_duplicates++;
+			s->dropped_duplicates++;
+			freemsg(im);
+			return;
+		}
+		s->consecutive_duplicates=0;
+		frame_rate_conv_save_luma(s,&pic);
+	}
+	ms_average_fps_update(&s->output_fps,(uint32_t)f->ticker->time);
+	ms_queue_put(f->outputs[0],im);
+}
+
+static double frame_rate_conv_slot_time(FrameRateConvState *s, int slot){
+	return (double)s->grid_origin+(slot*1000.0/s->fps);
+}
+
+/*the capture time of a frame in milliseconds, on a clock starting at the ticker time of the first frame*/
+static uint64_t frame_rate_conv_frame_time(FrameRateConvState *s, mblk_t *im, uint64_t now){
+	uint32_t ts=mblk_get_timestamp_info(im);
+	if (ts==0) ts=(uint32_t)(now*90);
+	if (!s->clock_started){
+		s->clock_started=TRUE;
+		s->clock=(int64_t)now*90;
+	}else s->clock+=(int32_t)(ts-s->last_timestamp);
+	s->last_timestamp=ts;
+	s->last_arrival=now;
+	return s->clock>0 ? (uint64_t)(s->clock/90) : 0;
+}
+
+static void frame_rate_conv_process(MSFilter *f){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	uint64_t now=f->ticker->time;
+	mblk_t *im;
+
+	ms_filter_lock(f);
+	while((im=ms_queue_get(f->inputs[0]))!=NULL){
+		uint64_t frame_time;
+		int slot;
+		ms_average_fps_update(&s->input_fps,(uint32_t)now);
+		if (s->fps<=0){
+			frame_rate_conv_output(f,im);
+			continue;
+		}
+		frame_time=frame_rate_conv_frame_time(s,im,now);
+		if (s->last_slot==-1 && s->candidate==NULL){
+			s->grid_origin=frame_time;
+		}
+		slot=(int)(((double)frame_time-(double)s->grid_origin)*s->fps/1000.0+0.5);
+		if (slot<=s->last_slot){
+			/*a frame has already been sent for this period*/
+			s->dropped_frames++;
+			freemsg(im);
+			continue;
+		}
+		if (s->candidate!=NULL){
+			if (slot==s->candidate_slot){
+				double slot_time=frame_rate_conv_slot_time(s,slot);
+				if (fabs(frame_time-slot_time)<fabs(s->candidate_time-slot_time)){
+					freemsg(s->candidate);
+					s->candidate=im;
+					s->candidate_time=frame_time;
+				}else freemsg(im);
+				s->dropped_frames++;
+				continue;
+			}
+			frame_rate_conv_output(f,s->candidate);
+			s->last_slot=s->candidate_slot;
+		}
+		s->candidate=im;
+		s->candidate_time=frame_time;
+		s->candidate_slot=slot;
+	}
+	/*no frame to come can be closer to the slot than the candidate: the capture clock has moved on by the time
+	elapsed since the last frame was received*/
+	if (s->candidate!=NULL){
+		double slot_time=frame_rate_conv_slot_time(s,s->candidate_slot);
+		double clock_now=(double)(s->clock/90)+(double)(now-s->last_arrival);
+		if (clock_now-slot_time>=slot_time-(double)s->candidate_time){
+			frame_rate_conv_output(f,s->candidate);
+			s->last_slot=s->candidate_slot;
+			s->candidate=NULL;
+		}
+	}
+	ms_filter_unlock(f);
+}
+
+static int frame_rate_conv_set_fps(MSFilter *f, void *arg){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	ms_filter_lock(f);
+	s->fps=*((float*)arg);
+	frame_rate_conv_reset(s); /*restart the grid*/
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int frame_rate_conv_get_fps(MSFilter *f, void *arg){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	*((float*)arg)=s->fps;
+	return 0;
+}
+
+static int frame_rate_conv_set_duplicate_threshold(MSFilter *f, void *arg){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	ms_filter_lock(f);
+	s->duplicate_threshold=*((float*)arg);
+	s->consecutive_duplicates=0;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int frame_rate_conv_get_stats(MSFilter *f, void *arg){
+	FrameRateConvState *s=(FrameRateConvState*)f->data;
+	MSFrameRateConvStats *stats=(MSFrameRateConvStats*)arg;
+	ms_filter_lock(f);
+	stats->input_fps=ms_average_fps_get(&s->input_fps);
+	stats->output_fps=ms_average_fps_get(&s->output_fps);
+	stats->dropped_frames=s->dropped_frames;
+	stats->dropped_duplicates=s->dropped_duplicates;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static MSFilterMethod methods[]={
+	{	MS_FILTER_SET_FPS	,	frame_rate_conv_set_fps	},
+	{	MS_FILTER_GET_FPS	,	frame_rate_conv_get_fps	},
+	{	MS_FRAME_RATE_CONV_SET_DUPLICATE_THRESHOLD	,	frame_rate_conv_set_duplicate_threshold	},
+	{	MS_FRAME_RATE_CONV_GET_STATS	,	frame_rate_conv_get_stats	},
+	{	0	,	NULL }
+};
+
+#ifdef _MSC_VER
+
+MSFilterDesc ms_frame_rate_conv_desc={
+	MS_FRAME_RATE_CONV_ID,
+	"MSFrameRateConv",
+	N_("A video frame rate converter"),
+	MS_FILTER_OTHER,
+	NULL,
+	1,
+	1,
+	frame_rate_conv_init,
+	NULL,
+	frame_rate_conv_process,
+	frame_rate_conv_postprocess,
+	frame_rate_conv_uninit,
+	methods
+};
+
+#else
+
+MSFilterDesc ms_frame_rate_conv_desc={
+	.id=MS_FRAME_RATE_CONV_ID,
+	.name="MSFrameRateConv",
+	.text=N_("A video frame rate converter"),
+	.ninputs=1,
+	.noutputs=1,
+	.init=frame_rate_conv_init,
+	.process=frame_rate_conv_process,
+	.postprocess=frame_rate_conv_postprocess,
+	.uninit=frame_rate_conv_uninit,
+	.methods=methods
+};
+
+#endif
+
+MS_FILTER_DESC_EXPORT(ms_frame_rate_conv_desc)
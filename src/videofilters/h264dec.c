@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/msvideo.h"
 #include "mediastreamer2/msticker.h"
 #include "stream_regulator.h"
+#include "rtp_reorder_buffer.h"
 
 #include "ffmpeg-priv.h"
 
@@ -41,6 +42,8 @@ typedef struct _DecData{
 	uint8_t *bitstream;
 	int bitstream_size;
 	MSStreamRegulator *regulator;
+	MSRtpReorderBuffer *reorder_buffer;
+	int reordering_delay; /*set by the method, given to the reorder buffer at the next process*/
 	MSYuvBufAllocator *buf_allocator;
 	bool_t first_image_decoded;
 	bool_t avpf_enabled;
@@ -85,6 +88,8 @@ static void dec_init(MSFilter *f){
 		ms_error("Could not allocate frame");
 	}
 	d->regulator = NULL;
+	d->reorder_buffer = ms_rtp_reorder_buffer_new(MS_RTP_REORDER_BUFFER_DEFAULT_DELAY, MS_RTP_REORDER_BUFFER_DEFAULT_MAX_PACKETS);
+	d->reordering_delay = MS_RTP_REORDER_BUFFER_DEFAULT_DELAY;
 	d->buf_allocator = ms_yuv_buf_allocator_new();
 	f->data=d;
 }
@@ -115,6 +120,7 @@ static void dec_uninit(MSFilter *f){
 	if (d->sws_ctx) sws_freeContext(d->sws_ctx);
 	ms_free(d->bitstream);
 	ms_yuv_buf_allocator_free(d->buf_allocator);
+	ms_rtp_reorder_buffer_destroy(d->reorder_buffer);
 	ms_free(d);
 }
 
@@ -263,10 +269,24 @@ static void dec_process(MSFilter *f){
 	DecData *d=(DecData*)f->data;
 	mblk_t *im, *om;
 	MSQueue nalus;
+	MSQueue packets;
 	bool_t requestPLI = FALSE;
 
 	ms_queue_init(&nalus);
+	ms_queue_init(&packets);
+	ms_rtp_reorder_buffer_set_max_delay(d->reorder_buffer,d->reordering_delay);
+	/*put the packets back in sequence order, so that reordering is not taken for losses*/
 	while((im=ms_queue_get(f->inputs[0]))!=NULL){
+		if (msgdsize(im) == 0) {
+			/*the reset packet stays behind the packets received before it*/
+			ms_rtp_reorder_buffer_flush(d->reorder_buffer,&packets);
+			ms_queue_put(&packets,im);
+		} else {
+			ms_rtp_reorder_buffer_put(d->reorder_buffer,im,f->ticker->time);
+		}
+	}
+	ms_rtp_reorder_buffer_get(d->reorder_buffer,&packets,f->ticker->time);
+	while((im=ms_queue_get(&packets))!=NULL){
 		// Reset all contexts when an empty packet is received
 		if(msgdsize(im) == 0) {
 			rfc3984_uninit(&d->unpacker);
@@ -397,6 +417,12 @@ static int dec_enable_avpf(MSFilter *f, void *data){
 	return 0;
 }
 
+static int dec_set_reordering_delay(MSFilter *f, void *arg){
+	DecData *d=(DecData*)f->data;
+	d->reordering_delay=*(int*)arg;
+	return 0;
+}
+
 static MSFilterMethod  h264_dec_methods[]={
 	{	MS_FILTER_ADD_FMTP                                 ,	dec_add_fmtp      },
 	{	MS_VIDEO_DECODER_RESET_FIRST_IMAGE_NOTIFICATION    ,	reset_first_image },
@@ -404,6 +430,7 @@ static MSFilterMethod  h264_dec_methods[]={
 	{	MS_FILTER_GET_FPS                                  ,	dec_get_fps       },
 	{	MS_FILTER_GET_OUTPUT_FMT                           ,	dec_get_outfmt    },
 	{	MS_VIDEO_DECODER_ENABLE_AVPF                       ,	dec_enable_avpf   },
+	{	MS_VIDEO_DECODER_SET_REORDERING_DELAY              ,	dec_set_reordering_delay },
 	{	0                                                  ,	NULL              }
 };
 
@@ -22,168 +22,95 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "mediastreamer2/msjpegwriter.h"
+#include "mediastreamer2/msticker.h"
 #include "mediastreamer2/msvideo.h"
-#include "ffmpeg-priv.h"
+#include "jpeg_snapshot.h"
 
 
 typedef struct {
-	FILE *file;
+	MSJpegSnapshotService *service;
 	char *filename;
-	char *tmpFilename;
-	AVCodec *codec;
-	AVFrame* pict;
+	MSJpegWriterDataCallback cb;
+	uint64_t next_snapshot_time;
+	int interval; /*in seconds, 0 for one-shot snapshots*/
+	bool_t snapshot_requested;
 }JpegWriter;
 
-static void close_file(JpegWriter *obj, bool_t doRenaming);
-
-static bool_t open_file(JpegWriter *obj, const char *filename) {
-	obj->filename=ms_strdup(filename);
-	obj->tmpFilename=ms_strdup_printf("%s.part",filename);
-	obj->file = fopen(obj->tmpFilename, "wb");
-	if(!obj->file) {
-		ms_error("Could not open %s for write", obj->tmpFilename);
-		close_file(obj,FALSE);
-	}
-	return TRUE;
-}
-
-static void close_file(JpegWriter *obj, bool_t doRenaming) {
-	if (obj->file) {
-		fclose(obj->file);
-		obj->file = NULL;
-	}
-	if(doRenaming) {
-		if(rename(obj->tmpFilename, obj->filename) != 0) {
-			ms_error("Could not rename %s into %s", obj->tmpFilename, obj->filename);
-		}
-	}
-	ms_free(obj->filename);
-	obj->filename = NULL;
-	
-	ms_free(obj->tmpFilename);
-	obj->tmpFilename = NULL;
-}
-
 static void jpg_init(MSFilter *f){
 	JpegWriter *s=ms_new0(JpegWriter,1);
-	s->codec=avcodec_find_encoder(CODEC_ID_MJPEG);
-	if (s->codec==NULL){
-		ms_error("Could not find CODEC_ID_MJPEG !");
-	}
-	s->pict = av_frame_alloc();
+	s->service=ms_jpeg_snapshot_service_ref();
 	f->data=s;
 }
 
 static void jpg_uninit(MSFilter *f){
 	JpegWriter *s=(JpegWriter*)f->data;
-	if (s->file!=NULL){
-		close_file(s, FALSE);
+	if (s->service){
+		ms_jpeg_snapshot_service_cancel(s->service, s);
+		ms_jpeg_snapshot_service_unref(s->service);
 	}
-	if (s->pict) av_frame_free(&s->pict);
+	if (s->filename) ms_free(s->filename);
 	ms_free(s);
 }
 
 static int take_snapshot(MSFilter *f, void *arg){
 	JpegWriter *s=(JpegWriter*)f->data;
 	const char *filename = (const char *)arg;
-	int err = 0;
 	ms_filter_lock(f);
-	if (s->file!=NULL){
-		close_file(s, FALSE);
+	if (s->filename){
+		ms_free(s->filename);
+		s->filename=NULL;
 	}
-	if(!open_file(s, filename)) err=-1;
+	if (filename) s->filename=ms_strdup(filename);
+	s->snapshot_requested=TRUE;
 	ms_filter_unlock(f);
-	return err;
+	return 0;
 }
 
-static void cleanup(JpegWriter *s, AVCodecContext *avctx, bool_t success){
-	if (s->file){
-		close_file(s, success);
-	}
-	if (avctx){
-		avcodec_close(avctx);
-		av_free(avctx);
+static int set_interval(MSFilter *f, void *arg){
+	JpegWriter *s=(JpegWriter*)f->data;
+	ms_filter_lock(f);
+	s->interval=*(int*)arg;
+	s->next_snapshot_time=0;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int set_data_callback(MSFilter *f, void *arg){
+	JpegWriter *s=(JpegWriter*)f->data;
+	ms_filter_lock(f);
+	s->cb=*(MSJpegWriterDataCallback*)arg;
+	ms_filter_unlock(f);
+	if (s->cb.cb==NULL && s->service){
+		/*make sure the previous callback is not called anymore, the pending files are still written*/
+		ms_jpeg_snapshot_service_remove_callback(s->service, s);
 	}
+	return 0;
 }
 
 static void jpg_process(MSFilter *f){
 	JpegWriter *s=(JpegWriter*)f->data;
+	mblk_t *m=ms_queue_peek_last(f->inputs[0]);
 	ms_filter_lock(f);
-	if (s->file!=NULL && s->codec!=NULL){
-		MSPicture yuvbuf, yuvjpeg;
-		mblk_t *m=ms_queue_peek_last(f->inputs[0]);
-		if (ms_yuv_buf_init_from_mblk(&yuvbuf,m)==0){
-			int error,got_pict;
-			int comp_buf_sz=msgdsize(m);
-			uint8_t *comp_buf=(uint8_t*)ms_malloc0(comp_buf_sz);
-			mblk_t *jpegm;
-			struct SwsContext *sws_ctx;
-			struct AVPacket packet;
-			AVCodecContext *avctx=avcodec_alloc_context3(s->codec);
-
-			memset(&packet, 0, sizeof(packet));
-
-			avctx->width=yuvbuf.w;
-			avctx->height=yuvbuf.h;
-			avctx->time_base.num = 1;
-			avctx->time_base.den =1;
-			avctx->pix_fmt=PIX_FMT_YUVJ420P;
-
-			error=avcodec_open2(avctx,s->codec,NULL);
-			if (error!=0) {
-				ms_error("avcodec_open() failed: %i",error);
-				cleanup(s,NULL, FALSE);
-				av_free(avctx);
-				goto end;
-			}
-			sws_ctx=sws_getContext(avctx->width,avctx->height,PIX_FMT_YUV420P,
-				avctx->width,avctx->height,avctx->pix_fmt,SWS_FAST_BILINEAR,NULL, NULL, NULL);
-			if (sws_ctx==NULL) {
-				ms_error(" sws_getContext() failed.");
-				cleanup(s,avctx, FALSE);
-				goto end;
-			}
-			jpegm=ms_yuv_buf_alloc (&yuvjpeg,avctx->width, avctx->height);
-#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(0,9,0)
-			if (sws_scale(sws_ctx,(const uint8_t *const*)yuvbuf.planes,yuvbuf.strides,0,avctx->height,yuvjpeg.planes,yuvjpeg.strides)<0){
-#else
-			if (sws_scale(sws_ctx,(uint8_t **)yuvbuf.planes,yuvbuf.strides,0,avctx->height,yuvjpeg.planes,yuvjpeg.strides)<0){
-#endif
-				ms_error("sws_scale() failed.");
-				sws_freeContext(sws_ctx);
-				cleanup(s,avctx, FALSE);
-				freemsg(jpegm);
-				goto end;
-			}
-			sws_freeContext(sws_ctx);
-
-			av_frame_unref(s->pict);
-			avpicture_fill((AVPicture*)s->pict,(uint8_t*)jpegm->b_rptr,avctx->pix_fmt,avctx->width,avctx->height);
-			packet.data=comp_buf;
-			packet.size=comp_buf_sz;
-			error=avcodec_encode_video2(avctx, &packet, s->pict, &got_pict);
-			if (error<0){
-				ms_error("Could not encode jpeg picture.");
-			}else{
-				if (fwrite(comp_buf,packet.size,1,s->file)>0){
-					ms_message("Snapshot done");
-				}else{
-					ms_error("Error writing snapshot.");
-				}
-			}
-			ms_free(comp_buf);
-			cleanup(s,avctx, TRUE);
-			freemsg(jpegm);
+	if (m!=NULL && s->service!=NULL && (s->filename!=NULL || s->cb.cb!=NULL)){
+		bool_t take=s->snapshot_requested;
+		if (s->interval>0 && f->ticker->time>=s->next_snapshot_time){
+			s->next_snapshot_time=f->ticker->time+(uint64_t)s->interval*1000;
+			take=TRUE;
+		}
+		if (take){
+			/*the encoding is done by the snapshot service thread, on its own reference to the frame*/
+			ms_jpeg_snapshot_service_submit(s->service, s, dupmsg(m), s->filename, &s->cb);
+			s->snapshot_requested=FALSE;
 		}
-		goto end;
 	}
-	end:
 	ms_filter_unlock(f);
 	ms_queue_flush(f->inputs[0]);
 }
 
 static MSFilterMethod jpg_methods[]={
 	{	MS_JPEG_WRITER_TAKE_SNAPSHOT, take_snapshot },
+	{	MS_JPEG_WRITER_SET_INTERVAL, set_interval },
+	{	MS_JPEG_WRITER_SET_DATA_CALLBACK, set_data_callback },
 	{	0,NULL}
 };
 
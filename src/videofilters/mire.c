@@ -28,16 +28,25 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/mswebcam.h"
 #include "mediastreamer2/mediastream.h"
 
+#include "synthetic_frames.h"
+
 #include <math.h>
 
+/*the pattern moves one step per frame: the luma, moving two pixels per step over squares of 85, repeats itself
+every 85 steps, when the chroma has moved by one square. A VGA period then takes 39 MB.*/
+#define MIRE_PATTERN_PERIOD 85
+/*above this size, the frames of a whole period are drawn when needed instead of being cached*/
+#define MIRE_CYCLE_MAX_BYTES (48*1024*1024)
 
 typedef struct _MireData{
 	MSVideoSize vsize;
-	MSPicture pict;
 	int index;
 	uint64_t starttime;
 	float fps;
-	mblk_t *pic;
+	MSSyntheticFramesCache *cache;
+	MSSyntheticFrames *frames;
+	MSYuvBufAllocator *allocator;
+	bool_t tags_enabled;
 }MireData;
 
 void mire_init(MSFilter *f){
@@ -47,19 +56,14 @@ void mire_init(MSFilter *f){
 	d->fps=15;
 	d->index=0;
 	d->starttime=0;
-	d->pic=NULL;
+	d->cache=ms_synthetic_frames_cache_ref();
 	f->data=d;
 }
 
 void mire_uninit(MSFilter *f){
-	ms_free(f->data);
-}
-
-static void mire_preprocess(MSFilter *f){
 	MireData *d=(MireData*)f->data;
-	d->pic=ms_yuv_buf_alloc(&d->pict,d->vsize.width,d->vsize.height);
-	memset(d->pic->b_rptr,0,d->pic->b_wptr-d->pic->b_rptr);
-	d->starttime=f->ticker->time;
+	ms_synthetic_frames_cache_unref(d->cache);
+	ms_free(d);
 }
 
 static void plane_draw(uint8_t *p, int w, int h, int lsz, int index, int color1, int color2){
@@ -67,6 +71,8 @@ static void plane_draw(uint8_t *p, int w, int h, int lsz, int index, int color1,
 	
 	for(i=0;i<h;++i){
 		int tmp = index + (cos(4*(double)(i)/(double)h) * (w/8));
+		/*shifted by whole pairs of squares to stay positive, the divisions below truncating towards zero*/
+		tmp += 170*(w/(8*170)+1);
 		for(j=0;j<w;++j){
 			p[j]= (( ((i+tmp)/85) + ((j+tmp)/85)  ) & 0x1) ? color1 : color2;
 		}
@@ -74,27 +80,58 @@ static void plane_draw(uint8_t *p, int w, int h, int lsz, int index, int color1,
 	}
 }
 
-static void mire_draw(MireData *d){
-	plane_draw(d->pict.planes[0],d->pict.w,d->pict.h,d->pict.strides[0],d->index*2,150,12);
-	plane_draw(d->pict.planes[1],d->pict.w/2,d->pict.h/2,d->pict.strides[1],d->index,100,60);
-	plane_draw(d->pict.planes[2],d->pict.w/2,d->pict.h/2,d->pict.strides[2],d->index,200,100);
+static void mire_draw(MSPicture *pict, int index){
+	plane_draw(pict->planes[0],pict->w,pict->h,pict->strides[0],index*2,150,12);
+	plane_draw(pict->planes[1],pict->w/2,pict->h/2,pict->strides[1],index,100,60);
+	plane_draw(pict->planes[2],pict->w/2,pict->h/2,pict->strides[2],index,200,100);
+}
+
+static mblk_t *mire_generate(void *user_data, int index, int count, MSVideoSize *vsize){
+	MSPicture pict;
+	mblk_t *m=ms_yuv_buf_alloc(&pict,vsize->width,vsize->height);
+	mire_draw(&pict,index);
+	return m;
+}
+
+static void mire_preprocess(MSFilter *f){
+	MireData *d=(MireData*)f->data;
+	int frame_size=(d->vsize.width*d->vsize.height*3)/2;
+	if ((int64_t)frame_size*MIRE_PATTERN_PERIOD<=MIRE_CYCLE_MAX_BYTES){
+		d->frames=ms_synthetic_frames_cache_get(d->cache,"mire",d->vsize,0,MIRE_PATTERN_PERIOD,mire_generate,NULL);
+	}
+	d->allocator=ms_yuv_buf_allocator_new();
+	d->index=0;
+	d->starttime=f->ticker->time;
 }
 
 static void mire_process(MSFilter *f){
 	MireData *d=(MireData*)f->data;
 	float elapsed=(float)(f->ticker->time-d->starttime);
 	if ((elapsed*d->fps/1000.0)>d->index){
-		mire_draw(d);
-		ms_queue_put(f->outputs[0],dupb(d->pic));
+		MSPicture pict;
+		mblk_t *m;
+		if (d->frames){
+			m=ms_synthetic_frames_get_frame(d->frames,d->index,d->allocator);
+			ms_yuv_buf_init_from_mblk(&pict,m);
+		}else{
+			m=ms_yuv_buf_allocator_get(d->allocator,&pict,d->vsize.width,d->vsize.height);
+			mire_draw(&pict,d->index%MIRE_PATTERN_PERIOD);
+		}
+		if (d->tags_enabled) ms_yuv_buf_write_tag(&pict,(uint32_t)d->index,(uint32_t)ms_get_cur_time_ms());
+		ms_queue_put(f->outputs[0],m);
 		d->index++;
 	}
 }
 
 void mire_postprocess(MSFilter *f){
 	MireData *d=(MireData*)f->data;
-	if (d->pic) {
-		freemsg(d->pic);
-		d->pic=NULL;
+	if (d->frames) {
+		ms_synthetic_frames_cache_release(d->cache,d->frames);
+		d->frames=NULL;
+	}
+	if (d->allocator){
+		ms_yuv_buf_allocator_free(d->allocator);
+		d->allocator=NULL;
 	}
 }
 
@@ -121,11 +158,18 @@ static int mire_get_vsize(MSFilter *f, void* data){
 	return 0;
 }
 
+static int mire_enable_frame_tags(MSFilter *f, void* data){
+	MireData *d=(MireData*)f->data;
+	d->tags_enabled=*(int*)data;
+	return 0;
+}
+
 MSFilterMethod mire_methods[]={
 	{	MS_FILTER_SET_VIDEO_SIZE, mire_set_vsize },
 	{	MS_FILTER_SET_FPS		, mire_set_fps	},
 	{	MS_FILTER_GET_PIX_FMT	, mire_get_fmt	},
 	{	MS_FILTER_GET_VIDEO_SIZE, mire_get_vsize },
+	{	MS_MIRE_ENABLE_FRAME_TAGS, mire_enable_frame_tags },
 	{	0,0 }
 };
 
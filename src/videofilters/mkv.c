@@ -1161,6 +1161,26 @@ static int matroska_close_segment(Matroska *obj) {
 	return 0;
 }
 
+static void matroska_write_void(Matroska *obj, filepos_t begin, filepos_t end) {
+	ebml_element *voidElt;
+	if(end - begin < 2) {
+		return;
+	}
+	voidElt = EBML_ElementCreate(obj->p, &EBML_ContextEbmlVoid, FALSE, NULL);
+	EBML_VoidSetFullSize(voidElt, end - begin);
+	Stream_Seek(obj->output, begin, SEEK_SET);
+	EBML_ElementRender(voidElt, obj->output, FALSE, FALSE, FALSE, NULL);
+	NodeDelete((node *)voidElt);
+}
+
+static void matroska_update_segment_size(Matroska *obj) {
+	filepos_t end = Stream_Seek(obj->output, 0, SEEK_END);
+	EBML_ElementForceDataSize((ebml_element *)obj->segment, end - EBML_ElementPositionData((ebml_element *)obj->segment));
+	Stream_Seek(obj->output, EBML_ElementPosition((ebml_element *)obj->segment), SEEK_SET);
+	EBML_ElementRenderHead((ebml_element *)obj->segment, obj->output, FALSE, NULL);
+	Stream_Seek(obj->output, end, SEEK_SET);
+}
+
 static ebml_master *matroska_find_track_entry(const Matroska *obj, int trackNum) {
 	ebml_element *trackEntry = NULL;
 	for(trackEntry = EBML_MasterChildren(obj->tracks);
@@ -1568,6 +1588,7 @@ static uint32_t time_loop_canceler_apply(TimeLoopCanceler *obj, uint32_t timesta
  * MKV Recorder Filter                                                                       *
  *********************************************************************************************/
 #define CLUSTER_MAX_DURATION 5000
+#define SEGMENT_HEADERS_RESERVED_SIZE 1024
 
 typedef struct {
 	Matroska file;
@@ -1582,6 +1603,7 @@ typedef struct {
 	TimeLoopCanceler **timeLoopCancelers;
 	ms_bool_t needKeyFrame;
 	ms_bool_t tracksInitialized;
+	ms_bool_t needNewCluster;
 } MKVRecorder;
 
 static void recorder_init(MSFilter *f) {
@@ -1654,14 +1676,15 @@ static matroska_block *write_frame(MKVRecorder *obj, mblk_t *buffer, int pin) {
 	m_frame.Size = msgdsize(frame);
 	m_frame.Data = frame->b_rptr;
 
-	if(matroska_clusters_count(&obj->file) == 0) {
+	if(matroska_clusters_count(&obj->file) == 0 || obj->file.cluster == NULL) {
 		matroska_start_cluster(&obj->file, mblk_get_timestamp_info(frame));
 	} else {
-		if((obj->inputDescsList[pin]->type == MSVideo && isKeyFrame) || (obj->duration - matroska_current_cluster_timecode(&obj->file) >= CLUSTER_MAX_DURATION)) {
+		if(obj->needNewCluster || (obj->inputDescsList[pin]->type == MSVideo && isKeyFrame) || (obj->duration - matroska_current_cluster_timecode(&obj->file) >= CLUSTER_MAX_DURATION)) {
 			matroska_close_cluster(&obj->file);
 			matroska_start_cluster(&obj->file, mblk_get_timestamp_info(frame));
 		}
 	}
+	obj->needNewCluster = FALSE;
 
 	block = matroska_write_block(&obj->file, &m_frame, pin + 1, isKeyFrame, codecPrivateData, codecPrivateSize);
 	freemsg(frame);
@@ -1731,9 +1754,9 @@ static int recorder_start(MSFilter *f, void *arg) {
 			matroska_set_doctype_version(&obj->file, MKV_DOCTYPE_VERSION, MKV_DOCTYPE_READ_VERSION);
 			matroska_write_ebml_header(&obj->file);
 			matroska_start_segment(&obj->file);
-			matroska_write_zeros(&obj->file, 1024);
+			matroska_write_zeros(&obj->file, SEGMENT_HEADERS_RESERVED_SIZE);
 			matroska_mark_segment_info_position(&obj->file);
-			matroska_write_zeros(&obj->file, 1024);
+			matroska_write_zeros(&obj->file, SEGMENT_HEADERS_RESERVED_SIZE);
 		} else {
 			for(i=0; i < f->desc->ninputs; i++) {
 				if(obj->inputDescsList[i] != NULL) {
@@ -1931,6 +1954,7 @@ static int recorder_close(MSFilter *f, void *arg) {
 	}
 	time_corrector_reset(&obj->timeCorrector);
 	obj->tracksInitialized = FALSE;
+	obj->needNewCluster = FALSE;
 	obj->state = MSRecorderClosed;
 	ms_message("MKVRecorder: the file has been successfully closed");
 	
@@ -1939,6 +1963,56 @@ end:
 	return 0;
 }
 
+/* Writes what recorder_close() writes, without closing anything, so that the file
+ * remains playable up to the last written block if it never gets closed. The spaces
+ * reserved for the meta seek and the segment headers are voided, and the next block
+ * opens a new cluster as the current one gets its final size. */
+static int recorder_sync(MSFilter *f, void *arg) {
+	MKVRecorder *obj = (MKVRecorder *)f->data;
+	int i;
+
+	ms_filter_lock(f);
+	if(obj->state == MSRecorderClosed) {
+		ms_filter_unlock(f);
+		return -1;
+	}
+	if(!obj->tracksInitialized || matroska_clusters_count(&obj->file) == 0) {
+		ms_filter_unlock(f);
+		return 0;
+	}
+	for(i=0; i < f->desc->ninputs; i++) {
+		if(obj->inputDescsList[i] != NULL && obj->modulesList[i] != NULL) {
+			uint8_t *codecPrivateData = NULL;
+			size_t codecPrivateDataSize;
+			module_get_private_data(obj->modulesList[i], &codecPrivateData, &codecPrivateDataSize);
+			matroska_track_set_info(&obj->file, i+1, obj->inputDescsList[i]);
+			if(codecPrivateDataSize > 0) {
+				matroska_track_set_codec_private(&obj->file, i + 1, codecPrivateData, codecPrivateDataSize);
+			}
+			ms_free(codecPrivateData);
+		}
+	}
+	matroska_close_cluster(&obj->file);
+	obj->needNewCluster = TRUE;
+
+	if(obj->openMode == MKV_OPEN_CREATE) {
+		matroska_go_to_segment_info_mark(&obj->file);
+	} else {
+		matroska_go_to_segment_info_begin(&obj->file);
+	}
+	matroska_set_segment_info(&obj->file, "libmediastreamer2", "libmediastreamer2", obj->duration + 1);
+	matroska_write_segment_info(&obj->file);
+	matroska_write_tracks(&obj->file);
+	if(obj->openMode == MKV_OPEN_CREATE) {
+		filepos_t tracksEnd = Stream_Seek(obj->file.output, 0, SEEK_CUR);
+		matroska_write_void(&obj->file, tracksEnd, obj->file.segmentInfoPosition + SEGMENT_HEADERS_RESERVED_SIZE);
+		matroska_write_void(&obj->file, EBML_ElementPositionData((ebml_element *)obj->file.segment), obj->file.segmentInfoPosition);
+	}
+	matroska_update_segment_size(&obj->file);
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static int recorder_set_input_fmt(MSFilter *f, void *arg) {
 	MKVRecorder *data=(MKVRecorder *)f->data;
 	const MSPinFormat *pinFmt = (const MSPinFormat *)arg;
@@ -2008,6 +2082,7 @@ static MSFilterMethod recorder_methods[]= {
 	{	MS_RECORDER_PAUSE           ,	recorder_stop              },
 	{	MS_FILTER_SET_INPUT_FMT     ,   recorder_set_input_fmt     },
 	{	MS_RECORDER_GET_STATE	    ,	recorder_get_state         },
+	{	MS_RECORDER_SYNC            ,	recorder_sync              },
 	{	0                           ,   NULL                       }
 };
 
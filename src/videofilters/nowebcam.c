@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/msticker.h"
 #include "mediastreamer2/mswebcam.h"
+#include "synthetic_frames.h"
 
 
 #ifndef NO_FFMPEG
@@ -351,6 +352,9 @@ typedef struct _SIData{
 	uint64_t lasttime;
 	float fps;
 	mblk_t *pic;
+	MSSyntheticFramesCache *cache;
+	MSSyntheticFrames *frames;
+	MSYuvBufAllocator *allocator;
 }SIData;
 
 void static_image_init(MSFilter *f){
@@ -371,19 +375,43 @@ void static_image_init(MSFilter *f){
 	}
 #endif
 	d->fps=1;
+	d->cache=ms_synthetic_frames_cache_ref();
+	d->allocator=ms_yuv_buf_allocator_new();
 	f->data=d;
 }
 
+static void static_image_release_frames(SIData *d){
+	if (d->frames){
+		ms_synthetic_frames_cache_release(d->cache,d->frames);
+		d->frames=NULL;
+	}
+}
+
 void static_image_uninit(MSFilter *f){
 	SIData *d=(SIData*)f->data;
+	if (d->pic) freemsg(d->pic);
+	static_image_release_frames(d);
+	ms_synthetic_frames_cache_unref(d->cache);
+	ms_yuv_buf_allocator_free(d->allocator);
 	if (d->nowebcamimage) ms_free(d->nowebcamimage);
 	ms_free(d);
 }
 
+static mblk_t *static_image_generate(void *user_data, int index, int count, MSVideoSize *vsize){
+	return ms_load_jpeg_as_yuv((const char*)user_data, vsize);
+}
+
 void static_image_preprocess(MSFilter *f){
 	SIData *d=(SIData*)f->data;
 	if (d->pic==NULL) {
-		d->pic = ms_load_jpeg_as_yuv(d->nowebcamimage, &d->vsize);
+		/*the image is decoded and scaled once for all the instances showing it at this size*/
+		const char *key=d->nowebcamimage ? d->nowebcamimage : "";
+		d->frames=ms_synthetic_frames_cache_get(d->cache,key,d->vsize,0,1,static_image_generate,d->nowebcamimage);
+		if (d->frames){
+			/*a private copy, as before the cache: it is sent with dupmsg() and the precious flag*/
+			d->pic=ms_synthetic_frames_get_frame(d->frames,0,d->allocator);
+			d->vsize=ms_synthetic_frames_get_size(d->frames);
+		}
 	}
 }
 
@@ -410,6 +438,7 @@ void static_image_postprocess(MSFilter *f){
 		freemsg(d->pic);
 		d->pic=NULL;
 	}
+	static_image_release_frames(d);
 }
 
 static int static_image_set_fps(MSFilter *f, void *arg){
@@ -465,6 +494,7 @@ static int static_image_set_image(MSFilter *f, void *arg){
 		freemsg(d->pic);
 		d->pic=NULL;
 	}
+	static_image_release_frames(d);
 	d->lasttime=0;
 	static_image_preprocess(f);
 
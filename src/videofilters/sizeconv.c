@@ -31,7 +31,7 @@ typedef struct SizeConvState{
 	MSVideoSize in_vsize;
 	YuvBuf outbuf;
 	MSScalerContext *sws_ctx;
-	mblk_t *om;
+	MSYuvBufAllocator *allocator;
 	float fps;
 	float start_time;
 	int frame_count;
@@ -49,7 +49,7 @@ static void size_conv_init(MSFilter *f){
 	s->in_vsize.width=0;
 	s->in_vsize.height=0;
 	s->sws_ctx=NULL;
-	s->om=NULL;
+	s->allocator=ms_yuv_buf_allocator_new();
 	s->start_time=0;
 	s->frame_count=-1;
 	s->fps=-1; /* default to process ALL frames */
@@ -59,6 +59,7 @@ static void size_conv_init(MSFilter *f){
 
 static void size_conv_uninit(MSFilter *f){
 	SizeConvState *s=(SizeConvState*)f->data;
+	ms_yuv_buf_allocator_free(s->allocator);
 	ms_free(s);
 }
 
@@ -68,28 +69,12 @@ static void size_conv_postprocess(MSFilter *f){
 		ms_scaler_context_free(s->sws_ctx);
 		s->sws_ctx=NULL;
 	}
-	if (s->om!=NULL){
-		freemsg(s->om);
-		s->om=NULL;
-	}
 	flushq(&s->rq,0);
 	s->frame_count=-1;
 }
 
 static mblk_t *size_conv_alloc_mblk(SizeConvState *s){
-	if (s->om!=NULL){
-		int ref=s->om->b_datap->db_ref;
-		if (ref==1){
-			return dupmsg(s->om);
-		}else{
-			/*the last msg is still referenced by somebody else*/
-			ms_message("size_conv_alloc_mblk: Somebody still retaining yuv buffer (ref=%i)",ref);
-			freemsg(s->om);
-			s->om=NULL;
-		}
-	}
-	s->om=ms_yuv_buf_alloc(&s->outbuf,s->target_vsize.width,s->target_vsize.height);
-	return dupmsg(s->om);
+	return ms_yuv_buf_allocator_get(s->allocator,&s->outbuf,s->target_vsize.width,s->target_vsize.height);
 }
 
 static MSScalerContext * get_resampler(SizeConvState *s, int w, int h){
@@ -175,8 +160,6 @@ static int sizeconv_set_vsize(MSFilter *f, void*arg){
 	SizeConvState *s=(SizeConvState*)f->data;
 	ms_filter_lock(f);
 	s->target_vsize=*(MSVideoSize*)arg;
-	freemsg(s->om);
-	s->om=NULL;
 	if (s->sws_ctx!=NULL) {
 		ms_scaler_context_free(s->sws_ctx);
 		s->sws_ctx=NULL;
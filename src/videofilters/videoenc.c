@@ -35,6 +35,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "rfc2429.h"
+#include "async_encoder.h"
 
 #define RATE_CONTROL_MARGIN 15000 /*bits/second*/
 
@@ -140,6 +141,7 @@ typedef struct EncState{
 	bool_t req_vfu;
 	const MSVideoConfiguration *vconf_list;
 	MSVideoConfiguration vconf;
+	MSAsyncEncoder *async_encoder;
 }EncState;
 
 static bool_t parse_video_fmtp(const char *fmtp, float *fps, MSVideoSize *vsize){
@@ -218,6 +220,8 @@ static const MSVideoConfiguration * get_vconf_list(EncState *s) {
 	}
 }
 
+static void enc_encode_frame(MSFilter *f, mblk_t *inm, uint64_t frame_time, MSQueue *output);
+
 static void enc_init(MSFilter *f, enum CodecID codec)
 {
 	EncState *s=ms_new0(EncState,1);
@@ -234,6 +238,7 @@ static void enc_init(MSFilter *f, enum CodecID codec)
 	s->vconf_list = get_vconf_list(s);
 	s->vconf = ms_video_find_best_configuration_for_bitrate(s->vconf_list, 500000, ms_get_cpu_count());
 	s->pict = av_frame_alloc();
+	s->async_encoder = ms_async_encoder_new(f, enc_encode_frame, 2);
 }
 
 static void enc_h263_init(MSFilter *f){
@@ -344,10 +349,11 @@ static void prepare_mpeg4(EncState *s){
 static void enc_uninit(MSFilter  *f){
 	EncState *s=(EncState*)f->data;
 	if (s->pict) av_frame_free(&s->pict);
+	ms_async_encoder_destroy(s->async_encoder);
 	ms_free(s);
 }
 
-static void enc_preprocess(MSFilter *f){
+static void enc_init_codec(MSFilter *f){
 	EncState *s=(EncState*)f->data;
 	int error;
 	prepare(s);
@@ -382,7 +388,13 @@ static void enc_preprocess(MSFilter *f){
 	s->framenum=0;
 }
 
-static void enc_postprocess(MSFilter *f){
+static void enc_preprocess(MSFilter *f){
+	EncState *s=(EncState*)f->data;
+	enc_init_codec(f);
+	ms_async_encoder_start(s->async_encoder);
+}
+
+static void enc_uninit_codec(MSFilter *f){
 	EncState *s=(EncState*)f->data;
 	if (s->av_context.codec!=NULL){
 		avcodec_close(&s->av_context);
@@ -394,6 +406,12 @@ static void enc_postprocess(MSFilter *f){
 	}
 }
 
+static void enc_postprocess(MSFilter *f){
+	EncState *s=(EncState*)f->data;
+	ms_async_encoder_stop(s->async_encoder);
+	enc_uninit_codec(f);
+}
+
 static void add_rfc2190_header(mblk_t **packet, AVCodecContext *context){
 	mblk_t *header;
 	header = allocb(4, 0);
@@ -449,7 +467,7 @@ static int get_gbsc_bytealigned(uint8_t *begin, uint8_t *end){
 }
 #endif
 
-static void rfc2190_generate_packets(MSFilter *f, EncState *s, mblk_t *frame, uint32_t timestamp){
+static void rfc2190_generate_packets(MSFilter *f, EncState *s, mblk_t *frame, uint32_t timestamp, MSQueue *output){
 	mblk_t *packet=NULL;
 
 	while (frame->b_rptr<frame->b_wptr){
@@ -459,13 +477,13 @@ static void rfc2190_generate_packets(MSFilter *f, EncState *s, mblk_t *frame, ui
 			packet->b_rptr + get_gbsc_bytealigned(packet->b_rptr, MIN(packet->b_rptr+s->mtu,frame->b_wptr));
 		add_rfc2190_header(&packet, &s->av_context);
 		mblk_set_timestamp_info(packet,timestamp);
-		ms_queue_put(f->outputs[0],packet);
+		ms_queue_put(output,packet);
 	}
 	/* the marker bit is set on the last packet, if any.*/
 	mblk_set_marker_info(packet,TRUE);
 }
 
-static void mpeg4_fragment_and_send(MSFilter *f,EncState *s,mblk_t *frame, uint32_t timestamp){
+static void mpeg4_fragment_and_send(MSFilter *f,EncState *s,mblk_t *frame, uint32_t timestamp, MSQueue *output){
 	uint8_t *rptr;
 	mblk_t *packet=NULL;
 	int len;
@@ -475,14 +493,14 @@ static void mpeg4_fragment_and_send(MSFilter *f,EncState *s,mblk_t *frame, uint3
 		packet->b_rptr=rptr;
 		packet->b_wptr=rptr+len;
 		mblk_set_timestamp_info(packet,timestamp);
-		ms_queue_put(f->outputs[0],packet);
+		ms_queue_put(output,packet);
 		rptr+=len;
 	}
 	/*set marker bit on last packet*/
 	mblk_set_marker_info(packet,TRUE);
 }
 
-static void rfc4629_generate_follow_on_packets(MSFilter *f, EncState *s, mblk_t *frame, uint32_t timestamp, uint8_t *psc, uint8_t *end, bool_t last_packet){
+static void rfc4629_generate_follow_on_packets(MSFilter *f, EncState *s, mblk_t *frame, uint32_t timestamp, uint8_t *psc, uint8_t *end, bool_t last_packet, MSQueue *output){
 	mblk_t *packet;
 	int len=end-psc;
 
@@ -502,7 +520,7 @@ static void rfc4629_generate_follow_on_packets(MSFilter *f, EncState *s, mblk_t
 		uint8_t *pos;
 		/*adjust the first packet generated*/
 		pos=packet->b_wptr=packet->b_rptr+s->mtu;
-		ms_queue_put(f->outputs[0],packet);
+		ms_queue_put(output,packet);
 		ms_debug("generating %i follow-on packets",num);
 		for (i=1;i<num;++i){
 			mblk_t *header;
@@ -517,9 +535,9 @@ static void rfc4629_generate_follow_on_packets(MSFilter *f, EncState *s, mblk_t
 			header->b_cont=packet;
 			packet=header;
 			mblk_set_timestamp_info(packet,timestamp);
-			ms_queue_put(f->outputs[0],packet);
+			ms_queue_put(output,packet);
 		}
-	}else ms_queue_put(f->outputs[0],packet);
+	}else ms_queue_put(output,packet);
 	/* the marker bit is set on the last packet, if any.*/
 	mblk_set_marker_info(packet,last_packet);
 }
@@ -599,7 +617,7 @@ struct jpeghdr_qtable {
 
 static void mjpeg_fragment_and_send(MSFilter *f,EncState *s,mblk_t *frame, uint32_t timestamp,
 							 uint8_t type,	uint8_t typespec, int dri,
-							 uint8_t q, mblk_t *lqt, mblk_t *cqt) {
+							 uint8_t q, mblk_t *lqt, mblk_t *cqt, MSQueue *output) {
 	struct jpeghdr jpghdr;
 	struct jpeghdr_rst rsthdr;
 	struct jpeghdr_qtable qtblhdr;
@@ -670,7 +688,7 @@ static void mjpeg_fragment_and_send(MSFilter *f,EncState *s,mblk_t *frame, uint3
 		packet->b_wptr=packet->b_wptr + data_len;
 
 		mblk_set_timestamp_info(packet,timestamp);
-		ms_queue_put(f->outputs[0],packet);
+		ms_queue_put(output,packet);
 
 		jpghdr.off += data_len;
 		bytes_left -= data_len;
@@ -742,10 +760,10 @@ static mblk_t *skip_jpeg_headers(mblk_t *full_frame, mblk_t **lqt, mblk_t **cqt)
 	return full_frame;
 }
 
-static void split_and_send(MSFilter *f, EncState *s, mblk_t *frame){
+static void split_and_send(MSFilter *f, EncState *s, mblk_t *frame, uint64_t frame_time, MSQueue *output){
 	uint8_t *lastpsc;
 	uint8_t *psc;
-	uint32_t timestamp=f->ticker->time*90LL;
+	uint32_t timestamp=frame_time*90LL;
 
 	if (s->codec==CODEC_ID_MPEG4
 #if HAVE_AVCODEC_SNOW
@@ -753,7 +771,7 @@ static void split_and_send(MSFilter *f, EncState *s, mblk_t *frame){
 #endif
 	)
 	{
-		mpeg4_fragment_and_send(f,s,frame,timestamp);
+		mpeg4_fragment_and_send(f,s,frame,timestamp,output);
 		return;
 	}
 	else if (s->codec==CODEC_ID_MJPEG)
@@ -767,7 +785,8 @@ static void split_and_send(MSFilter *f, EncState *s, mblk_t *frame){
 								0, /* dri ?*/
 								255, /* q */
 								lqt,
-								cqt);
+								cqt,
+								output);
 		return;
 	}
 
@@ -777,29 +796,38 @@ static void split_and_send(MSFilter *f, EncState *s, mblk_t *frame){
 		while(1){
 			psc=get_psc(lastpsc+2,frame->b_wptr,s->mtu);
 			if (psc!=NULL){
-				rfc4629_generate_follow_on_packets(f,s,frame,timestamp,lastpsc,psc,FALSE);
+				rfc4629_generate_follow_on_packets(f,s,frame,timestamp,lastpsc,psc,FALSE,output);
 				lastpsc=psc;
 			}else break;
 		}
 		/* send the end of frame */
-		rfc4629_generate_follow_on_packets(f,s,frame, timestamp,lastpsc,frame->b_wptr,TRUE);
+		rfc4629_generate_follow_on_packets(f,s,frame, timestamp,lastpsc,frame->b_wptr,TRUE,output);
 	}else if (f->desc->id==MS_H263_OLD_ENC_ID){
-		rfc2190_generate_packets(f,s,frame,timestamp);
+		rfc2190_generate_packets(f,s,frame,timestamp,output);
 	}else{
 		ms_fatal("Ca va tres mal.");
 	}
 }
 
-static void process_frame(MSFilter *f, mblk_t *inm){
+static void enc_encode_frame(MSFilter *f, mblk_t *inm, uint64_t frame_time, MSQueue *output){
 	EncState *s=(EncState*)f->data;
 
 	AVCodecContext *c=&s->av_context;
 	int error,got_packet;
-	mblk_t *comp_buf=s->comp_buf;
-	int comp_buf_sz=comp_buf->b_datap->db_lim-comp_buf->b_datap->db_base;
+	mblk_t *comp_buf;
+	int comp_buf_sz;
 	YuvBuf yuv;
 	struct AVPacket packet;
+
+	if (c->codec==NULL) return;
 	memset(&packet, 0, sizeof(packet));
+	comp_buf_sz=s->comp_buf->b_datap->db_lim-s->comp_buf->b_datap->db_base;
+	if (s->comp_buf->b_datap->db_ref>1){
+		/*packets of the previous frame are still waiting to be fetched, don't overwrite them*/
+		freemsg(s->comp_buf);
+		s->comp_buf=allocb(comp_buf_sz,0);
+	}
+	comp_buf=s->comp_buf;
 
 	ms_yuv_buf_init_from_mblk(&yuv, inm);
 	/* convert image if necessary */
@@ -809,7 +837,7 @@ static void process_frame(MSFilter *f, mblk_t *inm){
 	/* timestamp used by ffmpeg, unset here */
 	s->pict->pts=AV_NOPTS_VALUE;
 
-	if (ms_video_starter_need_i_frame (&s->starter, f->ticker->time)){
+	if (ms_video_starter_need_i_frame (&s->starter, frame_time)){
 		/*sends an I frame at 2 seconds and 4 seconds after the beginning of the call*/
 		s->req_vfu=TRUE;
 	}
@@ -835,15 +863,14 @@ static void process_frame(MSFilter *f, mblk_t *inm){
 	else if (got_packet){
 		s->framenum++;
 		if (s->framenum==1){
-			ms_video_starter_first_frame(&s->starter, f->ticker->time);
+			ms_video_starter_first_frame(&s->starter, frame_time);
 		}
 		if (c->coded_frame->pict_type==FF_I_TYPE){
 			ms_message("Emitting I-frame");
 		}
 		comp_buf->b_wptr+=packet.size;
-		split_and_send(f,s,comp_buf);
+		split_and_send(f,s,comp_buf,frame_time,output);
 	}
-	freemsg(inm);
 }
 
 static void enc_process(MSFilter *f){
@@ -853,11 +880,10 @@ static void enc_process(MSFilter *f){
 		ms_queue_flush(f->inputs[0]);
 		return;
 	}
-	ms_filter_lock(f);
 	while((inm=ms_queue_get(f->inputs[0]))!=0){
-		process_frame(f,inm);
+		ms_async_encoder_push(s->async_encoder,inm,f->ticker->time);
 	}
-	ms_filter_unlock(f);
+	ms_async_encoder_fetch(s->async_encoder,f->outputs[0]);
 }
 
 
@@ -869,10 +895,10 @@ static int enc_set_configuration(MSFilter *f, void *data) {
 	if (s->vconf.required_bitrate > s->vconf.bitrate_limit)
 		s->vconf.required_bitrate = s->vconf.bitrate_limit;
 	if (s->av_context.codec != NULL) {
-		/* When we are processing, apply new settings immediately */
+		/* When we are processing, apply new settings immediately. The worker thread holds the filter lock while encoding. */
 		ms_filter_lock(f);
-		enc_postprocess(f);
-		enc_preprocess(f);
+		enc_uninit_codec(f);
+		enc_init_codec(f);
 		ms_filter_unlock(f);
 		return 0;
 	}
@@ -945,6 +971,12 @@ static int enc_set_br(MSFilter *f, void *arg) {
 	return 0;
 }
 
+static int enc_enable_async(MSFilter *f, void *data) {
+	EncState *s = (EncState *)f->data;
+	ms_async_encoder_enable(s->async_encoder, *((bool_t *)data) ? TRUE : FALSE);
+	return 0;
+}
+
 static int enc_get_configuration_list(MSFilter *f, void *data) {
 	EncState *s = (EncState *)f->data;
 	const MSVideoConfiguration **vconf_list = (const MSVideoConfiguration **)data;
@@ -966,6 +998,7 @@ static MSFilterMethod methods[] = {
 	{ MS_VIDEO_ENCODER_REQ_VFU,                enc_req_vfu                },
 	{ MS_VIDEO_ENCODER_GET_CONFIGURATION_LIST, enc_get_configuration_list },
 	{ MS_VIDEO_ENCODER_SET_CONFIGURATION,      enc_set_configuration      },
+	{ MS_VIDEO_ENCODER_ENABLE_ASYNC,           enc_enable_async           },
 	{ 0,                                       NULL                       }
 };
 
@@ -24,6 +24,8 @@
 #include "mediastreamer2/msvideo.h"
 #include "mediastreamer2/videostarter.h"
 #include "vp8rtpfmt.h"
+#include "async_encoder.h"
+#include "rtp_reorder_buffer.h"
 
 #define PICTURE_ID_ON_16_BITS
 /*#define AVPF_DEBUG*/
@@ -66,6 +68,36 @@ static const MSVideoConfiguration vp8_conf_list[] = {
 #endif
 };
 
+#define VP8_MAX_TEMPORAL_LAYERS 3
+#define VP8_MAX_TEMPORAL_PERIODICITY 4
+
+#define VP8_TL_NO_UPDATE (VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF)
+/* Base layer frames only reference and update the last frame. */
+#define VP8_TL_UPDATE_LAST (VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF)
+/* Middle layer frames reference the last (base layer) frame and update the golden frame. */
+#define VP8_TL_UPDATE_GOLDEN (VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_ARF | VP8_EFLAG_NO_UPD_ENTROPY)
+/* Top layer frames are not used as reference. */
+#define VP8_TL_NO_UPDATE_REF_LAST (VP8_EFLAG_NO_REF_GF | VP8_EFLAG_NO_REF_ARF | VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF | VP8_EFLAG_NO_UPD_ENTROPY)
+#define VP8_TL_NO_UPDATE_REF_LAST_GOLDEN (VP8_EFLAG_NO_REF_ARF | VP8_EFLAG_NO_UPD_LAST | VP8_EFLAG_NO_UPD_GF | VP8_EFLAG_NO_UPD_ARF | VP8_EFLAG_NO_UPD_ENTROPY)
+
+typedef struct EncTemporalLayersPattern {
+	int periodicity;
+	int layer_id[VP8_MAX_TEMPORAL_PERIODICITY];
+	unsigned int flags[VP8_MAX_TEMPORAL_PERIODICITY];
+	bool_t layer_sync[VP8_MAX_TEMPORAL_PERIODICITY];
+	int rate_decimator[VP8_MAX_TEMPORAL_LAYERS];
+	int bitrate_pct[VP8_MAX_TEMPORAL_LAYERS]; /*cumulative share of the target bitrate*/
+} EncTemporalLayersPattern;
+
+/* Indexed by the number of temporal layers minus one. A frame never references a frame of an upper layer,
+ * so that any subset of the lower layers can be decoded. */
+static const EncTemporalLayersPattern vp8_temporal_layers_patterns[VP8_MAX_TEMPORAL_LAYERS] = {
+	{ 1, { 0 }, { 0 }, { FALSE }, { 1 }, { 100 } },
+	{ 2, { 0, 1 }, { VP8_TL_UPDATE_LAST, VP8_TL_NO_UPDATE_REF_LAST }, { FALSE, TRUE }, { 2, 1 }, { 60, 100 } },
+	{ 4, { 0, 2, 1, 2 }, { VP8_TL_UPDATE_LAST, VP8_TL_NO_UPDATE_REF_LAST, VP8_TL_UPDATE_GOLDEN, VP8_TL_NO_UPDATE_REF_LAST_GOLDEN },
+		{ FALSE, TRUE, TRUE, FALSE }, { 4, 2, 1 }, { 40, 60, 100 } }
+};
+
 typedef struct EncFrameState {
 	vpx_ref_frame_type_t type;
 	vpx_codec_pts_t count;
@@ -92,9 +124,15 @@ typedef struct EncState {
 	MSVideoStarter starter;
 	MSVideoConfiguration vconf;
 	const MSVideoConfiguration *vconf_list;
+	MSAsyncEncoder *async_encoder;
 	int last_fir_seq_nr;
+	int temporal_layers;
+	int ts_pattern_index;
+	int max_payload_size; /*0 for ms_get_payload_max_size()*/
 	uint16_t picture_id;
 	uint16_t last_sli_id;
+	uint8_t tl0picidx;
+	bool_t tl0_recovery; /*the next base layer frame references the acknowledged altref, see enc_fill_temporal_layers_flags()*/
 	bool_t force_keyframe;
 	bool_t invalid_frame_reported;
 	bool_t avpf_enabled;
@@ -105,6 +143,7 @@ typedef struct EncState {
 
 static bool_t should_generate_key_frame(EncState *s, int min_interval);
 static void enc_reset_frames_state(EncState *s);
+static void enc_encode_frame(MSFilter *f, mblk_t *im, uint64_t frame_time, MSQueue *output);
 
 static void enc_init(MSFilter *f) {
 	EncState *s = (EncState *)ms_new0(EncState, 1);
@@ -124,12 +163,16 @@ static void enc_init(MSFilter *f) {
 	s->picture_id = ortp_random() & 0x007F;
 #endif
 	s->avpf_enabled = FALSE;
+	s->temporal_layers = 1;
+	s->tl0picidx = ortp_random() & 0xFF;
+	s->async_encoder = ms_async_encoder_new(f, enc_encode_frame, 2);
 	enc_reset_frames_state(s);
 	f->data = s;
 }
 
 static void enc_uninit(MSFilter *f) {
 	EncState *s = (EncState *)f->data;
+	ms_async_encoder_destroy(s->async_encoder);
 	ms_free(s);
 }
 
@@ -143,7 +186,7 @@ static void enc_reset_frames_state(EncState *s){
 	s->frames_state.reconstruct.type=VP8_LAST_FRAME;
 }
 
-static void enc_preprocess(MSFilter *f) {
+static void enc_init_codec(MSFilter *f) {
 	EncState *s = (EncState *)f->data;
 	vpx_codec_err_t res;
 	vpx_codec_caps_t caps;
@@ -194,6 +237,24 @@ static void enc_preprocess(MSFilter *f) {
 	s->cfg.g_w = s->vconf.vsize.width;
 	s->cfg.g_h = s->vconf.vsize.height;
 
+	if (s->temporal_layers > 1) {
+		const EncTemporalLayersPattern *pattern = &vp8_temporal_layers_patterns[s->temporal_layers - 1];
+		int i;
+		s->cfg.ts_number_layers = s->temporal_layers;
+		s->cfg.ts_periodicity = pattern->periodicity;
+		for (i = 0; i < pattern->periodicity; i++) {
+			s->cfg.ts_layer_id[i] = pattern->layer_id[i];
+		}
+		for (i = 0; i < s->temporal_layers; i++) {
+			s->cfg.ts_rate_decimator[i] = pattern->rate_decimator[i];
+			s->cfg.ts_target_bitrate[i] = s->cfg.rc_target_bitrate * pattern->bitrate_pct[i] / 100;
+		}
+		/* A keyframe placed by the encoder in an upper layer would be dropped along with it, keyframes are placed by enc_fill_temporal_layers_flags() instead. */
+		s->cfg.kf_mode = VPX_KF_DISABLED;
+		ms_message("VP8 encoder using %d temporal layers", s->temporal_layers);
+	}
+	s->ts_pattern_index = 0;
+
 	/* Initialize codec */
 	res =  vpx_codec_enc_init(&s->codec, s->iface, &s->cfg, s->flags);
 	if (res) {
@@ -212,6 +273,7 @@ static void enc_preprocess(MSFilter *f) {
 
 	s->invalid_frame_reported = FALSE;
 	vp8rtpfmt_packer_init(&s->packer);
+	if (s->max_payload_size > 0) vp8rtpfmt_packer_set_max_payload_size(&s->packer, s->max_payload_size);
 	if (s->avpf_enabled == TRUE) {
 		s->force_keyframe = TRUE;
 	} else if (s->frame_count == 0) {
@@ -220,6 +282,12 @@ static void enc_preprocess(MSFilter *f) {
 	s->ready = TRUE;
 }
 
+static void enc_preprocess(MSFilter *f) {
+	EncState *s = (EncState *)f->data;
+	enc_init_codec(f);
+	ms_async_encoder_start(s->async_encoder);
+}
+
 static vpx_codec_pts_t enc_last_reference_frame_count(EncState *s) {
 	return MAX(s->frames_state.golden.count, s->frames_state.altref.count);
 }
@@ -414,6 +482,48 @@ static void enc_fill_encoder_flags(EncState *s, unsigned int *flags) {
 	}
 }
 
+/*
+ * The pattern uses the last and golden frames, the altref is left for the loss recovery: with AVPF, a base layer
+ * frame is stored in it every reference interval and acknowledged by RPSI. On a SLI, the pattern restarts with a base
+ * layer frame referencing only this acknowledged frame, that all the layers then reference again. Without an
+ * acknowledged altref, the recovery is a keyframe.
+ */
+static void enc_fill_temporal_layers_flags(EncState *s, unsigned int *flags) {
+	const EncTemporalLayersPattern *pattern = &vp8_temporal_layers_patterns[s->temporal_layers - 1];
+
+	if (s->tl0_recovery == TRUE) {
+		s->tl0_recovery = FALSE;
+		s->ts_pattern_index = 0;
+		if (s->frames_state.altref.acknowledged == TRUE) {
+			*flags = (pattern->flags[0] & ~VP8_EFLAG_NO_REF_ARF) | VP8_EFLAG_NO_REF_LAST | VP8_EFLAG_NO_REF_GF;
+			ms_message("VP8: restarting the base layer from the acknowledged altref frame [%i]", (int)s->frames_state.altref.picture_id);
+			return;
+		}
+		s->invalid_frame_reported = TRUE;
+	}
+	if (s->invalid_frame_reported == TRUE) {
+		s->invalid_frame_reported = FALSE;
+		if (should_generate_key_frame(s, MIN_KEY_FRAME_DIST)) s->force_keyframe = TRUE;
+	}
+	if ((s->avpf_enabled != TRUE) && (s->ts_pattern_index == 0)
+		&& (s->frame_count >= s->frames_state.last_independent_frame + 10 * (vpx_codec_pts_t)s->vconf.fps)) {
+		/* 1 keyframe each 10s, at the start of the pattern so that it is in the base layer. */
+		s->force_keyframe = TRUE;
+	}
+	if (s->force_keyframe == TRUE) {
+		*flags = VPX_EFLAG_FORCE_KF;
+		/* Restart the pattern, the keyframe belongs to the base layer. */
+		s->ts_pattern_index = 0;
+		return;
+	}
+	*flags = pattern->flags[s->ts_pattern_index];
+	if ((s->avpf_enabled == TRUE) && (s->ts_pattern_index == 0)
+		&& (s->frame_count >= s->frames_state.altref.count + enc_get_ref_frames_interval(s))) {
+		/* This base layer frame becomes the new recovery point. */
+		*flags &= ~VP8_EFLAG_NO_UPD_ARF;
+	}
+}
+
 static bool_t is_frame_independent(unsigned int flags){
 	if (flags & VPX_EFLAG_FORCE_KF) return TRUE;
 
@@ -424,156 +534,184 @@ static bool_t is_frame_independent(unsigned int flags){
 	return FALSE;
 }
 
-static void enc_process(MSFilter *f) {
-	mblk_t *im;
-	uint64_t timems = f->ticker->time;
-	uint32_t timestamp = timems*90;
+static void enc_encode_frame(MSFilter *f, mblk_t *im, uint64_t frame_time, MSQueue *output) {
+	uint32_t timestamp = frame_time*90;
 	EncState *s = (EncState *)f->data;
 	unsigned int flags = 0;
 	vpx_codec_err_t err;
 	MSPicture yuv;
+	vpx_image_t img;
 	bool_t is_ref_frame=FALSE;
-
-	ms_filter_lock(f);
+	const EncTemporalLayersPattern *pattern = &vp8_temporal_layers_patterns[s->temporal_layers - 1];
+	int layer_id = 0;
 
 #ifdef AVPF_DEBUG
 	ms_message("VP8 enc_process:");
 #endif
 
-	if (!s->ready) {
-		ms_queue_flush(f->inputs[0]);
-		ms_filter_unlock(f);
-		return;
-	}
-
-	if ((im = ms_queue_peek_last(f->inputs[0])) != NULL) {
-		vpx_image_t img;
+	if (!s->ready) return;
 
-		flags = 0;
-		ms_yuv_buf_init_from_mblk(&yuv, im);
-		vpx_img_wrap(&img, VPX_IMG_FMT_I420, s->vconf.vsize.width, s->vconf.vsize.height, 1, yuv.planes[0]);
+	ms_yuv_buf_init_from_mblk(&yuv, im);
+	vpx_img_wrap(&img, VPX_IMG_FMT_I420, s->vconf.vsize.width, s->vconf.vsize.height, 1, yuv.planes[0]);
 
-		if ((s->avpf_enabled != TRUE) && ms_video_starter_need_i_frame(&s->starter, f->ticker->time)) {
-			s->force_keyframe = TRUE;
-		}
-		if (s->force_keyframe == TRUE) {
-			ms_message("Forcing vp8 key frame for filter [%p]", f);
-			flags = VPX_EFLAG_FORCE_KF;
-		} else if (s->avpf_enabled == TRUE) {
-			if (s->frame_count == 0) s->force_keyframe = TRUE;
-			enc_fill_encoder_flags(s, &flags);
-		}
+	if ((s->avpf_enabled != TRUE) && ms_video_starter_need_i_frame(&s->starter, frame_time)) {
+		s->force_keyframe = TRUE;
+	}
+	if (s->temporal_layers > 1) {
+		enc_fill_temporal_layers_flags(s, &flags);
+		if (flags & VPX_EFLAG_FORCE_KF) ms_message("Forcing vp8 key frame for filter [%p]", f);
+		layer_id = pattern->layer_id[s->ts_pattern_index];
+		vpx_codec_control(&s->codec, VP8E_SET_TEMPORAL_LAYER_ID, layer_id);
+	} else if (s->force_keyframe == TRUE) {
+		ms_message("Forcing vp8 key frame for filter [%p]", f);
+		flags = VPX_EFLAG_FORCE_KF;
+	} else if (s->avpf_enabled == TRUE) {
+		if (s->frame_count == 0) s->force_keyframe = TRUE;
+		enc_fill_encoder_flags(s, &flags);
+	}
 
 #ifdef AVPF_DEBUG
-		ms_message("VP8 encoder frames state:");
-		ms_message("\tgolden: count=%" PRIi64 ", picture_id=0x%04x, ack=%s",
-			s->frames_state.golden.count, s->frames_state.golden.picture_id, (s->frames_state.golden.acknowledged == TRUE) ? "Y" : "N");
-		ms_message("\taltref: count=%" PRIi64 ", picture_id=0x%04x, ack=%s",
-			s->frames_state.altref.count, s->frames_state.altref.picture_id, (s->frames_state.altref.acknowledged == TRUE) ? "Y" : "N");
+	ms_message("VP8 encoder frames state:");
+	ms_message("\tgolden: count=%" PRIi64 ", picture_id=0x%04x, ack=%s",
+		s->frames_state.golden.count, s->frames_state.golden.picture_id, (s->frames_state.golden.acknowledged == TRUE) ? "Y" : "N");
+	ms_message("\taltref: count=%" PRIi64 ", picture_id=0x%04x, ack=%s",
+		s->frames_state.altref.count, s->frames_state.altref.picture_id, (s->frames_state.altref.acknowledged == TRUE) ? "Y" : "N");
 #endif
-		err = vpx_codec_encode(&s->codec, &img, s->frame_count, 1, flags, 1000000LL/(2*(int)s->vconf.fps)); /*encoder has half a framerate interval to encode*/
-		if (err) {
-			ms_error("vpx_codec_encode failed : %d %s (%s)\n", err, vpx_codec_err_to_string(err), vpx_codec_error_detail(&s->codec));
-		} else {
-			vpx_codec_iter_t iter = NULL;
-			const vpx_codec_cx_pkt_t *pkt;
-			MSList *list = NULL;
-
-			/* Update the frames state. */
-			is_ref_frame=FALSE;
-			if (flags & VPX_EFLAG_FORCE_KF) {
-				enc_mark_reference_frame_as_sent(s, VP8_GOLD_FRAME);
-				enc_mark_reference_frame_as_sent(s, VP8_ALTR_FRAME);
-				s->frames_state.golden.is_independant=TRUE;
-				s->frames_state.altref.is_independant=TRUE;
-				s->frames_state.last_independent_frame=s->frame_count;
-				s->force_keyframe = FALSE;
-				is_ref_frame=TRUE;
-			}else if (flags & VP8_EFLAG_FORCE_GF) {
-				enc_mark_reference_frame_as_sent(s, VP8_GOLD_FRAME);
-				is_ref_frame=TRUE;
-			}else if (flags & VP8_EFLAG_FORCE_ARF) {
-				enc_mark_reference_frame_as_sent(s, VP8_ALTR_FRAME);
-				is_ref_frame=TRUE;
-			}else if (flags & VP8_EFLAG_NO_REF_LAST) {
-				enc_mark_reference_frame_as_sent(s, VP8_LAST_FRAME);
-				is_ref_frame=is_reconstruction_frame_sane(s,flags);
-			}
-			if (is_frame_independent(flags)){
-				s->frames_state.last_independent_frame=s->frame_count;
-			}
-
-			/* Pack the encoded frame. */
-			while( (pkt = vpx_codec_get_cx_data(&s->codec, &iter)) ) {
-				if ((pkt->kind == VPX_CODEC_CX_FRAME_PKT) && (pkt->data.frame.sz > 0)) {
-					Vp8RtpFmtPacket *packet = ms_new0(Vp8RtpFmtPacket, 1);
-
-					packet->m = allocb(pkt->data.frame.sz, 0);
-					memcpy(packet->m->b_wptr, pkt->data.frame.buf, pkt->data.frame.sz);
-					packet->m->b_wptr += pkt->data.frame.sz;
-					mblk_set_timestamp_info(packet->m, timestamp);
-					packet->pd = ms_new0(Vp8RtpFmtPayloadDescriptor, 1);
-					packet->pd->start_of_partition = TRUE;
-					packet->pd->non_reference_frame = s->avpf_enabled && !is_ref_frame;
-					if (s->avpf_enabled == TRUE) {
-						packet->pd->extended_control_bits_present = TRUE;
-						packet->pd->pictureid_present = TRUE;
-						packet->pd->pictureid = s->picture_id;
-					} else {
-						packet->pd->extended_control_bits_present = FALSE;
-						packet->pd->pictureid_present = FALSE;
-					}
-					if (s->flags & VPX_CODEC_USE_OUTPUT_PARTITION) {
-						packet->pd->pid = (uint8_t)pkt->data.frame.partition_id;
-						if (!(pkt->data.frame.flags & VPX_FRAME_IS_FRAGMENT)) {
-							mblk_set_marker_info(packet->m, TRUE);
-						}
-					} else {
-						packet->pd->pid = 0;
+	err = vpx_codec_encode(&s->codec, &img, s->frame_count, 1, flags, 1000000LL/(2*(int)s->vconf.fps)); /*encoder has half a framerate interval to encode*/
+	if (err) {
+		ms_error("vpx_codec_encode failed : %d %s (%s)\n", err, vpx_codec_err_to_string(err), vpx_codec_error_detail(&s->codec));
+	} else {
+		vpx_codec_iter_t iter = NULL;
+		const vpx_codec_cx_pkt_t *pkt;
+		MSList *list = NULL;
+
+		/* Update the frames state. */
+		is_ref_frame=FALSE;
+		if (flags & VPX_EFLAG_FORCE_KF) {
+			enc_mark_reference_frame_as_sent(s, VP8_GOLD_FRAME);
+			enc_mark_reference_frame_as_sent(s, VP8_ALTR_FRAME);
+			s->frames_state.golden.is_independant=TRUE;
+			s->frames_state.altref.is_independant=TRUE;
+			s->frames_state.last_independent_frame=s->frame_count;
+			s->force_keyframe = FALSE;
+			is_ref_frame=TRUE;
+		}else if (flags & VP8_EFLAG_FORCE_GF) {
+			enc_mark_reference_frame_as_sent(s, VP8_GOLD_FRAME);
+			is_ref_frame=TRUE;
+		}else if (flags & VP8_EFLAG_FORCE_ARF) {
+			enc_mark_reference_frame_as_sent(s, VP8_ALTR_FRAME);
+			is_ref_frame=TRUE;
+		}else if ((s->temporal_layers > 1) && !(flags & VP8_EFLAG_NO_UPD_ARF)) {
+			/* A base layer frame stored as the recovery point of the temporal layers. */
+			enc_mark_reference_frame_as_sent(s, VP8_ALTR_FRAME);
+			s->frames_state.altref.is_independant = !!(flags & VP8_EFLAG_NO_REF_LAST);
+			is_ref_frame=TRUE;
+		}else if (flags & VP8_EFLAG_NO_REF_LAST) {
+			enc_mark_reference_frame_as_sent(s, VP8_LAST_FRAME);
+			is_ref_frame=is_reconstruction_frame_sane(s,flags);
+		}
+		if (is_frame_independent(flags)){
+			s->frames_state.last_independent_frame=s->frame_count;
+		}
+		if (layer_id == 0) s->tl0picidx++;
+
+		/* Pack the encoded frame. */
+		while( (pkt = vpx_codec_get_cx_data(&s->codec, &iter)) ) {
+			if ((pkt->kind == VPX_CODEC_CX_FRAME_PKT) && (pkt->data.frame.sz > 0)) {
+				Vp8RtpFmtPacket *packet = ms_new0(Vp8RtpFmtPacket, 1);
+
+				packet->m = allocb(pkt->data.frame.sz, 0);
+				memcpy(packet->m->b_wptr, pkt->data.frame.buf, pkt->data.frame.sz);
+				packet->m->b_wptr += pkt->data.frame.sz;
+				mblk_set_timestamp_info(packet->m, timestamp);
+				packet->pd = ms_new0(Vp8RtpFmtPayloadDescriptor, 1);
+				packet->pd->start_of_partition = TRUE;
+				packet->pd->non_reference_frame = s->avpf_enabled && !is_ref_frame;
+				if (s->avpf_enabled == TRUE) {
+					packet->pd->extended_control_bits_present = TRUE;
+					packet->pd->pictureid_present = TRUE;
+					packet->pd->pictureid = s->picture_id;
+				} else {
+					packet->pd->extended_control_bits_present = FALSE;
+					packet->pd->pictureid_present = FALSE;
+				}
+				if (s->temporal_layers > 1) {
+					packet->pd->extended_control_bits_present = TRUE;
+					packet->pd->tl0picidx_present = TRUE;
+					packet->pd->tl0picidx = s->tl0picidx;
+					packet->pd->tid_present = TRUE;
+					packet->pd->tid = (uint8_t)layer_id;
+					packet->pd->layer_sync = !(flags & VPX_EFLAG_FORCE_KF) && pattern->layer_sync[s->ts_pattern_index];
+					packet->pd->non_reference_frame = (flags & VP8_TL_NO_UPDATE) == VP8_TL_NO_UPDATE;
+				}
+				if (s->flags & VPX_CODEC_USE_OUTPUT_PARTITION) {
+					packet->pd->pid = (uint8_t)pkt->data.frame.partition_id;
+					if (!(pkt->data.frame.flags & VPX_FRAME_IS_FRAGMENT)) {
 						mblk_set_marker_info(packet->m, TRUE);
 					}
-					list = ms_list_append(list, packet);
+				} else {
+					packet->pd->pid = 0;
+					mblk_set_marker_info(packet->m, TRUE);
 				}
+				list = ms_list_append(list, packet);
 			}
+		}
 
 #ifdef AVPF_DEBUG
-			ms_message("VP8 encoder picture_id=%i ***| %s | %s | %s | %s", (int)s->picture_id,
-				(flags & VPX_EFLAG_FORCE_KF) ? "KF " : (flags & VP8_EFLAG_FORCE_GF) ? "GF " :  (flags & VP8_EFLAG_FORCE_ARF) ? "ARF" : "   ",
-				(flags & VP8_EFLAG_NO_REF_GF) ? "NOREFGF" : "       ",
-				(flags & VP8_EFLAG_NO_REF_ARF) ? "NOREFARF" : "        ",
-				(flags & VP8_EFLAG_NO_REF_LAST) ? "NOREFLAST" : "         ");
+		ms_message("VP8 encoder picture_id=%i ***| %s | %s | %s | %s", (int)s->picture_id,
+			(flags & VPX_EFLAG_FORCE_KF) ? "KF " : (flags & VP8_EFLAG_FORCE_GF) ? "GF " :  (flags & VP8_EFLAG_FORCE_ARF) ? "ARF" : "   ",
+			(flags & VP8_EFLAG_NO_REF_GF) ? "NOREFGF" : "       ",
+			(flags & VP8_EFLAG_NO_REF_ARF) ? "NOREFARF" : "        ",
+			(flags & VP8_EFLAG_NO_REF_LAST) ? "NOREFLAST" : "         ");
 #endif
 
-			vp8rtpfmt_packer_process(&s->packer, list, f->outputs[0]);
+		vp8rtpfmt_packer_process(&s->packer, list, output);
 
-			/* Handle video starter if AVPF is not enabled. */
-			s->frame_count++;
-			if ((s->avpf_enabled != TRUE) && (s->frame_count == 1)) {
-				ms_video_starter_first_frame(&s->starter, f->ticker->time);
-			}
+		/* Handle video starter if AVPF is not enabled. */
+		s->frame_count++;
+		if ((s->avpf_enabled != TRUE) && (s->frame_count == 1)) {
+			ms_video_starter_first_frame(&s->starter, frame_time);
+		}
+
+		s->ts_pattern_index = (s->ts_pattern_index + 1) % pattern->periodicity;
 
-			/* Increment the pictureID. */
-			s->picture_id++;
+		/* Increment the pictureID. */
+		s->picture_id++;
 #ifdef PICTURE_ID_ON_16_BITS
-			if (s->picture_id == 0)
-				s->picture_id = 0x8000;
+		if (s->picture_id == 0)
+			s->picture_id = 0x8000;
 #else
-			if (s->picture_id == 0x0080)
-				s->picture_id = 0;
+		if (s->picture_id == 0x0080)
+			s->picture_id = 0;
 #endif
-		}
 	}
-	ms_filter_unlock(f);
+}
+
+static void enc_process(MSFilter *f) {
+	EncState *s = (EncState *)f->data;
+	mblk_t *im;
+
+	if (s->ready && (im = ms_queue_peek_last(f->inputs[0])) != NULL) {
+		/* Only the most recent frame is encoded, the worker thread gets its own reference to it. */
+		ms_async_encoder_push(s->async_encoder, dupmsg(im), f->ticker->time);
+	}
 	ms_queue_flush(f->inputs[0]);
+	ms_async_encoder_fetch(s->async_encoder, f->outputs[0]);
 }
 
-static void enc_postprocess(MSFilter *f) {
+static void enc_uninit_codec(MSFilter *f) {
 	EncState *s = (EncState *)f->data;
 	if (s->ready) vpx_codec_destroy(&s->codec);
 	vp8rtpfmt_packer_uninit(&s->packer);
 	s->ready = FALSE;
 }
 
+static void enc_postprocess(MSFilter *f) {
+	EncState *s = (EncState *)f->data;
+	ms_async_encoder_stop(s->async_encoder);
+	enc_uninit_codec(f);
+}
+
 static int enc_set_configuration(MSFilter *f, void *data) {
 	EncState *s = (EncState *)f->data;
 	const MSVideoConfiguration *vconf = (const MSVideoConfiguration *)data;
@@ -583,9 +721,10 @@ static int enc_set_configuration(MSFilter *f, void *data) {
 		s->vconf.required_bitrate = s->vconf.bitrate_limit;
 	s->cfg.rc_target_bitrate = ((float)s->vconf.required_bitrate) * 0.92 / 1024.0; //0.9=take into account IP/UDP/RTP overhead, in average.
 	if (s->ready) {
+		/* The worker thread holds the filter lock while encoding, the codec can be safely reinitialized. */
 		ms_filter_lock(f);
-		enc_postprocess(f);
-		enc_preprocess(f);
+		enc_uninit_codec(f);
+		enc_init_codec(f);
 		ms_filter_unlock(f);
 		return 0;
 	}
@@ -706,6 +845,18 @@ static int enc_notify_sli(MSFilter *f, void *data) {
 
 	diff=(64 + (int)(most_recent & 0x3F) - (int)(sli->picture_id & 0x3F)) % 64;
 	s->last_sli_id=most_recent-diff;
+	if (s->temporal_layers > 1) {
+		/* The lost frame is recovered from the acknowledged altref frame, or by a keyframe if there is none or if the
+		 * lost frame is the altref itself. A loss older than the altref does not matter anymore. */
+		ms_message("VP8: receiving SLI with pic id [%i], altref=[%i]", s->last_sli_id, (int)s->frames_state.altref.picture_id);
+		if (!s->frames_state.altref.acknowledged || (s->last_sli_id == s->frames_state.altref.picture_id)) {
+			s->invalid_frame_reported = TRUE;
+		} else if (PICID_NEWER_THAN(s->last_sli_id, s->frames_state.altref.picture_id)) {
+			s->tl0_recovery = TRUE;
+		}
+		ms_filter_unlock(f);
+		return 0;
+	}
 	fs=enc_get_most_recent_reference_frame(s,FALSE);
 	ms_message("VP8: receiving SLI with pic id [%i], last-ref=[%i], most recent pic id=[%i]",s->last_sli_id, fs ? (int)fs->picture_id : 0, most_recent);
 	if (s->frames_state.golden.picture_id == s->last_sli_id) {
@@ -775,6 +926,50 @@ static int enc_enable_avpf(MSFilter *f, void *data) {
 	return 0;
 }
 
+static int enc_set_temporal_layers(MSFilter *f, void *data) {
+	EncState *s = (EncState *)f->data;
+	int layers = *(int *)data;
+	if ((layers < 1) || (layers > VP8_MAX_TEMPORAL_LAYERS)) {
+		ms_error("VP8: unsupported number of temporal layers %d", layers);
+		return -1;
+	}
+	ms_filter_lock(f);
+	s->temporal_layers = layers;
+	if (s->ready) {
+		enc_uninit_codec(f);
+		enc_init_codec(f);
+	}
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int enc_get_temporal_layers(MSFilter *f, void *data) {
+	EncState *s = (EncState *)f->data;
+	*(int *)data = s->temporal_layers;
+	return 0;
+}
+
+static int enc_set_mtu(MSFilter *f, void *data) {
+	EncState *s = (EncState *)f->data;
+	ms_filter_lock(f);
+	s->max_payload_size = *(int *)data;
+	if (s->ready) vp8rtpfmt_packer_set_max_payload_size(&s->packer, s->max_payload_size);
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int enc_get_mtu(MSFilter *f, void *data) {
+	EncState *s = (EncState *)f->data;
+	*(int *)data = s->max_payload_size > 0 ? s->max_payload_size : ms_get_payload_max_size();
+	return 0;
+}
+
+static int enc_enable_async(MSFilter *f, void *data) {
+	EncState *s = (EncState *)f->data;
+	ms_async_encoder_enable(s->async_encoder, *((bool_t *)data) ? TRUE : FALSE);
+	return 0;
+}
+
 static MSFilterMethod enc_methods[] = {
 	{ MS_FILTER_SET_VIDEO_SIZE,                enc_set_vsize              },
 	{ MS_FILTER_SET_FPS,                       enc_set_fps                },
@@ -792,6 +987,11 @@ static MSFilterMethod enc_methods[] = {
 	{ MS_VIDEO_ENCODER_SET_CONFIGURATION_LIST, enc_set_configuration_list },
 	{ MS_VIDEO_ENCODER_SET_CONFIGURATION,      enc_set_configuration      },
 	{ MS_VIDEO_ENCODER_ENABLE_AVPF,            enc_enable_avpf            },
+	{ MS_VIDEO_ENCODER_ENABLE_ASYNC,           enc_enable_async           },
+	{ MS_VIDEO_ENCODER_SET_TEMPORAL_LAYERS,    enc_set_temporal_layers    },
+	{ MS_VIDEO_ENCODER_GET_TEMPORAL_LAYERS,    enc_get_temporal_layers    },
+	{ MS_FILTER_SET_MTU,                       enc_set_mtu                },
+	{ MS_FILTER_GET_MTU,                       enc_get_mtu                },
 	{ 0,                                       NULL                       }
 };
 
@@ -855,12 +1055,14 @@ typedef struct DecState {
 	vpx_codec_iface_t *iface;
 	vpx_codec_flags_t flags;
 	Vp8RtpFmtUnpackerCtx unpacker;
+	MSRtpReorderBuffer *reorder_buffer;
 	long last_cseq; /*last receive sequence number, used to locate missing partition fragment*/
 	int current_partition_id; /*current partition id*/
 	uint64_t last_error_reported_time;
-	mblk_t *yuv_msg;
+	MSYuvBufAllocator *allocator;
 	MSPicture outbuf;
 	int yuv_width, yuv_height;
+	int max_temporal_layer;
 	MSQueue q;
 	MSAverageFPS fps;
 	bool_t first_image_decoded;
@@ -879,11 +1081,13 @@ static void dec_init(MSFilter *f) {
 	s->last_error_reported_time = 0;
 	s->yuv_width = 0;
 	s->yuv_height = 0;
-	s->yuv_msg = 0;
+	s->allocator = ms_yuv_buf_allocator_new();
 	ms_queue_init(&s->q);
 	s->first_image_decoded = FALSE;
 	s->avpf_enabled = FALSE;
 	s->freeze_on_error = TRUE;
+	s->max_temporal_layer = -1;
+	s->reorder_buffer = ms_rtp_reorder_buffer_new(MS_RTP_REORDER_BUFFER_DEFAULT_DELAY, MS_RTP_REORDER_BUFFER_DEFAULT_MAX_PACKETS);
 	f->data = s;
 	ms_average_fps_init(&s->fps, "VP8 decoder: FPS: %f");
 }
@@ -913,6 +1117,7 @@ static void dec_preprocess(MSFilter* f) {
 		s->freeze_on_error = TRUE;
 		ms_message("VP8: initializing decoder context: avpf=[%i] freeze_on_error=[%i]",s->avpf_enabled,s->freeze_on_error);
 		vp8rtpfmt_unpacker_init(&s->unpacker, f, s->avpf_enabled, s->freeze_on_error, (s->flags & VPX_CODEC_USE_INPUT_FRAGMENTS) ? TRUE : FALSE);
+		vp8rtpfmt_unpacker_set_max_temporal_layer(&s->unpacker, s->max_temporal_layer);
 		s->first_image_decoded = FALSE;
 		s->ready=TRUE;
 	}
@@ -922,8 +1127,9 @@ static void dec_preprocess(MSFilter* f) {
 static void dec_uninit(MSFilter *f) {
 	DecState *s = (DecState *)f->data;
 	vp8rtpfmt_unpacker_uninit(&s->unpacker);
+	ms_rtp_reorder_buffer_destroy(s->reorder_buffer);
 	vpx_codec_destroy(&s->codec);
-	if (s->yuv_msg) freemsg(s->yuv_msg);
+	ms_yuv_buf_allocator_free(s->allocator);
 	ms_queue_flush(&s->q);
 	ms_free(s);
 }
@@ -936,15 +1142,23 @@ static void dec_process(MSFilter *f) {
 	vpx_codec_iter_t iter = NULL;
 	MSQueue frame;
 	MSQueue mtofree_queue;
+	MSQueue packets;
 	Vp8RtpFmtFrameInfo frame_info;
 	
 	ms_filter_lock(f);
 
 	ms_queue_init(&frame);
 	ms_queue_init(&mtofree_queue);
+	ms_queue_init(&packets);
+
+	/* Put the packets back in sequence order, so that reordering is not taken for losses. */
+	while ((im = ms_queue_get(f->inputs[0])) != NULL) {
+		ms_rtp_reorder_buffer_put(s->reorder_buffer, im, f->ticker->time);
+	}
+	ms_rtp_reorder_buffer_get(s->reorder_buffer, &packets, f->ticker->time);
 
 	/* Unpack RTP payload format for VP8. */
-	vp8rtpfmt_unpacker_feed(&s->unpacker, f->inputs[0]);
+	vp8rtpfmt_unpacker_feed(&s->unpacker, &packets);
 
 	/* Decode unpacked VP8 frames. */
 	while (vp8rtpfmt_unpacker_get_frame(&s->unpacker, &frame, &frame_info) == 0) {
@@ -961,6 +1175,7 @@ static void dec_process(MSFilter *f) {
 
 		/* Get decoded frame */
 		if ((img = vpx_codec_get_frame(&s->codec, &iter))) {
+			mblk_t *yuv_msg;
 			int i, j;
 			int reference_updates = 0;
 
@@ -970,9 +1185,9 @@ static void dec_process(MSFilter *f) {
 				}
 			}
 
+			/* a new buffer per frame, so that the frames still held downstream are not overwritten */
+			yuv_msg = ms_yuv_buf_allocator_get(s->allocator, &s->outbuf, img->d_w, img->d_h);
 			if (s->yuv_width != img->d_w || s->yuv_height != img->d_h) {
-				if (s->yuv_msg) freemsg(s->yuv_msg);
-				s->yuv_msg = ms_yuv_buf_alloc(&s->outbuf, img->d_w, img->d_h);
 				s->yuv_width = img->d_w;
 				s->yuv_height = img->d_h;
 				ms_filter_notify_no_arg(f, MS_FILTER_OUTPUT_FMT_CHANGED);
@@ -990,7 +1205,7 @@ static void dec_process(MSFilter *f) {
 					src += img->stride[i];
 				}
 			}
-			ms_queue_put(f->outputs[0], dupmsg(s->yuv_msg));
+			ms_queue_put(f->outputs[0], yuv_msg);
 
 			if (ms_average_fps_update(&s->fps, f->ticker->time)) {
 				ms_message("VP8 decoder: Frame size: %dx%d", s->yuv_width, s->yuv_height);
@@ -1043,6 +1258,23 @@ static int dec_reset(MSFilter *f, void *data) {
 	return 0;
 }
 
+static int dec_set_max_temporal_layer(MSFilter *f, void *data) {
+	DecState *s = (DecState *)f->data;
+	ms_filter_lock(f);
+	s->max_temporal_layer = *(int *)data;
+	if (s->ready) vp8rtpfmt_unpacker_set_max_temporal_layer(&s->unpacker, s->max_temporal_layer);
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int dec_set_reordering_delay(MSFilter *f, void *data) {
+	DecState *s = (DecState *)f->data;
+	ms_filter_lock(f);
+	ms_rtp_reorder_buffer_set_max_delay(s->reorder_buffer, *(int *)data);
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static int dec_get_vsize(MSFilter *f, void *data) {
 	DecState *s = (DecState *)f->data;
 	MSVideoSize *vsize = (MSVideoSize *)data;
@@ -1074,6 +1306,8 @@ static MSFilterMethod dec_methods[] = {
 	{ MS_VIDEO_DECODER_ENABLE_AVPF,                    dec_enable_avpf       },
 	{ MS_VIDEO_DECODER_FREEZE_ON_ERROR,                dec_freeze_on_error   },
 	{ MS_VIDEO_DECODER_RESET,                          dec_reset             },
+	{ MS_VIDEO_DECODER_SET_MAX_TEMPORAL_LAYER,         dec_set_max_temporal_layer },
+	{ MS_VIDEO_DECODER_SET_REORDERING_DELAY,           dec_set_reordering_delay },
 	{ MS_FILTER_GET_VIDEO_SIZE,                        dec_get_vsize         },
 	{ MS_FILTER_GET_FPS,                               dec_get_fps           },
 	{ MS_FILTER_GET_OUTPUT_FMT,                        dec_get_out_fmt       },
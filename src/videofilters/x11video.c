@@ -35,6 +35,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <sys/shm.h>
 
 #define SCALE_FACTOR 4.0f
+#define NB_XV_BUFFERS 2
 
 static bool_t x11_error=FALSE;
 
@@ -46,9 +47,15 @@ static int x11error_handler(Display *d, XErrorEvent*ev){
 
 static void x11video_unprepare(MSFilter *f);
 
+/*
+ * Frames are composed by the filter's process() into one of two XShm images, while the other one is blitted
+ * by the render thread, so that a slow X server never blocks the ticker. The render thread always displays
+ * the latest composed frame: a frame not yet picked up when the next one is composed is dropped.
+ */
 typedef struct X11Video
 {
-	MSPicture fbuf;
+	MSPicture fbuf; /*the image being composed*/
+	MSPicture bufs[NB_XV_BUFFERS];
 	MSPicture local_pic;
 	mblk_t *local_msg;
 	MSVideoSize wsize; /*wished window size */
@@ -60,10 +67,19 @@ typedef struct X11Video
 	Display *display;
 	Window window_id;
 	XvPortID port;
-	XShmSegmentInfo shminfo;
-	XvImage *xv_image;
+	XShmSegmentInfo shminfo[NB_XV_BUFFERS];
+	XvImage *xv_image[NB_XV_BUFFERS];
 	GC gc;
 	MSScalerContext *sws2;
+	ms_thread_t render_thread;
+	ms_mutex_t render_lock;
+	ms_cond_t render_cond;
+	int front; /*the image last handed to the render thread*/
+	int pending; /*the image waiting to be rendered, -1 if none*/
+	int latest; /*the image holding the last composed frame*/
+	unsigned int rendered_frames;
+	unsigned int dropped_frames;
+	bool_t render_thread_running;
 	bool_t auto_window;
 	bool_t own_window;
 	bool_t ready;
@@ -74,9 +90,21 @@ typedef struct X11Video
 
 
 
+static ms_once_t xlib_threads_once=MS_ONCE_INIT;
+
+/*
+ * The X11 connection is used by the render thread and, while it is stopped, by the ticker and the methods.
+ * Xlib needs its internal locks for that, which must be enabled before any other Xlib call of the process:
+ * applications giving their own window should call XInitThreads() before opening their display.
+ */
+static void xlib_init_threads(void){
+	if (!XInitThreads()) ms_warning("XInitThreads() failed, Xlib is not thread safe");
+}
+
 static Display *init_display(){
 	const char *display;
 	Display *ret;
+	ms_once(&xlib_threads_once,xlib_init_threads);
 	display=getenv("DISPLAY");
 	if (display==NULL) display=":0";
 	ret=XOpenDisplay(display);
@@ -107,6 +135,9 @@ static void x11video_init(MSFilter  *f){
 	obj->wsize=def_size; /* the size of the window*/
 	obj->show=TRUE;
 	obj->port=-1;
+	obj->pending=-1;
+	ms_mutex_init(&obj->render_lock,NULL);
+	ms_cond_init(&obj->render_cond,NULL);
 	f->data=obj;
 
 	XSetErrorHandler(x11error_handler);
@@ -124,6 +155,8 @@ static void x11video_uninit(MSFilter *f){
 		XCloseDisplay(obj->display);
 		obj->display=NULL;
 	}
+	ms_cond_destroy(&obj->render_cond);
+	ms_mutex_destroy(&obj->render_lock);
 	ms_free(obj);
 }
 
@@ -155,13 +188,159 @@ static void x11video_fill_background(MSFilter *f){
 	X11Video *s=(X11Video*)f->data;
 	uint8_t rgb[3]={0,0,0};
 	uint8_t yuv[3]={0,0,0};
-	int ysize=s->fbuf.h*s->fbuf.strides[0];
-	int usize=s->fbuf.h*s->fbuf.strides[1]/2;
-	int vsize=s->fbuf.h*s->fbuf.strides[2]/2;
+	int i;
 	ms_rgb_to_yuv(rgb,yuv);
-	memset(s->fbuf.planes[0],yuv[0],ysize);
-	memset(s->fbuf.planes[1],yuv[1],usize);
-	memset(s->fbuf.planes[2],yuv[2],vsize);
+	for(i=0;i<NB_XV_BUFFERS;++i){
+		MSPicture *pic=&s->bufs[i];
+		memset(pic->planes[0],yuv[0],pic->h*pic->strides[0]);
+		memset(pic->planes[1],yuv[1],pic->h*pic->strides[1]/2);
+		memset(pic->planes[2],yuv[2],pic->h*pic->strides[2]/2);
+	}
+}
+
+static bool_t x11video_render(X11Video *s, int index){
+	XWindowAttributes wa;
+	MSVideoSize wsize;
+	MSRect rect;
+
+	XGetWindowAttributes(s->display,s->window_id,&wa);
+	if (x11_error == TRUE) {
+		ms_error("Could not get window attributes for window %lu", s->window_id);
+		return FALSE;
+	}
+	ms_mutex_lock(&s->render_lock);
+	if (wa.width!=s->wsize.width || wa.height!=s->wsize.height){
+		ms_warning("Resized to %ix%i", wa.width,wa.height);
+		s->wsize.width=wa.width;
+		s->wsize.height=wa.height;
+		XClearWindow(s->display,s->window_id);
+	}
+	wsize=s->wsize;
+	ms_mutex_unlock(&s->render_lock);
+
+	ms_layout_center_rectangle(wsize,s->vsize,&rect);
+	XvShmPutImage(s->display,s->port,s->window_id,s->gc, s->xv_image[index],
+	              0,0,s->bufs[index].w,s->bufs[index].h,
+	              rect.x,rect.y,rect.w,rect.h,TRUE);
+	/*when the port is synced to vblank, this is what paces the rendering on the display refresh*/
+	XSync(s->display,FALSE);
+	return TRUE;
+}
+
+/*
+ * While it runs, the render thread is the only one using the X11 connection: it is stopped before
+ * the window or the images are changed.
+ */
+static void *x11video_render_thread(void *arg){
+	X11Video *s=(X11Video*)arg;
+	int index;
+	bool_t rendered;
+
+	ms_mutex_lock(&s->render_lock);
+	while(s->render_thread_running){
+		if (s->pending==-1){
+			ms_cond_wait(&s->render_cond,&s->render_lock);
+			continue;
+		}
+		index=s->pending;
+		s->pending=-1;
+		s->front=index;
+		ms_mutex_unlock(&s->render_lock);
+
+		rendered=(x11_error==FALSE) && x11video_render(s,index);
+
+		ms_mutex_lock(&s->render_lock);
+		if (rendered) s->rendered_frames++;
+		else s->dropped_frames++;
+	}
+	ms_mutex_unlock(&s->render_lock);
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+static void x11video_start_render_thread(X11Video *s){
+	s->pending=-1;
+	s->front=0;
+	s->latest=0;
+	s->render_thread_running=TRUE;
+	ms_thread_create(&s->render_thread,NULL,x11video_render_thread,s);
+}
+
+static void x11video_stop_render_thread(X11Video *s){
+	if (!s->render_thread_running) return;
+	ms_mutex_lock(&s->render_lock);
+	s->render_thread_running=FALSE;
+	if (s->pending!=-1){
+		s->pending=-1;
+		s->dropped_frames++;
+	}
+	ms_cond_signal(&s->render_cond);
+	ms_mutex_unlock(&s->render_lock);
+	ms_thread_join(s->render_thread,NULL);
+}
+
+/*ask the adaptor to wait for the vertical blank before displaying an image, when it supports it*/
+static void x11video_enable_vsync(X11Video *s){
+	int nattrs=0;
+	int i;
+	XvAttribute *attrs=XvQueryPortAttributes(s->display,s->port,&nattrs);
+
+	for(i=0;i<nattrs;++i){
+		if (strcmp(attrs[i].name,"XV_SYNC_TO_VBLANK")==0 && (attrs[i].flags & XvSettable)){
+			Atom atom=XInternAtom(s->display,"XV_SYNC_TO_VBLANK",False);
+			XvSetPortAttribute(s->display,s->port,atom,1);
+			ms_message("Xv port %i synced to vertical blank",(int)s->port);
+			break;
+		}
+	}
+	if (attrs) XFree(attrs);
+}
+
+static int x11video_create_image(MSFilter *f, int index, int imgfmt_id){
+	X11Video *s=(X11Video*)f->data;
+	XShmSegmentInfo *shminfo=&s->shminfo[index];
+	XvImage *image;
+	MSPicture *pic=&s->bufs[index];
+
+	/*create the shared memory XvImage*/
+	memset(shminfo,0,sizeof(*shminfo));
+	image=s->xv_image[index]=XvShmCreateImage(s->display,s->port,imgfmt_id,NULL,s->fbuf.w,s->fbuf.h,shminfo);
+	if (image==NULL){
+		ms_error("XvShmCreateImage failed.");
+		return -1;
+	}
+	/*allocate some shared memory to receive the pixel data */
+	shminfo->shmid=shmget(IPC_PRIVATE, image->data_size,IPC_CREAT | 0777);
+	if (shminfo->shmid==-1){
+		ms_error("Could not allocate %i bytes of shared memory: %s",
+		         image->data_size,
+		         strerror(errno));
+		return -1;
+	}
+	shminfo->shmaddr=shmat(shminfo->shmid,NULL,0);
+	if (shminfo->shmaddr==(void*)-1){
+		ms_error("shmat() failed: %s",strerror(errno));
+		shminfo->shmaddr=NULL;
+		return -1;
+	}
+	/*ask the x-server to attach this shared memory segment*/
+	x11_error=FALSE;
+	if (!XShmAttach(s->display,shminfo)){
+		ms_error("XShmAttach failed !");
+		return -1;
+	}
+	image->data=shminfo->shmaddr;
+	pic->w=s->fbuf.w;
+	pic->h=s->fbuf.h;
+	pic->planes[0]=(void*)image->data;
+	pic->planes[2]=pic->planes[0]+(image->height*image->pitches[0]);
+	pic->planes[1]=pic->planes[2]+((image->height/2)*image->pitches[1]);
+	pic->planes[3]=NULL;
+	pic->strides[0]=image->pitches[0];
+	pic->strides[2]=image->pitches[1];
+	pic->strides[1]=image->pitches[2];
+	pic->strides[3]=0;
+	return 0;
 }
 
 static void x11video_prepare(MSFilter *f){
@@ -172,7 +351,6 @@ static void x11video_prepare(MSFilter *f){
 	XvAdaptorInfo *xai=NULL;
 	XvPortID port=-1;
 	int imgfmt_id=0;
-	XShmSegmentInfo *shminfo=&s->shminfo;
 	XWindowAttributes wa;
 
 	if (s->display==NULL) return;
@@ -257,44 +435,15 @@ static void x11video_prepare(MSFilter *f){
 	}
 	s->port=port;
 
-	/*create the shared memory XvImage*/
-	memset(shminfo,0,sizeof(*shminfo));
-	s->xv_image=XvShmCreateImage(s->display,s->port,imgfmt_id,NULL,s->fbuf.w,s->fbuf.h,shminfo);
-	if (s->xv_image==NULL){
-		ms_error("XvShmCreateImage failed.");
-		x11video_unprepare(f);
-		return;
-	}
-	/*allocate some shared memory to receive the pixel data */
-	shminfo->shmid=shmget(IPC_PRIVATE, s->xv_image->data_size,IPC_CREAT | 0777);
-	if (shminfo->shmid==-1){
-		ms_error("Could not allocate %i bytes of shared memory: %s",
-		         s->xv_image->data_size,
-		         strerror(errno));
-		x11video_unprepare(f);
-		return;
-	}
-	shminfo->shmaddr=shmat(shminfo->shmid,NULL,0);
-	if (shminfo->shmaddr==(void*)-1){
-		ms_error("shmat() failed: %s",strerror(errno));
-		shminfo->shmaddr=NULL;
-		x11video_unprepare(f);
-		return;
-	}
-	/*ask the x-server to attach this shared memory segment*/
-	x11_error=FALSE;
-	if (!XShmAttach(s->display,shminfo)){
-		ms_error("XShmAttach failed !");
-		x11video_unprepare(f);
-		return ;
+	x11video_enable_vsync(s);
+
+	for(i=0;i<NB_XV_BUFFERS;++i){
+		if (x11video_create_image(f,i,imgfmt_id)!=0){
+			x11video_unprepare(f);
+			return;
+		}
 	}
-	s->xv_image->data=s->shminfo.shmaddr;
-	s->fbuf.planes[0]=(void*)s->xv_image->data;
-	s->fbuf.planes[2]=s->fbuf.planes[0]+(s->xv_image->height*s->xv_image->pitches[0]);
-	s->fbuf.planes[1]=s->fbuf.planes[2]+((s->xv_image->height/2)*s->xv_image->pitches[1]);
-	s->fbuf.strides[0]=s->xv_image->pitches[0];
-	s->fbuf.strides[2]=s->xv_image->pitches[1];
-	s->fbuf.strides[1]=s->xv_image->pitches[2];
+	s->fbuf=s->bufs[0];
 
 	/* set picture black */
 	x11video_fill_background(f);
@@ -307,30 +456,36 @@ static void x11video_prepare(MSFilter *f){
 		return ;
 	}
 
+	x11video_start_render_thread(s);
 	s->ready=TRUE;
 }
 
 static void x11video_unprepare(MSFilter *f){
 	X11Video *s=(X11Video*)f->data;
+	int i;
+
+	x11video_stop_render_thread(s);
 	if (s->port!=-1){
 		XvStopVideo(s->display,s->port, s->window_id);
 		XvUngrabPort(s->display,s->port,CurrentTime);
 		s->port=-1;
 	}
-	if (s->shminfo.shmaddr!=NULL){
-		XShmDetach(s->display,&s->shminfo);
-		shmdt(s->shminfo.shmaddr);
-		shmctl(s->shminfo.shmid,IPC_RMID,NULL);
-		memset(&s->shminfo,0,sizeof(s->shminfo));
+	for(i=0;i<NB_XV_BUFFERS;++i){
+		if (s->shminfo[i].shmaddr!=NULL){
+			XShmDetach(s->display,&s->shminfo[i]);
+			shmdt(s->shminfo[i].shmaddr);
+			shmctl(s->shminfo[i].shmid,IPC_RMID,NULL);
+			memset(&s->shminfo[i],0,sizeof(s->shminfo[i]));
+		}
+		if (s->xv_image[i]) {
+			XFree(s->xv_image[i]);
+			s->xv_image[i]=NULL;
+		}
 	}
 	if (s->gc){
 		XFreeGC(s->display,s->gc);
 		s->gc=NULL;
 	}
-	if (s->xv_image) {
-		XFree(s->xv_image);
-		s->xv_image=NULL;
-	}
 	if (s->sws2){
 		ms_scaler_context_free (s->sws2);
 		s->sws2=NULL;
@@ -350,34 +505,55 @@ static void x11video_preprocess(MSFilter *f){
 	}
 }
 
+/*the images are kept so that the last frame stays displayed, but the render thread must not outlive the graph*/
+static void x11video_postprocess(MSFilter *f){
+	X11Video *obj=(X11Video*)f->data;
+	ms_filter_lock(f);
+	x11video_stop_render_thread(obj);
+	ms_filter_unlock(f);
+}
+
+
+/*pick the image to compose the next frame into: it can't be the one being rendered*/
+static void x11video_select_back_buffer(X11Video *obj){
+	int back;
+	ms_mutex_lock(&obj->render_lock);
+	if (obj->pending!=-1){
+		/*the render thread did not pick up the previous frame yet, replace it*/
+		back=obj->pending;
+		obj->pending=-1;
+		obj->dropped_frames++;
+	}else back=(obj->front+1)%NB_XV_BUFFERS;
+	ms_mutex_unlock(&obj->render_lock);
+	obj->fbuf=obj->bufs[back];
+}
+
+static void x11video_submit_back_buffer(X11Video *obj){
+	int back=(obj->fbuf.planes[0]==obj->bufs[0].planes[0]) ? 0 : 1;
+	obj->latest=back;
+	ms_mutex_lock(&obj->render_lock);
+	obj->pending=back;
+	ms_cond_signal(&obj->render_cond);
+	ms_mutex_unlock(&obj->render_lock);
+}
 
 static void x11video_process(MSFilter *f){
 	X11Video *obj=(X11Video*)f->data;
 	mblk_t *inm;
 	int update=0;
+	int nb_frames=0;
 	MSPicture lsrc={0};
 	MSPicture src={0};
 	MSRect mainrect,localrect;
 	bool_t precious=FALSE;
 	bool_t local_precious=FALSE;
-	XWindowAttributes wa;
 	MSTickerLateEvent late_info;
 
 	ms_filter_lock(f);
 
-	if ((obj->window_id == 0) || (x11_error == TRUE)) goto end;
+	if (f->inputs[0]!=NULL) nb_frames=f->inputs[0]->q.q_mcount;
 
-	XGetWindowAttributes(obj->display,obj->window_id,&wa);
-	if (x11_error == TRUE) {
-		ms_error("Could not get window attributes for window %lu", obj->window_id);
-		goto end;
-	}
-	if (wa.width!=obj->wsize.width || wa.height!=obj->wsize.height){
-		ms_warning("Resized to %ix%i", wa.width,wa.height);
-		obj->wsize.width=wa.width;
-		obj->wsize.height=wa.height;
-		XClearWindow(obj->display,obj->window_id);
-	}
+	if ((obj->window_id == 0) || (x11_error == TRUE)) goto end;
 
 	ms_ticker_get_last_late_tick(f->ticker, &late_info);
 	if(late_info.current_late_ms > 100) {
@@ -400,6 +576,7 @@ static void x11video_process(MSFilter *f){
 			precious=mblk_get_precious_flag(inm);
 			if (!ms_video_size_equal(newsize,obj->vsize) ) {
 				ms_message("received size is %ix%i",newsize.width,newsize.height);
+				x11video_unprepare(f);
 				obj->vsize=newsize;
 				if (obj->autofit){
 					MSVideoSize new_window_size;
@@ -414,7 +591,6 @@ static void x11video_process(MSFilter *f){
 					XResizeWindow(obj->display,obj->window_id,new_window_size.width,new_window_size.height);
 					XSync(obj->display,FALSE);
 				}
-				x11video_unprepare(f);
 				x11video_prepare(f);
 				if (!obj->ready) goto end;
 			}
@@ -430,6 +606,9 @@ static void x11video_process(MSFilter *f){
 			update=1;
 		}
 	}
+	if (!update) goto end;
+
+	x11video_select_back_buffer(obj);
 
 	ms_layout_compute(obj->vsize, obj->vsize,obj->lsize,obj->corner,obj->scale_factor,&mainrect,&localrect);
 
@@ -446,13 +625,16 @@ static void x11video_process(MSFilter *f){
 		if (!local_precious) ms_yuv_buf_mirror(&obj->local_pic);
 	}
 
-	if (update && src.w!=0){
+	if (src.w!=0){
 		ms_yuv_buf_copy(src.planes,src.strides,obj->fbuf.planes,obj->fbuf.strides,obj->vsize);
 		if (obj->mirror && !precious) ms_yuv_buf_mirror(&obj->fbuf);
+	}else if (obj->fbuf.planes[0]!=obj->bufs[obj->latest].planes[0]){
+		/*only the local view changed: start from the last composed frame*/
+		ms_yuv_buf_copy(obj->bufs[obj->latest].planes,obj->bufs[obj->latest].strides,obj->fbuf.planes,obj->fbuf.strides,obj->vsize);
 	}
 
 	/*copy resized local view into a corner:*/
-	if (update && obj->local_msg!=NULL && obj->corner!=-1){
+	if (obj->local_msg!=NULL && obj->corner!=-1){
 		MSPicture corner=obj->fbuf;
 		MSVideoSize roi;
 		roi.width=obj->local_pic.w;
@@ -466,18 +648,17 @@ static void x11video_process(MSFilter *f){
 		ms_yuv_buf_copy(obj->local_pic.planes,obj->local_pic.strides,
 				corner.planes,corner.strides,roi);
 	}
-	if (update){
-		MSRect rect;
-		ms_layout_center_rectangle(obj->wsize,obj->vsize,&rect);
-		//ms_message("XvShmPutImage() %ix%i --> %ix%i",obj->fbuf.w,obj->fbuf.h,obj->wsize.width,obj->wsize.height);
 
-		XvShmPutImage(obj->display,obj->port,obj->window_id,obj->gc, obj->xv_image,
-		              0,0,obj->fbuf.w,obj->fbuf.h,
-		              rect.x,rect.y,rect.w,rect.h,TRUE);
-		XSync(obj->display,FALSE);
-	}
+	x11video_submit_back_buffer(obj);
+	/*the frame submitted to the render thread is the last one of the queue, the others are skipped*/
+	if (src.w!=0) nb_frames--;
 
 end:
+	if (nb_frames>0){
+		ms_mutex_lock(&obj->render_lock);
+		obj->dropped_frames+=nb_frames;
+		ms_mutex_unlock(&obj->render_lock);
+	}
 	ms_filter_unlock(f);
 	if (f->inputs[0]!=NULL)
 		ms_queue_flush(f->inputs[0]);
@@ -488,7 +669,9 @@ end:
 static int x11video_set_vsize(MSFilter *f,void *arg){
 	X11Video *s=(X11Video*)f->data;
 	ms_filter_lock(f);
+	ms_mutex_lock(&s->render_lock);
 	s->wsize=*(MSVideoSize*)arg;
+	ms_mutex_unlock(&s->render_lock);
 	ms_filter_unlock(f);
 	return 0;
 }
@@ -572,6 +755,16 @@ static int x11video_set_background_color(MSFilter *f,void *arg){
 	return 0;
 }
 
+static int x11video_get_stats(MSFilter *f,void *arg){
+	X11Video *s=(X11Video*)f->data;
+	MSVideoDisplayStats *stats=(MSVideoDisplayStats*)arg;
+	ms_mutex_lock(&s->render_lock);
+	stats->rendered_frames=s->rendered_frames;
+	stats->dropped_frames=s->dropped_frames;
+	ms_mutex_unlock(&s->render_lock);
+	return 0;
+}
+
 static MSFilterMethod methods[]={
 	{	MS_FILTER_SET_VIDEO_SIZE	,	x11video_set_vsize },
 /* methods for compatibility with the MSVideoDisplay interface*/
@@ -583,6 +776,7 @@ static MSFilterMethod methods[]={
 	{	MS_VIDEO_DISPLAY_SET_LOCAL_VIEW_SCALEFACTOR	, x11video_set_scalefactor },
 	{	MS_VIDEO_DISPLAY_SET_BACKGROUND_COLOR    ,  x11video_set_background_color},
 	{	MS_VIDEO_DISPLAY_SHOW_VIDEO			, x11video_show_video },
+	{	MS_VIDEO_DISPLAY_GET_STATS			, x11video_get_stats },
 	{	0	,NULL}
 };
 
@@ -597,6 +791,7 @@ MSFilterDesc ms_x11video_desc={
 	.init=x11video_init,
 	.preprocess=x11video_preprocess,
 	.process=x11video_process,
+	.postprocess=x11video_postprocess,
 	.uninit=x11video_uninit,
 	.methods=methods
 };
@@ -232,10 +232,20 @@ MSAudioEndpoint * ms_audio_endpoint_get_from_stream(AudioStream *st, bool_t is_r
 	MSAudioEndpoint *ep=ms_audio_endpoint_new();
 	ep->st=st;
 	cut_audio_stream_graph(ep,is_remote);
+	if (st->ec && ms_filter_has_method(st->ec,MS_ECHO_CANCELLER_ENABLE_ASYNC)){
+		/*the echo cancellers of the legs sharing the conference ticker run in parallel*/
+		bool_t async=TRUE;
+		ms_filter_call_method(st->ec,MS_ECHO_CANCELLER_ENABLE_ASYNC,&async);
+	}
 	return ep;
 }
 
 void ms_audio_endpoint_release_from_stream(MSAudioEndpoint *obj){
+	AudioStream *st=obj->st;
+	if (st->ec && ms_filter_has_method(st->ec,MS_ECHO_CANCELLER_ENABLE_ASYNC)){
+		bool_t async=FALSE;
+		ms_filter_call_method(st->ec,MS_ECHO_CANCELLER_ENABLE_ASYNC,&async);
+	}
 	redo_audio_stream_graph(obj);
 	ms_audio_endpoint_destroy(obj);
 }
@@ -60,6 +60,7 @@ static void audio_stream_free(AudioStream *stream) {
 	if (stream->soundwrite!=NULL) ms_filter_destroy(stream->soundwrite);
 	if (stream->dtmfgen!=NULL) ms_filter_destroy(stream->dtmfgen);
 	if (stream->plc!=NULL)	ms_filter_destroy(stream->plc);
+	if (stream->playout!=NULL) ms_filter_destroy(stream->playout);
 	if (stream->ec!=NULL)	ms_filter_destroy(stream->ec);
 	if (stream->volrecv!=NULL) ms_filter_destroy(stream->volrecv);
 	if (stream->volsend!=NULL) ms_filter_destroy(stream->volsend);
@@ -757,6 +758,11 @@ int audio_stream_start_from_io(AudioStream *stream, RtpProfile *profile, const c
 		ms_filter_call_method(stream->ms.rtpsend,MS_RTP_SEND_SET_SESSION,rtps);
 	stream->ms.rtprecv=ms_filter_new(MS_RTP_RECV_ID);
 	ms_filter_call_method(stream->ms.rtprecv,MS_RTP_RECV_SET_SESSION,rtps);
+	if (stream->use_adaptive_playout){
+		MSRtpRecvPlayoutParams params={0};
+		params.enabled=TRUE;
+		ms_filter_call_method(stream->ms.rtprecv,MS_RTP_RECV_SET_PLAYOUT_PARAMS,&params);
+	}
 	stream->ms.sessions.rtp_session=rtps;
 
 	if((stream->features & AUDIO_STREAM_FEATURE_DTMF_ECHO) != 0)
@@ -1052,6 +1058,15 @@ int audio_stream_start_from_io(AudioStream *stream, RtpProfile *profile, const c
 		stream->plc = NULL;
 	}
 
+	/* Smooth the changes of the playout delay made by the rtp receiver */
+	if (stream->use_adaptive_playout) {
+		stream->playout = ms_filter_new(MS_AUDIO_PLAYOUT_ID);
+		ms_filter_call_method(stream->playout, MS_FILTER_SET_NCHANNELS, &nchannels);
+		ms_filter_call_method(stream->playout, MS_FILTER_SET_SAMPLE_RATE, &sample_rate);
+	} else {
+		stream->playout = NULL;
+	}
+
 	if (stream->features & AUDIO_STREAM_FEATURE_LOCAL_PLAYING){
 		stream->local_mixer=ms_filter_new(MS_AUDIO_MIXER_ID);
 	}
@@ -1095,6 +1110,8 @@ int audio_stream_start_from_io(AudioStream *stream, RtpProfile *profile, const c
 	ms_connection_helper_link(&h,stream->ms.decoder,0,0);
 	if (stream->plc)
 		ms_connection_helper_link(&h,stream->plc,0,0);
+	if (stream->playout)
+		ms_connection_helper_link(&h,stream->playout,0,0);
 	if (stream->dtmfgen)
 		ms_connection_helper_link(&h,stream->dtmfgen,0,0);
 	if (stream->volrecv)
@@ -1131,6 +1148,7 @@ int audio_stream_start_from_io(AudioStream *stream, RtpProfile *profile, const c
 				,NULL);
 
 	stream->ms.start_time=stream->ms.last_packet_time=ms_time(NULL);
+	stream->ms.start_time_ms=ms_get_cur_time_ms();
 	stream->ms.is_beginning=TRUE;
 	stream->ms.state=MSStreamStarted;
 
@@ -1426,6 +1444,10 @@ void audio_stream_enable_automatic_gain_control(AudioStream *stream, bool_t val)
 	stream->use_agc=val;
 }
 
+void audio_stream_enable_adaptive_playout(AudioStream *stream, bool_t enabled){
+	stream->use_adaptive_playout=enabled;
+}
+
 void audio_stream_enable_noise_gate(AudioStream *stream, bool_t val){
 	stream->use_ng=val;
 	if (stream->volsend){
@@ -1572,6 +1594,8 @@ void audio_stream_stop(AudioStream * stream){
 			ms_connection_helper_unlink(&h,stream->ms.decoder,0,0);
 			if (stream->plc!=NULL)
 				ms_connection_helper_unlink(&h,stream->plc,0,0);
+			if (stream->playout!=NULL)
+				ms_connection_helper_unlink(&h,stream->playout,0,0);
 			if (stream->dtmfgen!=NULL)
 				ms_connection_helper_unlink(&h,stream->dtmfgen,0,0);
 			if (stream->volrecv!=NULL)
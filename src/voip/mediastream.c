@@ -24,9 +24,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "ortp/port.h"
 #include "mediastreamer2/mediastream.h"
+#include "mediastreamer2/msmetrics.h"
+#include "mediastreamer2/msmtu.h"
 #include "private.h"
 #include <ctype.h>
 
+#if !defined(_WIN32) && !defined(_WIN32_WCE)
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
 
 
 #ifndef MS_MINIMAL_MTU
@@ -100,10 +107,137 @@ MSTickerPrio __ms_get_default_prio(bool_t is_video) {
 	}
 }
 
+#define METRICS_UPDATE_INTERVAL 1000 /*ms*/
+
+typedef struct _MSMediaStreamMetrics {
+	MSMetric *rtp_sent_bytes;
+	MSMetric *rtp_received_bytes;
+	MSMetric *rtp_sent_packets;
+	MSMetric *rtp_received_packets;
+	MSMetric *rtp_lost_packets;
+	MSMetric *rtcp_received_packets;
+	MSMetric *jitter;
+	MSMetric *jitter_buffer;
+	MSMetric *quality;
+	MSMetric *upload_bitrate;
+	MSMetric *download_bitrate;
+	MSMetric *round_trip;
+	uint64_t last_update_time_ms;
+} MSMediaStreamMetrics;
+
+static const double round_trip_bounds[] = {0.01, 0.025, 0.05, 0.1, 0.2, 0.4, 0.8, 1.6}; /*seconds*/
+
+static MSMediaStreamMetrics *media_stream_metrics_new(MediaStream *stream) {
+	MSMediaStreamMetrics *obj = ms_new0(MSMediaStreamMetrics, 1);
+	char *labels = ms_strdup_printf("type=\"%s\",stream=\"%i\"", media_stream_type_str(stream), ms_metrics_new_id());
+
+	obj->rtp_sent_bytes = ms_metric_new("ms2_rtp_sent_bytes", MSMetricCounter, "RTP bytes sent.", labels);
+	obj->rtp_received_bytes = ms_metric_new("ms2_rtp_received_bytes", MSMetricCounter, "RTP payload bytes received.", labels);
+	obj->rtp_sent_packets = ms_metric_new("ms2_rtp_sent_packets", MSMetricCounter, "RTP packets sent.", labels);
+	obj->rtp_received_packets = ms_metric_new("ms2_rtp_received_packets", MSMetricCounter, "RTP packets received.", labels);
+	obj->rtp_lost_packets = ms_metric_new("ms2_rtp_lost_packets", MSMetricCounter, "RTP packets lost, as computed for the RTCP reports.", labels);
+	obj->rtcp_received_packets = ms_metric_new("ms2_rtcp_received_packets", MSMetricCounter, "RTCP compound packets received.", labels);
+	obj->jitter = ms_metric_new("ms2_stream_jitter_seconds", MSMetricGauge, "Interarrival jitter of the received RTP packets.", labels);
+	obj->jitter_buffer = ms_metric_new("ms2_stream_jitter_buffer_seconds", MSMetricGauge, "Size of the jitter buffer.", labels);
+	obj->quality = ms_metric_new("ms2_stream_quality_rating", MSMetricGauge, "Quality rating, from 0 to 5, -1 if unknown.", labels);
+	obj->upload_bitrate = ms_metric_new("ms2_stream_upload_bitrate", MSMetricGauge, "RTP upload bitrate in bits per second.", labels);
+	obj->download_bitrate = ms_metric_new("ms2_stream_download_bitrate", MSMetricGauge, "RTP download bitrate in bits per second.", labels);
+	obj->round_trip = ms_metric_new_histogram("ms2_stream_round_trip_seconds", "Round trip delays computed from the RTCP reports.",
+		labels, round_trip_bounds, sizeof(round_trip_bounds) / sizeof(round_trip_bounds[0]));
+	ms_free(labels);
+	return obj;
+}
+
+static void media_stream_metrics_destroy(MSMediaStreamMetrics *obj) {
+	ms_metric_destroy(obj->rtp_sent_bytes);
+	ms_metric_destroy(obj->rtp_received_bytes);
+	ms_metric_destroy(obj->rtp_sent_packets);
+	ms_metric_destroy(obj->rtp_received_packets);
+	ms_metric_destroy(obj->rtp_lost_packets);
+	ms_metric_destroy(obj->rtcp_received_packets);
+	ms_metric_destroy(obj->jitter);
+	ms_metric_destroy(obj->jitter_buffer);
+	ms_metric_destroy(obj->quality);
+	ms_metric_destroy(obj->upload_bitrate);
+	ms_metric_destroy(obj->download_bitrate);
+	ms_metric_destroy(obj->round_trip);
+	ms_free(obj);
+}
+
+static void media_stream_update_metrics(MediaStream *stream, uint64_t curtime_ms) {
+	MSMediaStreamMetrics *obj = stream->metrics;
+	RtpSession *session = stream->sessions.rtp_session;
+	const rtp_stats_t *stats;
+	const jitter_stats_t *jitter_stats;
+
+	if (obj == NULL || session == NULL || curtime_ms - obj->last_update_time_ms < METRICS_UPDATE_INTERVAL) return;
+	obj->last_update_time_ms = curtime_ms;
+	stats = rtp_session_get_stats(session);
+	ms_metric_set(obj->rtp_sent_bytes, (double)stats->sent);
+	ms_metric_set(obj->rtp_received_bytes, (double)stats->hw_recv);
+	ms_metric_set(obj->rtp_sent_packets, (double)stats->packet_sent);
+	ms_metric_set(obj->rtp_received_packets, (double)stats->packet_recv);
+	ms_metric_set(obj->rtp_lost_packets, (double)MAX(stats->cum_packet_loss, 0));
+	jitter_stats = rtp_session_get_jitter_stats(session);
+	if (stream->current_pt && stream->current_pt->clock_rate > 0) {
+		ms_metric_set(obj->jitter, (double)jitter_stats->jitter / stream->current_pt->clock_rate);
+	}
+	ms_metric_set(obj->jitter_buffer, jitter_stats->jitter_buffer_size_ms / 1000.0);
+	ms_metric_set(obj->quality, media_stream_get_quality_rating(stream));
+	ms_metric_set(obj->upload_bitrate, media_stream_get_up_bw(stream));
+	ms_metric_set(obj->download_bitrate, media_stream_get_down_bw(stream));
+}
+
+static void media_stream_mtu_discovered(void *user_data, const char *host, int mtu) {
+	MediaStream *stream = (MediaStream *)user_data;
+	stream->mtu_changed = TRUE;
+}
+
+static void media_stream_stop_mtu_discovery(MediaStream *stream) {
+	if (stream->mtu_destination == NULL) return;
+	ms_mtu_discovery_cancel(stream->mtu_destination, media_stream_mtu_discovered, stream);
+	ms_free(stream->mtu_destination);
+	stream->mtu_destination = NULL;
+	stream->mtu_changed = FALSE;
+}
+
+static void media_stream_set_max_payload_size(MediaStream *stream, int size) {
+	if (stream->encoder != NULL && ms_filter_has_method(stream->encoder, MS_FILTER_SET_MTU)) {
+		ms_filter_call_method(stream->encoder, MS_FILTER_SET_MTU, &size);
+	}
+	if (stream->rtpsend != NULL) ms_filter_call_method(stream->rtpsend, MS_FILTER_SET_MTU, &size);
+}
+
+static void media_stream_update_mtu(MediaStream *stream) {
+	RtpSession *session = stream->sessions.rtp_session;
+	char host[NI_MAXHOST];
+	int mtu;
+
+	if (!stream->mtu_discovery_enabled || session == NULL || session->rtp.gs.rem_addrlen == 0) return;
+	if (getnameinfo((struct sockaddr *)&session->rtp.gs.rem_addr, session->rtp.gs.rem_addrlen, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0) return;
+	if (stream->mtu_destination == NULL || strcmp(stream->mtu_destination, host) != 0) {
+		media_stream_stop_mtu_discovery(stream);
+		stream->mtu_destination = ms_strdup(host);
+		ms_mtu_discovery_request(host, media_stream_mtu_discovered, stream);
+		stream->mtu_changed = TRUE;
+	}
+	if (!stream->mtu_changed) return;
+	stream->mtu_changed = FALSE;
+	mtu = ms_mtu_discovery_get(host);
+	if (mtu > 60 && mtu != stream->applied_mtu) {
+		/*60= IPv6+UDP+RTP overhead, as for ms_set_mtu()*/
+		int size = MIN(mtu - 60, ms_get_payload_max_size());
+		ms_message("%s stream [%p]: path mtu to %s is %i, max payload size set to %i", media_stream_type_str(stream), stream, host, mtu, size);
+		stream->applied_mtu = mtu;
+		media_stream_set_max_payload_size(stream, size);
+	}
+}
+
 void media_stream_init(MediaStream *stream) {
 	stream->evd = ortp_ev_dispatcher_new(stream->sessions.rtp_session);
 	stream->evq = ortp_ev_queue_new();
 	rtp_session_register_event_queue(stream->sessions.rtp_session, stream->evq);
+	stream->metrics = media_stream_metrics_new(stream);
 }
 
 RtpSession * ms_create_duplex_rtp_session(const char* local_ip, int loc_rtp_port, int loc_rtcp_port) {
@@ -180,6 +314,8 @@ void media_stream_free(MediaStream *stream) {
 	if (stream->decoder != NULL) ms_filter_destroy(stream->decoder);
 	if (stream->voidsink != NULL) ms_filter_destroy(stream->voidsink);
 	if (stream->qi) ms_quality_indicator_destroy(stream->qi);
+	if (stream->metrics) media_stream_metrics_destroy(stream->metrics);
+	media_stream_stop_mtu_discovery(stream);
 }
 
 bool_t media_stream_started(MediaStream *stream) {
@@ -216,6 +352,15 @@ void media_stream_enable_adaptive_jittcomp(MediaStream *stream, bool_t enabled)
 	rtp_session_enable_adaptive_jitter_compensation(stream->sessions.rtp_session, enabled);
 }
 
+void media_stream_enable_mtu_discovery(MediaStream *stream, bool_t enabled) {
+	stream->mtu_discovery_enabled = enabled;
+	if (!enabled) {
+		media_stream_stop_mtu_discovery(stream);
+		if (stream->applied_mtu > 0) media_stream_set_max_payload_size(stream, ms_get_payload_max_size());
+		stream->applied_mtu = 0;
+	}
+}
+
 void media_stream_enable_dtls(MediaStream *stream, MSDtlsSrtpParams *params){
 	if (stream->sessions.dtls_context==NULL) {
 		ms_message("Start DTLS media stream context in stream session [%p]", &(stream->sessions));
@@ -288,27 +433,51 @@ bool_t ms_is_multicast(const char *address) {
 	return ret;
 }
 
+/*the round trip delay is computed again from a report block acknowledging one of our sender reports*/
+static bool_t rtcp_updates_round_trip(const mblk_t *m){
+	const report_block_t *rb=NULL;
+	if (rtcp_is_SR(m)) rb=rtcp_SR_get_report_block(m,0);
+	else if (rtcp_is_RR(m)) rb=rtcp_RR_get_report_block(m,0);
+	return rb!=NULL && report_block_get_last_SR_time(rb)!=0;
+}
+
 static void media_stream_process_rtcp(MediaStream *stream, mblk_t *m, time_t curtime){
+	bool_t rtt_updated=FALSE;
+
 	stream->last_packet_time=curtime;
-	ms_message("%s stream [%p]: receiving RTCP %s%s",media_stream_type_str(stream),stream,(rtcp_is_SR(m)?"SR":""),(rtcp_is_RR(m)?"RR":""));
+	ms_log_with_site(&stream->rtcp_received_log_site,ORTP_MESSAGE,0,1000,"%s stream [%p]: receiving RTCP %s%s",media_stream_type_str(stream),stream,(rtcp_is_SR(m)?"SR":""),(rtcp_is_RR(m)?"RR":""));
 	do{
 		if (stream->rc_enable && stream->rc) ms_bitrate_controller_process_rtcp(stream->rc,m);
 		if (stream->qi) ms_quality_indicator_update_from_feedback(stream->qi,m);
 		stream->process_rtcp(stream,m);
+		if (rtcp_updates_round_trip(m)) rtt_updated=TRUE;
 	}while(rtcp_next_packet(m));
+	if (stream->metrics){
+		ms_metric_add(stream->metrics->rtcp_received_packets,1);
+		if (rtt_updated){
+			float rtt=rtp_session_get_round_trip_propagation(stream->sessions.rtp_session);
+			if (rtt>0) ms_metric_observe(stream->metrics->round_trip,rtt);
+		}
+	}
 }
 
 void media_stream_iterate(MediaStream *stream){
 	time_t curtime=ms_time(NULL);
+	uint64_t curtime_ms=ms_get_cur_time_ms();
 
 	if (stream->ice_check_list) ice_check_list_process(stream->ice_check_list,stream->sessions.rtp_session);
 	/*we choose to update the quality indicator as much as possible, since local statistics can be computed realtime. */
 	if (stream->state==MSStreamStarted){
-		if (stream->is_beginning && (curtime-stream->start_time>15)){
+		if (stream->is_beginning && (curtime_ms-stream->start_time_ms>15000)){
 			rtp_session_set_rtcp_report_interval(stream->sessions.rtp_session,5000);
 			stream->is_beginning=FALSE;
 		}
-		if (stream->qi && curtime>stream->last_iterate_time) ms_quality_indicator_update_local(stream->qi);
+		if (stream->qi && curtime_ms-stream->last_qi_update_time_ms>=1000){
+			ms_quality_indicator_update_local(stream->qi);
+			stream->last_qi_update_time_ms=curtime_ms;
+		}
+		media_stream_update_metrics(stream,curtime_ms);
+		media_stream_update_mtu(stream);
 	}
 	stream->last_iterate_time=curtime;
 
@@ -327,7 +496,7 @@ void media_stream_iterate(MediaStream *stream){
 				mblk_t *m=ortp_event_get_data(ev)->packet;
 				media_stream_process_rtcp(stream,m,curtime);
 			}else if (evt==ORTP_EVENT_RTCP_PACKET_EMITTED){
-				ms_message("%s_stream_iterate[%p], local statistics available:"
+				ms_log_with_site(&stream->rtcp_emitted_log_site,ORTP_MESSAGE,0,1000,"%s_stream_iterate[%p], local statistics available:"
 							"\n\tLocal current jitter buffer size: %5.1fms",
 					media_stream_type_str(stream), stream, rtp_session_get_jitter_stats(stream->sessions.rtp_session)->jitter_buffer_size_ms);
 			} else if (evt==ORTP_EVENT_STUN_PACKET_RECEIVED){
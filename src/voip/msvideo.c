@@ -179,9 +179,149 @@ void ms_yuv_buf_copy(uint8_t *src_planes[], const int src_strides[],
 	plane_copy(src_planes[2],src_strides[2],dst_planes[2],dst_strides[2],roi);
 }
 
+/*
+ * All the MSYuvBufAllocator share a process-wide pool of frame buffers, sorted by size classes: each power of two
+ * is divided into four classes, so that at most 25% of a buffer is wasted. A buffer returns to the pool when its
+ * last reference is released, from whatever thread, and can then be reused by any filter asking for a frame of a
+ * close size. The picture data starts on a YUV_BUF_ALIGNMENT boundary.
+ */
+#define YUV_BUF_ALIGNMENT 32
+#define YUV_BUF_POOL_CLASSES 72
+#define YUV_BUF_POOL_MIN_SHIFT 12 /*smallest class is 4kB*/
+#define YUV_BUF_POOL_MAX_PER_CLASS 16
+#define YUV_BUF_POOL_MAX_CACHED (64*1024*1024)
+
+typedef struct _YuvBufHeader{
+	struct _YuvBufHeader *next;
+	struct _YuvBufPool *pool; /*the pool the buffer returns to*/
+	void *raw;
+	size_t size;
+	int size_class;
+}YuvBufHeader;
+
+typedef struct _YuvBufPool{
+	YuvBufHeader *free_bufs[YUV_BUF_POOL_CLASSES];
+	int nfree[YUV_BUF_POOL_CLASSES];
+	size_t cached_bytes;
+	unsigned int hits;
+	unsigned int misses;
+	int refcount; /*allocators and buffers in use*/
+}YuvBufPool;
+
+struct _MSYuvBufAllocator{
+	YuvBufPool *pool;
+	unsigned int hits;
+	unsigned int misses;
+};
+
+/*the pool is created by the first allocator and destroyed with the last allocator or buffer, which may be released
+ from any thread: the global pointer, the refcount and the free lists are protected by a single lock*/
+static YuvBufPool *yuv_buf_pool=NULL;
+static ms_mutex_t yuv_buf_pool_lock;
+static ms_once_t yuv_buf_pool_once=MS_ONCE_INIT;
+
+static void yuv_buf_pool_init_lock(void){
+	ms_mutex_init(&yuv_buf_pool_lock,NULL);
+}
+
+static size_t yuv_buf_pool_class_size(int size_class){
+	return (size_t)(4+size_class%4)<<(size_class/4+YUV_BUF_POOL_MIN_SHIFT-2);
+}
+
+static int yuv_buf_pool_size_class(size_t size){
+	int size_class;
+	for(size_class=0;size_class<YUV_BUF_POOL_CLASSES;++size_class){
+		if (yuv_buf_pool_class_size(size_class)>=size) return size_class;
+	}
+	return -1; /*too big to be pooled*/
+}
+
+/*must be called with the pool lock held, returns the pool if it has to be destroyed, once the lock is released*/
+static YuvBufPool *yuv_buf_pool_unref_locked(YuvBufPool *pool){
+	if (--pool->refcount>0) return NULL;
+	if (yuv_buf_pool==pool) yuv_buf_pool=NULL;
+	return pool;
+}
+
+static void yuv_buf_pool_destroy(YuvBufPool *pool){
+	int i;
+	if (pool==NULL) return;
+	for(i=0;i<YUV_BUF_POOL_CLASSES;++i){
+		while(pool->free_bufs[i]!=NULL){
+			YuvBufHeader *hdr=pool->free_bufs[i];
+			pool->free_bufs[i]=hdr->next;
+			ms_free(hdr->raw);
+		}
+	}
+	ms_free(pool);
+}
+
+static void yuv_buf_pool_release(void *base){
+	YuvBufHeader *hdr=(YuvBufHeader*)((uint8_t*)base-sizeof(YuvBufHeader));
+	YuvBufPool *pool=hdr->pool;
+	YuvBufPool *destroyed;
+
+	ms_mutex_lock(&yuv_buf_pool_lock);
+	if (hdr->size_class>=0 && pool->nfree[hdr->size_class]<YUV_BUF_POOL_MAX_PER_CLASS
+		&& pool->cached_bytes+hdr->size<=YUV_BUF_POOL_MAX_CACHED){
+		hdr->next=pool->free_bufs[hdr->size_class];
+		pool->free_bufs[hdr->size_class]=hdr;
+		pool->nfree[hdr->size_class]++;
+		pool->cached_bytes+=hdr->size;
+		hdr=NULL;
+	}
+	destroyed=yuv_buf_pool_unref_locked(pool);
+	ms_mutex_unlock(&yuv_buf_pool_lock);
+	if (hdr) ms_free(hdr->raw);
+	yuv_buf_pool_destroy(destroyed);
+}
+
+/*returns a mblk_t whose data is aligned once the video header of header_size bytes is skipped*/
+static mblk_t *yuv_buf_pool_get(MSYuvBufAllocator *obj, int header_size, int size){
+	YuvBufPool *pool=obj->pool;
+	int size_class=yuv_buf_pool_size_class(size);
+	YuvBufHeader *hdr=NULL;
+	uint8_t *base;
+
+	ms_mutex_lock(&yuv_buf_pool_lock);
+	if (size_class>=0 && pool->free_bufs[size_class]!=NULL){
+		hdr=pool->free_bufs[size_class];
+		pool->free_bufs[size_class]=hdr->next;
+		pool->nfree[size_class]--;
+		pool->cached_bytes-=hdr->size;
+		pool->hits++;
+		obj->hits++;
+	}else{
+		pool->misses++;
+		obj->misses++;
+	}
+	pool->refcount++;
+	ms_mutex_unlock(&yuv_buf_pool_lock);
+
+	if (hdr==NULL){
+		size_t buf_size=size_class>=0 ? yuv_buf_pool_class_size(size_class) : (size_t)size;
+		uint8_t *raw=(uint8_t*)ms_malloc(sizeof(YuvBufHeader)+header_size+YUV_BUF_ALIGNMENT-1+buf_size);
+		uint8_t *data=raw+sizeof(YuvBufHeader)+header_size;
+		data+=(YUV_BUF_ALIGNMENT-((intptr_t)data%YUV_BUF_ALIGNMENT))%YUV_BUF_ALIGNMENT;
+		hdr=(YuvBufHeader*)(data-header_size-sizeof(YuvBufHeader));
+		hdr->raw=raw;
+		hdr->size=buf_size;
+		hdr->size_class=size_class;
+		hdr->pool=pool;
+	}
+	hdr->next=NULL;
+	base=(uint8_t*)hdr+sizeof(YuvBufHeader);
+	return esballoc(base,(int)(header_size+hdr->size),0,yuv_buf_pool_release);
+}
+
 MSYuvBufAllocator *ms_yuv_buf_allocator_new(void) {
-	msgb_allocator_t *allocator = (msgb_allocator_t *)ms_new0(msgb_allocator_t, 1);
-	msgb_allocator_init(allocator);
+	MSYuvBufAllocator *allocator = ms_new0(MSYuvBufAllocator, 1);
+	ms_once(&yuv_buf_pool_once, yuv_buf_pool_init_lock);
+	ms_mutex_lock(&yuv_buf_pool_lock);
+	if (yuv_buf_pool==NULL) yuv_buf_pool=ms_new0(YuvBufPool,1);
+	yuv_buf_pool->refcount++;
+	allocator->pool=yuv_buf_pool;
+	ms_mutex_unlock(&yuv_buf_pool_lock);
 	return allocator;
 }
 
@@ -189,7 +329,7 @@ mblk_t *ms_yuv_buf_allocator_get(MSYuvBufAllocator *obj, MSPicture *buf, int w,
 	int size=(w * (h & 0x1 ? h+1 : h) *3)/2; /*swscale doesn't like odd numbers of line*/
 	const int header_size = sizeof(mblk_video_header);
 	const int padding=16;
-	mblk_t *msg = msgb_allocator_alloc(obj, header_size + size+padding);
+	mblk_t *msg = yuv_buf_pool_get(obj, header_size, size+padding);
 	mblk_video_header* hdr = (mblk_video_header*)msg->b_wptr;
 	hdr->w = w;
 	hdr->h = h;
@@ -200,17 +340,29 @@ mblk_t *ms_yuv_buf_allocator_get(MSYuvBufAllocator *obj, MSPicture *buf, int w,
 	return msg;
 }
 
-void ms_yuv_buf_allocator_free(MSYuvBufAllocator *obj) {
-	mblk_t *m;
-	int possibly_leaked = 0;
-	for(m = qbegin(&obj->q); !qend(&obj->q,m); m = qnext(&obj->q, m)){
-		if (m->b_datap->db_ref > 1) possibly_leaked++;
+void ms_yuv_buf_allocator_get_stats(const MSYuvBufAllocator *obj, MSYuvBufAllocatorStats *stats) {
+	YuvBufPool *pool;
+	memset(stats,0,sizeof(*stats));
+	ms_once(&yuv_buf_pool_once, yuv_buf_pool_init_lock);
+	ms_mutex_lock(&yuv_buf_pool_lock);
+	pool=obj ? obj->pool : yuv_buf_pool;
+	if (pool!=NULL){
+		stats->hits=obj ? obj->hits : pool->hits;
+		stats->misses=obj ? obj->misses : pool->misses;
+		stats->cached_bytes=pool->cached_bytes;
 	}
-	msgb_allocator_uninit(obj);
+	ms_mutex_unlock(&yuv_buf_pool_lock);
+}
+
+void ms_yuv_buf_allocator_free(MSYuvBufAllocator *obj) {
+	YuvBufPool *destroyed;
+	ms_message("MSYuvBufAllocator [%p] destroyed: %u hits, %u misses", obj, obj->hits, obj->misses);
+	/*the buffers still in use keep the pool alive, they are not leaked*/
+	ms_mutex_lock(&yuv_buf_pool_lock);
+	destroyed=yuv_buf_pool_unref_locked(obj->pool);
+	ms_mutex_unlock(&yuv_buf_pool_lock);
 	ms_free(obj);
-	if (possibly_leaked > 0){
-		ms_warning("ms_yuv_buf_allocator_free(): leaving %i mblk_t still ref'd, possible leak.", possibly_leaked);
-	}
+	yuv_buf_pool_destroy(destroyed);
 }
 
 static void plane_horizontal_mirror(uint8_t *p, int linesize, int w, int h){
@@ -398,6 +550,80 @@ void ms_rgb_to_yuv(const uint8_t rgb[3], uint8_t yuv[3]){
 	yuv[2]=(uint8_t)(0.439*rgb[0] - 0.368*rgb[1] - 0.071*rgb[2] + 128);
 }
 
+/*
+ * The tag is made of 80 bits, drawn as 32 blocks per row from the top-left corner of the picture: a marker byte,
+ * the sequence number, the timestamp and a check byte. The blocks are positioned relatively to the picture width,
+ * so that the tag can still be read after the picture has been scaled.
+ */
+#define FRAME_TAG_COLUMNS 32
+#define FRAME_TAG_BITS 80
+#define FRAME_TAG_MARKER 0xA5
+
+static void frame_tag_block(const MSPicture *pic, int bit, int *x, int *y, int *w, int *h){
+	int col=bit%FRAME_TAG_COLUMNS;
+	int row=bit/FRAME_TAG_COLUMNS;
+	*x=(col*pic->w/FRAME_TAG_COLUMNS) & ~1;
+	*y=(row*pic->w/FRAME_TAG_COLUMNS) & ~1;
+	*w=(((col+1)*pic->w/FRAME_TAG_COLUMNS) & ~1)-*x;
+	*h=(((row+1)*pic->w/FRAME_TAG_COLUMNS) & ~1)-*y;
+}
+
+static void frame_tag_encode(uint8_t bytes[10], uint32_t seq, uint32_t timestamp){
+	int i;
+	bytes[0]=FRAME_TAG_MARKER;
+	for(i=0;i<4;++i){
+		bytes[1+i]=(seq>>(24-8*i)) & 0xff;
+		bytes[5+i]=(timestamp>>(24-8*i)) & 0xff;
+	}
+	bytes[9]=0;
+	for(i=0;i<9;++i) bytes[9]^=bytes[i];
+}
+
+int ms_yuv_buf_write_tag(MSPicture *pic, uint32_t seq, uint32_t timestamp){
+	uint8_t bytes[10];
+	int bit,x,y,w,h,i;
+
+	frame_tag_block(pic,FRAME_TAG_BITS-1,&x,&y,&w,&h);
+	if (w<2 || y+h>pic->h) return -1;
+	frame_tag_encode(bytes,seq,timestamp);
+	for(bit=0;bit<FRAME_TAG_BITS;++bit){
+		uint8_t luma=(bytes[bit/8] & (0x80>>(bit%8))) ? 235 : 16;
+		frame_tag_block(pic,bit,&x,&y,&w,&h);
+		for(i=0;i<h;++i){
+			memset(pic->planes[0]+(y+i)*pic->strides[0]+x,luma,w);
+		}
+		for(i=0;i<h/2;++i){
+			memset(pic->planes[1]+(y/2+i)*pic->strides[1]+x/2,128,w/2);
+			memset(pic->planes[2]+(y/2+i)*pic->strides[2]+x/2,128,w/2);
+		}
+	}
+	return 0;
+}
+
+int ms_yuv_buf_read_tag(const MSPicture *pic, uint32_t *seq, uint32_t *timestamp){
+	uint8_t bytes[10]={0};
+	uint8_t check[10];
+	int bit,x,y,w,h,i,j;
+
+	frame_tag_block(pic,FRAME_TAG_BITS-1,&x,&y,&w,&h);
+	if (w<2 || y+h>pic->h) return -1;
+	for(bit=0;bit<FRAME_TAG_BITS;++bit){
+		int sum=0;
+		frame_tag_block(pic,bit,&x,&y,&w,&h);
+		/*only the center of the block is looked at, the edges are blurred by the encoding and scaling*/
+		for(i=h/4;i<h-h/4;++i){
+			for(j=w/4;j<w-w/4;++j){
+				sum+=pic->planes[0][(y+i)*pic->strides[0]+x+j];
+			}
+		}
+		if (sum>=128*(h-2*(h/4))*(w-2*(w/4))) bytes[bit/8]|=0x80>>(bit%8);
+	}
+	*seq=((uint32_t)bytes[1]<<24)|((uint32_t)bytes[2]<<16)|((uint32_t)bytes[3]<<8)|bytes[4];
+	*timestamp=((uint32_t)bytes[5]<<24)|((uint32_t)bytes[6]<<16)|((uint32_t)bytes[7]<<8)|bytes[8];
+	frame_tag_encode(check,*seq,*timestamp);
+	return memcmp(bytes,check,sizeof(bytes))==0 ? 0 : -1;
+}
+
 #if !defined(NO_FFMPEG)
 
 
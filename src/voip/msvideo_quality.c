@@ -0,0 +1,186 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#include "mediastreamer2/msvideo.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Objective quality metrics comparing a decoded picture with the original one, computed on the luma plane.
+ */
+
+#define SSIM_WINDOW 8
+#define SSIM_STEP 4
+#define SSIM_C1 (0.01*255*0.01*255)
+#define SSIM_C2 (0.03*255*0.03*255)
+
+static uint64_t luma_row_ssd(const uint8_t *a, const uint8_t *b, int n){
+	uint64_t sum=0;
+	int i=0;
+#if defined(__SSE2__)
+	__m128i zero=_mm_setzero_si128();
+	__m128i acc=_mm_setzero_si128();
+	uint32_t lanes[4];
+	for(;i+16<=n;i+=16){
+		__m128i va=_mm_loadu_si128((const __m128i*)(a+i));
+		__m128i vb=_mm_loadu_si128((const __m128i*)(b+i));
+		__m128i lo=_mm_sub_epi16(_mm_unpacklo_epi8(va,zero),_mm_unpacklo_epi8(vb,zero));
+		__m128i hi=_mm_sub_epi16(_mm_unpackhi_epi8(va,zero),_mm_unpackhi_epi8(vb,zero));
+		acc=_mm_add_epi32(acc,_mm_madd_epi16(lo,lo));
+		acc=_mm_add_epi32(acc,_mm_madd_epi16(hi,hi));
+	}
+	_mm_storeu_si128((__m128i*)lanes,acc);
+	sum=(uint64_t)lanes[0]+lanes[1]+lanes[2]+lanes[3];
+#elif defined(__ARM_NEON__)
+	uint32x4_t acc=vdupq_n_u32(0);
+	uint64x2_t acc64;
+	for(;i+16<=n;i+=16){
+		uint8x16_t d=vabdq_u8(vld1q_u8(a+i),vld1q_u8(b+i));
+		acc=vpadalq_u16(acc,vmull_u8(vget_low_u8(d),vget_low_u8(d)));
+		acc=vpadalq_u16(acc,vmull_u8(vget_high_u8(d),vget_high_u8(d)));
+	}
+	acc64=vpaddlq_u32(acc);
+	sum=vgetq_lane_u64(acc64,0)+vgetq_lane_u64(acc64,1);
+#endif
+	for(;i<n;++i){
+		int d=(int)a[i]-(int)b[i];
+		sum+=d*d;
+	}
+	return sum;
+}
+
+double ms_yuv_buf_psnr(const MSPicture *ref, const MSPicture *pic){
+	uint64_t ssd=0;
+	double mse;
+	int i;
+
+	if (ref->w!=pic->w || ref->h!=pic->h) return -1;
+	for(i=0;i<ref->h;++i){
+		ssd+=luma_row_ssd(ref->planes[0]+i*ref->strides[0],pic->planes[0]+i*pic->strides[0],ref->w);
+	}
+	if (ssd==0) return 100;
+	mse=(double)ssd/((double)ref->w*ref->h);
+	return 10*log10(255.0*255.0/mse);
+}
+
+typedef struct _SsimSums{
+	uint32_t sa,sb,saa,sbb,sab;
+}SsimSums;
+
+static void ssim_window_sums(const uint8_t *a, int stride_a, const uint8_t *b, int stride_b, SsimSums *s){
+	int i;
+#if defined(__SSE2__)
+	__m128i zero=_mm_setzero_si128();
+	__m128i suma=zero,sumb=zero,aa=zero,bb=zero,ab=zero;
+	uint32_t lanes[4];
+	uint16_t sums[8];
+	for(i=0;i<SSIM_WINDOW;++i){
+		__m128i va=_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a+i*stride_a)),zero);
+		__m128i vb=_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b+i*stride_b)),zero);
+		suma=_mm_add_epi16(suma,va);
+		sumb=_mm_add_epi16(sumb,vb);
+		aa=_mm_add_epi32(aa,_mm_madd_epi16(va,va));
+		bb=_mm_add_epi32(bb,_mm_madd_epi16(vb,vb));
+		ab=_mm_add_epi32(ab,_mm_madd_epi16(va,vb));
+	}
+	_mm_storeu_si128((__m128i*)sums,suma);
+	s->sa=sums[0]+sums[1]+sums[2]+sums[3]+sums[4]+sums[5]+sums[6]+sums[7];
+	_mm_storeu_si128((__m128i*)sums,sumb);
+	s->sb=sums[0]+sums[1]+sums[2]+sums[3]+sums[4]+sums[5]+sums[6]+sums[7];
+	_mm_storeu_si128((__m128i*)lanes,aa);
+	s->saa=lanes[0]+lanes[1]+lanes[2]+lanes[3];
+	_mm_storeu_si128((__m128i*)lanes,bb);
+	s->sbb=lanes[0]+lanes[1]+lanes[2]+lanes[3];
+	_mm_storeu_si128((__m128i*)lanes,ab);
+	s->sab=lanes[0]+lanes[1]+lanes[2]+lanes[3];
+#elif defined(__ARM_NEON__)
+	uint16x8_t suma=vdupq_n_u16(0),sumb=vdupq_n_u16(0);
+	uint32x4_t aa=vdupq_n_u32(0),bb=vdupq_n_u32(0),ab=vdupq_n_u32(0);
+	uint64x2_t r;
+	for(i=0;i<SSIM_WINDOW;++i){
+		uint16x8_t va=vmovl_u8(vld1_u8(a+i*stride_a));
+		uint16x8_t vb=vmovl_u8(vld1_u8(b+i*stride_b));
+		suma=vaddq_u16(suma,va);
+		sumb=vaddq_u16(sumb,vb);
+		aa=vmlal_u16(aa,vget_low_u16(va),vget_low_u16(va));
+		aa=vmlal_u16(aa,vget_high_u16(va),vget_high_u16(va));
+		bb=vmlal_u16(bb,vget_low_u16(vb),vget_low_u16(vb));
+		bb=vmlal_u16(bb,vget_high_u16(vb),vget_high_u16(vb));
+		ab=vmlal_u16(ab,vget_low_u16(va),vget_low_u16(vb));
+		ab=vmlal_u16(ab,vget_high_u16(va),vget_high_u16(vb));
+	}
+	r=vpaddlq_u32(vpaddlq_u16(suma));
+	s->sa=(uint32_t)(vgetq_lane_u64(r,0)+vgetq_lane_u64(r,1));
+	r=vpaddlq_u32(vpaddlq_u16(sumb));
+	s->sb=(uint32_t)(vgetq_lane_u64(r,0)+vgetq_lane_u64(r,1));
+	r=vpaddlq_u32(aa);
+	s->saa=(uint32_t)(vgetq_lane_u64(r,0)+vgetq_lane_u64(r,1));
+	r=vpaddlq_u32(bb);
+	s->sbb=(uint32_t)(vgetq_lane_u64(r,0)+vgetq_lane_u64(r,1));
+	r=vpaddlq_u32(ab);
+	s->sab=(uint32_t)(vgetq_lane_u64(r,0)+vgetq_lane_u64(r,1));
+#else
+	int j;
+	memset(s,0,sizeof(*s));
+	for(i=0;i<SSIM_WINDOW;++i){
+		for(j=0;j<SSIM_WINDOW;++j){
+			uint32_t va=a[i*stride_a+j];
+			uint32_t vb=b[i*stride_b+j];
+			s->sa+=va;
+			s->sb+=vb;
+			s->saa+=va*va;
+			s->sbb+=vb*vb;
+			s->sab+=va*vb;
+		}
+	}
+#endif
+}
+
+double ms_yuv_buf_ssim(const MSPicture *ref, const MSPicture *pic){
+	double sum=0;
+	int count=0;
+	int x,y;
+
+	if (ref->w!=pic->w || ref->h!=pic->h) return -1;
+	if (ref->w<SSIM_WINDOW || ref->h<SSIM_WINDOW) return -1;
+	/*8x8 windows overlapping by half*/
+	for(y=0;y+SSIM_WINDOW<=ref->h;y+=SSIM_STEP){
+		for(x=0;x+SSIM_WINDOW<=ref->w;x+=SSIM_STEP){
+			SsimSums s;
+			double n=SSIM_WINDOW*SSIM_WINDOW;
+			double mua,mub,vara,varb,cov;
+			ssim_window_sums(ref->planes[0]+y*ref->strides[0]+x,ref->strides[0],pic->planes[0]+y*pic->strides[0]+x,pic->strides[0],&s);
+			mua=s.sa/n;
+			mub=s.sb/n;
+			vara=s.saa/n-mua*mua;
+			varb=s.sbb/n-mub*mub;
+			cov=s.sab/n-mua*mub;
+			sum+=((2*mua*mub+SSIM_C1)*(2*cov+SSIM_C2))/((mua*mua+mub*mub+SSIM_C1)*(vara+varb+SSIM_C2));
+			count++;
+		}
+	}
+	return sum/count;
+}
@@ -24,6 +24,83 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define TYPE_FU_A 28    /*fragmented unit 0x1C*/
 #define TYPE_STAP_A 24  /*single time aggregation packet  0x18*/
 
+#define FUA_POOL_MAX_BUFFERS 4 /*enough for the NALs of a frame held by the decoder, and the one being reassembled*/
+
+#define FUA_CONTEXT_BUCKETS 64
+
+/*
+ * The fragments of a FU-A NAL are copied as they arrive into a buffer sized after the previous NAL, grown when needed.
+ * The buffers are taken from a small pool, and return to it when the decoder frees the NAL.
+ * This state is kept out of the public Rfc3984Context, so that plugins embedding it keep working: it is found from
+ * the context in a table that rfc3984_init() and rfc3984_uninit() fill and empty.
+ */
+typedef struct _Rfc3984FuaContext{
+	const Rfc3984Context *owner;
+	queue_t pool;
+	int size_hint; /*size of the last reassembled NAL*/
+} Rfc3984FuaContext;
+
+static MSList *fua_contexts[FUA_CONTEXT_BUCKETS];
+static ms_mutex_t fua_contexts_lock;
+static ms_once_t fua_contexts_once=MS_ONCE_INIT;
+
+static void fua_contexts_init_lock(void){
+	ms_mutex_init(&fua_contexts_lock,NULL);
+}
+
+static MSList **fua_contexts_bucket(const Rfc3984Context *ctx){
+	return &fua_contexts[((uintptr_t)ctx/sizeof(void*))%FUA_CONTEXT_BUCKETS];
+}
+
+/*call with the lock held*/
+static MSList *fua_contexts_find(MSList *bucket, const Rfc3984Context *ctx){
+	for(;bucket!=NULL;bucket=bucket->next){
+		if (((Rfc3984FuaContext*)bucket->data)->owner==ctx) return bucket;
+	}
+	return NULL;
+}
+
+/*get the FU-A state of the context, created if needed*/
+static Rfc3984FuaContext *fua_context_get(const Rfc3984Context *ctx){
+	MSList **bucket=fua_contexts_bucket(ctx);
+	MSList *elem;
+	Rfc3984FuaContext *fua;
+
+	ms_once(&fua_contexts_once,fua_contexts_init_lock);
+	ms_mutex_lock(&fua_contexts_lock);
+	elem=fua_contexts_find(*bucket,ctx);
+	if (elem!=NULL){
+		fua=(Rfc3984FuaContext*)elem->data;
+	}else{
+		fua=ms_new0(Rfc3984FuaContext,1);
+		fua->owner=ctx;
+		qinit(&fua->pool);
+		*bucket=ms_list_prepend(*bucket,fua);
+	}
+	ms_mutex_unlock(&fua_contexts_lock);
+	return fua;
+}
+
+static void fua_context_release(const Rfc3984Context *ctx){
+	MSList **bucket=fua_contexts_bucket(ctx);
+	MSList *elem;
+	Rfc3984FuaContext *fua=NULL;
+
+	ms_once(&fua_contexts_once,fua_contexts_init_lock);
+	ms_mutex_lock(&fua_contexts_lock);
+	elem=fua_contexts_find(*bucket,ctx);
+	if (elem!=NULL){
+		fua=(Rfc3984FuaContext*)elem->data;
+		*bucket=ms_list_remove_link(*bucket,elem);
+	}
+	ms_mutex_unlock(&fua_contexts_lock);
+	if (fua){
+		/*NALs still in use by the caller keep their own reference on the buffers*/
+		flushq(&fua->pool,0);
+		ms_free(fua);
+	}
+}
+
 
 static MS2_INLINE void nal_header_init(uint8_t *h, uint8_t nri, uint8_t type){
 	*h=((nri&0x3)<<5) | (type & ((1<<5)-1));
@@ -51,6 +128,9 @@ void rfc3984_destroy(Rfc3984Context *ctx){
 void rfc3984_init(Rfc3984Context *ctx){
 	ms_queue_init(&ctx->q);
 	ctx->m=NULL;
+	/*a context reinitialized without rfc3984_uninit() starts with an empty pool*/
+	fua_context_release(ctx);
+	fua_context_get(ctx);
 	ctx->maxsz=ms_get_payload_max_size();
 	ctx->mode=0;
 	ctx->last_ts=0x943FEA43;/*some random value*/
@@ -200,17 +280,71 @@ static void rfc3984_pack_mode_1(Rfc3984Context *ctx, MSQueue *naluq, MSQueue *rt
 	}
 }
 
+/*take a free buffer of the pool, of at least size bytes but not much more; the pool is replenished up to its limit*/
+static mblk_t *fua_pool_alloc(queue_t *pool, int size){
+	mblk_t *m,*found=NULL,*unfit=NULL;
+
+	for(m=qbegin(pool);!qend(pool,m);m=qnext(pool,m)){
+		if (m->b_datap->db_ref==1){
+			int capacity=(int)(m->b_datap->db_lim-m->b_datap->db_base);
+			if (capacity>=size && capacity<=2*size){
+				found=m;
+				break;
+			}
+			unfit=m;
+		}
+	}
+	if (found==NULL){
+		if (unfit!=NULL){
+			remq(pool,unfit);
+			freemsg(unfit);
+		}
+		/*when all the buffers are held by the decoder, the NAL is not pooled*/
+		if (pool->q_mcount>=FUA_POOL_MAX_BUFFERS) return allocb(size,0);
+		found=allocb(size,0);
+		putq(pool,found);
+	}
+	return dupb(found);
+}
+
+/*copy a fragment, without its FU indicator and header, at the end of the NAL being reassembled*/
+static void fua_append(Rfc3984Context *ctx, Rfc3984FuaContext *fua, mblk_t *im){
+	int len=(int)(im->b_wptr-im->b_rptr);
+	mblk_t *om=ctx->m;
+
+	if (om->b_datap->db_lim-om->b_wptr<len){
+		int used=(int)(om->b_wptr-om->b_rptr);
+		int capacity=(int)(om->b_datap->db_lim-om->b_datap->db_base);
+		mblk_t *grown=fua_pool_alloc(&fua->pool,MAX(2*capacity,used+len));
+
+		mblk_meta_copy(om,grown);
+		memcpy(grown->b_wptr,om->b_rptr,used);
+		grown->b_wptr+=used;
+		freemsg(om);
+		ctx->m=om=grown;
+	}
+	memcpy(om->b_wptr,im->b_rptr,len);
+	om->b_wptr+=len;
+	freemsg(im);
+}
+
 static mblk_t * aggregate_fua(Rfc3984Context *ctx, mblk_t *im){
+	Rfc3984FuaContext *fua;
 	mblk_t *om=NULL;
 	uint8_t fu_header;
 	uint8_t nri,type;
 	bool_t start,end;
+	if (im->b_wptr-im->b_rptr<2){
+		ms_error("Malformed FU-A packet");
+		freemsg(im);
+		return NULL;
+	}
+	fua=fua_context_get(ctx);
 	fu_header=im->b_rptr[1];
 	type=nal_header_get_type(&fu_header);
 	start=fu_header>>7;
 	end=(fu_header>>6)&0x1;
 	if (start){
-		mblk_t *new_header;
 		nri=nal_header_get_nri(im->b_rptr);
 		if (ctx->m!=NULL){
 			ms_error("receiving FU-A start while previous FU-A is not "
@@ -219,26 +353,24 @@ static mblk_t * aggregate_fua(Rfc3984Context *ctx, mblk_t *im){
 			ctx->m=NULL;
 		}
 		im->b_rptr+=2; /*skip the nal header and the fu header*/
-		new_header=allocb(1,0); /* allocate small fragment to put the correct nal header, this is to avoid to write on the buffer
-					which can break processing of other users of the buffers */
-		nal_header_init(new_header->b_wptr,nri,type);
-		new_header->b_wptr++;
-		mblk_meta_copy(im,new_header);
-		concatb(new_header,im);
-		ctx->m=new_header;
+		ctx->m=fua_pool_alloc(&fua->pool,MAX(fua->size_hint,(int)(im->b_wptr-im->b_rptr)+1));
+		mblk_meta_copy(im,ctx->m);
+		/*the nal header is rebuilt in the reassembled buffer, the received ones are not written*/
+		nal_header_init(ctx->m->b_wptr++,nri,type);
+		fua_append(ctx,fua,im);
 	}else{
 		if (ctx->m!=NULL){
 			im->b_rptr+=2;
-			concatb(ctx->m,im);
+			fua_append(ctx,fua,im);
 		}else{
 			ms_error("Receiving continuation FU packet but no start.");
 			freemsg(im);
 		}
 	}
 	if (end && ctx->m){
-		msgpullup(ctx->m,-1);
 		om=ctx->m;
 		ctx->m=NULL;
+		fua->size_hint=(int)(om->b_wptr-om->b_rptr);
 	}
 	return om;
 }
@@ -350,6 +482,7 @@ void rfc3984_uninit(Rfc3984Context *ctx){
 	ms_queue_flush(&ctx->q);
 	if (ctx->m) freemsg(ctx->m);
 	ctx->m=NULL;
+	fua_context_release(ctx);
 }
 
 void rfc3984_set_mode(Rfc3984Context *ctx, int mode){
@@ -22,6 +22,192 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/mediastream.h"
 #include "mediastreamer2/dtmfgen.h"
 #include "mediastreamer2/msfileplayer.h"
+#include "tone_cache.h"
+
+
+/*
+ * Plays in loop the samples of a ring file kept in the tone cache, which are shared by all the ring streams
+ * playing the same file in the same format, instead of reading and converting the file for each of them.
+ */
+typedef struct _CachedPlayerData{
+	MSToneCache *cache;
+	char *file;
+	mblk_t *pcm;
+	int rate;
+	int nchannels;
+	int pos; /*bytes*/
+	int loop_after;
+	int pause_time;
+	uint32_t ts;
+	MSPlayerState state;
+} CachedPlayerData;
+
+static void cached_player_init(MSFilter *f){
+	CachedPlayerData *d=ms_new0(CachedPlayerData,1);
+	d->cache=ms_tone_cache_ref();
+	d->loop_after=-1;
+	d->state=MSPlayerClosed;
+	f->data=d;
+}
+
+static void cached_player_uninit(MSFilter *f){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	if (d->pcm) freemsg(d->pcm);
+	if (d->file) ms_free(d->file);
+	ms_tone_cache_unref(d->cache);
+	ms_free(d);
+}
+
+static int cached_player_load(MSFilter *f, const char *file, int rate, int nchannels){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	mblk_t *pcm=ms_tone_cache_get_file(d->cache,file,&rate,&nchannels);
+	if (pcm==NULL) return -1;
+	ms_filter_lock(f);
+	if (d->pcm) freemsg(d->pcm);
+	d->pcm=pcm;
+	d->rate=rate;
+	d->nchannels=nchannels;
+	d->pos=0;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int cached_player_open(MSFilter *f, void *arg){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	const char *file=(const char*)arg;
+	if (cached_player_load(f,file,0,0)!=0) return -1;
+	if (d->file) ms_free(d->file);
+	d->file=ms_strdup(file);
+	d->state=MSPlayerPaused;
+	return 0;
+}
+
+static int cached_player_start(MSFilter *f, void *arg){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	if (d->state==MSPlayerClosed) return -1;
+	d->state=MSPlayerPlaying;
+	return 0;
+}
+
+static int cached_player_loop(MSFilter *f, void *arg){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	d->loop_after=*((int*)arg);
+	return 0;
+}
+
+/*the samples are converted to the requested format once, by the cache*/
+static int cached_player_set_sr(MSFilter *f, void *arg){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	if (d->file==NULL) return -1;
+	return cached_player_load(f,d->file,*((int*)arg),d->nchannels);
+}
+
+static int cached_player_get_sr(MSFilter *f, void *arg){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	*((int*)arg)=d->rate;
+	return 0;
+}
+
+static int cached_player_set_nchannels(MSFilter *f, void *arg){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	if (d->file==NULL) return -1;
+	return cached_player_load(f,d->file,d->rate,*((int*)arg));
+}
+
+static int cached_player_get_nchannels(MSFilter *f, void *arg){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	*((int*)arg)=d->nchannels;
+	return 0;
+}
+
+static void cached_player_process(MSFilter *f){
+	CachedPlayerData *d=(CachedPlayerData*)f->data;
+	int nsamples=(f->ticker->interval*d->rate)/1000;
+	int bytes=nsamples*d->nchannels*2;
+	int size;
+	mblk_t *om;
+
+	ms_filter_lock(f);
+	if (d->state!=MSPlayerPlaying){
+		ms_filter_unlock(f);
+		return;
+	}
+	size=d->pcm->b_wptr-d->pcm->b_rptr;
+	if (d->pause_time>0){
+		om=allocb(bytes,0);
+		memset(om->b_wptr,0,bytes);
+		d->pause_time-=f->ticker->interval;
+	}else if (d->pos+bytes<=size){
+		/*copied, as the filters downstream may modify it in place*/
+		om=allocb(bytes,0);
+		memcpy(om->b_wptr,d->pcm->b_rptr+d->pos,bytes);
+		d->pos+=bytes;
+	}else{
+		om=allocb(bytes,0);
+		memcpy(om->b_wptr,d->pcm->b_rptr+d->pos,size-d->pos);
+		memset(om->b_wptr+size-d->pos,0,bytes-(size-d->pos));
+		d->pos=size;
+	}
+	om->b_wptr=om->b_rptr+bytes;
+	mblk_set_timestamp_info(om,d->ts);
+	d->ts+=nsamples;
+	ms_queue_put(f->outputs[0],om);
+	if (d->pos>=size){
+		ms_filter_notify_no_arg(f,MS_PLAYER_EOF);
+		/*for compatibility:*/
+		ms_filter_notify_no_arg(f,MS_FILE_PLAYER_EOF);
+		d->pos=0;
+		/* special value for playing file only once */
+		if (d->loop_after<0) d->state=MSPlayerPaused;
+		else d->pause_time=d->loop_after;
+	}
+	ms_filter_unlock(f);
+}
+
+static MSFilterMethod cached_player_methods[]={
+	{	MS_FILTER_SET_SAMPLE_RATE,	cached_player_set_sr	},
+	{	MS_FILTER_GET_SAMPLE_RATE,	cached_player_get_sr	},
+	{	MS_FILTER_SET_NCHANNELS,	cached_player_set_nchannels	},
+	{	MS_FILTER_GET_NCHANNELS,	cached_player_get_nchannels	},
+	{	MS_PLAYER_OPEN,	cached_player_open	},
+	{	MS_PLAYER_START,	cached_player_start	},
+	{	MS_PLAYER_SET_LOOP,	cached_player_loop	},
+	{	0,	NULL	}
+};
+
+#ifdef _MSC_VER
+
+static MSFilterDesc cached_player_desc={
+	MS_FILTER_PLUGIN_ID,
+	"MSCachedPlayer",
+	"Ring file player sharing its samples with the tone cache",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	1,
+	cached_player_init,
+	NULL,
+	cached_player_process,
+	NULL,
+	cached_player_uninit,
+	cached_player_methods
+};
+
+#else
+
+static MSFilterDesc cached_player_desc={
+	.id=MS_FILTER_PLUGIN_ID,
+	.name="MSCachedPlayer",
+	.text="Ring file player sharing its samples with the tone cache",
+	.category=MS_FILTER_OTHER,
+	.noutputs=1,
+	.init=cached_player_init,
+	.process=cached_player_process,
+	.uninit=cached_player_uninit,
+	.methods=cached_player_methods
+};
+
+#endif
 
 
 static void ring_player_event_handler(void *ud, MSFilter *f, unsigned int evid, void *arg){
@@ -53,18 +239,33 @@ RingStream * ring_start_with_cb(const char *file,int interval,MSSndCard *sndcard
 	MSTickerParams params={0};
 
 	stream=(RingStream *)ms_new0(RingStream,1);
-	stream->source=ms_filter_new(MS_FILE_PLAYER_ID);
-	ms_filter_add_notify_callback(stream->source,ring_player_event_handler,stream,TRUE);
-	if (func!=NULL)
-		ms_filter_add_notify_callback(stream->source,func,user_data,FALSE);
 	stream->gendtmf=ms_filter_new(MS_DTMF_GEN_ID);
 	stream->sndwrite=ms_snd_card_create_writer(sndcard);
-	stream->write_resampler=ms_filter_new(MS_RESAMPLE_ID);
-	
+
 	if (file){
-		ms_filter_call_method(stream->source,MS_FILE_PLAYER_OPEN,(void*)file);
-		ms_filter_call_method(stream->source,MS_FILE_PLAYER_LOOP,&interval);
-		ms_filter_call_method_noarg(stream->source,MS_FILE_PLAYER_START);
+		/*the samples of the file are shared by all the ring streams, unless the cache cannot handle the file*/
+		stream->source=ms_filter_new_from_desc(&cached_player_desc);
+		if (ms_filter_call_method(stream->source,MS_PLAYER_OPEN,(void*)file)==0){
+			if (func!=NULL)
+				ms_filter_add_notify_callback(stream->source,func,user_data,FALSE);
+			ms_filter_call_method(stream->source,MS_PLAYER_SET_LOOP,&interval);
+			ms_filter_call_method_noarg(stream->source,MS_PLAYER_START);
+		}else{
+			ms_filter_destroy(stream->source);
+			stream->source=NULL;
+		}
+	}
+	if (stream->source==NULL){
+		stream->write_resampler=ms_filter_new(MS_RESAMPLE_ID);
+		stream->source=ms_filter_new(MS_FILE_PLAYER_ID);
+		ms_filter_add_notify_callback(stream->source,ring_player_event_handler,stream,TRUE);
+		if (func!=NULL)
+			ms_filter_add_notify_callback(stream->source,func,user_data,FALSE);
+		if (file){
+			ms_filter_call_method(stream->source,MS_FILE_PLAYER_OPEN,(void*)file);
+			ms_filter_call_method(stream->source,MS_FILE_PLAYER_LOOP,&interval);
+			ms_filter_call_method_noarg(stream->source,MS_FILE_PLAYER_START);
+		}
 	}
 	
 	/*configure sound outputfilter*/
@@ -74,14 +275,31 @@ RingStream * ring_start_with_cb(const char *file,int interval,MSSndCard *sndcard
 	ms_filter_call_method(stream->sndwrite,MS_FILTER_GET_SAMPLE_RATE,&dstrate);
 	ms_filter_call_method(stream->sndwrite,MS_FILTER_SET_NCHANNELS,&srcchannels);
 	ms_filter_call_method(stream->sndwrite,MS_FILTER_GET_NCHANNELS,&dstchannels);
+
+	if (stream->source->desc==&cached_player_desc){
+		/*let the cache convert the samples to the format of the sound card*/
+		if (srcrate!=dstrate) ms_filter_call_method(stream->source,MS_FILTER_SET_SAMPLE_RATE,&dstrate);
+		if (srcchannels!=dstchannels) ms_filter_call_method(stream->source,MS_FILTER_SET_NCHANNELS,&dstchannels);
+		ms_filter_call_method(stream->source,MS_FILTER_GET_SAMPLE_RATE,&srcrate);
+		ms_filter_call_method(stream->source,MS_FILTER_GET_NCHANNELS,&srcchannels);
+		if (srcrate!=dstrate || srcchannels!=dstchannels){
+			stream->write_resampler=ms_filter_new(MS_RESAMPLE_ID);
+			if (stream->write_resampler){
+				ms_filter_call_method(stream->write_resampler,MS_FILTER_SET_SAMPLE_RATE,&srcrate);
+				ms_filter_call_method(stream->write_resampler,MS_FILTER_SET_NCHANNELS,&srcchannels);
+			}
+		}
+		ms_filter_call_method(stream->gendtmf,MS_FILTER_SET_SAMPLE_RATE,&srcrate);
+		ms_filter_call_method(stream->gendtmf,MS_FILTER_SET_NCHANNELS,&srcchannels);
+	}
 	
 	/*configure output of resampler*/
 	if (stream->write_resampler){
 		ms_filter_call_method(stream->write_resampler,MS_FILTER_SET_OUTPUT_SAMPLE_RATE,&dstrate);
 		ms_filter_call_method(stream->write_resampler,MS_FILTER_SET_OUTPUT_NCHANNELS,&dstchannels);
 	
-		/*the input of the resampler, as well as dtmf generator are configured within the ring_player_event_handler()
-		 * callback triggered during the open of the file player*/
+		/*with the file player, the input of the resampler, as well as dtmf generator are configured within the
+		 * ring_player_event_handler() callback triggered during the open of the file player*/
 	
 		ms_message("configuring resampler output to rate=[%i], nchannels=[%i]",dstrate,dstchannels);
 	}
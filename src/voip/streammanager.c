@@ -0,0 +1,338 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2010  Belledonne Communications SARL (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "mediastreamer-config.h"
+#endif
+
+#include "mediastreamer2/msstreammanager.h"
+
+#ifdef __linux
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define HAVE_EPOLL 1
+#endif
+
+#define STREAM_INTERVAL 1000 /*ms, the period of the quality indicator and bitrate controller updates*/
+#define ICE_RUNNING_INTERVAL 20 /*ms, the default pacing of ICE checks*/
+#define ICE_COMPLETED_INTERVAL 200 /*ms, for keepalives and retransmissions once ICE has completed*/
+#define RTCP_READ_DELAY 20 /*ms, for the ticker to read a RTCP packet and queue its event*/
+#define MAX_EVENTS 64
+
+/*
+ * The streams are kept in a binary heap ordered by the time they are due. Iterating the manager only
+ * visits the streams that are due, and waiting sleeps until the first of them is.
+ */
+typedef struct _MSManagedStream {
+	MSStreamManager *manager;
+	MediaStream *stream;
+	uint64_t due; /*ms*/
+	int index; /*in the heap*/
+	int rtcp_fd; /*the socket watched for RTCP, -1 if none*/
+} MSManagedStream;
+
+struct _MSStreamManager {
+	MSManagedStream **heap;
+	int count;
+	int size;
+	int epfd;
+	int evfd;
+	MSStreamManagerStats stats;
+	MSManagedStream *current; /*the stream being iterated, cleared if it is removed meanwhile*/
+	volatile bool_t woken;
+};
+
+static void heap_swap(MSStreamManager *obj, int i, int j) {
+	MSManagedStream *tmp = obj->heap[i];
+	obj->heap[i] = obj->heap[j];
+	obj->heap[j] = tmp;
+	obj->heap[i]->index = i;
+	obj->heap[j]->index = j;
+}
+
+static void heap_up(MSStreamManager *obj, int i) {
+	while (i > 0 && obj->heap[(i - 1) / 2]->due > obj->heap[i]->due) {
+		heap_swap(obj, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_down(MSStreamManager *obj, int i) {
+	for (;;) {
+		int smallest = i, child = 2 * i + 1;
+		if (child < obj->count && obj->heap[child]->due < obj->heap[smallest]->due) smallest = child;
+		child++;
+		if (child < obj->count && obj->heap[child]->due < obj->heap[smallest]->due) smallest = child;
+		if (smallest == i) return;
+		heap_swap(obj, i, smallest);
+		i = smallest;
+	}
+}
+
+static MSManagedStream *stream_manager_find(MSStreamManager *obj, MediaStream *stream) {
+	MSManagedStream *ms = stream->managed;
+	return (ms != NULL && ms->manager == obj) ? ms : NULL;
+}
+
+static void stream_manager_set_due(MSStreamManager *obj, MSManagedStream *ms, uint64_t due) {
+	uint64_t prev = ms->due;
+	ms->due = due;
+	if (due < prev) heap_up(obj, ms->index);
+	else heap_down(obj, ms->index);
+}
+
+/*
+ * Watches the RTCP socket of the stream, which may have been recreated since it was last iterated.
+ * With rtcp-mux the RTCP packets come on the RTP socket, which is not watched since every RTP packet would wake
+ * the manager: such a stream only gets its RTCP processed at its next periodic iteration.
+ */
+static void stream_manager_watch_rtcp(MSStreamManager *obj, MSManagedStream *ms) {
+#ifdef HAVE_EPOLL
+	RtpSession *session = ms->stream->sessions.rtp_session;
+	int fd = session ? (int)rtp_session_get_rtcp_socket(session) : -1;
+
+	if (obj->epfd == -1) return;
+	if (fd != -1 && fd == (int)rtp_session_get_rtp_socket(session)) fd = -1;
+	if (fd == ms->rtcp_fd) return;
+	if (ms->rtcp_fd != -1) epoll_ctl(obj->epfd, EPOLL_CTL_DEL, ms->rtcp_fd, NULL);
+	ms->rtcp_fd = -1;
+	if (fd != -1) {
+		struct epoll_event ev = {0};
+		/*edge triggered, the socket is read by the ticker*/
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = ms;
+		if (epoll_ctl(obj->epfd, EPOLL_CTL_ADD, fd, &ev) == 0) ms->rtcp_fd = fd;
+		else ms_warning("MSStreamManager: cannot watch RTCP socket of stream [%p]: %s", ms->stream, strerror(errno));
+	}
+#endif
+}
+
+static void stream_manager_unwatch_rtcp(MSStreamManager *obj, MSManagedStream *ms) {
+#ifdef HAVE_EPOLL
+	if (ms->rtcp_fd != -1 && obj->epfd != -1) epoll_ctl(obj->epfd, EPOLL_CTL_DEL, ms->rtcp_fd, NULL);
+#endif
+	ms->rtcp_fd = -1;
+}
+
+static int stream_interval(MediaStream *stream) {
+	IceCheckList *cl = stream->ice_check_list;
+	if (cl != NULL && cl->session != NULL && cl->session->state != IS_Stopped && cl->session->state != IS_Failed) {
+		if (cl->state == ICL_Running || cl->gathering_candidates) return ICE_RUNNING_INTERVAL;
+		return ICE_COMPLETED_INTERVAL;
+	}
+	return STREAM_INTERVAL;
+}
+
+static void stream_iterate(MediaStream *stream) {
+	switch (stream->type) {
+		case MSAudio:
+			audio_stream_iterate((AudioStream *)stream);
+			break;
+#ifdef VIDEO_ENABLED
+		case MSVideo:
+			video_stream_iterate((VideoStream *)stream);
+			break;
+#endif
+		default:
+			media_stream_iterate(stream);
+			break;
+	}
+}
+
+/* Without a way to watch the sockets, sleeps by small steps to react to ms_stream_manager_wakeup(). */
+static int stream_manager_sleep(MSStreamManager *obj, int timeout) {
+	if (timeout < 0) timeout = STREAM_INTERVAL;
+	while (timeout > 0 && !obj->woken) {
+		int step = MIN(timeout, 10);
+		ms_usleep(step * 1000);
+		timeout -= step;
+	}
+	if (obj->woken) {
+		obj->woken = FALSE;
+		return 1;
+	}
+	return 0;
+}
+
+/* Takes the pending events of the sockets, waiting for them at most timeout ms. Returns the number of events. */
+static int stream_manager_poll(MSStreamManager *obj, int timeout) {
+#ifdef HAVE_EPOLL
+	struct epoll_event events[MAX_EVENTS];
+	uint64_t now;
+	int i, n;
+
+	if (obj->epfd == -1) return stream_manager_sleep(obj, timeout);
+	n = epoll_wait(obj->epfd, events, MAX_EVENTS, timeout);
+	if (n <= 0) return 0;
+	now = ms_get_cur_time_ms();
+	for (i = 0; i < n; i++) {
+		MSManagedStream *ms = (MSManagedStream *)events[i].data.ptr;
+		if (ms == NULL) {
+			uint64_t value;
+			if (read(obj->evfd, &value, sizeof(value)) != sizeof(value)) ms_warning("MSStreamManager: cannot read eventfd");
+			continue;
+		}
+		obj->stats.rtcp_wakeups++;
+		if (ms->due > now + RTCP_READ_DELAY) stream_manager_set_due(obj, ms, now + RTCP_READ_DELAY);
+	}
+	return n;
+#else
+	return stream_manager_sleep(obj, timeout);
+#endif
+}
+
+MSStreamManager *ms_stream_manager_new(void) {
+	MSStreamManager *obj = ms_new0(MSStreamManager, 1);
+	obj->epfd = -1;
+	obj->evfd = -1;
+#ifdef HAVE_EPOLL
+	obj->epfd = epoll_create1(EPOLL_CLOEXEC);
+	obj->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (obj->epfd == -1 || obj->evfd == -1) {
+		/*the streams are then iterated on their timers only*/
+		ms_error("MSStreamManager: cannot create epoll or eventfd, RTCP packets are not watched: %s", strerror(errno));
+		if (obj->epfd != -1) close(obj->epfd);
+		if (obj->evfd != -1) close(obj->evfd);
+		obj->epfd = -1;
+		obj->evfd = -1;
+	} else {
+		struct epoll_event ev = {0};
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		epoll_ctl(obj->epfd, EPOLL_CTL_ADD, obj->evfd, &ev);
+	}
+#endif
+	return obj;
+}
+
+void ms_stream_manager_destroy(MSStreamManager *obj) {
+	int i;
+	for (i = 0; i < obj->count; i++) {
+		stream_manager_unwatch_rtcp(obj, obj->heap[i]);
+		obj->heap[i]->stream->managed = NULL;
+		ms_free(obj->heap[i]);
+	}
+	if (obj->heap) ms_free(obj->heap);
+	if (obj->evfd != -1) close(obj->evfd);
+	if (obj->epfd != -1) close(obj->epfd);
+	ms_free(obj);
+}
+
+void ms_stream_manager_add(MSStreamManager *obj, MediaStream *stream) {
+	MSManagedStream *ms;
+
+	if (stream->managed != NULL) {
+		ms_warning("MSStreamManager: stream [%p] is already managed", stream);
+		return;
+	}
+	if (obj->count == obj->size) {
+		obj->size = obj->size ? obj->size * 2 : 64;
+		obj->heap = ms_realloc(obj->heap, obj->size * sizeof(MSManagedStream *));
+	}
+	ms = ms_new0(MSManagedStream, 1);
+	ms->manager = obj;
+	ms->stream = stream;
+	stream->managed = ms;
+	ms->due = ms_get_cur_time_ms();
+	ms->rtcp_fd = -1;
+	ms->index = obj->count;
+	obj->heap[obj->count++] = ms;
+	heap_up(obj, ms->index);
+	stream_manager_watch_rtcp(obj, ms);
+}
+
+void ms_stream_manager_remove(MSStreamManager *obj, MediaStream *stream) {
+	MSManagedStream *ms = stream_manager_find(obj, stream);
+	int i;
+
+	if (ms == NULL) {
+		ms_warning("MSStreamManager: stream [%p] is not managed", stream);
+		return;
+	}
+	stream_manager_unwatch_rtcp(obj, ms);
+	if (ms == obj->current) obj->current = NULL;
+	i = ms->index;
+	obj->count--;
+	if (i != obj->count) {
+		heap_swap(obj, i, obj->count);
+		heap_down(obj, i);
+		heap_up(obj, i);
+	}
+	stream->managed = NULL;
+	ms_free(ms);
+}
+
+void ms_stream_manager_schedule(MSStreamManager *obj, MediaStream *stream) {
+	MSManagedStream *ms = stream_manager_find(obj, stream);
+	if (ms != NULL) stream_manager_set_due(obj, ms, ms_get_cur_time_ms());
+}
+
+int ms_stream_manager_iterate(MSStreamManager *obj) {
+	uint64_t now;
+
+	stream_manager_poll(obj, 0);
+	now = ms_get_cur_time_ms();
+	while (obj->count > 0 && obj->heap[0]->due <= now) {
+		MSManagedStream *ms = obj->heap[0];
+		/*the callbacks run by the iteration may add, schedule or remove streams, this one included*/
+		obj->current = ms;
+		stream_iterate(ms->stream);
+		obj->stats.iterations++;
+		if (obj->current == NULL) continue;
+		obj->current = NULL;
+		stream_manager_watch_rtcp(obj, ms);
+		stream_manager_set_due(obj, ms, now + stream_interval(ms->stream));
+	}
+	if (obj->count == 0) return -1;
+	return (int)(obj->heap[0]->due - now);
+}
+
+void ms_stream_manager_wait(MSStreamManager *obj, int timeout_ms) {
+	int delay = -1;
+
+	if (obj->count > 0) {
+		uint64_t now = ms_get_cur_time_ms();
+		delay = obj->heap[0]->due > now ? (int)(obj->heap[0]->due - now) : 0;
+	}
+	if (timeout_ms >= 0 && (delay < 0 || timeout_ms < delay)) delay = timeout_ms;
+	if (delay != 0 && stream_manager_poll(obj, delay) > 0) obj->stats.wakeups++;
+}
+
+void ms_stream_manager_wakeup(MSStreamManager *obj) {
+#ifdef HAVE_EPOLL
+	uint64_t value = 1;
+	if (obj->evfd != -1) {
+		if (write(obj->evfd, &value, sizeof(value)) != sizeof(value)) ms_warning("MSStreamManager: cannot write eventfd");
+		return;
+	}
+#endif
+	obj->woken = TRUE;
+}
+
+int ms_stream_manager_get_fd(const MSStreamManager *obj) {
+	return obj->epfd;
+}
+
+const MSStreamManagerStats *ms_stream_manager_get_stats(const MSStreamManager *obj) {
+	return &obj->stats;
+}
+
+int ms_stream_manager_get_stream_count(const MSStreamManager *obj) {
+	return obj->count;
+}
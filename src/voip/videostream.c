@@ -1096,6 +1096,7 @@ static int video_stream_start_with_source_and_output(VideoStream *stream, RtpPro
 	if (stream->ms.sessions.ticker==NULL) media_stream_start_ticker(&stream->ms);
 
 	stream->ms.start_time=ms_time(NULL);
+	stream->ms.start_time_ms=ms_get_cur_time_ms();
 	stream->last_fps_check=(uint64_t)-1;
 	stream->ms.is_beginning=TRUE;
 
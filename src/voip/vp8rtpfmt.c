@@ -898,6 +898,13 @@ void vp8rtpfmt_unpacker_init(Vp8RtpFmtUnpackerCtx *ctx, MSFilter *f, bool_t avpf
 	ctx->error_notified = FALSE;
 	ctx->initialized_last_ts = FALSE;
 	ctx->initialized_ref_cseq = FALSE;
+	ctx->pending_cseq_inconsistency = FALSE;
+	ctx->max_temporal_layer = -1;
+}
+
+/* Packets of the temporal layers above max_temporal_layer are dropped, as a forwarding server would do. -1 keeps all the layers. */
+void vp8rtpfmt_unpacker_set_max_temporal_layer(Vp8RtpFmtUnpackerCtx *ctx, int max_temporal_layer) {
+	ctx->max_temporal_layer = max_temporal_layer;
 }
 
 void vp8rtpfmt_unpacker_uninit(Vp8RtpFmtUnpackerCtx *ctx) {
@@ -932,6 +939,17 @@ void vp8rtpfmt_unpacker_feed(Vp8RtpFmtUnpackerCtx *ctx, MSQueue *in) {
 				ctx->ref_cseq=cseq;
 			}
 		}
+		if ((packet->error == Vp8RtpFmtOk) && (ctx->max_temporal_layer >= 0) && (packet->pd->tid_present == TRUE)
+			&& (packet->pd->tid > ctx->max_temporal_layer)) {
+			/* The sequence gap left by the dropped packet is not a loss, but a loss detected on it must be reported on the next kept packet. */
+			if (packet->cseq_inconsistency) ctx->pending_cseq_inconsistency = TRUE;
+			free_packet(packet);
+			continue;
+		}
+		if (ctx->pending_cseq_inconsistency) {
+			packet->cseq_inconsistency = TRUE;
+			ctx->pending_cseq_inconsistency = FALSE;
+		}
 		packets_list=ms_list_append(packets_list,packet);
 	}
 	generate_frames_list(ctx, packets_list);
@@ -962,7 +980,7 @@ static void packer_process_frame_part(void *p, void *c) {
 	mblk_t *dm = NULL;
 	uint8_t *rptr;
 	uint8_t pdsize = 1;
-	int max_size = ms_get_payload_max_size();
+	int max_size = ctx->max_payload_size;
 	int dlen;
 	bool_t marker_info = mblk_get_marker_info(packet->m);
 
@@ -1014,7 +1032,7 @@ static void packer_process_frame_part(void *p, void *c) {
 		}
 		if ((packet->pd->tid_present == TRUE) || (packet->pd->keyidx_present == TRUE)) {
 			if (packet->pd->tid_present == TRUE) {
-				*pdm->b_wptr |= (packet->pd->tid & 0xC0);
+				*pdm->b_wptr |= ((packet->pd->tid << 6) & 0xC0);
 				if (packet->pd->layer_sync == TRUE) *pdm->b_wptr |= (1 << 5);
 			}
 			if (packet->pd->keyidx_present == TRUE) {
@@ -1044,11 +1062,16 @@ static void packer_process_frame_part(void *p, void *c) {
 
 
 void vp8rtpfmt_packer_init(Vp8RtpFmtPackerCtx *ctx) {
+	ctx->max_payload_size = ms_get_payload_max_size();
 }
 
 void vp8rtpfmt_packer_uninit(Vp8RtpFmtPackerCtx *ctx) {
 }
 
+void vp8rtpfmt_packer_set_max_payload_size(Vp8RtpFmtPackerCtx *ctx, int size) {
+	ctx->max_payload_size = size;
+}
+
 void vp8rtpfmt_packer_process(Vp8RtpFmtPackerCtx *ctx, MSList *in, MSQueue *out) {
 	ctx->output_queue = out;
 	ms_list_for_each2(in, packer_process_frame_part, ctx);
@@ -106,6 +106,7 @@ extern "C"{
 		MSVideoSize video_size;
 		uint32_t last_ts;
 		uint16_t ref_cseq;
+		int max_temporal_layer;
 		bool_t avpf_enabled;
 		bool_t freeze_on_error;
 		bool_t output_partitions;
@@ -114,19 +115,23 @@ extern "C"{
 		bool_t valid_keyframe_received;
 		bool_t initialized_last_ts;
 		bool_t initialized_ref_cseq;
+		bool_t pending_cseq_inconsistency;
 	} Vp8RtpFmtUnpackerCtx;
 
 	typedef struct Vp8RtpFmtPackerCtx {
 		MSQueue *output_queue;
+		int max_payload_size;
 	} Vp8RtpFmtPackerCtx;
 
 
 	void vp8rtpfmt_packer_init(Vp8RtpFmtPackerCtx *ctx);
 	void vp8rtpfmt_packer_uninit(Vp8RtpFmtPackerCtx *ctx);
+	void vp8rtpfmt_packer_set_max_payload_size(Vp8RtpFmtPackerCtx *ctx, int size);
 	void vp8rtpfmt_packer_process(Vp8RtpFmtPackerCtx *ctx, MSList *in, MSQueue *out);
 
 	void vp8rtpfmt_unpacker_init(Vp8RtpFmtUnpackerCtx *ctx, MSFilter *f, bool_t avpf_enabled, bool_t freeze_on_error, bool_t output_partitions);
 	void vp8rtpfmt_unpacker_uninit(Vp8RtpFmtUnpackerCtx *ctx);
+	void vp8rtpfmt_unpacker_set_max_temporal_layer(Vp8RtpFmtUnpackerCtx *ctx, int max_temporal_layer);
 	void vp8rtpfmt_unpacker_feed(Vp8RtpFmtUnpackerCtx *ctx, MSQueue *in);
 	int vp8rtpfmt_unpacker_get_frame(Vp8RtpFmtUnpackerCtx *ctx, MSQueue *out, Vp8RtpFmtFrameInfo *frame_info);
 	uint32_t vp8rtpfmt_unpacker_calc_extended_cseq(Vp8RtpFmtUnpackerCtx *ctx, uint16_t cseq);
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/msfileplayer.h"
 #include "mediastreamer2/msfilerec.h"
 #include "mediastreamer2/msrtp.h"
+#include "mediastreamer2/msstreammanager.h"
 #include "mediastreamer2/mstonedetector.h"
 #include "mediastreamer2_tester.h"
 #include "mediastreamer2_tester_private.h"
@@ -551,6 +552,57 @@ static void audio_stream_dtmf(int codec_payload, int initial_bitrate,int target_
 }
 #endif
 
+#define MANAGED_STREAMS 3
+#define MANAGED_STREAMS_RTP_PORT 5300
+
+typedef struct _managed_stream_t {
+	MSStreamManager *manager;
+	AudioStream *stream;
+	int iterations;
+	bool_t remove;
+} managed_stream_t;
+
+static void managed_stream_event_cb(const OrtpEventData *evd, void *user_data) {
+	managed_stream_t *ctx = (managed_stream_t *)user_data;
+	ctx->iterations++;
+	if (ctx->remove) ms_stream_manager_remove(ctx->manager, &ctx->stream->ms);
+}
+
+/*
+ * A stream removed from the manager by a callback run while it is iterated shall not be touched any more, and the
+ * other streams shall still be iterated.
+ */
+static void stream_manager_remove_while_iterating(void) {
+	MSStreamManager *manager = ms_stream_manager_new();
+	managed_stream_t streams[MANAGED_STREAMS];
+	int i, round;
+
+	memset(streams, 0, sizeof(streams));
+	for (i = 0; i < MANAGED_STREAMS; i++) {
+		streams[i].manager = manager;
+		streams[i].stream = audio_stream_new2(MARIELLE_IP, MANAGED_STREAMS_RTP_PORT + 2 * i, MANAGED_STREAMS_RTP_PORT + 2 * i + 1);
+		streams[i].remove = (i == 1);
+		ortp_ev_dispatcher_connect(media_stream_get_event_dispatcher(&streams[i].stream->ms), ORTP_EVENT_ICE_GATHERING_FINISHED, 0,
+			managed_stream_event_cb, &streams[i]);
+		ms_stream_manager_add(manager, &streams[i].stream->ms);
+	}
+	for (round = 0; round < 2; round++) {
+		for (i = 0; i < MANAGED_STREAMS; i++) {
+			rtp_session_dispatch_event(streams[i].stream->ms.sessions.rtp_session, ortp_event_new(ORTP_EVENT_ICE_GATHERING_FINISHED));
+			if (streams[i].stream->ms.managed != NULL) ms_stream_manager_schedule(manager, &streams[i].stream->ms);
+		}
+		ms_stream_manager_iterate(manager);
+	}
+	BC_ASSERT_EQUAL(ms_stream_manager_get_stream_count(manager), MANAGED_STREAMS - 1, int, "%d");
+	for (i = 0; i < MANAGED_STREAMS; i++) {
+		BC_ASSERT_EQUAL(streams[i].iterations, streams[i].remove ? 1 : 2, int, "%d");
+		if (!streams[i].remove) ms_stream_manager_remove(manager, &streams[i].stream->ms);
+		audio_stream_stop(streams[i].stream);
+	}
+	BC_ASSERT_EQUAL(ms_stream_manager_get_stream_count(manager), 0, int, "%d");
+	ms_stream_manager_destroy(manager);
+}
+
 
 static test_t tests[] = {
 	{ "Basic audio stream", basic_audio_stream },
@@ -563,7 +615,8 @@ static test_t tests[] = {
 	{ "Encrypted audio stream, encryption mandatory", encrypted_audio_stream_encryption_mandatory },
 	{ "Encrypted audio stream with key change + encryption mandatory", encrypted_audio_stream_with_key_change_encryption_mandatory},
 	{ "Codec change for audio stream", codec_change_for_audio_stream },
-	{ "TMMBR feedback for audio stream", tmmbr_feedback_for_audio_stream }
+	{ "TMMBR feedback for audio stream", tmmbr_feedback_for_audio_stream },
+	{ "Stream manager with a stream removed while iterating", stream_manager_remove_while_iterating }
 };
 
 test_suite_t audio_stream_test_suite = {
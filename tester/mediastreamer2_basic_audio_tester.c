@@ -19,14 +19,23 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 
 #include "mediastreamer2/mediastream.h"
+#include "mediastreamer2/msasyncfilerec.h"
 #include "mediastreamer2/dtmfgen.h"
+#include "mediastreamer2/mschanadapter.h"
+#include "mediastreamer2/flowcontrol.h"
 #include "mediastreamer2/msfileplayer.h"
 #include "mediastreamer2/msfilerec.h"
 #include "mediastreamer2/msrtp.h"
 #include "mediastreamer2/mstonedetector.h"
+#include "mediastreamer2/msutils.h"
 #include "mediastreamer2_tester.h"
 #include "mediastreamer2_tester_private.h"
 #include "private.h"
+#include "audio_playout.h"
+#include "waveheader.h"
+
+#include <math.h>
+#include <sys/stat.h>
 
 static int basic_audio_tester_before_all(void) {
 	ms_init();
@@ -254,6 +263,729 @@ static void dtmfgen_filerec_fileplay_tonedet(void) {
     free(recorded_file);
 }
 
+#define ASYNC_FILEREC_FILE_NAME "async_filerec_file.wav"
+#define ASYNC_FILEREC_OGG_FILE_NAME "async_filerec_file.ogg"
+
+/*record the tones with the asynchronous recorder, whose headers are written every 500ms*/
+static void async_filerec_record(const char *recorded_file, MSAsyncFileRecStats *stats) {
+	MSConnectionHelper h;
+	unsigned int filter_mask = FILTER_MASK_VOIDSOURCE | FILTER_MASK_DTMFGEN;
+	MSFilter *rec = ms_filter_new(MS_ASYNC_FILE_REC_ID);
+	bool_t send_silence = TRUE;
+	int sync_interval = 500;
+
+	ms_tester_create_ticker();
+	ms_tester_create_filters(filter_mask);
+	ms_filter_call_method(rec, MS_ASYNC_FILE_REC_SET_SYNC_INTERVAL, &sync_interval);
+	BC_ASSERT_EQUAL(ms_filter_call_method(rec, MS_RECORDER_OPEN, (void *)recorded_file), 0, int, "%d");
+	ms_filter_call_method_noarg(rec, MS_RECORDER_START);
+	ms_filter_call_method(ms_tester_voidsource, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	ms_connection_helper_start(&h);
+	ms_connection_helper_link(&h, ms_tester_voidsource, -1, 0);
+	ms_connection_helper_link(&h, ms_tester_dtmfgen, 0, 0);
+	ms_connection_helper_link(&h, rec, 0, -1);
+	ms_ticker_attach(ms_tester_ticker, ms_tester_voidsource);
+	ms_tester_tone_generation_loop();
+	ms_ticker_detach(ms_tester_ticker, ms_tester_voidsource);
+	ms_filter_call_method(rec, MS_ASYNC_FILE_REC_GET_STATS, stats);
+	ms_filter_call_method_noarg(rec, MS_RECORDER_CLOSE);
+	ms_connection_helper_start(&h);
+	ms_connection_helper_unlink(&h, ms_tester_voidsource, -1, 0);
+	ms_connection_helper_unlink(&h, ms_tester_dtmfgen, 0, 0);
+	ms_connection_helper_unlink(&h, rec, 0, -1);
+	ms_filter_destroy(rec);
+	ms_tester_destroy_filters(filter_mask);
+	ms_tester_destroy_ticker();
+
+	BC_ASSERT_GREATER(stats->recorded, 1000, int, "%d");
+	BC_ASSERT_EQUAL(stats->dropped, 0, int, "%d");
+	BC_ASSERT_GREATER(stats->syncs, 0, unsigned int, "%u");
+}
+
+static void async_filerec_fileplay_tonedet(void) {
+	MSConnectionHelper h;
+	unsigned int filter_mask = FILTER_MASK_FILEPLAY | FILTER_MASK_TONEDET | FILTER_MASK_VOIDSINK;
+	char *recorded_file = bc_tester_file(ASYNC_FILEREC_FILE_NAME);
+	MSAsyncFileRecStats stats;
+
+	unlink(recorded_file);
+	async_filerec_record(recorded_file, &stats);
+
+	ms_tester_create_ticker();
+	ms_tester_create_filters(filter_mask);
+	ms_filter_add_notify_callback(ms_tester_tonedet, (MSFilterNotifyFunc)tone_detected_cb, NULL, TRUE);
+	ms_filter_call_method(ms_tester_fileplay, MS_FILE_PLAYER_OPEN, recorded_file);
+	ms_filter_call_method_noarg(ms_tester_fileplay, MS_FILE_PLAYER_START);
+	ms_connection_helper_start(&h);
+	ms_connection_helper_link(&h, ms_tester_fileplay, -1, 0);
+	ms_connection_helper_link(&h, ms_tester_tonedet, 0, 0);
+	ms_connection_helper_link(&h, ms_tester_voidsink, 0, -1);
+	ms_ticker_attach(ms_tester_ticker, ms_tester_fileplay);
+	ms_tester_tone_detection_loop();
+	ms_filter_call_method_noarg(ms_tester_fileplay, MS_FILE_PLAYER_CLOSE);
+	ms_ticker_detach(ms_tester_ticker, ms_tester_fileplay);
+	ms_connection_helper_start(&h);
+	ms_connection_helper_unlink(&h, ms_tester_fileplay, -1, 0);
+	ms_connection_helper_unlink(&h, ms_tester_tonedet, 0, 0);
+	ms_connection_helper_unlink(&h, ms_tester_voidsink, 0, -1);
+	ms_tester_destroy_filters(filter_mask);
+	ms_tester_destroy_ticker();
+	unlink(recorded_file);
+	free(recorded_file);
+}
+
+#if HAVE_OPUS
+static void async_filerec_ogg_opus(void) {
+	char *recorded_file = bc_tester_file(ASYNC_FILEREC_OGG_FILE_NAME);
+	MSAsyncFileRecStats stats;
+	char magic[4] = { 0 };
+	struct stat st;
+	FILE *f;
+
+	async_filerec_record(recorded_file, &stats);
+	f = fopen(recorded_file, "rb");
+	BC_ASSERT_PTR_NOT_NULL_FATAL(f);
+	BC_ASSERT_EQUAL((int)fread(magic, 1, 4, f), 4, int, "%d");
+	fclose(f);
+	BC_ASSERT_EQUAL(memcmp(magic, "OggS", 4), 0, int, "%d");
+	BC_ASSERT_EQUAL(stat(recorded_file, &st), 0, int, "%d");
+	BC_ASSERT_GREATER((int)st.st_size, 1000, int, "%d");
+	unlink(recorded_file);
+	free(recorded_file);
+}
+#endif
+
+
+#define FLOWCONTROL_REF_FILE "sounds/hello16000.wav"
+#define FLOWCONTROL_OUT_FILE "flowcontrol_out.wav"
+
+static int16_t *read_wav_samples(const char *filename, wave_header_t *header, int *nsamples) {
+	FILE *f = fopen(filename, "rb");
+	int16_t *samples = NULL;
+
+	*nsamples = 0;
+	if (f == NULL) return NULL;
+	if (fread(header, sizeof(*header), 1, f) == 1) {
+		*nsamples = le_uint32(header->data_chunk.len) / 2;
+		samples = ms_new(int16_t, *nsamples);
+		*nsamples = (int)fread(samples, 2, *nsamples, f);
+	}
+	fclose(f);
+	return samples;
+}
+
+static void write_wav_samples(const char *filename, wave_header_t *header, const int16_t *samples, int nsamples) {
+	FILE *f = fopen(filename, "wb");
+
+	if (f == NULL) return;
+	header->riff_chunk.len = le_uint32(nsamples * 2 + 36);
+	header->data_chunk.len = le_uint32(nsamples * 2);
+	fwrite(header, sizeof(*header), 1, f);
+	fwrite(samples, 2, nsamples, f);
+	fclose(f);
+}
+
+/*energy of the second order difference, that raises with the clicks caused by discontinuities*/
+static double high_frequency_energy(const int16_t *samples, int nsamples) {
+	double energy = 0;
+	int i;
+	for (i = 2; i < nsamples; i++) {
+		double d = (double)samples[i] - 2 * samples[i - 1] + samples[i - 2];
+		energy += d * d;
+	}
+	return energy;
+}
+
+static void flowcontrol_audiodiff_base(int samples_to_drop) {
+	char *ref_file = bc_tester_res(FLOWCONTROL_REF_FILE);
+	char *out_file = bc_tester_file(FLOWCONTROL_OUT_FILE);
+	MSAudioDiffParams params = { 10, 100 };
+	MSAudioFlowController ctl;
+	wave_header_t header;
+	int16_t *in, *out;
+	int nsamples, nout = 0, block, i;
+	double similar = 0;
+	double hf_ratio;
+
+	in = read_wav_samples(ref_file, &header, &nsamples);
+	BC_ASSERT_PTR_NOT_NULL_FATAL(in);
+	block = wave_header_get_rate(&header) / 50;
+	out = ms_new(int16_t, nsamples + nsamples / 4);
+	ms_audio_flow_controller_init(&ctl);
+	ms_audio_flow_controller_set_target(&ctl, samples_to_drop, (nsamples / block) * block);
+	for (i = 0; i + block <= nsamples; i += block) {
+		mblk_t *m = allocb(block * 2, 0);
+		memcpy(m->b_wptr, in + i, block * 2);
+		m->b_wptr += block * 2;
+		m = ms_audio_flow_controller_process(&ctl, m);
+		if (m != NULL) {
+			memcpy(out + nout, m->b_rptr, m->b_wptr - m->b_rptr);
+			nout += (int)(m->b_wptr - m->b_rptr) / 2;
+			freemsg(m);
+		}
+	}
+	BC_ASSERT_EQUAL(i - nout, samples_to_drop, int, "%d");
+	write_wav_samples(out_file, &header, out, nout);
+
+	/*the dropped or inserted samples shall not add audible clicks*/
+	hf_ratio = high_frequency_energy(out, nout) / high_frequency_energy(in, i);
+	ms_message("Flow control: %i samples dropped, high frequency energy ratio %f", i - nout, hf_ratio);
+	BC_ASSERT_TRUE(fabs(hf_ratio - 1) < 0.002);
+	BC_ASSERT_EQUAL(ms_audio_diff(ref_file, out_file, &similar, &params, NULL, NULL), 0, int, "%d");
+	BC_ASSERT_GREATER(similar, 0.9, double, "%f");
+
+	unlink(out_file);
+	free(out_file);
+	free(ref_file);
+	ms_free(in);
+	ms_free(out);
+}
+
+static void flowcontrol_drop_audiodiff(void) {
+	flowcontrol_audiodiff_base(160);
+}
+
+static void flowcontrol_insert_audiodiff(void) {
+	flowcontrol_audiodiff_base(-160);
+}
+
+typedef struct _ChannelAdapterGraph {
+	MSFilter *source;
+	MSFilter *adapter;
+	MSFilter *sink;
+} ChannelAdapterGraph;
+
+static void channel_adapter_graph_init(ChannelAdapterGraph *g, int inputchans, int outputchans) {
+	g->source = ms_filter_new(MS_VOID_SOURCE_ID);
+	g->adapter = ms_filter_new(MS_CHANNEL_ADAPTER_ID);
+	g->sink = ms_filter_new(MS_VOID_SINK_ID);
+	BC_ASSERT_EQUAL(ms_filter_call_method(g->adapter, MS_FILTER_SET_NCHANNELS, &inputchans), 0, int, "%d");
+	BC_ASSERT_EQUAL(ms_filter_call_method(g->adapter, MS_CHANNEL_ADAPTER_SET_OUTPUT_NCHANNELS, &outputchans), 0, int, "%d");
+	ms_filter_link(g->source, 0, g->adapter, 0);
+	ms_filter_link(g->adapter, 0, g->sink, 0);
+}
+
+static void channel_adapter_graph_uninit(ChannelAdapterGraph *g) {
+	ms_filter_unlink(g->source, 0, g->adapter, 0);
+	ms_filter_unlink(g->adapter, 0, g->sink, 0);
+	ms_filter_destroy(g->source);
+	ms_filter_destroy(g->adapter);
+	ms_filter_destroy(g->sink);
+}
+
+/* Converts the frames with the adapter, the output block is returned. */
+static mblk_t *channel_adapter_convert(ChannelAdapterGraph *g, const int16_t *frames, int nsamples, uint8_t **data) {
+	mblk_t *m = allocb(nsamples * 2, 0);
+	memcpy(m->b_wptr, frames, nsamples * 2);
+	m->b_wptr += nsamples * 2;
+	if (data) *data = m->b_rptr;
+	ms_queue_put(g->adapter->inputs[0], m);
+	ms_filter_process(g->adapter);
+	return ms_queue_get(g->adapter->outputs[0]);
+}
+
+static void channel_adapter_mappings(void) {
+	/* Not a multiple of the processing chunk, to go through the vector and scalar code. */
+	const int nframes = 333;
+	int inputchans, outputchans;
+
+	for (inputchans = 1; inputchans <= MS_CHANNEL_ADAPTER_MAX_CHANNELS; inputchans++) {
+		for (outputchans = 1; outputchans <= MS_CHANNEL_ADAPTER_MAX_CHANNELS; outputchans++) {
+			ChannelAdapterGraph g;
+			MSChannelAdapterMatrix matrix;
+			int16_t *frames = ms_new(int16_t, nframes * inputchans);
+			uint8_t *indata;
+			mblk_t *om;
+			int errors = 0;
+			int i, o, n;
+
+			channel_adapter_graph_init(&g, inputchans, outputchans);
+			ms_filter_call_method(g.adapter, MS_CHANNEL_ADAPTER_GET_MATRIX, &matrix);
+			for (i = 0; i < nframes * inputchans; i++) frames[i] = (int16_t)((i * 7919 + inputchans * 104729) % 65536 - 32768);
+			om = channel_adapter_convert(&g, frames, nframes * inputchans, &indata);
+			BC_ASSERT_PTR_NOT_NULL(om);
+			if (om == NULL) goto end;
+			BC_ASSERT_EQUAL((int)msgdsize(om), nframes * outputchans * 2, int, "%d");
+			if (outputchans <= inputchans) BC_ASSERT_PTR_EQUAL(om->b_rptr, indata);
+
+			for (o = 0; o < outputchans; o++) {
+				float sum = 0;
+				for (i = 0; i < inputchans; i++) sum += matrix.coefs[o][i];
+				/* Mono goes to the center, or to left and right without a center, and the downmix never clips. */
+				if (inputchans == 1) {
+					bool_t has_center = (outputchans == 1 || outputchans == 3 || outputchans >= 5);
+					bool_t mono_target = has_center ? (o == (outputchans == 1 ? 0 : 1)) : (o < 2);
+					BC_ASSERT_TRUE(sum == (mono_target ? 1 : 0));
+				} else BC_ASSERT_TRUE(sum <= 1.0001f);
+			}
+			for (n = 0; n < nframes; n++) {
+				for (o = 0; o < outputchans; o++) {
+					double expected = 0, bound = 1;
+					int value = ((int16_t *)om->b_rptr)[n * outputchans + o];
+					for (i = 0; i < inputchans; i++) {
+						expected += matrix.coefs[o][i] * frames[n * inputchans + i];
+						bound += fabs(frames[n * inputchans + i]) / 32768.0;
+					}
+					if (fabs(value - expected) > bound) errors++;
+				}
+			}
+			BC_ASSERT_EQUAL(errors, 0, int, "%d");
+			if (errors) ms_error("%i->%i channels: %i wrong samples", inputchans, outputchans, errors);
+			freemsg(om);
+		end:
+			channel_adapter_graph_uninit(&g);
+			ms_free(frames);
+		}
+	}
+}
+
+static void channel_adapter_stereo(void) {
+	ChannelAdapterGraph g;
+	MSChannelAdapterMatrix matrix;
+	const int16_t stereo[] = {1000, 3000, -32768, -32768, 32767, 32767, -101, 100};
+	const int16_t mono[] = {2000, -32768, 32767, 0};
+	int16_t *samples;
+	uint8_t *indata;
+	mblk_t *om;
+	int i;
+
+	/* Stereo to mono averages both channels, in place. */
+	channel_adapter_graph_init(&g, 2, 1);
+	om = channel_adapter_convert(&g, stereo, 8, &indata);
+	BC_ASSERT_PTR_EQUAL(om->b_rptr, indata);
+	BC_ASSERT_EQUAL((int)msgdsize(om), 8, int, "%d");
+	for (i = 0; i < 4; i++) BC_ASSERT_EQUAL(((int16_t *)om->b_rptr)[i], mono[i], int, "%d");
+	freemsg(om);
+	channel_adapter_graph_uninit(&g);
+
+	/* Mono to stereo duplicates the samples. */
+	channel_adapter_graph_init(&g, 1, 2);
+	om = channel_adapter_convert(&g, mono, 4, NULL);
+	BC_ASSERT_EQUAL((int)msgdsize(om), 16, int, "%d");
+	samples = (int16_t *)om->b_rptr;
+	for (i = 0; i < 4; i++) {
+		BC_ASSERT_EQUAL(samples[2 * i], mono[i], int, "%d");
+		BC_ASSERT_EQUAL(samples[2 * i + 1], mono[i], int, "%d");
+	}
+	freemsg(om);
+	channel_adapter_graph_uninit(&g);
+
+	/* Same number of channels: the blocks go through untouched, unless a custom matrix is set. */
+	channel_adapter_graph_init(&g, 2, 2);
+	om = channel_adapter_convert(&g, stereo, 8, &indata);
+	BC_ASSERT_PTR_EQUAL(om->b_rptr, indata);
+	BC_ASSERT_EQUAL(memcmp(om->b_rptr, stereo, sizeof(stereo)), 0, int, "%d");
+	freemsg(om);
+	memset(&matrix, 0, sizeof(matrix));
+	matrix.coefs[0][1] = 1;
+	matrix.coefs[1][0] = 1;
+	BC_ASSERT_EQUAL(ms_filter_call_method(g.adapter, MS_CHANNEL_ADAPTER_SET_MATRIX, &matrix), 0, int, "%d");
+	om = channel_adapter_convert(&g, stereo, 8, NULL);
+	samples = (int16_t *)om->b_rptr;
+	for (i = 0; i < 4; i++) {
+		BC_ASSERT_EQUAL(samples[2 * i], stereo[2 * i + 1], int, "%d");
+		BC_ASSERT_EQUAL(samples[2 * i + 1], stereo[2 * i], int, "%d");
+	}
+	freemsg(om);
+	matrix.coefs[0][0] = 3;
+	BC_ASSERT_NOT_EQUAL(ms_filter_call_method(g.adapter, MS_CHANNEL_ADAPTER_SET_MATRIX, &matrix), 0, int, "%d");
+	/* A single coefficient must stay within ]-2,2[ even if the row sum is small enough. */
+	memset(&matrix, 0, sizeof(matrix));
+	matrix.coefs[0][0] = 2;
+	matrix.coefs[1][1] = 1;
+	BC_ASSERT_NOT_EQUAL(ms_filter_call_method(g.adapter, MS_CHANNEL_ADAPTER_SET_MATRIX, &matrix), 0, int, "%d");
+	matrix.coefs[0][0] = 1.9f;
+	BC_ASSERT_EQUAL(ms_filter_call_method(g.adapter, MS_CHANNEL_ADAPTER_SET_MATRIX, &matrix), 0, int, "%d");
+	channel_adapter_graph_uninit(&g);
+}
+
+static uint32_t fnv1a_hash(uint32_t hash, const uint8_t *data, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+#define G722_REF_FILE "sounds/hello16000.wav"
+
+/*
+ * The encoded stream and decoded audio of hello16000.wav, followed by a full scale square wave and noise,
+ * shall be bit exact with the sample by sample implementation of the codec that was used to record the hashes.
+ */
+static void g722_bit_exact(void) {
+	char *ref_file = bc_tester_res(G722_REF_FILE);
+	wave_header_t header;
+	MSFilter *source = ms_filter_new(MS_VOID_SOURCE_ID);
+	MSFilter *enc = ms_filter_new(MS_G722_ENC_ID);
+	MSFilter *dec = ms_filter_new(MS_G722_DEC_ID);
+	MSFilter *sink = ms_filter_new(MS_VOID_SINK_ID);
+	uint32_t enc_hash = 2166136261u, dec_hash = 2166136261u;
+	unsigned int seed = 1;
+	int enc_bytes = 0, dec_bytes = 0;
+	int16_t *samples, *in;
+	int nsamples, i;
+	mblk_t *m;
+
+	in = read_wav_samples(ref_file, &header, &nsamples);
+	BC_ASSERT_PTR_NOT_NULL_FATAL(in);
+	samples = ms_new(int16_t, nsamples + 32000);
+	memcpy(samples, in, nsamples * 2);
+	for (i = 0; i < 16000; i++) samples[nsamples + i] = ((i / 7) & 1) ? 32767 : -32768;
+	for (i = 0; i < 16000; i++) {
+		seed = seed * 1103515245 + 12345;
+		samples[nsamples + 16000 + i] = (int16_t)(seed >> 16);
+	}
+	nsamples += 32000;
+
+	ms_filter_link(source, 0, enc, 0);
+	ms_filter_link(enc, 0, dec, 0);
+	ms_filter_link(dec, 0, sink, 0);
+	for (i = 0; i + 320 <= nsamples; i += 320) {
+		m = allocb(640, 0);
+		memcpy(m->b_wptr, samples + i, 640);
+		m->b_wptr += 640;
+		ms_queue_put(enc->inputs[0], m);
+		ms_filter_process(enc);
+		while ((m = ms_queue_get(enc->outputs[0])) != NULL) {
+			enc_hash = fnv1a_hash(enc_hash, m->b_rptr, m->b_wptr - m->b_rptr);
+			enc_bytes += (int)(m->b_wptr - m->b_rptr);
+			ms_queue_put(dec->inputs[0], m);
+		}
+		ms_filter_process(dec);
+		while ((m = ms_queue_get(dec->outputs[0])) != NULL) {
+			dec_hash = fnv1a_hash(dec_hash, m->b_rptr, m->b_wptr - m->b_rptr);
+			dec_bytes += (int)(m->b_wptr - m->b_rptr);
+			freemsg(m);
+		}
+	}
+	BC_ASSERT_EQUAL(enc_bytes, nsamples / 2, int, "%d");
+	BC_ASSERT_EQUAL(dec_bytes, nsamples * 2, int, "%d");
+	BC_ASSERT_EQUAL(enc_hash, 0x592a6ce2, unsigned int, "0x%08x");
+	BC_ASSERT_EQUAL(dec_hash, 0xd6f9d3b1, unsigned int, "0x%08x");
+
+	ms_filter_unlink(source, 0, enc, 0);
+	ms_filter_unlink(enc, 0, dec, 0);
+	ms_filter_unlink(dec, 0, sink, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(enc);
+	ms_filter_destroy(dec);
+	ms_filter_destroy(sink);
+	ms_free(samples);
+	ms_free(in);
+	free(ref_file);
+}
+
+/*
+ * The echo canceller shall deliver every frame when switched between the synchronous and asynchronous modes while
+ * running: in asynchronous mode they are processed on the echo canceller service and output on the next tick.
+ */
+static void echo_canceller_async(void) {
+	MSFilter *ref_source = ms_filter_new(MS_VOID_SOURCE_ID);
+	MSFilter *echo_source = ms_filter_new(MS_VOID_SOURCE_ID);
+	MSFilter *ec = ms_filter_new(MS_SPEEX_EC_ID);
+	MSFilter *ref_sink = ms_filter_new(MS_VOID_SINK_ID);
+	MSFilter *clean_sink = ms_filter_new(MS_VOID_SINK_ID);
+	MSTicker *ticker = ms_ticker_new();
+	const int tick_bytes = 160; /* 10 ms at 8 kHz */
+	int in_bytes = 0, out_bytes = 0, async_bytes = 0;
+	bool_t enabled;
+	mblk_t *m;
+	int i;
+
+	if (ec == NULL) {
+		ms_warning("MSSpeexEC is not available, skipping");
+		ms_ticker_destroy(ticker);
+		ms_filter_destroy(ref_source);
+		ms_filter_destroy(echo_source);
+		ms_filter_destroy(ref_sink);
+		ms_filter_destroy(clean_sink);
+		return;
+	}
+	ms_filter_link(ref_source, 0, ec, 0);
+	ms_filter_link(echo_source, 0, ec, 1);
+	ms_filter_link(ec, 0, ref_sink, 0);
+	ms_filter_link(ec, 1, clean_sink, 0);
+	enabled = TRUE;
+	BC_ASSERT_EQUAL(ms_filter_call_method(ec, MS_ECHO_CANCELLER_ENABLE_ASYNC, &enabled), 0, int, "%d");
+	ms_filter_preprocess(ec, ticker);
+	for (i = 0; i < 300; i++) {
+		if (i == 100 || i == 200) {
+			/* Disabled then enabled again while a job is pending. */
+			enabled = (i == 200);
+			ms_filter_call_method(ec, MS_ECHO_CANCELLER_ENABLE_ASYNC, &enabled);
+		}
+		m = allocb(tick_bytes, 0);
+		memset(m->b_wptr, 0, tick_bytes);
+		m->b_wptr += tick_bytes;
+		ms_queue_put(ec->inputs[0], m);
+		ms_queue_put(ec->inputs[1], dupmsg(m));
+		in_bytes += tick_bytes;
+		ms_filter_process(ec);
+		ms_queue_flush(ec->outputs[0]);
+		while ((m = ms_queue_get(ec->outputs[1])) != NULL) {
+			out_bytes += (int)msgdsize(m);
+			if (i < 100) async_bytes += (int)msgdsize(m);
+			freemsg(m);
+		}
+	}
+	/* Collect the frames of the last job. */
+	ms_filter_process(ec);
+	while ((m = ms_queue_get(ec->outputs[1])) != NULL) {
+		out_bytes += (int)msgdsize(m);
+		freemsg(m);
+	}
+	ms_filter_postprocess(ec);
+
+	BC_ASSERT_TRUE(async_bytes > 0);
+	/* Only the samples not making a whole frame of the canceller may be left. */
+	BC_ASSERT_TRUE(out_bytes <= in_bytes);
+	BC_ASSERT_TRUE(in_bytes - out_bytes < 1024);
+
+	ms_filter_unlink(ref_source, 0, ec, 0);
+	ms_filter_unlink(echo_source, 0, ec, 1);
+	ms_filter_unlink(ec, 0, ref_sink, 0);
+	ms_filter_unlink(ec, 1, clean_sink, 0);
+	ms_filter_destroy(ec);
+	ms_ticker_destroy(ticker);
+	ms_filter_destroy(ref_source);
+	ms_filter_destroy(echo_source);
+	ms_filter_destroy(ref_sink);
+	ms_filter_destroy(clean_sink);
+}
+
+/*
+ * The echo canceller shall measure the clock skew between the playback and capture devices: the reference is fed at
+ * 8040 Hz and the echo at 8000 Hz on the same ticker, so that the estimated skew shall converge to 1.005.
+ */
+static void echo_canceller_skew(void) {
+	MSFilter *ec = ms_filter_new(MS_SPEEX_EC_ID);
+	MSFilter *ref_source = ms_filter_new(MS_VOID_SOURCE_ID);
+	MSFilter *echo_source = ms_filter_new(MS_VOID_SOURCE_ID);
+	MSFilter *ref_sink = ms_filter_new(MS_VOID_SINK_ID);
+	MSFilter *clean_sink = ms_filter_new(MS_VOID_SINK_ID);
+	const int ref_rate = 8040, echo_rate = 8000;
+	MSTicker ticker;
+	float skew = 0;
+	int i;
+
+	if (ec == NULL) {
+		ms_warning("MSSpeexEC is not available, skipping");
+		ms_filter_destroy(ref_source);
+		ms_filter_destroy(echo_source);
+		ms_filter_destroy(ref_sink);
+		ms_filter_destroy(clean_sink);
+		return;
+	}
+	ms_filter_link(ref_source, 0, ec, 0);
+	ms_filter_link(echo_source, 0, ec, 1);
+	ms_filter_link(ec, 0, ref_sink, 0);
+	ms_filter_link(ec, 1, clean_sink, 0);
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 10;
+	ms_filter_preprocess(ec, &ticker);
+	BC_ASSERT_EQUAL(ms_filter_call_method(ec, MS_ECHO_CANCELLER_GET_SKEW, &skew), 0, int, "%d");
+	BC_ASSERT_TRUE(skew == 1.0f);
+	/* 40 seconds, so that the samples missing from the first tick weigh little in the estimate. */
+	for (i = 0; i < 4000; i++) {
+		int ref_bytes = 2 * ((i + 1) * ref_rate / 100 - i * ref_rate / 100);
+		int echo_bytes = 2 * ((i + 1) * echo_rate / 100 - i * echo_rate / 100);
+		mblk_t *m = allocb(ref_bytes, 0);
+		memset(m->b_wptr, 0, ref_bytes);
+		m->b_wptr += ref_bytes;
+		ms_queue_put(ec->inputs[0], m);
+		m = allocb(echo_bytes, 0);
+		memset(m->b_wptr, 0, echo_bytes);
+		m->b_wptr += echo_bytes;
+		ms_queue_put(ec->inputs[1], m);
+		ticker.time += ticker.interval;
+		ms_filter_process(ec);
+		ms_queue_flush(ec->outputs[0]);
+		ms_queue_flush(ec->outputs[1]);
+	}
+	BC_ASSERT_EQUAL(ms_filter_call_method(ec, MS_ECHO_CANCELLER_GET_SKEW, &skew), 0, int, "%d");
+	ms_filter_postprocess(ec);
+	BC_ASSERT_TRUE(fabs(skew - (float)ref_rate / echo_rate) < 0.001);
+
+	ms_filter_unlink(ref_source, 0, ec, 0);
+	ms_filter_unlink(echo_source, 0, ec, 1);
+	ms_filter_unlink(ec, 0, ref_sink, 0);
+	ms_filter_unlink(ec, 1, clean_sink, 0);
+	ms_filter_destroy(ec);
+	ms_filter_destroy(ref_source);
+	ms_filter_destroy(echo_source);
+	ms_filter_destroy(ref_sink);
+	ms_filter_destroy(clean_sink);
+}
+
+static void adaptive_playout_delay_estimator(void) {
+	MSDelayEstimator *estimator = ms_delay_estimator_new(500, 5, 1000);
+	int i;
+
+	BC_ASSERT_EQUAL(ms_delay_estimator_get_quantile(estimator, 0.5f), 0, int, "%d");
+	/* Nine packets out of ten at 10 ms, the others at 200 ms: the quantiles are the upper bounds of their bins. */
+	for (i = 0; i < 100; i++) {
+		ms_delay_estimator_add(estimator, (i % 10 == 9) ? 200 : 10);
+	}
+	BC_ASSERT_EQUAL(ms_delay_estimator_get_quantile(estimator, 0.5f), 15, int, "%d");
+	BC_ASSERT_EQUAL(ms_delay_estimator_get_quantile(estimator, 0.85f), 15, int, "%d");
+	BC_ASSERT_EQUAL(ms_delay_estimator_get_quantile(estimator, 0.95f), 205, int, "%d");
+	/* Longer delays are counted as the longest one tracked. */
+	ms_delay_estimator_add(estimator, 1000);
+	BC_ASSERT_EQUAL(ms_delay_estimator_get_quantile(estimator, 1.0f), 500, int, "%d");
+	ms_delay_estimator_reset(estimator);
+	BC_ASSERT_EQUAL(ms_delay_estimator_get_quantile(estimator, 0.95f), 0, int, "%d");
+	ms_delay_estimator_destroy(estimator);
+
+	/* With a short memory, the old observations are forgotten. */
+	estimator = ms_delay_estimator_new(500, 5, 10);
+	for (i = 0; i < 50; i++) ms_delay_estimator_add(estimator, 200);
+	for (i = 0; i < 50; i++) ms_delay_estimator_add(estimator, 10);
+	BC_ASSERT_EQUAL(ms_delay_estimator_get_quantile(estimator, 0.9f), 15, int, "%d");
+	ms_delay_estimator_destroy(estimator);
+}
+
+static void adaptive_playout_accelerate(void) {
+	const int rate = 8000;
+	const int period = 40; /* 200 Hz */
+	int16_t samples[400], noise[400];
+	uint32_t seed = 1;
+	float similarity;
+	int i, removed, max_diff = 0;
+
+	for (i = 0; i < 400; i++) {
+		samples[i] = (int16_t)(8000 * sin(2 * M_PI * i / period));
+	}
+	BC_ASSERT_EQUAL(ms_audio_find_period(samples, 400, 1, rate, FALSE, &similarity), period, int, "%d");
+	BC_ASSERT_TRUE(similarity > 0.99f);
+
+	/* Not enough samples to search the longest period, or a period longer than allowed: nothing is removed. */
+	BC_ASSERT_EQUAL(ms_audio_accelerate(samples, 100, 1, rate, 0.5f, 400), 0, int, "%d");
+	BC_ASSERT_EQUAL(ms_audio_accelerate(samples, 400, 1, rate, 0.5f, period - 1), 0, int, "%d");
+
+	/* One period is removed, the signal left is the same sine. */
+	removed = ms_audio_accelerate(samples, 400, 1, rate, 0.5f, 400);
+	BC_ASSERT_EQUAL(removed, period, int, "%d");
+	for (i = 0; i < 400 - removed; i++) {
+		int diff = abs(samples[i] - (int16_t)(8000 * sin(2 * M_PI * i / period)));
+		if (diff > max_diff) max_diff = diff;
+	}
+	BC_ASSERT_TRUE(max_diff <= 2);
+
+	/* A signal that is not periodic is left untouched. */
+	for (i = 0; i < 400; i++) {
+		seed = seed * 1103515245 + 12345;
+		noise[i] = (int16_t)((int)((seed >> 16) & 0x7fff) % 16000 - 8000);
+	}
+	BC_ASSERT_EQUAL(ms_audio_accelerate(noise, 400, 1, rate, 0.5f, 400), 0, int, "%d");
+}
+
+#define PLAYOUT_TEST_PACKETS 150
+#define PLAYOUT_TEST_PTIME 20
+#define PLAYOUT_TEST_START 1000 /* ms, ticker time of the first packet */
+
+static void adaptive_playout_send(RtpSession *session, uint32_t ts) {
+	uint8_t payload[160];
+	mblk_t *m;
+
+	memset(payload, 0xff, sizeof(payload));
+	m = rtp_session_create_packet(session, RTP_FIXED_HEADER_SIZE, payload, sizeof(payload));
+	rtp_session_sendm_with_ts(session, m, ts);
+}
+
+/*
+ * Drives MSRtpRecv with a manual ticker. The packets are sent over the loopback at the ticks of their arrival times,
+ * the last ones first, so that those arriving together are out of order:
+ * - packet 20 arrives with packet 21;
+ * - packets 60 to 67 arrive together 150 ms after the time of packet 60, the 5 first ones after their playout time;
+ * - from packet 100 the timestamps jump 10 s ahead, the 10 first ones are early and restart the playout.
+ */
+static void adaptive_playout_rtprecv(void) {
+	RtpSession *sender = rtp_session_new(RTP_SESSION_SENDONLY);
+	RtpSession *receiver = rtp_session_new(RTP_SESSION_RECVONLY);
+	MSFilter *rtprecv = ms_filter_new(MS_RTP_RECV_ID);
+	MSFilter *sink = ms_filter_new(MS_VOID_SINK_ID);
+	MSRtpRecvPlayoutParams params = {0};
+	MSRtpRecvPlayoutStats stats = {0};
+	MSTicker ticker;
+	uint64_t arrival[PLAYOUT_TEST_PACKETS];
+	uint32_t ts[PLAYOUT_TEST_PACKETS];
+	int64_t last_ts = -1;
+	int output = 0, output_after_jump = 0;
+	bool_t ordered = TRUE;
+	mblk_t *m;
+	int i;
+
+	for (i = 0; i < PLAYOUT_TEST_PACKETS; i++) {
+		arrival[i] = PLAYOUT_TEST_START + i * PLAYOUT_TEST_PTIME;
+		ts[i] = i * 160 + (i >= 100 ? 80000 : 0);
+	}
+	arrival[20] = arrival[21];
+	for (i = 60; i < 68; i++) arrival[i] = arrival[60] + 150;
+
+	rtp_session_set_scheduling_mode(receiver, 0);
+	rtp_session_set_blocking_mode(receiver, 0);
+	rtp_session_set_payload_type(receiver, 0);
+	rtp_session_enable_rtcp(receiver, FALSE);
+	rtp_session_set_local_addr(receiver, "127.0.0.1", 50070, 50071);
+	rtp_session_set_scheduling_mode(sender, 0);
+	rtp_session_set_blocking_mode(sender, 0);
+	rtp_session_set_payload_type(sender, 0);
+	rtp_session_enable_rtcp(sender, FALSE);
+	rtp_session_set_remote_addr_full(sender, "127.0.0.1", 50070, "127.0.0.1", 50071);
+
+	params.enabled = TRUE;
+	params.quantile = 0.95f;
+	params.min_delay = 60;
+	params.max_delay = 500;
+	ms_filter_call_method(rtprecv, MS_RTP_RECV_SET_SESSION, receiver);
+	ms_filter_call_method(rtprecv, MS_RTP_RECV_SET_PLAYOUT_PARAMS, &params);
+	ms_filter_link(rtprecv, 0, sink, 0);
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 10;
+	ticker.time = PLAYOUT_TEST_START - ticker.interval;
+	ms_filter_preprocess(rtprecv, &ticker);
+	ms_filter_process(rtprecv); /* flushes the sockets */
+
+	for (ticker.time = PLAYOUT_TEST_START; ticker.time <= arrival[PLAYOUT_TEST_PACKETS - 1] + 500; ticker.time += ticker.interval) {
+		bool_t sent = FALSE;
+		for (i = PLAYOUT_TEST_PACKETS - 1; i >= 0; i--) {
+			if (arrival[i] > ticker.time - ticker.interval && arrival[i] <= ticker.time) {
+				adaptive_playout_send(sender, ts[i]);
+				sent = TRUE;
+			}
+		}
+		if (sent) ms_usleep(1000);
+		ms_filter_process(rtprecv);
+		while ((m = ms_queue_get(rtprecv->outputs[0])) != NULL) {
+			int64_t t = mblk_get_timestamp_info(m);
+			if (t <= last_ts) ordered = FALSE;
+			if (t >= 80000 + 100 * 160) output_after_jump++;
+			last_ts = t;
+			output++;
+			freemsg(m);
+		}
+	}
+	BC_ASSERT_EQUAL(ms_filter_call_method(rtprecv, MS_RTP_RECV_GET_PLAYOUT_STATS, &stats), 0, int, "%d");
+	ms_filter_postprocess(rtprecv);
+
+	BC_ASSERT_TRUE(ordered);
+	BC_ASSERT_EQUAL((int)stats.packets, PLAYOUT_TEST_PACKETS, int, "%d");
+	BC_ASSERT_EQUAL((int)stats.late, 5, int, "%d");
+	BC_ASSERT_EQUAL((int)stats.early, 10, int, "%d");
+	BC_ASSERT_EQUAL((int)stats.resyncs, 1, int, "%d");
+	BC_ASSERT_TRUE(stats.delay_increases >= 1);
+	BC_ASSERT_EQUAL(output, PLAYOUT_TEST_PACKETS - 5 - 10, int, "%d");
+	BC_ASSERT_EQUAL(output_after_jump, 40, int, "%d");
+
+	ms_filter_unlink(rtprecv, 0, sink, 0);
+	ms_filter_destroy(rtprecv);
+	ms_filter_destroy(sink);
+	rtp_session_destroy(sender);
+	rtp_session_destroy(receiver);
+}
 
 test_t basic_audio_tests[] = {
 	{ "dtmfgen-tonedet", dtmfgen_tonedet },
@@ -263,7 +995,21 @@ test_t basic_audio_tests[] = {
 	{ "dtmfgen-enc-dec-tonedet-opus", dtmfgen_enc_dec_tonedet_opus },
 #endif
 	{ "dtmfgen-enc-rtp-dec-tonedet", dtmfgen_enc_rtp_dec_tonedet },
-	{ "dtmfgen-filerec-fileplay-tonedet", dtmfgen_filerec_fileplay_tonedet }
+	{ "dtmfgen-filerec-fileplay-tonedet", dtmfgen_filerec_fileplay_tonedet },
+	{ "async-filerec-fileplay-tonedet", async_filerec_fileplay_tonedet },
+#if HAVE_OPUS
+	{ "async-filerec-ogg-opus", async_filerec_ogg_opus },
+#endif
+	{ "flowcontrol-drop-audiodiff", flowcontrol_drop_audiodiff },
+	{ "flowcontrol-insert-audiodiff", flowcontrol_insert_audiodiff },
+	{ "channel-adapter-mappings", channel_adapter_mappings },
+	{ "channel-adapter-stereo", channel_adapter_stereo },
+	{ "g722-bit-exact", g722_bit_exact },
+	{ "echo-canceller-async", echo_canceller_async },
+	{ "echo-canceller-skew", echo_canceller_skew },
+	{ "adaptive-playout-delay-estimator", adaptive_playout_delay_estimator },
+	{ "adaptive-playout-accelerate", adaptive_playout_accelerate },
+	{ "adaptive-playout-rtprecv", adaptive_playout_rtprecv }
 };
 
 test_suite_t basic_audio_test_suite = {
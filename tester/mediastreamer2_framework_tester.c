@@ -22,11 +22,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "mediastreamer2/dtmfgen.h"
 #include "mediastreamer2/msfileplayer.h"
 #include "mediastreamer2/msfilerec.h"
+#include "mediastreamer2/msmetrics.h"
 #include "mediastreamer2/msrtp.h"
 #include "mediastreamer2/mstonedetector.h"
 #include "mediastreamer2_tester.h"
 #include "mediastreamer2_tester_private.h"
 
+#include <math.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 static int tester_before_all(void) {
 /*	ms_init();
 	ms_filter_enable_statistics(TRUE);
@@ -130,6 +139,80 @@ static void test_video_processing (void) {
 	ms_yuv_buf_allocator_free(yba);
 
 }
+
+static void test_yuv_buf_allocator_reuse(void) {
+	MSYuvBufAllocator *yba = ms_yuv_buf_allocator_new();
+	MSYuvBufAllocatorStats stats;
+	MSPicture pic;
+	uint8_t *data;
+	mblk_t *m;
+
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_VGA_W, MS_VIDEO_SIZE_VGA_H);
+	data = pic.planes[0];
+	freemsg(m);
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_VGA_W, MS_VIDEO_SIZE_VGA_H);
+	BC_ASSERT_PTR_EQUAL(pic.planes[0], data);
+	BC_ASSERT_EQUAL(((intptr_t)pic.planes[0])%32, 0, int, "%d");
+	ms_yuv_buf_allocator_get_stats(yba, &stats);
+	BC_ASSERT_EQUAL(stats.hits+stats.misses, 2, unsigned int, "%u");
+	BC_ASSERT_TRUE(stats.hits >= 1);
+	freemsg(m);
+	ms_yuv_buf_allocator_get_stats(yba, &stats);
+	BC_ASSERT_TRUE(stats.cached_bytes > 0);
+	ms_yuv_buf_allocator_free(yba);
+}
+
+static void test_yuv_buf_allocator_size_classes(void) {
+	MSYuvBufAllocator *yba = ms_yuv_buf_allocator_new();
+	MSPicture pic;
+	uint8_t *data;
+	mblk_t *m;
+
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_VGA_W, MS_VIDEO_SIZE_VGA_H);
+	data = pic.planes[0];
+	freemsg(m);
+	/*a slightly bigger picture falls in the same size class*/
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_VGA_W+2, MS_VIDEO_SIZE_VGA_H);
+	BC_ASSERT_PTR_EQUAL(pic.planes[0], data);
+	freemsg(m);
+	/*a much smaller one does not waste the big buffer*/
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_QCIF_W, MS_VIDEO_SIZE_QCIF_H);
+	BC_ASSERT_PTR_NOT_EQUAL(pic.planes[0], data);
+	freemsg(m);
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_VGA_W, MS_VIDEO_SIZE_VGA_H);
+	BC_ASSERT_PTR_EQUAL(pic.planes[0], data);
+	freemsg(m);
+	ms_yuv_buf_allocator_free(yba);
+}
+
+static void *release_frame_thread(void *arg) {
+	freemsg((mblk_t *)arg);
+	return NULL;
+}
+
+static void test_yuv_buf_allocator_cross_thread_release(void) {
+	MSYuvBufAllocator *yba = ms_yuv_buf_allocator_new();
+	MSYuvBufAllocatorStats before, after;
+	ms_thread_t thread;
+	MSPicture pic;
+	uint8_t *data;
+	mblk_t *m;
+
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_CIF_W, MS_VIDEO_SIZE_CIF_H);
+	data = pic.planes[0];
+	BC_ASSERT_EQUAL(ms_thread_create(&thread, NULL, release_frame_thread, m), 0, int, "%d");
+	ms_thread_join(thread, NULL);
+	ms_yuv_buf_allocator_get_stats(yba, &before);
+	m = ms_yuv_buf_allocator_get(yba, &pic, MS_VIDEO_SIZE_CIF_W, MS_VIDEO_SIZE_CIF_H);
+	ms_yuv_buf_allocator_get_stats(yba, &after);
+	BC_ASSERT_PTR_EQUAL(pic.planes[0], data);
+	BC_ASSERT_EQUAL(after.hits, before.hits+1, unsigned int, "%u");
+
+	/*the frame outlives its allocator, and is released by another thread*/
+	ms_yuv_buf_allocator_free(yba);
+	BC_ASSERT_EQUAL(ms_thread_create(&thread, NULL, release_frame_thread, m), 0, int, "%d");
+	ms_thread_join(thread, NULL);
+}
 #endif
 
 static void test_is_multicast(void) {
@@ -178,12 +261,128 @@ static void test_filterdesc_enable_disable() {
 	test_filterdesc_enable_disable_base("pcmu", "MSUlawDec", FALSE);
 	test_filterdesc_enable_disable_base("pcma", "MSAlawEnc", TRUE);
 }
+static void test_metrics_export(void) {
+	static const double bounds[] = { 0.1, 0.5 };
+	MSMetric *counter = ms_metric_new("ms2_tester_events", MSMetricCounter, "Events counted by the tester", "kind=\"a\"");
+	MSMetric *other = ms_metric_new("ms2_tester_events", MSMetricCounter, NULL, "kind=\"c\"");
+	MSMetric *gauge = ms_metric_new("ms2_tester_level", MSMetricGauge, "Level set by the tester", NULL);
+	MSMetric *histogram = ms_metric_new_histogram("ms2_tester_latency_seconds", "Latency observed by the tester",
+		"stream=\"1\"", bounds, 2);
+	char *text;
+	size_t len;
+
+	BC_ASSERT_PTR_NOT_NULL(counter);
+	BC_ASSERT_PTR_NOT_NULL(gauge);
+	BC_ASSERT_PTR_NOT_NULL(histogram);
+	/*a family keeps its type*/
+	BC_ASSERT_PTR_NULL(ms_metric_new("ms2_tester_level", MSMetricCounter, NULL, NULL));
+
+	ms_metric_add(counter, 2);
+	ms_metric_add(counter, 3);
+	ms_metric_set(gauge, 7.5);
+	ms_metric_add(gauge, -2.5);
+	ms_metric_observe(histogram, 0.05);
+	ms_metric_observe(histogram, 0.25);
+	ms_metric_observe(histogram, 0.25);
+	ms_metric_observe(histogram, 2);
+	BC_ASSERT_EQUAL(ms_metric_get(counter), 5, double, "%f");
+	BC_ASSERT_TRUE(fabs(ms_metric_get(histogram) - 2.55) < 1e-9);
+
+	text = ms_metrics_to_text();
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "# TYPE ms2_tester_events counter\n# HELP ms2_tester_events Events counted by the tester\n"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "ms2_tester_events_total{kind=\"a\"} 5\n"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "ms2_tester_events_total{kind=\"c\"} 0\n"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "# TYPE ms2_tester_level gauge\n"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "ms2_tester_level 5\n"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "# TYPE ms2_tester_latency_seconds histogram\n"));
+	/*the buckets are cumulative*/
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "ms2_tester_latency_seconds_bucket{stream=\"1\",le=\"0.1\"} 1\n"
+		"ms2_tester_latency_seconds_bucket{stream=\"1\",le=\"0.5\"} 3\n"
+		"ms2_tester_latency_seconds_bucket{stream=\"1\",le=\"+Inf\"} 4\n"
+		"ms2_tester_latency_seconds_count{stream=\"1\"} 4\n"
+		"ms2_tester_latency_seconds_sum{stream=\"1\"} 2.55\n"));
+	len = strlen(text);
+	BC_ASSERT_TRUE(len >= 6 && strcmp(text + len - 6, "# EOF\n") == 0);
+	ms_free(text);
+
+	ms_metric_set_labels(counter, "kind=\"b\"");
+	text = ms_metrics_to_text();
+	BC_ASSERT_PTR_NULL(strstr(text, "kind=\"a\""));
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "ms2_tester_events_total{kind=\"b\"} 5\n"));
+	ms_free(text);
+
+	/*the family is removed with its last metric*/
+	ms_metric_destroy(counter);
+	text = ms_metrics_to_text();
+	BC_ASSERT_PTR_NULL(strstr(text, "kind=\"b\""));
+	BC_ASSERT_PTR_NOT_NULL(strstr(text, "# TYPE ms2_tester_events counter\n"));
+	ms_free(text);
+	ms_metric_destroy(other);
+	ms_metric_destroy(gauge);
+	ms_metric_destroy(histogram);
+	text = ms_metrics_to_text();
+	BC_ASSERT_PTR_NULL(strstr(text, "ms2_tester_"));
+	ms_free(text);
+}
+
+#ifndef _WIN32
+static void test_metrics_server(void) {
+	static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+	MSMetric *gauge = ms_metric_new("ms2_tester_scraped", MSMetricGauge, NULL, NULL);
+	char *path = bc_tester_file("metrics.sock");
+	struct sockaddr_un addr;
+	char response[65536];
+	size_t len = 0;
+	ssize_t n;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		ms_warning("Path [%s] too long for a unix socket, skipping", path);
+		ms_metric_destroy(gauge);
+		free(path);
+		return;
+	}
+	ms_metric_set(gauge, 42);
+	BC_ASSERT_EQUAL(ms_metrics_start_server(path), 0, int, "%d");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	BC_ASSERT_EQUAL(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0, int, "%d");
+	BC_ASSERT_EQUAL((int)send(fd, request, strlen(request), 0), (int)strlen(request), int, "%d");
+	while (len < sizeof(response) - 1 && (n = recv(fd, response + len, sizeof(response) - 1 - len, 0)) > 0) {
+		len += n;
+	}
+	response[len] = '\0';
+	close(fd);
+
+	BC_ASSERT_EQUAL(strncmp(response, "HTTP/1.0 200 OK\r\n", 17), 0, int, "%d");
+	BC_ASSERT_PTR_NOT_NULL(strstr(response, "Content-Type: application/openmetrics-text"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(response, "\r\n\r\n# TYPE "));
+	BC_ASSERT_PTR_NOT_NULL(strstr(response, "\nms2_tester_scraped 42\n"));
+	BC_ASSERT_TRUE(len >= 6 && strcmp(response + len - 6, "# EOF\n") == 0);
+
+	ms_metrics_stop_server();
+	BC_ASSERT_NOT_EQUAL(access(path, F_OK), 0, int, "%d");
+	ms_metric_destroy(gauge);
+	free(path);
+}
+#endif
+
 static test_t tests[] = {
 	 { "Multiple ms_voip_init", filter_register_tester },
 	 { "Is multicast", test_is_multicast},
 	 { "FilterDesc enabling/disabling", test_filterdesc_enable_disable},
+	 { "Metrics export", test_metrics_export},
+#ifndef _WIN32
+	 { "Metrics server", test_metrics_server},
+#endif
 #ifdef VIDEO_ENABLED
-	 { "Video processing function", test_video_processing}
+	 { "Video processing function", test_video_processing},
+	 { "YUV buffer pool reuse", test_yuv_buf_allocator_reuse},
+	 { "YUV buffer pool size classes", test_yuv_buf_allocator_size_classes},
+	 { "YUV buffer pool cross-thread release", test_yuv_buf_allocator_cross_thread_release}
 #endif
 };
 
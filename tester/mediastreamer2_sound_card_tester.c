@@ -19,13 +19,17 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "mediastreamer2/mediastream.h"
 #include "mediastreamer2/dtmfgen.h"
+#include "mediastreamer2/flowcontrol.h"
 #include "mediastreamer2/msfileplayer.h"
 #include "mediastreamer2/msfilerec.h"
 #include "mediastreamer2/msrtp.h"
 #include "mediastreamer2/mstonedetector.h"
+#include "mediastreamer2/msvirtualsnd.h"
 #include "mediastreamer2_tester.h"
 #include "mediastreamer2_tester_private.h"
 
+#include <sys/stat.h>
+
 static int sound_card_tester_before_all(void) {
 	ms_init();
 	ms_filter_enable_statistics(TRUE);
@@ -428,6 +432,290 @@ static void soundread_filerec_fileplay_soundwrite(void) {
     free(writable_filename);
 }
 
+/* PulseAudio names the cards of module-null-sink and module-null-source "Null Output" and "Null Input" */
+static MSSndCard *find_pulseaudio_null_card(unsigned int capability) {
+	const MSList *it;
+	for (it = ms_snd_card_manager_get_list(ms_snd_card_manager_get()); it != NULL; it = it->next) {
+		MSSndCard *card = (MSSndCard *)it->data;
+		if (strcmp(ms_snd_card_get_driver_type(card), "PulseAudio") == 0 && (ms_snd_card_get_capabilities(card) & capability)
+			&& strstr(ms_snd_card_get_name(card), "Null") != NULL) {
+			return card;
+		}
+	}
+	return NULL;
+}
+
+static void pulseaudio_null_sink(void) {
+	MSSndCard *card = find_pulseaudio_null_card(MS_SND_CARD_CAP_PLAYBACK);
+	MSFilter *source, *writer;
+	MSAudioXrunStats xruns = {0};
+	int sample_rate = 16000;
+	int latency = 40, fragment_size = 10, value = 0;
+	bool_t send_silence = TRUE;
+
+	if (card == NULL) {
+		ms_warning("No PulseAudio null sink, start the daemon with module-null-sink loaded to run this test");
+		return;
+	}
+	ms_tester_create_ticker();
+	source = ms_filter_new(MS_VOID_SOURCE_ID);
+	writer = ms_snd_card_create_writer(card);
+	BC_ASSERT_PTR_NOT_NULL_FATAL(writer);
+	ms_filter_call_method(source, MS_FILTER_SET_SAMPLE_RATE, &sample_rate);
+	ms_filter_call_method(source, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	BC_ASSERT_EQUAL(ms_filter_call_method(writer, MS_FILTER_SET_SAMPLE_RATE, &sample_rate), 0, int, "%d");
+	BC_ASSERT_EQUAL(ms_filter_call_method(writer, MS_AUDIO_PLAYBACK_SET_LATENCY, &latency), 0, int, "%d");
+	BC_ASSERT_EQUAL(ms_filter_call_method(writer, MS_AUDIO_PLAYBACK_SET_FRAGMENT_SIZE, &fragment_size), 0, int, "%d");
+	ms_filter_link(source, 0, writer, 0);
+	ms_ticker_attach(ms_tester_ticker, source);
+
+	ms_sleep(3);
+
+	/* the buffer attributes can not change once the stream is connected */
+	BC_ASSERT_NOT_EQUAL(ms_filter_call_method(writer, MS_AUDIO_PLAYBACK_SET_LATENCY, &latency), 0, int, "%d");
+	ms_filter_call_method(writer, MS_AUDIO_PLAYBACK_GET_LATENCY, &value);
+	BC_ASSERT_EQUAL(value, latency, int, "%d");
+	BC_ASSERT_EQUAL(ms_filter_call_method(writer, MS_AUDIO_PLAYBACK_GET_XRUN_STATS, &xruns), 0, int, "%d");
+	/* the stream may start with an underrun, but a void source keeps it fed afterwards */
+	BC_ASSERT_LOWER(xruns.underruns, 1, unsigned int, "%u");
+	BC_ASSERT_EQUAL(xruns.overruns, 0, unsigned int, "%u");
+
+	ms_ticker_detach(ms_tester_ticker, source);
+	ms_filter_unlink(source, 0, writer, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(writer);
+	ms_tester_destroy_ticker();
+}
+
+static void pulseaudio_null_source(void) {
+	MSSndCard *card = find_pulseaudio_null_card(MS_SND_CARD_CAP_CAPTURE);
+	MSFilter *reader, *sink;
+	MSAudioXrunStats xruns = {0};
+	int latency = 40, value = 0;
+
+	if (card == NULL) {
+		ms_warning("No PulseAudio null source, start the daemon with module-null-source loaded to run this test");
+		return;
+	}
+	ms_tester_create_ticker();
+	reader = ms_snd_card_create_reader(card);
+	BC_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	sink = ms_filter_new(MS_VOID_SINK_ID);
+	BC_ASSERT_EQUAL(ms_filter_call_method(reader, MS_AUDIO_CAPTURE_SET_LATENCY, &latency), 0, int, "%d");
+	ms_filter_link(reader, 0, sink, 0);
+	ms_ticker_attach(ms_tester_ticker, reader);
+
+	ms_sleep(3);
+
+	ms_filter_call_method(reader, MS_AUDIO_CAPTURE_GET_LATENCY, &value);
+	BC_ASSERT_EQUAL(value, latency, int, "%d");
+	BC_ASSERT_EQUAL(ms_filter_call_method(reader, MS_AUDIO_CAPTURE_GET_XRUN_STATS, &xruns), 0, int, "%d");
+	BC_ASSERT_EQUAL(xruns.overruns, 0, unsigned int, "%u");
+
+	ms_ticker_detach(ms_tester_ticker, reader);
+	ms_filter_unlink(reader, 0, sink, 0);
+	ms_filter_destroy(reader);
+	ms_filter_destroy(sink);
+	ms_tester_destroy_ticker();
+}
+
+/* The snd-aloop and snd-dummy kernel modules provide sound cards without any hardware */
+static MSSndCard *find_alsa_virtual_card(void) {
+	const MSList *it;
+	for (it = ms_snd_card_manager_get_list(ms_snd_card_manager_get()); it != NULL; it = it->next) {
+		MSSndCard *card = (MSSndCard *)it->data;
+		unsigned int caps = MS_SND_CARD_CAP_CAPTURE | MS_SND_CARD_CAP_PLAYBACK;
+		const char *name = ms_snd_card_get_name(card);
+		if (strcmp(ms_snd_card_get_driver_type(card), "ALSA") == 0 && (ms_snd_card_get_capabilities(card) & caps) == caps
+			&& (strstr(name, "Loopback") != NULL || strstr(name, "Dummy") != NULL)) {
+			return card;
+		}
+	}
+	return NULL;
+}
+
+static void alsa_virtual_card(void) {
+	MSSndCard *card = find_alsa_virtual_card();
+	MSFilter *source, *writer, *reader, *sink;
+	MSAudioXrunStats xruns = {0};
+	int sample_rate = 16000;
+	bool_t send_silence = TRUE;
+
+	if (card == NULL) {
+		ms_warning("No ALSA loopback or dummy card, load the snd-aloop or snd-dummy module to run this test");
+		return;
+	}
+	ms_tester_create_ticker();
+	source = ms_filter_new(MS_VOID_SOURCE_ID);
+	sink = ms_filter_new(MS_VOID_SINK_ID);
+	writer = ms_snd_card_create_writer(card);
+	reader = ms_snd_card_create_reader(card);
+	BC_ASSERT_PTR_NOT_NULL_FATAL(writer);
+	BC_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	ms_filter_call_method(source, MS_FILTER_SET_SAMPLE_RATE, &sample_rate);
+	ms_filter_call_method(source, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	ms_filter_call_method(writer, MS_FILTER_SET_SAMPLE_RATE, &sample_rate);
+	ms_filter_call_method(reader, MS_FILTER_SET_SAMPLE_RATE, &sample_rate);
+	ms_filter_link(source, 0, writer, 0);
+	ms_filter_link(reader, 0, sink, 0);
+	/* the capture device becomes the clock of the ticker */
+	ms_ticker_attach_multiple(ms_tester_ticker, reader, source, NULL);
+
+	ms_sleep(3);
+
+	BC_ASSERT_EQUAL(ms_filter_call_method(reader, MS_AUDIO_CAPTURE_GET_XRUN_STATS, &xruns), 0, int, "%d");
+	BC_ASSERT_EQUAL(xruns.overruns, 0, unsigned int, "%u");
+	BC_ASSERT_EQUAL(ms_filter_call_method(writer, MS_AUDIO_PLAYBACK_GET_XRUN_STATS, &xruns), 0, int, "%d");
+	BC_ASSERT_LOWER(xruns.underruns, 1, unsigned int, "%u");
+
+	ms_ticker_detach(ms_tester_ticker, reader);
+	ms_ticker_detach(ms_tester_ticker, source);
+	ms_filter_unlink(source, 0, writer, 0);
+	ms_filter_unlink(reader, 0, sink, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(writer);
+	ms_filter_destroy(reader);
+	ms_filter_destroy(sink);
+	ms_tester_destroy_ticker();
+}
+
+#define VIRTUAL_CARDS 32
+#define VIRTUAL_PLAYBACK_FILE_NAME "virtual_playback.wav"
+
+/* Many virtual cards with drifting and jittering clocks, each one playing what it captures */
+static void virtual_sound_cards(void) {
+	MSSndCard *cards[VIRTUAL_CARDS];
+	MSFilter *readers[VIRTUAL_CARDS];
+	MSFilter *writers[VIRTUAL_CARDS];
+	MSVirtualSndCardParams params;
+	MSAudioXrunStats xruns;
+	char *playback_file = bc_tester_file(VIRTUAL_PLAYBACK_FILE_NAME);
+	struct stat st;
+	int rate = 0;
+	int i;
+
+	ms_tester_create_ticker();
+	for (i = 0; i < VIRTUAL_CARDS; i++) {
+		char name[32];
+		ms_virtual_snd_card_params_init(&params);
+		params.clock_skew = (float)(i * 100);
+		params.jitter = 5;
+		params.seed = i + 1;
+		params.playback_file = (i == 0) ? playback_file : NULL;
+		snprintf(name, sizeof(name), "virtual %i", i);
+		cards[i] = ms_virtual_snd_card_new(name, &params);
+		readers[i] = ms_snd_card_create_reader(cards[i]);
+		writers[i] = ms_snd_card_create_writer(cards[i]);
+		ms_filter_link(readers[i], 0, writers[i], 0);
+		ms_ticker_attach(ms_tester_ticker, readers[i]);
+	}
+	ms_filter_call_method(readers[0], MS_FILTER_GET_SAMPLE_RATE, &rate);
+	BC_ASSERT_EQUAL(rate, 16000, int, "%d");
+	rate = 8000;
+	BC_ASSERT_NOT_EQUAL(ms_filter_call_method(writers[0], MS_FILTER_SET_SAMPLE_RATE, &rate), 0, int, "%d");
+
+	ms_sleep(3);
+
+	for (i = 0; i < VIRTUAL_CARDS; i++) {
+		ms_ticker_detach(ms_tester_ticker, readers[i]);
+		BC_ASSERT_EQUAL(ms_filter_call_method(writers[i], MS_AUDIO_PLAYBACK_GET_XRUN_STATS, &xruns), 0, int, "%d");
+		/* a card consumes at the pace it captures, whatever its drift */
+		BC_ASSERT_EQUAL(xruns.overruns, 0, unsigned int, "%u");
+		BC_ASSERT_LOWER(xruns.underruns, 1, unsigned int, "%u");
+		ms_filter_unlink(readers[i], 0, writers[i], 0);
+		ms_filter_destroy(readers[i]);
+		ms_filter_destroy(writers[i]);
+		ms_snd_card_destroy(cards[i]);
+	}
+	ms_tester_destroy_ticker();
+
+	/* about 3 seconds of 16kHz mono samples were recorded */
+	BC_ASSERT_EQUAL(stat(playback_file, &st), 0, int, "%d");
+	BC_ASSERT_GREATER((int)st.st_size, 2 * 16000 * 2, int, "%d");
+	unlink(playback_file);
+	free(playback_file);
+}
+
+#define DRIFTING_CARDS_DURATION 60 /* s */
+
+/*
+ * Captures with a card and plays with another one, whose clocks drift apart. The drift may be compensated with a
+ * MSAudioFlowController as an application bridging two devices does: the samples captured over a second in excess of
+ * what the playback card consumes in a second are dropped over the next one, or inserted if missing.
+ */
+static void virtual_cards_drift_base(float capture_skew, float playback_skew, bool_t compensate, MSAudioXrunStats *xruns) {
+	MSVirtualSndCardParams params;
+	MSSndCard *capture_card, *playback_card;
+	MSFilter *reader, *writer;
+	MSAudioFlowController ctl;
+	MSTicker ticker;
+	MSQueue captured_queue;
+	int captured = 0;
+	mblk_t *m;
+
+	ms_virtual_snd_card_params_init(&params);
+	params.clock_skew = capture_skew;
+	params.jitter = 5;
+	capture_card = ms_virtual_snd_card_new("virtual capture", &params);
+	params.clock_skew = playback_skew;
+	params.jitter = 0;
+	playback_card = ms_virtual_snd_card_new("virtual playback", &params);
+	reader = ms_snd_card_create_reader(capture_card);
+	writer = ms_snd_card_create_writer(playback_card);
+	ms_filter_link(reader, 0, writer, 0);
+	ms_audio_flow_controller_init(&ctl);
+	ms_queue_init(&captured_queue);
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 10;
+	ms_filter_preprocess(reader, &ticker);
+	ms_filter_preprocess(writer, &ticker);
+	for (ticker.time = 0; ticker.time <= DRIFTING_CARDS_DURATION * 1000; ticker.time += ticker.interval) {
+		ms_filter_process(reader);
+		/* the link queue is the input of the writer, the captured periods are taken from it to be compensated */
+		while ((m = ms_queue_get(reader->outputs[0])) != NULL) ms_queue_put(&captured_queue, m);
+		while ((m = ms_queue_get(&captured_queue)) != NULL) {
+			captured += (int)msgdsize(m) / 2;
+			if (compensate) m = ms_audio_flow_controller_process(&ctl, m);
+			if (m != NULL) ms_queue_put(reader->outputs[0], m);
+		}
+		ms_filter_process(writer);
+		if (compensate && ticker.time > 0 && ticker.time % 1000 == 0) {
+			int consumed = (int)(params.sample_rate * (1 + playback_skew / 1e6));
+			ms_audio_flow_controller_set_target(&ctl, captured - consumed, captured);
+			captured = 0;
+		}
+	}
+	BC_ASSERT_EQUAL(ms_filter_call_method(writer, MS_AUDIO_PLAYBACK_GET_XRUN_STATS, xruns), 0, int, "%d");
+	ms_filter_postprocess(reader);
+	ms_filter_postprocess(writer);
+
+	ms_filter_unlink(reader, 0, writer, 0);
+	ms_filter_destroy(reader);
+	ms_filter_destroy(writer);
+	ms_snd_card_destroy(capture_card);
+	ms_snd_card_destroy(playback_card);
+}
+
+/* Two cards 4000 ppm apart, more than the playback buffer can absorb over a minute */
+static void virtual_sound_cards_drift(void) {
+	MSAudioXrunStats xruns;
+
+	virtual_cards_drift_base(2000, -2000, FALSE, &xruns);
+	BC_ASSERT_GREATER(xruns.overruns, 1, unsigned int, "%u");
+
+	virtual_cards_drift_base(2000, -2000, TRUE, &xruns);
+	BC_ASSERT_EQUAL(xruns.overruns, 0, unsigned int, "%u");
+	BC_ASSERT_LOWER(xruns.underruns, 1, unsigned int, "%u");
+
+	virtual_cards_drift_base(-2000, 2000, FALSE, &xruns);
+	BC_ASSERT_GREATER(xruns.underruns, 1, unsigned int, "%u");
+
+	virtual_cards_drift_base(-2000, 2000, TRUE, &xruns);
+	BC_ASSERT_EQUAL(xruns.overruns, 0, unsigned int, "%u");
+	BC_ASSERT_LOWER(xruns.underruns, 1, unsigned int, "%u");
+}
+
 
 test_t sound_card_tests[] = {
 	{ "dtmfgen-soundwrite", dtmfgen_soundwrite },
@@ -441,7 +729,12 @@ test_t sound_card_tests[] = {
 	{ "fileplay-soundwrite-8000-mono", fileplay_soundwrite_8000_mono },
 	{ "soundread-soundwrite", soundread_soundwrite },
 	{ "soundread-speexenc-speexdec-soundwrite", soundread_speexenc_speexdec_soundwrite },
-	{ "soundread-filerec-fileplay-soundwrite", soundread_filerec_fileplay_soundwrite }
+	{ "soundread-filerec-fileplay-soundwrite", soundread_filerec_fileplay_soundwrite },
+	{ "pulseaudio-null-sink", pulseaudio_null_sink },
+	{ "pulseaudio-null-source", pulseaudio_null_source },
+	{ "alsa-virtual-card", alsa_virtual_card },
+	{ "virtual-sound-cards", virtual_sound_cards },
+	{ "virtual-sound-cards-drift", virtual_sound_cards_drift }
 };
 
 test_suite_t sound_card_test_suite = {
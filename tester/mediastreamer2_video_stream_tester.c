@@ -19,6 +19,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "mediastreamer2/mediastream.h"
 #include "mediastreamer2/msrtp.h"
+#include "mediastreamer2/msjpegwriter.h"
+#include "mediastreamer2/msframerateconv.h"
+#include "rtp_reorder_buffer.h"
 #include "mediastreamer2_tester.h"
 #include "mediastreamer2_tester_private.h"
 #include <math.h>
@@ -455,6 +458,83 @@ static void avpf_rpsi_count(void) {
 	video_stream_tester_destroy(margaux);
 }
 
+static void vp8_temporal_layers_base(int max_temporal_layer, float expected_fps) {
+	video_stream_tester_t* marielle=video_stream_tester_new();
+	video_stream_tester_t* margaux=video_stream_tester_new();
+	bool_t supported = ms_filter_codec_supported("vp8");
+	int layers = 3;
+	int dummy = 0;
+
+	margaux->vconf=ms_new0(MSVideoConfiguration,1);
+	margaux->vconf->bitrate_limit=margaux->vconf->required_bitrate=256000;
+	margaux->vconf->fps=20;
+	margaux->vconf->vsize.height=MS_VIDEO_SIZE_CIF_H;
+	margaux->vconf->vsize.width=MS_VIDEO_SIZE_CIF_W;
+	margaux->cam = mediastreamer2_tester_get_mire_webcam(ms_web_cam_manager_get());
+
+	if (supported) {
+		init_video_streams(marielle, margaux, FALSE, TRUE, NULL, VP8_PAYLOAD_TYPE);
+		BC_ASSERT_EQUAL(ms_filter_call_method(margaux->vs->ms.encoder, MS_VIDEO_ENCODER_SET_TEMPORAL_LAYERS, &layers), 0, int, "%d");
+		ms_filter_call_method(marielle->vs->ms.decoder, MS_VIDEO_DECODER_SET_MAX_TEMPORAL_LAYER, &max_temporal_layer);
+
+		BC_ASSERT_TRUE(wait_for_until_with_parse_events(&marielle->vs->ms, &margaux->vs->ms, &marielle->stats.number_of_decoder_first_image_decoded, 1, 10000, event_queue_cb, &marielle->stats, event_queue_cb, &margaux->stats));
+		wait_for_until_with_parse_events(&marielle->vs->ms, &margaux->vs->ms, &dummy, 1, 5000, event_queue_cb, &marielle->stats, event_queue_cb, &margaux->stats);
+		/* Only the frames of the kept layers are decoded, without any decoding error. */
+		BC_ASSERT_LOWER(fabs(video_stream_get_received_framerate(marielle->vs) - expected_fps), 2.f, float, "%f");
+		BC_ASSERT_EQUAL(marielle->stats.number_of_decoder_decoding_error, 0, int, "%d");
+		uninit_video_streams(marielle, margaux);
+	} else {
+		ms_error("VP8 codec is not supported!");
+	}
+	video_stream_tester_destroy(marielle);
+	video_stream_tester_destroy(margaux);
+}
+
+static void vp8_temporal_layers_base_layer_only(void) {
+	vp8_temporal_layers_base(0, 5);
+}
+
+static void vp8_temporal_layers_two_lower_layers(void) {
+	vp8_temporal_layers_base(1, 10);
+}
+
+static void vp8_temporal_layers_all_layers(void) {
+	vp8_temporal_layers_base(2, 20);
+}
+
+static void avpf_vp8_temporal_layers_loss(void) {
+	video_stream_tester_t* marielle=video_stream_tester_new();
+	video_stream_tester_t* margaux=video_stream_tester_new();
+	OrtpNetworkSimulatorParams params = { 0 };
+	bool_t supported = ms_filter_codec_supported("vp8");
+	int layers = 3;
+
+	margaux->vconf=ms_new0(MSVideoConfiguration,1);
+	margaux->vconf->bitrate_limit=margaux->vconf->required_bitrate=256000;
+	margaux->vconf->fps=20;
+	margaux->vconf->vsize.height=MS_VIDEO_SIZE_CIF_H;
+	margaux->vconf->vsize.width=MS_VIDEO_SIZE_CIF_W;
+	margaux->cam = mediastreamer2_tester_get_mire_webcam(ms_web_cam_manager_get());
+
+	if (supported) {
+		params.enabled = TRUE;
+		params.loss_rate = 5.;
+		init_video_streams(marielle, margaux, TRUE, FALSE, &params, VP8_PAYLOAD_TYPE);
+		BC_ASSERT_EQUAL(ms_filter_call_method(margaux->vs->ms.encoder, MS_VIDEO_ENCODER_SET_TEMPORAL_LAYERS, &layers), 0, int, "%d");
+
+		BC_ASSERT_TRUE(wait_for_until_with_parse_events(&marielle->vs->ms, &margaux->vs->ms, &marielle->stats.number_of_decoder_first_image_decoded, 1, 10000, event_queue_cb, &marielle->stats, event_queue_cb, &margaux->stats));
+		/* The base layer frames stored as recovery points are acknowledged, and the losses are reported by SLI. */
+		BC_ASSERT_TRUE(wait_for_until_with_parse_events(&marielle->vs->ms, &margaux->vs->ms, &margaux->stats.number_of_RPSI, 1, 15000, event_queue_cb, &marielle->stats, event_queue_cb, &margaux->stats));
+		BC_ASSERT_TRUE(wait_for_until_with_parse_events(&marielle->vs->ms, &margaux->vs->ms, &margaux->stats.number_of_SLI, 1, 15000, event_queue_cb, &marielle->stats, event_queue_cb, &margaux->stats));
+		BC_ASSERT_GREATER(video_stream_get_received_framerate(marielle->vs), 5.f, float, "%f");
+		uninit_video_streams(marielle, margaux);
+	} else {
+		ms_error("VP8 codec is not supported!");
+	}
+	video_stream_tester_destroy(marielle);
+	video_stream_tester_destroy(margaux);
+}
+
 static void video_stream_first_iframe_lost_vp8(void) {
 	video_stream_tester_t* marielle=video_stream_tester_new();
 	video_stream_tester_t* margaux=video_stream_tester_new();
@@ -678,6 +758,585 @@ static void video_configuration_stream(void) {
 #endif
 }
 
+/*
+ * Video quality measurement: the source generates a synthetic moving picture, deterministic for a given sequence
+ * number and resolution, and tags each frame with its sequence number. The sink reads the tag back from the
+ * decoded frames, regenerates the original and compares them.
+ */
+#define VIDEO_QUALITY_FILE_NAME "video_quality.csv"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static void video_quality_generate(MSPicture *pic, uint32_t seq) {
+	int *ctab = ms_new(int, pic->w);
+	int *rtab = ms_new(int, pic->h);
+	int i, j;
+
+	for (j = 0; j < pic->w; j++) ctab[j] = (int)(50 * sin(2 * M_PI * (3.0 * j / pic->w + seq * 0.02)));
+	for (i = 0; i < pic->h; i++) rtab[i] = (int)(50 * cos(2 * M_PI * (2.0 * i / pic->h + seq * 0.01)));
+	for (i = 0; i < pic->h; i++) {
+		uint8_t *y = pic->planes[0] + i * pic->strides[0];
+		for (j = 0; j < pic->w; j++) y[j] = (uint8_t)(128 + ctab[j] + rtab[i]);
+	}
+	for (i = 0; i < pic->h / 2; i++) {
+		uint8_t *u = pic->planes[1] + i * pic->strides[1];
+		uint8_t *v = pic->planes[2] + i * pic->strides[2];
+		for (j = 0; j < pic->w / 2; j++) {
+			u[j] = (uint8_t)(128 + ctab[2 * j] / 2);
+			v[j] = (uint8_t)(128 + rtab[2 * i] / 2);
+		}
+	}
+	/* The timestamp is part of the picture, it is set to the sequence number so that the original can be regenerated. */
+	ms_yuv_buf_write_tag(pic, seq, seq);
+	ms_free(ctab);
+	ms_free(rtab);
+}
+
+typedef struct _VideoQualitySourceData {
+	MSVideoSize vsize;
+	float fps;
+	uint64_t start_time;
+	uint32_t seq;
+} VideoQualitySourceData;
+
+static void video_quality_source_init(MSFilter *f) {
+	VideoQualitySourceData *d = ms_new0(VideoQualitySourceData, 1);
+	MS_VIDEO_SIZE_ASSIGN(d->vsize, VGA);
+	d->fps = 15;
+	f->data = d;
+}
+
+static void video_quality_source_preprocess(MSFilter *f) {
+	VideoQualitySourceData *d = (VideoQualitySourceData *)f->data;
+	d->start_time = f->ticker->time;
+	d->seq = 0;
+}
+
+static void video_quality_source_process(MSFilter *f) {
+	VideoQualitySourceData *d = (VideoQualitySourceData *)f->data;
+	MSPicture pic;
+	mblk_t *m;
+
+	ms_filter_lock(f);
+	if ((f->ticker->time - d->start_time) * d->fps >= d->seq * 1000.0) {
+		m = ms_yuv_buf_alloc(&pic, d->vsize.width, d->vsize.height);
+		video_quality_generate(&pic, d->seq);
+		mblk_set_timestamp_info(m, (uint32_t)(f->ticker->time * 90));
+		ms_queue_put(f->outputs[0], m);
+		d->seq++;
+	}
+	ms_filter_unlock(f);
+}
+
+static void video_quality_source_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+static int video_quality_source_set_vsize(MSFilter *f, void *arg) {
+	VideoQualitySourceData *d = (VideoQualitySourceData *)f->data;
+	ms_filter_lock(f);
+	d->vsize = *(MSVideoSize *)arg;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int video_quality_source_get_vsize(MSFilter *f, void *arg) {
+	*(MSVideoSize *)arg = ((VideoQualitySourceData *)f->data)->vsize;
+	return 0;
+}
+
+static int video_quality_source_set_fps(MSFilter *f, void *arg) {
+	VideoQualitySourceData *d = (VideoQualitySourceData *)f->data;
+	ms_filter_lock(f);
+	d->fps = *(float *)arg;
+	d->start_time = f->ticker ? f->ticker->time : 0;
+	d->seq = 0;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int video_quality_source_get_fps(MSFilter *f, void *arg) {
+	*(float *)arg = ((VideoQualitySourceData *)f->data)->fps;
+	return 0;
+}
+
+static int video_quality_source_get_pix_fmt(MSFilter *f, void *arg) {
+	*(MSPixFmt *)arg = MS_YUV420P;
+	return 0;
+}
+
+static MSFilterMethod video_quality_source_methods[] = {
+	{ MS_FILTER_SET_VIDEO_SIZE, video_quality_source_set_vsize },
+	{ MS_FILTER_GET_VIDEO_SIZE, video_quality_source_get_vsize },
+	{ MS_FILTER_SET_FPS, video_quality_source_set_fps },
+	{ MS_FILTER_GET_FPS, video_quality_source_get_fps },
+	{ MS_FILTER_GET_PIX_FMT, video_quality_source_get_pix_fmt },
+	{ 0, NULL }
+};
+
+static MSFilterDesc video_quality_source_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSVideoQualitySource",
+	"Generates tagged synthetic frames for video quality measurement.",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	1,
+	video_quality_source_init,
+	video_quality_source_preprocess,
+	video_quality_source_process,
+	NULL,
+	video_quality_source_uninit,
+	video_quality_source_methods
+};
+
+typedef struct _VideoQualitySinkData {
+	int received;
+	int untagged;
+	uint32_t first_seq;
+	uint32_t last_seq;
+	double psnr_sum;
+	double psnr_min;
+	double ssim_sum;
+	double ssim_min;
+} VideoQualitySinkData;
+
+static void video_quality_sink_init(MSFilter *f) {
+	f->data = ms_new0(VideoQualitySinkData, 1);
+}
+
+static void video_quality_sink_process(MSFilter *f) {
+	VideoQualitySinkData *d = (VideoQualitySinkData *)f->data;
+	mblk_t *m;
+
+	while ((m = ms_queue_get(f->inputs[0])) != NULL) {
+		MSPicture pic, ref;
+		uint32_t seq, ts;
+		if (ms_yuv_buf_init_from_mblk(&pic, m) == 0 && ms_yuv_buf_read_tag(&pic, &seq, &ts) == 0) {
+			mblk_t *orig = ms_yuv_buf_alloc(&ref, pic.w, pic.h);
+			double psnr, ssim;
+			video_quality_generate(&ref, seq);
+			psnr = ms_yuv_buf_psnr(&ref, &pic);
+			ssim = ms_yuv_buf_ssim(&ref, &pic);
+			freemsg(orig);
+			ms_filter_lock(f);
+			if (d->received == 0) {
+				d->first_seq = seq;
+				d->psnr_min = psnr;
+				d->ssim_min = ssim;
+			}
+			if (seq > d->last_seq) d->last_seq = seq;
+			d->psnr_sum += psnr;
+			d->ssim_sum += ssim;
+			d->psnr_min = MIN(d->psnr_min, psnr);
+			d->ssim_min = MIN(d->ssim_min, ssim);
+			d->received++;
+			ms_filter_unlock(f);
+		} else {
+			ms_filter_lock(f);
+			d->untagged++;
+			ms_filter_unlock(f);
+		}
+		freemsg(m);
+	}
+	if (f->inputs[1] != NULL) ms_queue_flush(f->inputs[1]);
+}
+
+static void video_quality_sink_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+static MSFilterDesc video_quality_sink_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSVideoQualitySink",
+	"Compares the received tagged frames with the original ones.",
+	MS_FILTER_OTHER,
+	NULL,
+	2,
+	0,
+	video_quality_sink_init,
+	NULL,
+	video_quality_sink_process,
+	NULL,
+	video_quality_sink_uninit,
+	NULL
+};
+
+static void video_quality_write_csv(const char *codec, MSVideoSize vsize, float loss, VideoQualitySinkData *d, int lost, bool_t passed) {
+	char *filename = bc_tester_file(VIDEO_QUALITY_FILE_NAME);
+	FILE *f = fopen(filename, "a");
+
+	if (f != NULL) {
+		if (ftell(f) == 0) {
+			fprintf(f, "codec,width,height,loss,received,lost,untagged,psnr_mean,psnr_min,ssim_mean,ssim_min,result\n");
+		}
+		fprintf(f, "%s,%d,%d,%.1f,%d,%d,%d,%.2f,%.2f,%.4f,%.4f,%s\n", codec, vsize.width, vsize.height, loss,
+			d->received, lost, d->untagged, d->psnr_sum / d->received, d->psnr_min, d->ssim_sum / d->received,
+			d->ssim_min, passed ? "pass" : "fail");
+		fclose(f);
+	} else {
+		ms_error("Cannot open %s for writing", filename);
+	}
+	free(filename);
+}
+
+static void video_quality_base(int payload_type, MSVideoSize vsize, int bitrate, float loss, double min_psnr, double min_ssim) {
+	video_stream_tester_t *marielle = video_stream_tester_new();
+	video_stream_tester_t *margaux = video_stream_tester_new();
+	PayloadType *pt = rtp_profile_get_payload(&rtp_profile, payload_type);
+	bool_t supported = pt ? ms_filter_codec_supported(pt->mime_type) : FALSE;
+	OrtpNetworkSimulatorParams params = { 0 };
+
+	if (supported) {
+		MSFilter *source;
+		VideoQualitySinkData stats;
+		double psnr, ssim;
+		int lost;
+		bool_t passed;
+
+		if (ms_factory_lookup_filter_by_name(ms_factory_get_fallback(), video_quality_sink_desc.name) == NULL) {
+			ms_factory_register_filter(ms_factory_get_fallback(), &video_quality_sink_desc);
+		}
+		margaux->vconf = ms_new0(MSVideoConfiguration, 1);
+		margaux->vconf->required_bitrate = bitrate;
+		margaux->vconf->bitrate_limit = bitrate;
+		margaux->vconf->vsize = vsize;
+		margaux->vconf->fps = 15;
+		create_video_stream(marielle, payload_type);
+		create_video_stream(margaux, payload_type);
+		if (loss > 0) {
+			/* Let the receiver recover from the losses with PLI/SLI, as it would in a call. */
+			payload_type_set_flag(pt, PAYLOAD_TYPE_RTCP_FEEDBACK_ENABLED);
+			params.enabled = TRUE;
+			params.loss_rate = loss;
+			/* The simulator drops the packets a session receives. */
+			rtp_session_enable_network_simulation(marielle->vs->ms.sessions.rtp_session, &params);
+		} else {
+			payload_type_unset_flag(pt, PAYLOAD_TYPE_RTCP_FEEDBACK_ENABLED);
+		}
+		video_stream_set_direction(marielle->vs, MediaStreamRecvOnly);
+		video_stream_set_display_filter_name(marielle->vs, "MSVideoQualitySink");
+		BC_ASSERT_EQUAL(video_stream_start(marielle->vs, &rtp_profile, margaux->local_ip, margaux->local_rtp, margaux->local_ip, margaux->local_rtcp, payload_type, 50, marielle->cam), 0, int, "%d");
+		source = ms_filter_new_from_desc(&video_quality_source_desc);
+		video_stream_set_direction(margaux->vs, MediaStreamSendOnly);
+		BC_ASSERT_EQUAL(video_stream_start_with_source(margaux->vs, &rtp_profile, marielle->local_ip, marielle->local_rtp, marielle->local_ip, marielle->local_rtcp, payload_type, 50, NULL, source), 0, int, "%d");
+		BC_ASSERT_PTR_NOT_NULL_FATAL(marielle->vs->output);
+
+		wait_for_until_with_parse_events(&marielle->vs->ms, &margaux->vs->ms, &((VideoQualitySinkData *)marielle->vs->output->data)->received,
+			150, 30000, event_queue_cb, &marielle->stats, event_queue_cb, &margaux->stats);
+
+		ms_filter_lock(marielle->vs->output);
+		stats = *(VideoQualitySinkData *)marielle->vs->output->data;
+		ms_filter_unlock(marielle->vs->output);
+
+		BC_ASSERT_TRUE(stats.received > 0);
+		if (loss > 0) {
+			const rtp_stats_t *rtp_stats = rtp_session_get_stats(marielle->vs->ms.sessions.rtp_session);
+			BC_ASSERT_TRUE(rtp_stats->cum_packet_loss > 0);
+		}
+		if (stats.received > 0) {
+			psnr = stats.psnr_sum / stats.received;
+			ssim = stats.ssim_sum / stats.received;
+			lost = (int)(stats.last_seq - stats.first_seq + 1) - stats.received;
+			passed = psnr >= min_psnr && ssim >= min_ssim;
+			ms_message("Video quality %s %dx%d loss=%.1f%%: received=%d lost=%d untagged=%d psnr mean=%.2fdB min=%.2fdB ssim mean=%.4f min=%.4f",
+				pt->mime_type, vsize.width, vsize.height, loss, stats.received, lost, stats.untagged, psnr, stats.psnr_min, ssim, stats.ssim_min);
+			video_quality_write_csv(pt->mime_type, vsize, loss, &stats, lost, passed);
+			BC_ASSERT_TRUE(psnr >= min_psnr);
+			BC_ASSERT_TRUE(ssim >= min_ssim);
+		}
+
+		destroy_video_stream(marielle);
+		destroy_video_stream(margaux);
+		payload_type_unset_flag(pt, PAYLOAD_TYPE_RTCP_FEEDBACK_ENABLED);
+	} else {
+		ms_error("Codec is not supported!");
+	}
+	video_stream_tester_destroy(marielle);
+	video_stream_tester_destroy(margaux);
+}
+
+static void video_quality_vp8_qvga(void) {
+	MSVideoSize vsize;
+	MS_VIDEO_SIZE_ASSIGN(vsize, QVGA);
+	video_quality_base(VP8_PAYLOAD_TYPE, vsize, 256000, 0, 30, 0.9);
+}
+
+static void video_quality_vp8_vga(void) {
+	MSVideoSize vsize;
+	MS_VIDEO_SIZE_ASSIGN(vsize, VGA);
+	video_quality_base(VP8_PAYLOAD_TYPE, vsize, 1024000, 0, 30, 0.9);
+}
+
+static void video_quality_vp8_vga_with_loss(void) {
+	MSVideoSize vsize;
+	MS_VIDEO_SIZE_ASSIGN(vsize, VGA);
+	video_quality_base(VP8_PAYLOAD_TYPE, vsize, 1024000, 5, 22, 0.75);
+}
+
+static void video_quality_h264_vga(void) {
+	MSVideoSize vsize;
+	MS_VIDEO_SIZE_ASSIGN(vsize, VGA);
+	video_quality_base(H264_PAYLOAD_TYPE, vsize, 1024000, 0, 30, 0.9);
+}
+
+#define SNAPSHOT_FILE_NAME "snapshot.jpg"
+
+static void jpeg_snapshot_data_cb(void *user_data, const uint8_t *data, size_t size) {
+	/* A jpeg starts with a SOI marker. */
+	if (size > 2 && data[0] == 0xFF && data[1] == 0xD8) (*(volatile int *)user_data)++;
+}
+
+static bool_t wait_for_snapshot_file(const char *filename, int timeout_ms) {
+	int elapsed;
+	for (elapsed = 0; elapsed < timeout_ms; elapsed += 20) {
+		FILE *f = fopen(filename, "rb");
+		if (f != NULL) {
+			fclose(f);
+			return TRUE;
+		}
+		ms_usleep(20000);
+	}
+	return FALSE;
+}
+
+static void jpeg_writer_snapshot(void) {
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *mire = ms_filter_new(MS_MIRE_ID);
+	MSFilter *writer = ms_filter_new(MS_JPEG_WRITER_ID);
+	char *filename = bc_tester_file(SNAPSHOT_FILE_NAME);
+	volatile int snapshots = 0;
+	MSJpegWriterDataCallback cb;
+	int elapsed;
+
+	unlink(filename);
+	cb.cb = jpeg_snapshot_data_cb;
+	cb.user_data = (void *)&snapshots;
+	ms_filter_call_method(writer, MS_JPEG_WRITER_SET_DATA_CALLBACK, &cb);
+	ms_filter_call_method(writer, MS_JPEG_WRITER_TAKE_SNAPSHOT, filename);
+	ms_filter_link(mire, 0, writer, 0);
+	ms_ticker_attach(ticker, mire);
+
+	/* The file is written before the callback is called. */
+	for (elapsed = 0; elapsed < 5000 && snapshots == 0; elapsed += 20) ms_usleep(20000);
+	BC_ASSERT_EQUAL(snapshots, 1, int, "%d");
+	BC_ASSERT_TRUE(wait_for_snapshot_file(filename, 100));
+	unlink(filename);
+
+	/* Removing the callback does not cancel the file snapshots. */
+	cb.cb = NULL;
+	ms_filter_call_method(writer, MS_JPEG_WRITER_SET_DATA_CALLBACK, &cb);
+	ms_filter_call_method(writer, MS_JPEG_WRITER_TAKE_SNAPSHOT, filename);
+	BC_ASSERT_TRUE(wait_for_snapshot_file(filename, 5000));
+	BC_ASSERT_EQUAL(snapshots, 1, int, "%d");
+
+	ms_ticker_detach(ticker, mire);
+	ms_filter_unlink(mire, 0, writer, 0);
+	ms_filter_destroy(writer);
+	ms_filter_destroy(mire);
+	ms_ticker_destroy(ticker);
+	unlink(filename);
+	free(filename);
+}
+
+static void reorder_buffer_put(MSRtpReorderBuffer *rb, uint16_t cseq, bool_t marker, uint64_t curtime) {
+	mblk_t *m = allocb(16, 0);
+	mblk_set_cseq(m, cseq);
+	mblk_set_marker_info(m, marker);
+	ms_rtp_reorder_buffer_put(rb, m, curtime);
+}
+
+/* Checks that the queue holds exactly the count packets starting at first, in order, and empties it. */
+static void reorder_buffer_check_output(MSQueue *q, uint16_t first, int count) {
+	mblk_t *m;
+	int received = 0;
+	while ((m = ms_queue_get(q)) != NULL) {
+		BC_ASSERT_EQUAL(mblk_get_cseq(m), (uint16_t)(first + received), int, "%d");
+		received++;
+		freemsg(m);
+	}
+	BC_ASSERT_EQUAL(received, count, int, "%d");
+}
+
+static void rtp_reorder_buffer(void) {
+	MSRtpReorderBuffer *rb;
+	MSQueue q;
+
+	ms_queue_init(&q);
+
+	/* Reordered packets are released in order. */
+	rb = ms_rtp_reorder_buffer_new(30, MS_RTP_REORDER_BUFFER_DEFAULT_MAX_PACKETS);
+	reorder_buffer_put(rb, 10, FALSE, 0);
+	reorder_buffer_put(rb, 12, FALSE, 0);
+	reorder_buffer_put(rb, 11, FALSE, 0);
+	reorder_buffer_put(rb, 13, TRUE, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 0);
+	reorder_buffer_check_output(&q, 10, 4);
+	BC_ASSERT_EQUAL(ms_rtp_reorder_buffer_get_reordered_packets(rb), 1, unsigned int, "%u");
+
+	/* A gap is waited for until the delay elapses, then the late packet is dropped. */
+	reorder_buffer_put(rb, 15, FALSE, 100);
+	ms_rtp_reorder_buffer_get(rb, &q, 100);
+	reorder_buffer_check_output(&q, 15, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 129);
+	reorder_buffer_check_output(&q, 15, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 130);
+	reorder_buffer_check_output(&q, 15, 1);
+	reorder_buffer_put(rb, 14, FALSE, 131);
+	ms_rtp_reorder_buffer_get(rb, &q, 131);
+	reorder_buffer_check_output(&q, 14, 0);
+
+	/* A gap opened at time 0 is not waited for longer than any other. */
+	ms_rtp_reorder_buffer_flush(rb, &q);
+	reorder_buffer_put(rb, 20, FALSE, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 0);
+	reorder_buffer_check_output(&q, 20, 1);
+	reorder_buffer_put(rb, 22, FALSE, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 29);
+	reorder_buffer_check_output(&q, 22, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 30);
+	reorder_buffer_check_output(&q, 22, 1);
+
+	/* A complete frame behind a gap is released without waiting. */
+	reorder_buffer_put(rb, 23, TRUE, 20);
+	ms_rtp_reorder_buffer_get(rb, &q, 20);
+	reorder_buffer_check_output(&q, 23, 1);
+	reorder_buffer_put(rb, 25, TRUE, 20);
+	reorder_buffer_put(rb, 26, FALSE, 20);
+	ms_rtp_reorder_buffer_get(rb, &q, 20);
+	reorder_buffer_check_output(&q, 25, 0);
+	reorder_buffer_put(rb, 27, TRUE, 20);
+	ms_rtp_reorder_buffer_get(rb, &q, 20);
+	reorder_buffer_check_output(&q, 25, 3);
+
+	/* Duplicates are dropped, whether they are held or already released. */
+	reorder_buffer_put(rb, 29, FALSE, 40);
+	reorder_buffer_put(rb, 29, FALSE, 40);
+	reorder_buffer_put(rb, 28, FALSE, 40);
+	reorder_buffer_put(rb, 28, FALSE, 40);
+	ms_rtp_reorder_buffer_get(rb, &q, 40);
+	reorder_buffer_check_output(&q, 28, 2);
+	reorder_buffer_put(rb, 29, FALSE, 40);
+	ms_rtp_reorder_buffer_get(rb, &q, 40);
+	reorder_buffer_check_output(&q, 29, 0);
+	ms_rtp_reorder_buffer_destroy(rb);
+
+	/* The sequence numbers wrap around. */
+	rb = ms_rtp_reorder_buffer_new(30, MS_RTP_REORDER_BUFFER_DEFAULT_MAX_PACKETS);
+	reorder_buffer_put(rb, 65534, FALSE, 0);
+	reorder_buffer_put(rb, 0, FALSE, 0);
+	reorder_buffer_put(rb, 65535, FALSE, 0);
+	reorder_buffer_put(rb, 1, TRUE, 0);
+	ms_rtp_reorder_buffer_get(rb, &q, 0);
+	reorder_buffer_check_output(&q, 65534, 4);
+	ms_rtp_reorder_buffer_destroy(rb);
+}
+
+/*
+ * Feeds frames captured at 30 fps to a converter set to 15 fps, all delivered in the same tick, and checks that
+ * they are placed by their timestamps: about one in two is forwarded, evenly spaced.
+ */
+static void frame_rate_conv_check(uint32_t first_timestamp) {
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *source = ms_filter_new(MS_VOID_SOURCE_ID);
+	MSFilter *conv = ms_filter_new(MS_FRAME_RATE_CONV_ID);
+	MSFilter *sink = ms_filter_new(MS_VOID_SINK_ID);
+	MSFrameRateConvStats stats;
+	float fps = 15;
+	uint32_t last_timestamp = 0;
+	int forwarded = 0;
+	mblk_t *m;
+	int i;
+
+	ms_filter_link(source, 0, conv, 0);
+	ms_filter_link(conv, 0, sink, 0);
+	ms_filter_call_method(conv, MS_FILTER_SET_FPS, &fps);
+	ms_filter_preprocess(conv, ticker);
+	for (i = 0; i < 60; i++) {
+		m = allocb(16, 0);
+		mblk_set_timestamp_info(m, first_timestamp + i * 3000);
+		ms_queue_put(conv->inputs[0], m);
+	}
+	ms_filter_process(conv);
+	while ((m = ms_queue_get(conv->outputs[0])) != NULL) {
+		uint32_t timestamp = mblk_get_timestamp_info(m);
+		if (forwarded > 0) {
+			BC_ASSERT_GREATER((int32_t)(timestamp - last_timestamp), 3000, int, "%d");
+			BC_ASSERT_LOWER((int32_t)(timestamp - last_timestamp), 9000, int, "%d");
+		}
+		last_timestamp = timestamp;
+		forwarded++;
+		freemsg(m);
+	}
+	BC_ASSERT_GREATER(forwarded, 29, int, "%d");
+	BC_ASSERT_LOWER(forwarded, 31, int, "%d");
+	ms_filter_call_method(conv, MS_FRAME_RATE_CONV_GET_STATS, &stats);
+	BC_ASSERT_GREATER(stats.dropped_frames, 28, unsigned int, "%u");
+	ms_filter_postprocess(conv);
+
+	ms_filter_unlink(source, 0, conv, 0);
+	ms_filter_unlink(conv, 0, sink, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(conv);
+	ms_filter_destroy(sink);
+	ms_ticker_destroy(ticker);
+}
+
+static void frame_rate_conv_timestamps(void) {
+	frame_rate_conv_check(3000);
+	/* The 90kHz timestamps wrap around in the middle of the sequence. */
+	frame_rate_conv_check(0xFFFFFFFF - 30 * 3000 + 1);
+}
+
+/* Meant to run headless, for instance with xvfb-run. Without the Xv extension, the frames are counted as dropped. */
+static void x11_video_display_stats(void) {
+	MSTicker *ticker;
+	MSFilter *mire;
+	MSFilter *display;
+	MSVideoDisplayStats stats = {0};
+	MSVideoDisplayStats stopped_stats = {0};
+
+	if (getenv("DISPLAY") == NULL) {
+		ms_message("No X11 display, skipping the X11 video display test");
+		return;
+	}
+	display = ms_filter_new_from_name("MSX11Video");
+	if (display == NULL) {
+		ms_message("No X11 video display, skipping the X11 video display test");
+		return;
+	}
+	ticker = ms_ticker_new();
+	mire = ms_filter_new(MS_MIRE_ID);
+	ms_filter_link(mire, 0, display, 0);
+	ms_ticker_attach(ticker, mire);
+	ms_usleep(2000000);
+	ms_ticker_detach(ticker, mire);
+
+	/* The render thread is joined once the graph is detached: the counters do not move anymore. */
+	BC_ASSERT_EQUAL(ms_filter_call_method(display, MS_VIDEO_DISPLAY_GET_STATS, &stats), 0, int, "%d");
+	BC_ASSERT_GREATER(stats.rendered_frames + stats.dropped_frames, 1, unsigned int, "%u");
+	ms_usleep(200000);
+	ms_filter_call_method(display, MS_VIDEO_DISPLAY_GET_STATS, &stopped_stats);
+	BC_ASSERT_EQUAL(stopped_stats.rendered_frames, stats.rendered_frames, unsigned int, "%u");
+	BC_ASSERT_EQUAL(stopped_stats.dropped_frames, stats.dropped_frames, unsigned int, "%u");
+
+	/* The render thread is started again with the graph. */
+	ms_ticker_attach(ticker, mire);
+	ms_usleep(1000000);
+	ms_ticker_detach(ticker, mire);
+	ms_filter_call_method(display, MS_VIDEO_DISPLAY_GET_STATS, &stopped_stats);
+	BC_ASSERT_GREATER(stopped_stats.rendered_frames + stopped_stats.dropped_frames,
+		stats.rendered_frames + stats.dropped_frames + 1, unsigned int, "%u");
+
+	ms_filter_unlink(mire, 0, display, 0);
+	ms_filter_destroy(display);
+	ms_filter_destroy(mire);
+	ms_ticker_destroy(ticker);
+}
+
 static test_t tests[] = {
 	{ "Basic video stream", basic_video_stream },
 	{ "Multicast video stream",multicast_video_stream },
@@ -691,7 +1350,19 @@ static test_t tests[] = {
 	{ "AVPF video stream first iframe lost H264", avpf_video_stream_first_iframe_lost_h264 },
 	{ "AVP video stream first iframe lost", video_stream_first_iframe_lost_vp8 },
 	{ "Video configuration", video_configuration_stream },
-	{ "AVPF RPSI count", avpf_rpsi_count}
+	{ "AVPF RPSI count", avpf_rpsi_count},
+	{ "VP8 temporal layers: base layer only", vp8_temporal_layers_base_layer_only },
+	{ "VP8 temporal layers: two lower layers", vp8_temporal_layers_two_lower_layers },
+	{ "VP8 temporal layers: all layers", vp8_temporal_layers_all_layers },
+	{ "AVPF VP8 temporal layers with loss", avpf_vp8_temporal_layers_loss },
+	{ "Video quality VP8 QVGA", video_quality_vp8_qvga },
+	{ "Video quality VP8 VGA", video_quality_vp8_vga },
+	{ "Video quality VP8 VGA with loss", video_quality_vp8_vga_with_loss },
+	{ "Video quality H264 VGA", video_quality_h264_vga },
+	{ "Jpeg writer snapshot", jpeg_writer_snapshot },
+	{ "RTP reorder buffer", rtp_reorder_buffer },
+	{ "Frame rate converter timestamps", frame_rate_conv_timestamps },
+	{ "X11 video display stats", x11_video_display_stats }
 };
 
 test_suite_t video_stream_test_suite = {
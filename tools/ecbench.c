@@ -0,0 +1,242 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Measures how the echo cancellation of a conference scales with the number of legs sharing a ticker,
+ * with the speex echo cancellers processing their frames on the ticker thread or on the shared worker pool.
+ */
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+
+#define SAMPLE_RATE 16000
+#define ECHO_DELAY 400 /*samples*/
+
+typedef struct _LegSource {
+	int16_t history[ECHO_DELAY];
+	uint64_t start_time;
+	uint64_t produced;
+	int pos;
+	unsigned int seed;
+} LegSource;
+
+static void leg_source_init(MSFilter *f) {
+	LegSource *s = ms_new0(LegSource, 1);
+	s->seed = (unsigned int)(intptr_t)f;
+	f->data = s;
+}
+
+static void leg_source_preprocess(MSFilter *f) {
+	LegSource *s = (LegSource *)f->data;
+	s->start_time = f->ticker->time;
+	s->produced = 0;
+}
+
+static void leg_source_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+/* Outputs a far end noise on pin 0, and its attenuated echo with some near end noise on pin 1. */
+static void leg_source_process(MSFilter *f) {
+	LegSource *s = (LegSource *)f->data;
+	int nsamples = (int)((f->ticker->time - s->start_time) * SAMPLE_RATE / 1000 - s->produced);
+	mblk_t *ref = allocb(nsamples * 2, 0);
+	mblk_t *echo = allocb(nsamples * 2, 0);
+	int i;
+
+	for (i = 0; i < nsamples; i++) {
+		int16_t far_end;
+		s->seed = s->seed * 1103515245 + 12345;
+		far_end = (int16_t)((int)(s->seed >> 16) % 8000);
+		((int16_t *)ref->b_wptr)[i] = far_end;
+		((int16_t *)echo->b_wptr)[i] = (int16_t)(s->history[s->pos] / 2 + (int)(s->seed & 0xff) - 128);
+		s->history[s->pos] = far_end;
+		s->pos = (s->pos + 1) % ECHO_DELAY;
+	}
+	ref->b_wptr += nsamples * 2;
+	echo->b_wptr += nsamples * 2;
+	s->produced += nsamples;
+	ms_queue_put(f->outputs[0], ref);
+	ms_queue_put(f->outputs[1], echo);
+}
+
+static MSFilterDesc leg_source_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSLegSource",
+	"Generates the signals of a conference leg with echo.",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	2,
+	leg_source_init,
+	leg_source_preprocess,
+	leg_source_process,
+	NULL,
+	leg_source_uninit,
+	NULL
+};
+
+static void leg_sink_process(MSFilter *f) {
+	ms_queue_flush(f->inputs[0]);
+	ms_queue_flush(f->inputs[1]);
+}
+
+static MSFilterDesc leg_sink_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSLegSink",
+	"Drops the outputs of an echo canceller.",
+	MS_FILTER_OTHER,
+	NULL,
+	2,
+	0,
+	NULL,
+	NULL,
+	leg_sink_process,
+	NULL,
+	NULL,
+	NULL
+};
+
+typedef struct _TickStats {
+	uint64_t last_time;
+	uint64_t count;
+	uint64_t late_ticks;
+	int max_deviation;
+} TickStats;
+
+static void probe_init(MSFilter *f) {
+	f->data = ms_new0(TickStats, 1);
+}
+
+static void probe_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+static void probe_process(MSFilter *f) {
+	TickStats *s = (TickStats *)f->data;
+	uint64_t now = ms_get_cur_time_ms();
+	if (s->last_time != 0) {
+		int deviation = abs((int)(now - s->last_time) - (int)f->ticker->interval);
+		if (deviation > f->ticker->interval / 2) s->late_ticks++;
+		if (deviation > s->max_deviation) s->max_deviation = deviation;
+		s->count++;
+	}
+	s->last_time = now;
+}
+
+static MSFilterDesc probe_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSTickProbe",
+	"Records the interval between two consecutive ticks.",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	0,
+	probe_init,
+	NULL,
+	probe_process,
+	NULL,
+	probe_uninit,
+	NULL
+};
+
+static void run_bench(int nb_legs, bool_t async, int duration) {
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter **sources = ms_new0(MSFilter *, nb_legs);
+	MSFilter **ecs = ms_new0(MSFilter *, nb_legs);
+	MSFilter **sinks = ms_new0(MSFilter *, nb_legs);
+	MSFilter *probe = ms_filter_new_from_desc(&probe_desc);
+	TickStats *stats = (TickStats *)probe->data;
+	int rate = SAMPLE_RATE;
+	int delay_ms = ECHO_DELAY * 1000 / SAMPLE_RATE;
+	float load = 0;
+	int i;
+
+	ms_ticker_set_name(ticker, "Conference bench MSTicker");
+	for (i = 0; i < nb_legs; i++) {
+		sources[i] = ms_filter_new_from_desc(&leg_source_desc);
+		ecs[i] = ms_filter_new(MS_SPEEX_EC_ID);
+		sinks[i] = ms_filter_new_from_desc(&leg_sink_desc);
+		if (ecs[i] == NULL) {
+			ms_error("No speex echo canceller in this build");
+			exit(-1);
+		}
+		ms_filter_call_method(ecs[i], MS_FILTER_SET_SAMPLE_RATE, &rate);
+		ms_filter_call_method(ecs[i], MS_ECHO_CANCELLER_SET_DELAY, &delay_ms);
+		ms_filter_call_method(ecs[i], MS_ECHO_CANCELLER_ENABLE_ASYNC, &async);
+		ms_filter_link(sources[i], 0, ecs[i], 0);
+		ms_filter_link(sources[i], 1, ecs[i], 1);
+		ms_filter_link(ecs[i], 0, sinks[i], 0);
+		ms_filter_link(ecs[i], 1, sinks[i], 1);
+		ms_ticker_attach(ticker, sources[i]);
+	}
+	ms_ticker_attach(ticker, probe);
+
+	for (i = 0; i < duration; i++) {
+		ms_sleep(1);
+		load += ms_ticker_get_average_load(ticker);
+	}
+
+	ms_ticker_detach(ticker, probe);
+	printf("legs=%-4d %-5s ticks=%-6llu late=%-5llu max jitter=%5dms load=%6.1f%%\n",
+		nb_legs, async ? "async" : "sync", (unsigned long long)stats->count, (unsigned long long)stats->late_ticks,
+		stats->max_deviation, load / duration);
+
+	for (i = 0; i < nb_legs; i++) {
+		ms_ticker_detach(ticker, sources[i]);
+		ms_filter_unlink(sources[i], 0, ecs[i], 0);
+		ms_filter_unlink(sources[i], 1, ecs[i], 1);
+		ms_filter_unlink(ecs[i], 0, sinks[i], 0);
+		ms_filter_unlink(ecs[i], 1, sinks[i], 1);
+		ms_filter_destroy(sources[i]);
+		ms_filter_destroy(ecs[i]);
+		ms_filter_destroy(sinks[i]);
+	}
+	ms_free(sources);
+	ms_free(ecs);
+	ms_free(sinks);
+	ms_filter_destroy(probe);
+	ms_ticker_destroy(ticker);
+}
+
+int main(int argc, char *argv[]) {
+	static const int legs[] = {1, 8, 64, 256};
+	int duration = 5;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			duration = atoi(argv[++i]);
+		} else {
+			printf("Usage: ecbench [--duration 5]\n");
+			return -1;
+		}
+	}
+
+	ms_init();
+	ortp_set_log_level_mask(ORTP_ERROR|ORTP_FATAL);
+	printf("%u cpus\n", ms_get_cpu_count());
+	for (i = 0; i < (int)(sizeof(legs) / sizeof(legs[0])); i++) {
+		run_bench(legs[i], FALSE, duration);
+		run_bench(legs[i], TRUE, duration);
+	}
+	ms_exit();
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+
+/*
+ * Measures the cost of the drift compensation done by MSAudioFlowController on 20ms blocks of a synthetic voice-like
+ * signal, for several drift rates in both directions. The previous implementation, dropping one sample per scan of
+ * the block, is run as a reference for the drop direction.
+ */
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/flowcontrol.h"
+
+#include <math.h>
+
+#define DURATION_S 60
+
+static void make_signal(int16_t *samples, int nsamples, int rate) {
+	int i;
+	for (i = 0; i < nsamples; i++) {
+		double t = (double)i / rate;
+		double env = 0.5 + 0.5 * sin(2 * M_PI * 3 * t);
+		samples[i] = (int16_t)(env * (6000 * sin(2 * M_PI * 180 * t) + 3000 * sin(2 * M_PI * 720 * t) + 1000 * sin(2 * M_PI * 2100 * t)) + (rand() % 64) - 32);
+	}
+}
+
+/* The algorithm used before, one full scan and one memmove per dropped sample. */
+static void legacy_discard(mblk_t *m, int nsamples, int todrop) {
+	int16_t *samples = (int16_t *)m->b_rptr;
+	while (todrop-- > 0) {
+		int min_diff = 32768;
+		int pos = 0;
+		int i;
+		for (i = 0; i < nsamples - 2; ++i) {
+			int tmp = abs((int)samples[i] - (int)samples[i + 1]) + abs((int)samples[i + 1] - (int)samples[i + 2]);
+			if (tmp <= min_diff) {
+				pos = i;
+				min_diff = tmp;
+			}
+		}
+		memmove(samples + pos + 1, samples + pos + 2, (nsamples - pos - 2) * 2);
+		m->b_wptr -= 2;
+		nsamples--;
+	}
+}
+
+static void run_bench(const int16_t *signal, int nsamples, int rate, double drift, bool_t legacy) {
+	MSAudioFlowController ctl;
+	int block = rate / 50;
+	int target = (int)(drift * nsamples);
+	int64_t in = 0, out = 0;
+	int dropped = 0;
+	uint64_t begin, elapsed;
+	int i;
+
+	ms_audio_flow_controller_init(&ctl);
+	ms_audio_flow_controller_set_target(&ctl, target, nsamples);
+	begin = ms_get_cur_time_ms();
+	for (i = 0; i + block <= nsamples; i += block) {
+		mblk_t *m = allocb(block * 2, 0);
+		memcpy(m->b_wptr, signal + i, block * 2);
+		m->b_wptr += block * 2;
+		in += block;
+		if (legacy) {
+			int th_dropped = (int)(((int64_t)target * (i + block)) / nsamples);
+			legacy_discard(m, block, th_dropped - dropped);
+			dropped = th_dropped;
+		} else {
+			m = ms_audio_flow_controller_process(&ctl, m);
+		}
+		if (m) {
+			out += (m->b_wptr - m->b_rptr) / 2;
+			freemsg(m);
+		}
+	}
+	elapsed = ms_get_cur_time_ms() - begin;
+	printf("%-6s rate=%-5d drift=%+6.2f%% blocks=%-6d samples=%+-6d time=%5llums %6.3fus/block\n",
+		legacy ? "legacy" : "new", rate, drift * 100, i / block, (int)(in - out), (unsigned long long)elapsed,
+		elapsed * 1000.0 / (i / block));
+}
+
+int main(int argc, char *argv[]) {
+	static const double drifts[] = { 0.001, 0.005, 0.02, -0.001, -0.005, -0.02 };
+	static const int rates[] = { 16000, 48000 };
+	unsigned int r, d;
+
+	ms_init();
+	ortp_set_log_level_mask(ORTP_ERROR | ORTP_FATAL);
+	for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+		int nsamples = rates[r] * DURATION_S;
+		int16_t *signal = ms_new(int16_t, nsamples);
+		make_signal(signal, nsamples, rates[r]);
+		for (d = 0; d < sizeof(drifts) / sizeof(drifts[0]); d++) {
+			if (drifts[d] > 0) run_bench(signal, nsamples, rates[r], drifts[d], TRUE);
+			run_bench(signal, nsamples, rates[r], drifts[d], FALSE);
+		}
+		ms_free(signal);
+	}
+	ms_exit();
+	return 0;
+}
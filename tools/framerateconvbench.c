@@ -0,0 +1,225 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Feeds a camera-like source delivering 30fps with jitter and bursts into the frame rate control of MSSizeConv
+ * and into MSFrameRateConv, both set to 15fps, and measures how regular the frames sent to the encoder are.
+ * With --mime, an encoder is added after the converter to compare the resulting ticker load.
+ */
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msvideo.h"
+#include "mediastreamer2/msframerateconv.h"
+
+#include <math.h>
+
+#define CAMERA_FPS 30
+#define CAMERA_JITTER_MS 12
+#define CAMERA_STALL_MS 80
+
+typedef struct _JitterySource {
+	MSVideoSize vsize;
+	double next_time;
+	int count;
+} JitterySource;
+
+static void jittery_source_init(MSFilter *f) {
+	JitterySource *s = ms_new0(JitterySource, 1);
+	MS_VIDEO_SIZE_ASSIGN(s->vsize, VGA);
+	f->data = s;
+}
+
+static void jittery_source_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+static void jittery_source_process(MSFilter *f) {
+	JitterySource *s = (JitterySource *)f->data;
+	double now = (double)f->ticker->time;
+
+	if (s->next_time == 0) s->next_time = now;
+	while (now >= s->next_time) {
+		MSPicture pic;
+		mblk_t *m = ms_yuv_buf_alloc(&pic, s->vsize.width, s->vsize.height);
+		memset(pic.planes[0], (s->count * 7) & 0xff, pic.strides[0] * pic.h);
+		memset(pic.planes[1], 128, pic.strides[1] * pic.h / 2);
+		memset(pic.planes[2], 128, pic.strides[2] * pic.h / 2);
+		ms_queue_put(f->outputs[0], m);
+		s->count++;
+		s->next_time += 1000.0 / CAMERA_FPS + (rand() % (2 * CAMERA_JITTER_MS + 1)) - CAMERA_JITTER_MS;
+		/* the camera sometimes stalls, then delivers the late frames in a burst */
+		if (rand() % 50 == 0) s->next_time += CAMERA_STALL_MS;
+	}
+}
+
+static MSFilterDesc jittery_source_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSJitterySource",
+	"A camera-like source with jitter.",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	1,
+	jittery_source_init,
+	NULL,
+	jittery_source_process,
+	NULL,
+	jittery_source_uninit,
+	NULL
+};
+
+typedef struct _IntervalStats {
+	uint64_t last_time;
+	uint64_t count;
+	double sum;
+	double sum2;
+	int max_interval;
+	int max_per_tick;
+} IntervalStats;
+
+static void probe_init(MSFilter *f) {
+	f->data = ms_new0(IntervalStats, 1);
+}
+
+static void probe_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+static void probe_process(MSFilter *f) {
+	IntervalStats *s = (IntervalStats *)f->data;
+	int per_tick = 0;
+	mblk_t *m;
+
+	while ((m = ms_queue_get(f->inputs[0])) != NULL) {
+		if (s->last_time != 0) {
+			int interval = (int)(f->ticker->time - s->last_time);
+			s->sum += interval;
+			s->sum2 += (double)interval * interval;
+			if (interval > s->max_interval) s->max_interval = interval;
+			s->count++;
+		}
+		s->last_time = f->ticker->time;
+		per_tick++;
+		if (f->outputs[0]) ms_queue_put(f->outputs[0], m);
+		else freemsg(m);
+	}
+	if (per_tick > s->max_per_tick) s->max_per_tick = per_tick;
+}
+
+static MSFilterDesc probe_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSFrameIntervalProbe",
+	"Records the interval between two consecutive frames.",
+	MS_FILTER_OTHER,
+	NULL,
+	1,
+	1,
+	probe_init,
+	NULL,
+	probe_process,
+	NULL,
+	probe_uninit,
+	NULL
+};
+
+static void run_bench(MSFilterId converter_id, const char *mime, float fps, int duration) {
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *source = ms_filter_new_from_desc(&jittery_source_desc);
+	MSFilter *converter = ms_filter_new(converter_id);
+	MSFilter *probe = ms_filter_new_from_desc(&probe_desc);
+	MSFilter *encoder = NULL;
+	MSFilter *sink = ms_filter_new(MS_VOID_SINK_ID);
+	IntervalStats *stats = (IntervalStats *)probe->data;
+	MSVideoSize vsize;
+	double mean = 0, stddev = 0;
+
+	MS_VIDEO_SIZE_ASSIGN(vsize, VGA);
+	srand(1);
+	ms_ticker_set_name(ticker, "Frame rate bench MSTicker");
+	ms_filter_call_method(converter, MS_FILTER_SET_VIDEO_SIZE, &vsize);
+	ms_filter_call_method(converter, MS_FILTER_SET_FPS, &fps);
+	ms_filter_link(source, 0, converter, 0);
+	ms_filter_link(converter, 0, probe, 0);
+	if (mime) {
+		encoder = ms_filter_create_encoder(mime);
+		if (encoder == NULL) {
+			ms_error("No encoder for %s", mime);
+			exit(-1);
+		}
+		ms_filter_call_method(encoder, MS_FILTER_SET_VIDEO_SIZE, &vsize);
+		ms_filter_call_method(encoder, MS_FILTER_SET_FPS, &fps);
+		ms_filter_link(probe, 0, encoder, 0);
+		ms_filter_link(encoder, 0, sink, 0);
+	}
+	ms_ticker_attach(ticker, source);
+	ms_sleep(duration);
+	ms_ticker_detach(ticker, source);
+
+	if (stats->count) {
+		mean = stats->sum / stats->count;
+		stddev = sqrt(stats->sum2 / stats->count - mean * mean);
+	}
+	printf("%-16s frames=%-5llu output fps=%5.2f interval mean=%6.2fms stddev=%6.2fms max=%4dms max frames per tick=%d",
+		converter->desc->name, (unsigned long long)stats->count, mean ? 1000.0 / mean : 0, mean, stddev,
+		stats->max_interval, stats->max_per_tick);
+	if (encoder) printf(" %s load=%5.1f%%", mime, ms_ticker_get_average_load(ticker));
+	printf("\n");
+
+	ms_filter_unlink(source, 0, converter, 0);
+	ms_filter_unlink(converter, 0, probe, 0);
+	if (encoder) {
+		ms_filter_unlink(probe, 0, encoder, 0);
+		ms_filter_unlink(encoder, 0, sink, 0);
+		ms_filter_destroy(encoder);
+	}
+	ms_filter_destroy(source);
+	ms_filter_destroy(converter);
+	ms_filter_destroy(probe);
+	ms_filter_destroy(sink);
+	ms_ticker_destroy(ticker);
+}
+
+int main(int argc, char *argv[]) {
+	const char *mime = NULL;
+	float fps = 15;
+	int duration = 10;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--mime") == 0 && i + 1 < argc) {
+			mime = argv[++i];
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			fps = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			duration = atoi(argv[++i]);
+		} else {
+			printf("Usage: framerateconvbench [--mime VP8] [--fps 15] [--duration 10]\n");
+			return -1;
+		}
+	}
+
+	ms_init();
+	ortp_set_log_level_mask(ORTP_WARNING|ORTP_ERROR|ORTP_FATAL);
+	run_bench(MS_SIZE_CONV_ID, mime, fps, duration);
+	run_bench(MS_FRAME_RATE_CONV_ID, mime, fps, duration);
+	ms_exit();
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Measures the G.722 encoding and decoding throughput on a single thread, as the number of
+ * 16kHz channels one core can encode, decode, or both, in real time.
+ */
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msfilter.h"
+
+#include <math.h>
+
+#define SAMPLE_RATE 16000
+#define PTIME 20
+#define PACKET_SAMPLES (SAMPLE_RATE * PTIME / 1000)
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* A few harmonics with a slow amplitude modulation and some noise, standing for speech. */
+static int16_t *make_signal(int nsamples) {
+	int16_t *samples = ms_new(int16_t, nsamples);
+	unsigned int seed = 1;
+	int i;
+
+	for (i = 0; i < nsamples; i++) {
+		double t = (double)i / SAMPLE_RATE;
+		double env = 0.5 + 0.5 * sin(2 * M_PI * 3 * t);
+		double v = 6000 * sin(2 * M_PI * 220 * t) + 3000 * sin(2 * M_PI * 660 * t) + 1500 * sin(2 * M_PI * 2750 * t);
+		seed = seed * 1103515245 + 12345;
+		samples[i] = (int16_t)(env * v + (int)((seed >> 16) & 0x3ff) - 512);
+	}
+	return samples;
+}
+
+/* The filter is given void neighbours, for its input and output queues to exist. */
+static MSFilter *new_linked_filter(MSFilterId id) {
+	MSFilter *f = ms_filter_new(id);
+	ms_filter_link(ms_filter_new(MS_VOID_SOURCE_ID), 0, f, 0);
+	ms_filter_link(f, 0, ms_filter_new(MS_VOID_SINK_ID), 0);
+	return f;
+}
+
+static void destroy_linked_filter(MSFilter *f) {
+	MSFilter *source = f->inputs[0]->prev.filter;
+	MSFilter *sink = f->outputs[0]->next.filter;
+	ms_filter_unlink(source, 0, f, 0);
+	ms_filter_unlink(f, 0, sink, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(sink);
+	ms_filter_destroy(f);
+}
+
+static void print_result(const char *what, int nsamples, int iterations, uint64_t elapsed) {
+	double audio_ms = (double)nsamples * 1000 / SAMPLE_RATE * iterations;
+	if (elapsed == 0) elapsed = 1;
+	printf("%-7s %8.0fms of audio in %6llums: %6.0f channels per core\n", what, audio_ms, (unsigned long long)elapsed,
+		audio_ms / elapsed);
+}
+
+static void run_bench(int seconds, int iterations) {
+	int nsamples = seconds * SAMPLE_RATE;
+	int16_t *samples = make_signal(nsamples);
+	MSFilter *enc = new_linked_filter(MS_G722_ENC_ID);
+	MSFilter *dec = new_linked_filter(MS_G722_DEC_ID);
+	MSQueue packets;
+	uint64_t begin, enc_time = 0, dec_time = 0;
+	mblk_t *m;
+	int it, i;
+
+	ms_queue_init(&packets);
+	for (it = 0; it < iterations; it++) {
+		begin = ms_get_cur_time_ms();
+		for (i = 0; i + PACKET_SAMPLES <= nsamples; i += PACKET_SAMPLES) {
+			m = allocb(PACKET_SAMPLES * 2, 0);
+			memcpy(m->b_wptr, samples + i, PACKET_SAMPLES * 2);
+			m->b_wptr += PACKET_SAMPLES * 2;
+			ms_queue_put(enc->inputs[0], m);
+			ms_filter_process(enc);
+			while ((m = ms_queue_get(enc->outputs[0])) != NULL) ms_queue_put(&packets, m);
+		}
+		enc_time += ms_get_cur_time_ms() - begin;
+
+		begin = ms_get_cur_time_ms();
+		while ((m = ms_queue_get(&packets)) != NULL) {
+			ms_queue_put(dec->inputs[0], m);
+			ms_filter_process(dec);
+			ms_queue_flush(dec->outputs[0]);
+		}
+		dec_time += ms_get_cur_time_ms() - begin;
+	}
+	print_result("encode", nsamples, iterations, enc_time);
+	print_result("decode", nsamples, iterations, dec_time);
+	print_result("both", nsamples, iterations, enc_time + dec_time);
+
+	destroy_linked_filter(enc);
+	destroy_linked_filter(dec);
+	ms_free(samples);
+}
+
+int main(int argc, char *argv[]) {
+	int seconds = 60;
+	int iterations = 5;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			seconds = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+			iterations = atoi(argv[++i]);
+		} else {
+			printf("Usage: g722bench [--seconds 60] [--iterations 5]\n");
+			return -1;
+		}
+	}
+
+	ms_init();
+	ortp_set_log_level_mask(ORTP_ERROR|ORTP_FATAL);
+	run_bench(seconds, iterations);
+	ms_exit();
+	return 0;
+}
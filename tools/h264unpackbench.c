@@ -0,0 +1,147 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Measures the H264 RTP unpacking throughput on a synthetic 1080p stream (4Mbit/s, 30fps, one I-frame per 2 seconds),
+ * with packet loss and reordering applied between the packer and the unpacker.
+ */
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msqueue.h"
+#include "mediastreamer2/rfc3984.h"
+
+#define FPS 30
+#define GOP_SIZE 60
+#define I_FRAME_SIZE 120000
+#define P_FRAME_SIZE 14000
+#define SLICES_PER_FRAME 4
+
+static mblk_t *make_nal(uint8_t nal_type, int size) {
+	mblk_t *m = allocb(size, 0);
+	int i;
+	*m->b_wptr++ = (3 << 5) | nal_type;
+	for (i = 1; i < size; i++) *m->b_wptr++ = (uint8_t)rand();
+	return m;
+}
+
+/* Packetize a whole stream once, so that only the unpacking is measured. */
+static void make_stream(MSQueue *rtpq, int nb_frames) {
+	Rfc3984Context *packer = rfc3984_new();
+	MSQueue nalus;
+	mblk_t *m;
+	int i, j;
+
+	rfc3984_set_mode(packer, 1);
+	ms_queue_init(&nalus);
+	for (i = 0; i < nb_frames; i++) {
+		bool_t iframe = (i % GOP_SIZE) == 0;
+		int slice_size = (iframe ? I_FRAME_SIZE : P_FRAME_SIZE) / SLICES_PER_FRAME;
+		if (iframe) {
+			ms_queue_put(&nalus, make_nal(7, 12));
+			ms_queue_put(&nalus, make_nal(8, 4));
+		}
+		for (j = 0; j < SLICES_PER_FRAME; j++) {
+			ms_queue_put(&nalus, make_nal(iframe ? 5 : 1, slice_size + (rand() % (slice_size / 4))));
+		}
+		rfc3984_pack(packer, &nalus, rtpq, (uint32_t)(i * 90000 / FPS));
+	}
+	rfc3984_destroy(packer);
+	/* Packets are contiguous when received from the network. */
+	for (m = qbegin(&rtpq->q); !qend(&rtpq->q, m); m = qnext(&rtpq->q, m)) {
+		msgpullup(m, -1);
+	}
+}
+
+static void run_bench(MSQueue *stream, float loss, float reorder, int iterations) {
+	MSQueue nalus;
+	uint64_t begin, elapsed;
+	uint64_t bytes = 0, nb_nalus = 0, nb_errors = 0, nb_packets = 0;
+	mblk_t *m, *held = NULL;
+	int i;
+
+	ms_queue_init(&nalus);
+	srand(1);
+	begin = ms_get_cur_time_ms();
+	for (i = 0; i < iterations; i++) {
+		Rfc3984Context *unpacker = rfc3984_new();
+		for (m = qbegin(&stream->q); !qend(&stream->q, m); m = qnext(&stream->q, m)) {
+			mblk_t *im;
+			if ((float)rand() / RAND_MAX < loss) continue;
+			im = dupmsg(m);
+			if (held == NULL && (float)rand() / RAND_MAX < reorder) {
+				/* This packet will be delivered after the next one. */
+				held = im;
+				continue;
+			}
+			nb_errors += (rfc3984_unpack(unpacker, im, &nalus) != 0);
+			nb_packets++;
+			if (held) {
+				nb_errors += (rfc3984_unpack(unpacker, held, &nalus) != 0);
+				nb_packets++;
+				held = NULL;
+			}
+			while ((im = ms_queue_get(&nalus)) != NULL) {
+				bytes += msgdsize(im);
+				nb_nalus++;
+				freemsg(im);
+			}
+		}
+		if (held) {
+			freemsg(held);
+			held = NULL;
+		}
+		rfc3984_destroy(unpacker);
+	}
+	elapsed = ms_get_cur_time_ms() - begin;
+	if (elapsed == 0) elapsed = 1;
+	printf("loss=%4.1f%% reorder=%4.1f%% packets=%-8llu nalus=%-7llu errors=%-6llu time=%5llums throughput=%7.1fMB/s %6.0f packets/ms\n",
+		loss * 100, reorder * 100, (unsigned long long)nb_packets, (unsigned long long)nb_nalus, (unsigned long long)nb_errors,
+		(unsigned long long)elapsed, (double)bytes / (1024.0 * 1024.0) / (elapsed / 1000.0), (double)nb_packets / elapsed);
+}
+
+int main(int argc, char *argv[]) {
+	MSQueue stream;
+	int nb_frames = 600;
+	int iterations = 20;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			nb_frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+			iterations = atoi(argv[++i]);
+		} else {
+			printf("Usage: h264unpackbench [--frames 600] [--iterations 20]\n");
+			return -1;
+		}
+	}
+
+	ms_init();
+	ortp_set_log_level_mask(ORTP_FATAL);
+	ms_queue_init(&stream);
+	make_stream(&stream, nb_frames);
+	run_bench(&stream, 0, 0, iterations);
+	run_bench(&stream, 0.05f, 0, iterations);
+	run_bench(&stream, 0.20f, 0, iterations);
+	run_bench(&stream, 0.05f, 0.05f, iterations);
+	run_bench(&stream, 0.20f, 0.20f, iterations);
+	ms_queue_flush(&stream);
+	ms_exit();
+	return 0;
+}
@@ -0,0 +1,251 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Sends a G.711 u-law stream over the loopback through a simulated network adding a delay to each packet:
+ * a fixed part, an exponentially distributed jitter, and spikes decreasing linearly as a congested queue empties.
+ * The stream is received by MSRtpRecv with adaptive playout, for several delay quantiles, and the average
+ * mouth-to-ear delay is reported against the packets lost by arriving too late. It includes the audio
+ * actually buffered by MSAudioPlayout, sampled during the run.
+ */
+
+#include "mediastreamer2/msrtp.h"
+#include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msaudioplayout.h"
+
+#include <math.h>
+
+#define PTIME 20 /*ms*/
+#define RATE 8000
+#define MAX_PENDING 1024
+
+typedef struct _JitterModel {
+	int delay; /*ms*/
+	int jitter; /*mean of the exponential jitter, in ms*/
+	int spike_height; /*ms*/
+	int spike_interval; /*mean time between two spikes, in ms, 0 for no spikes*/
+	float loss; /*ratio*/
+} JitterModel;
+
+typedef struct _PendingPacket {
+	uint64_t send_time;
+	uint32_t ts;
+} PendingPacket;
+
+typedef struct _Sender {
+	RtpSession *session;
+	ms_thread_t thread;
+	JitterModel model;
+	PendingPacket pending[MAX_PENDING]; /*by send time*/
+	int npending;
+	uint64_t spike_start;
+	int sent;
+	int lost;
+	volatile bool_t run;
+} Sender;
+
+static uint8_t s16_to_ulaw(int16_t sample) {
+	int sign = (sample >> 8) & 0x80;
+	int s = sign ? -(int)sample : sample;
+	int exponent = 7;
+	int mask;
+
+	if (s > 32635) s = 32635;
+	s += 0x84;
+	for (mask = 0x4000; (s & mask) == 0 && exponent > 0; exponent--, mask >>= 1);
+	return (uint8_t)~(sign | (exponent << 4) | ((s >> (exponent + 3)) & 0x0f));
+}
+
+/* A voiced signal, with a syllabic envelope. */
+static int16_t voice_sample(uint32_t n) {
+	double t = (double)n / RATE;
+	double env = 0.5 + 0.5 * sin(2 * M_PI * 3 * t);
+	return (int16_t)(env * (6000 * sin(2 * M_PI * 180 * t) + 3000 * sin(2 * M_PI * 720 * t)));
+}
+
+static int network_delay(Sender *s, uint64_t now) {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	int delay = s->model.delay + (int)(-s->model.jitter * log(u));
+
+	if (s->model.spike_interval > 0 && now - s->spike_start > (uint64_t)s->model.spike_height
+		&& rand() % (s->model.spike_interval / PTIME) == 0) {
+		s->spike_start = now;
+	}
+	if (now - s->spike_start < (uint64_t)s->model.spike_height) delay += s->model.spike_height - (int)(now - s->spike_start);
+	return delay;
+}
+
+static void send_packet(Sender *s, uint32_t ts) {
+	uint8_t payload[RATE * PTIME / 1000];
+	mblk_t *m;
+	int i;
+
+	for (i = 0; i < (int)sizeof(payload); i++) payload[i] = s16_to_ulaw(voice_sample(ts + i));
+	m = rtp_session_create_packet(s->session, RTP_FIXED_HEADER_SIZE, payload, sizeof(payload));
+	rtp_session_sendm_with_ts(s->session, m, ts);
+	s->sent++;
+}
+
+static void *sender_run(void *arg) {
+	Sender *s = (Sender *)arg;
+	uint64_t next = ms_get_cur_time_ms();
+	uint32_t ts = 0;
+
+	s->spike_start = next - s->model.spike_height;
+	while (s->run) {
+		uint64_t now = ms_get_cur_time_ms();
+		for (; next <= now; next += PTIME, ts += RATE * PTIME / 1000) {
+			if ((float)rand() / RAND_MAX < s->model.loss || s->npending == MAX_PENDING) {
+				s->lost++;
+			} else {
+				uint64_t send_time = next + network_delay(s, next);
+				int i = s->npending++;
+				for (; i > 0 && s->pending[i - 1].send_time > send_time; i--) s->pending[i] = s->pending[i - 1];
+				s->pending[i].send_time = send_time;
+				s->pending[i].ts = ts;
+			}
+		}
+		while (s->npending > 0 && s->pending[0].send_time <= now) {
+			send_packet(s, s->pending[0].ts);
+			memmove(s->pending, s->pending + 1, --s->npending * sizeof(PendingPacket));
+		}
+		ms_usleep(1000);
+	}
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+static RtpSession *create_session(int mode, int port) {
+	RtpSession *session = rtp_session_new(mode);
+	rtp_session_set_scheduling_mode(session, 0);
+	rtp_session_set_blocking_mode(session, 0);
+	rtp_session_set_payload_type(session, 0);
+	rtp_session_enable_rtcp(session, FALSE);
+	if (mode == RTP_SESSION_RECVONLY) rtp_session_set_local_addr(session, "127.0.0.1", port, port + 1);
+	else rtp_session_set_remote_addr_full(session, "127.0.0.1", port, "127.0.0.1", port + 1);
+	return session;
+}
+
+static void run_bench(const JitterModel *model, float quantile, int duration, int port) {
+	Sender sender = {0};
+	MSRtpRecvPlayoutParams params = {0};
+	MSRtpRecvPlayoutStats stats = {0};
+	MSAudioPlayoutStats playout_stats = {0};
+	RtpSession *session = create_session(RTP_SESSION_RECVONLY, port);
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *rtprecv = ms_filter_new(MS_RTP_RECV_ID);
+	MSFilter *decoder = ms_filter_create_decoder("PCMU");
+	MSFilter *playout = ms_filter_new(MS_AUDIO_PLAYOUT_ID);
+	MSFilter *sink = ms_filter_new(MS_VOID_SINK_ID);
+	double delay_sum = 0, target_sum = 0, buffered_sum = 0;
+	int rate = RATE;
+	int i;
+
+	params.enabled = TRUE;
+	params.quantile = quantile;
+	params.max_delay = 1000;
+	ms_filter_call_method(rtprecv, MS_RTP_RECV_SET_SESSION, session);
+	ms_filter_call_method(rtprecv, MS_RTP_RECV_SET_PLAYOUT_PARAMS, &params);
+	ms_filter_call_method(playout, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	ms_filter_link(rtprecv, 0, decoder, 0);
+	ms_filter_link(decoder, 0, playout, 0);
+	ms_filter_link(playout, 0, sink, 0);
+	ms_ticker_attach(ticker, rtprecv);
+
+	sender.session = create_session(RTP_SESSION_SENDONLY, port);
+	sender.model = *model;
+	sender.run = TRUE;
+	ms_thread_create(&sender.thread, NULL, sender_run, &sender);
+	for (i = 0; i < duration * 10; i++) {
+		ms_usleep(100000);
+		ms_filter_call_method(rtprecv, MS_RTP_RECV_GET_PLAYOUT_STATS, &stats);
+		ms_filter_call_method(playout, MS_AUDIO_PLAYOUT_GET_STATS, &playout_stats);
+		delay_sum += stats.current_delay;
+		target_sum += stats.target_delay;
+		buffered_sum += playout_stats.buffered;
+	}
+	sender.run = FALSE;
+	ms_thread_join(sender.thread, NULL);
+	ms_filter_call_method(rtprecv, MS_RTP_RECV_GET_PLAYOUT_STATS, &stats);
+	ms_filter_call_method(playout, MS_AUDIO_PLAYOUT_GET_STATS, &playout_stats);
+
+	ms_ticker_detach(ticker, rtprecv);
+	ms_filter_unlink(rtprecv, 0, decoder, 0);
+	ms_filter_unlink(decoder, 0, playout, 0);
+	ms_filter_unlink(playout, 0, sink, 0);
+	ms_filter_destroy(rtprecv);
+	ms_filter_destroy(decoder);
+	ms_filter_destroy(playout);
+	ms_filter_destroy(sink);
+	ms_ticker_destroy(ticker);
+	rtp_session_destroy(session);
+	rtp_session_destroy(sender.session);
+
+	/*mouth-to-ear: packetization, fastest transit, delay held by MSRtpRecv, audio buffered by MSAudioPlayout*/
+	printf("quantile=%.2f target=%5.1fms buffered=%5.1fms mouth-to-ear=%5.1fms late=%5.2f%% lost=%5.2f%% early=%llu"
+		" increases=%llu decreases=%llu resyncs=%llu accelerated=%ims expanded=%ims\n",
+		quantile, target_sum / (duration * 10), buffered_sum / (duration * 10),
+		PTIME + model->delay + (delay_sum + buffered_sum) / (duration * 10),
+		sender.sent ? 100.0 * stats.late / sender.sent : 0.0,
+		sender.sent + sender.lost ? 100.0 * sender.lost / (sender.sent + sender.lost) : 0.0,
+		(unsigned long long)stats.early, (unsigned long long)stats.delay_increases,
+		(unsigned long long)stats.delay_decreases, (unsigned long long)stats.resyncs,
+		playout_stats.accelerated, playout_stats.expanded);
+}
+
+int main(int argc, char *argv[]) {
+	static const float quantiles[] = { 0.5f, 0.8f, 0.9f, 0.95f, 0.99f };
+	JitterModel model = { 30, 10, 150, 10000, 0.01f };
+	int duration = 30;
+	int port = 7010;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			duration = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--delay") == 0 && i + 1 < argc) {
+			model.delay = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+			model.jitter = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--spike-height") == 0 && i + 1 < argc) {
+			model.spike_height = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--spike-interval") == 0 && i + 1 < argc) {
+			model.spike_interval = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+			model.loss = (float)atof(argv[++i]) / 100;
+		} else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+			port = atoi(argv[++i]);
+		} else {
+			printf("Usage: jitterbench [--duration 30 (s)] [--delay 30 (ms)] [--jitter 10 (ms, mean)] [--spike-height 150 (ms)]"
+				" [--spike-interval 10000 (ms, 0 for none)] [--loss 1 (%%)] [--port 7010]\n");
+			return -1;
+		}
+	}
+
+	ortp_init();
+	ms_init();
+	ortp_set_log_level_mask(ORTP_ERROR | ORTP_FATAL);
+	printf("network: delay=%ims jitter=%ims spikes of %ims every %ims, loss=%.1f%%\n", model.delay, model.jitter,
+		model.spike_height, model.spike_interval, model.loss * 100);
+	for (i = 0; i < (int)(sizeof(quantiles) / sizeof(quantiles[0])); i++) {
+		run_bench(&model, quantiles[i], duration, port + 2 * i);
+	}
+	ms_exit();
+	return 0;
+}
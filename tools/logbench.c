@@ -0,0 +1,131 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Measures the time spent by threads standing for tickers in each of their log calls, with the messages disabled,
+ * written synchronously by the oRTP handler, written by the asynchronous sink, or rate limited.
+ */
+
+#include "mediastreamer2/msasynclog.h"
+
+typedef enum _LogMode {
+	LogDisabled,
+	LogSynchronous,
+	LogAsynchronous,
+	LogRateLimited
+} LogMode;
+
+static const char *mode_names[] = {"disabled", "synchronous", "asynchronous", "rate limited"};
+
+typedef struct _LogThread {
+	ms_thread_t thread;
+	LogMode mode;
+	int index;
+	int lines;
+	int interval; /*us between two lines*/
+	double elapsed; /*ns*/
+} LogThread;
+
+static void *log_thread_run(void *arg) {
+	LogThread *t = (LogThread *)arg;
+	MSTimeSpec begin, end;
+	int i;
+
+	for (i = 0; i < t->lines; i++) {
+		ms_get_cur_time(&begin);
+		if (t->mode == LogRateLimited) {
+			ms_message_ratelimited(1000, "logbench thread [%i]: receiving RTCP SR, packet %i, jitter=%f", t->index, i, i * 0.001);
+		} else {
+			ms_message("logbench thread [%i]: receiving RTCP SR, packet %i, jitter=%f", t->index, i, i * 0.001);
+		}
+		ms_get_cur_time(&end);
+		t->elapsed += (end.tv_sec - begin.tv_sec) * 1e9 + (end.tv_nsec - begin.tv_nsec);
+		if (t->interval > 0 && i % 10 == 0) ms_usleep(t->interval * 10);
+	}
+	ms_thread_exit(NULL);
+	return NULL;
+}
+
+static void run_bench(LogMode mode, int nb_threads, int lines, int interval) {
+	LogThread *threads = ms_new0(LogThread, nb_threads);
+	MSAsyncLogStats stats = {0};
+	double elapsed = 0;
+	int i;
+
+	ortp_set_log_level_mask(mode == LogDisabled ? ORTP_WARNING|ORTP_ERROR|ORTP_FATAL : ORTP_MESSAGE|ORTP_WARNING|ORTP_ERROR|ORTP_FATAL);
+	if (mode == LogAsynchronous) ms_async_log_start();
+	for (i = 0; i < nb_threads; i++) {
+		threads[i].mode = mode;
+		threads[i].index = i;
+		threads[i].lines = lines;
+		threads[i].interval = interval;
+		ms_thread_create(&threads[i].thread, NULL, log_thread_run, &threads[i]);
+	}
+	for (i = 0; i < nb_threads; i++) {
+		ms_thread_join(threads[i].thread, NULL);
+		elapsed += threads[i].elapsed;
+	}
+	if (mode == LogAsynchronous) {
+		ms_async_log_get_stats(&stats);
+		ms_async_log_stop();
+	}
+	ortp_set_log_level_mask(ORTP_ERROR|ORTP_FATAL);
+	printf("threads=%-3d %-13s %8.0f ns per log line on the logging thread", nb_threads, mode_names[mode],
+		elapsed / ((double)nb_threads * lines));
+	if (mode == LogAsynchronous) printf(", %llu written, %llu dropped", (unsigned long long)stats.written, (unsigned long long)stats.dropped);
+	printf("\n");
+	ms_free(threads);
+}
+
+int main(int argc, char *argv[]) {
+	const char *file = "logbench.log";
+	int nb_threads = 4;
+	int lines = 100000;
+	int interval = 20;
+	FILE *log_file;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			nb_threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+			lines = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+			interval = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+			file = argv[++i];
+		} else {
+			printf("Usage: logbench [--threads 4] [--lines 100000] [--interval 20 (us between lines)] [--file logbench.log]\n");
+			return -1;
+		}
+	}
+
+	log_file = fopen(file, "w");
+	if (log_file == NULL) {
+		printf("Cannot open %s\n", file);
+		return -1;
+	}
+	ortp_set_log_file(log_file);
+	for (i = LogDisabled; i <= LogRateLimited; i++) {
+		run_bench((LogMode)i, nb_threads, lines, interval);
+	}
+	ortp_set_log_file(NULL);
+	fclose(log_file);
+	return 0;
+}
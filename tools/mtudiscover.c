@@ -17,21 +17,54 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+/*
+ * Discovers the path MTU to several hosts at once, with the asynchronous service of msmtu.h.
+ * A path with a constrained MTU can be set up with network namespaces, mtu_a reaching 10.0.2.1 through mtu_r
+ * whose link to mtu_b has a 1280 bytes MTU:
+ *   ip netns add mtu_a; ip netns add mtu_r; ip netns add mtu_b
+ *   ip link add va netns mtu_a type veth peer name vra netns mtu_r
+ *   ip link add vb netns mtu_b mtu 1280 type veth peer name vrb netns mtu_r mtu 1280
+ *   ip -n mtu_a addr add 10.0.1.1/24 dev va; ip -n mtu_r addr add 10.0.1.2/24 dev vra
+ *   ip -n mtu_b addr add 10.0.2.1/24 dev vb; ip -n mtu_r addr add 10.0.2.2/24 dev vrb
+ *   (set all the links up, the default routes of mtu_a and mtu_b through mtu_r, and net.ipv4.ip_forward=1 in mtu_r)
+ *   ip netns exec mtu_a mtudiscover 10.0.2.1 10.0.1.2
+ * which finds 1280 from the icmp errors of mtu_r, and 1500.
+ */
+
 #ifdef HAVE_CONFIG_H
 #include "mediastreamer-config.h"
 #endif
 
-#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msmtu.h"
+
+#define TIMEOUT 10000 /*ms*/
+
+static volatile int pending=0;
+
+static void on_mtu(void *user_data, const char *host, int mtu){
+	uint64_t start_time=*(uint64_t*)user_data;
+	printf("result: %s %i (%i ms)\n",host,mtu,(int)(ms_get_cur_time_ms()-start_time));
+	pending--;
+}
 
 int main(int argc, char *argv[]){
-	
+	uint64_t start_time;
+	int i;
+
 	ms_base_init();
 	if (argc<2){
-		ms_error("Usage: mtudiscover [host]");
+		ms_error("Usage: mtudiscover [host] [host]...");
 		return -1;
 	}
 	ortp_set_log_level_mask(ORTP_MESSAGE|ORTP_WARNING|ORTP_ERROR|ORTP_FATAL);
-	printf("result: %i \n",ms_discover_mtu(argv[1]));
+	start_time=ms_get_cur_time_ms();
+	pending=argc-1;
+	for (i=1;i<argc;i++){
+		int mtu=ms_mtu_discovery_request(argv[i],on_mtu,&start_time);
+		if (mtu!=0) on_mtu(&start_time,argv[i],mtu);
+	}
+	while (pending>0 && ms_get_cur_time_ms()-start_time<TIMEOUT) ms_usleep(10000);
+	for (i=1;i<argc;i++) ms_mtu_discovery_cancel(argv[i],on_mtu,&start_time);
 	ms_base_exit();
 	return 0;
 }
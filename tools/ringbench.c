@@ -0,0 +1,129 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Measures the cpu used by many ring streams playing the same file on virtual sound cards, with the samples
+ * shared through the tone cache by ring_start(), or read and resampled by a file player for each stream.
+ * Every stream plays a dtmf each second.
+ */
+
+#include <time.h>
+
+#include "mediastreamer2/mediastream.h"
+#include "mediastreamer2/dtmfgen.h"
+#include "mediastreamer2/msfileplayer.h"
+#include "mediastreamer2/msvirtualsnd.h"
+
+/* The graph ring_start() used to build for each stream. */
+static RingStream *file_ring_start(const char *file, int interval, MSSndCard *sndcard) {
+	RingStream *stream = ms_new0(RingStream, 1);
+	int srcrate, srcchannels, dstrate, dstchannels;
+	MSConnectionHelper h;
+
+	stream->source = ms_filter_new(MS_FILE_PLAYER_ID);
+	stream->gendtmf = ms_filter_new(MS_DTMF_GEN_ID);
+	stream->write_resampler = ms_filter_new(MS_RESAMPLE_ID);
+	stream->sndwrite = ms_snd_card_create_writer(sndcard);
+	ms_filter_call_method(stream->source, MS_FILE_PLAYER_OPEN, (void *)file);
+	ms_filter_call_method(stream->source, MS_FILE_PLAYER_LOOP, &interval);
+	ms_filter_call_method_noarg(stream->source, MS_FILE_PLAYER_START);
+	ms_filter_call_method(stream->source, MS_FILTER_GET_SAMPLE_RATE, &srcrate);
+	ms_filter_call_method(stream->source, MS_FILTER_GET_NCHANNELS, &srcchannels);
+	ms_filter_call_method(stream->sndwrite, MS_FILTER_GET_SAMPLE_RATE, &dstrate);
+	ms_filter_call_method(stream->sndwrite, MS_FILTER_GET_NCHANNELS, &dstchannels);
+	ms_filter_call_method(stream->gendtmf, MS_FILTER_SET_SAMPLE_RATE, &srcrate);
+	ms_filter_call_method(stream->gendtmf, MS_FILTER_SET_NCHANNELS, &srcchannels);
+	if (stream->write_resampler) {
+		ms_filter_call_method(stream->write_resampler, MS_FILTER_SET_SAMPLE_RATE, &srcrate);
+		ms_filter_call_method(stream->write_resampler, MS_FILTER_SET_NCHANNELS, &srcchannels);
+		ms_filter_call_method(stream->write_resampler, MS_FILTER_SET_OUTPUT_SAMPLE_RATE, &dstrate);
+		ms_filter_call_method(stream->write_resampler, MS_FILTER_SET_OUTPUT_NCHANNELS, &dstchannels);
+	}
+	stream->ticker = ms_ticker_new();
+	ms_ticker_set_name(stream->ticker, "Ring MSTicker");
+	ms_connection_helper_start(&h);
+	ms_connection_helper_link(&h, stream->source, -1, 0);
+	ms_connection_helper_link(&h, stream->gendtmf, 0, 0);
+	if (stream->write_resampler) ms_connection_helper_link(&h, stream->write_resampler, 0, 0);
+	ms_connection_helper_link(&h, stream->sndwrite, 0, -1);
+	ms_ticker_attach(stream->ticker, stream->source);
+	return stream;
+}
+
+static void run_bench(const char *file, MSSndCard *card, int nb_streams, bool_t cached, int duration) {
+	RingStream **streams = ms_new0(RingStream *, nb_streams);
+	clock_t begin;
+	double cpu;
+	char dtmf;
+	int i, j;
+
+	for (i = 0; i < nb_streams; i++) {
+		streams[i] = cached ? ring_start(file, 0, card) : file_ring_start(file, 0, card);
+	}
+	begin = clock();
+	for (j = 0; j < duration; j++) {
+		dtmf = '0' + (j % 10);
+		for (i = 0; i < nb_streams; i++) {
+			ms_filter_call_method(streams[i]->gendtmf, MS_DTMF_GEN_PLAY, &dtmf);
+		}
+		ms_sleep(1);
+	}
+	cpu = (double)(clock() - begin) / CLOCKS_PER_SEC;
+	printf("streams=%-5d %-11s cpu=%6.2fs in %ds: %6.1f%% of a core per 1000 streams\n", nb_streams,
+		cached ? "tone cache" : "file player", cpu, duration, cpu * 100 * 1000 / (duration * nb_streams));
+	for (i = 0; i < nb_streams; i++) {
+		ring_stop(streams[i]);
+	}
+	ms_free(streams);
+}
+
+int main(int argc, char *argv[]) {
+	const char *file = "/usr/share/sounds/linphone/rings/oldphone.wav";
+	MSVirtualSndCardParams params;
+	MSSndCard *card;
+	int nb_streams = 1000;
+	int duration = 10;
+	int i;
+
+	ms_virtual_snd_card_params_init(&params);
+	params.sample_rate = 48000;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--streams") == 0 && i + 1 < argc) {
+			nb_streams = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			duration = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+			params.sample_rate = atoi(argv[++i]);
+		} else if (argv[i][0] != '-') {
+			file = argv[i];
+		} else {
+			printf("Usage: ringbench [--streams 1000] [--duration 10] [--rate 48000] [ring file]\n");
+			return -1;
+		}
+	}
+
+	ms_init();
+	ortp_set_log_level_mask(ORTP_ERROR|ORTP_FATAL);
+	card = ms_virtual_snd_card_new("ringbench", &params);
+	ms_snd_card_manager_add_card(ms_snd_card_manager_get(), card);
+	run_bench(file, card, nb_streams, FALSE, duration);
+	run_bench(file, card, nb_streams, TRUE, duration);
+	ms_exit();
+	return 0;
+}
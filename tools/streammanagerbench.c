@@ -0,0 +1,128 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Measures the cpu used to keep idle audio streams iterated, by an application polling all of them
+ * with audio_stream_iterate() or by a MSStreamManager.
+ * The streams have RTP sessions without sockets, so that thousands of them can be created.
+ */
+
+#include <time.h>
+
+#include "mediastreamer2/msstreammanager.h"
+
+static AudioStream **create_streams(int nb_streams) {
+	AudioStream **streams = ms_new0(AudioStream *, nb_streams);
+	MSMediaStreamSessions sessions = {0};
+	int i;
+
+	for (i = 0; i < nb_streams; i++) {
+		sessions.rtp_session = rtp_session_new(RTP_SESSION_SENDRECV);
+		streams[i] = audio_stream_new_with_sessions(&sessions);
+	}
+	return streams;
+}
+
+static void destroy_streams(AudioStream **streams, int nb_streams) {
+	MSMediaStreamSessions sessions;
+	int i;
+
+	for (i = 0; i < nb_streams; i++) {
+		sessions = streams[i]->ms.sessions;
+		audio_stream_stop(streams[i]);
+		ms_media_stream_sessions_uninit(&sessions);
+	}
+	ms_free(streams);
+}
+
+static void print_result(const char *what, int nb_streams, clock_t cpu, int duration, uint64_t iterations) {
+	double seconds = (double)cpu / CLOCKS_PER_SEC;
+	printf("streams=%-6d %-16s cpu=%6.2fs in %ds (%5.2f%% of a core), %9.0f iterations/s\n", nb_streams, what,
+		seconds, duration, seconds * 100 / duration, (double)iterations / duration);
+}
+
+static void run_polling(int nb_streams, int poll_interval, int duration) {
+	AudioStream **streams = create_streams(nb_streams);
+	uint64_t end = ms_get_cur_time_ms() + duration * 1000, iterations = 0;
+	clock_t begin = clock();
+	char what[32];
+	int i;
+
+	while (ms_get_cur_time_ms() < end) {
+		for (i = 0; i < nb_streams; i++) {
+			audio_stream_iterate(streams[i]);
+		}
+		iterations += nb_streams;
+		ms_usleep(poll_interval * 1000);
+	}
+	snprintf(what, sizeof(what), "polling %ims", poll_interval);
+	print_result(what, nb_streams, clock() - begin, duration, iterations);
+	destroy_streams(streams, nb_streams);
+}
+
+static void run_manager(int nb_streams, int duration) {
+	AudioStream **streams = create_streams(nb_streams);
+	MSStreamManager *manager = ms_stream_manager_new();
+	uint64_t end = ms_get_cur_time_ms() + duration * 1000;
+	clock_t begin;
+	int i;
+
+	for (i = 0; i < nb_streams; i++) {
+		ms_stream_manager_add(manager, &streams[i]->ms);
+	}
+	begin = clock();
+	while (ms_get_cur_time_ms() < end) {
+		ms_stream_manager_iterate(manager);
+		ms_stream_manager_wait(manager, (int)(end - ms_get_cur_time_ms()));
+	}
+	print_result("stream manager", nb_streams, clock() - begin, duration, ms_stream_manager_get_stats(manager)->iterations);
+	for (i = 0; i < nb_streams; i++) {
+		ms_stream_manager_remove(manager, &streams[i]->ms);
+	}
+	ms_stream_manager_destroy(manager);
+	destroy_streams(streams, nb_streams);
+}
+
+int main(int argc, char *argv[]) {
+	static const int counts[] = {1000, 5000, 10000};
+	int poll_interval = 20;
+	int duration = 5;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			duration = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--poll-interval") == 0 && i + 1 < argc) {
+			poll_interval = atoi(argv[++i]);
+		} else {
+			printf("Usage: streammanagerbench [--duration 5] [--poll-interval 20]\n");
+			return -1;
+		}
+	}
+
+	ortp_init();
+	ms_init();
+	ortp_set_log_level_mask(ORTP_ERROR|ORTP_FATAL);
+	for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); i++) {
+		run_polling(counts[i], poll_interval, duration);
+		run_manager(counts[i], duration);
+	}
+	ms_exit();
+	return 0;
+}
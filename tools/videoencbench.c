@@ -0,0 +1,161 @@
+/*
+mediastreamer2 library - modular sound and video processing and streaming
+Copyright (C) 2006  Simon MORLAT (simon.morlat@linphone.org)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/*
+ * Measures the jitter of a video ticker running several encoders together with a light filter,
+ * standing for the RTP receive and decode part of the graph, with encoding done synchronously
+ * on the ticker thread or on the encoders' worker threads.
+ */
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msvideo.h"
+
+#define MAX_ENCODERS 16
+
+typedef struct _ProbeStats {
+	uint64_t last_time;
+	uint64_t count;
+	double sum;
+	uint64_t late_ticks;
+	int max_deviation;
+} ProbeStats;
+
+static void probe_init(MSFilter *f) {
+	f->data = ms_new0(ProbeStats, 1);
+}
+
+static void probe_uninit(MSFilter *f) {
+	ms_free(f->data);
+}
+
+static void probe_process(MSFilter *f) {
+	ProbeStats *s = (ProbeStats *)f->data;
+	uint64_t now = ms_get_cur_time_ms();
+	if (s->last_time != 0) {
+		int deviation = abs((int)(now - s->last_time) - (int)f->ticker->interval);
+		s->sum += deviation;
+		if (deviation > f->ticker->interval / 2) s->late_ticks++;
+		if (deviation > s->max_deviation) s->max_deviation = deviation;
+		s->count++;
+	}
+	s->last_time = now;
+}
+
+static MSFilterDesc probe_desc = {
+	MS_FILTER_PLUGIN_ID,
+	"MSTickProbe",
+	"Records the interval between two consecutive ticks.",
+	MS_FILTER_OTHER,
+	NULL,
+	0,
+	0,
+	probe_init,
+	NULL,
+	probe_process,
+	NULL,
+	probe_uninit,
+	NULL
+};
+
+static void run_bench(const char *mime, MSVideoSize vsize, int bitrate, int nb_encoders, bool_t async, int duration) {
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *sources[MAX_ENCODERS];
+	MSFilter *encoders[MAX_ENCODERS];
+	MSFilter *sinks[MAX_ENCODERS];
+	MSFilter *probe = ms_filter_new_from_desc(&probe_desc);
+	ProbeStats *stats = (ProbeStats *)probe->data;
+	float fps = 25;
+	double mean;
+	int i;
+
+	ms_ticker_set_name(ticker, "Video bench MSTicker");
+	for (i = 0; i < nb_encoders; i++) {
+		sources[i] = ms_filter_new(MS_MIRE_ID);
+		encoders[i] = ms_filter_create_encoder(mime);
+		sinks[i] = ms_filter_new(MS_VOID_SINK_ID);
+		if (encoders[i] == NULL) {
+			ms_error("No encoder for %s", mime);
+			exit(-1);
+		}
+		ms_filter_call_method(sources[i], MS_FILTER_SET_VIDEO_SIZE, &vsize);
+		ms_filter_call_method(sources[i], MS_FILTER_SET_FPS, &fps);
+		ms_filter_call_method(encoders[i], MS_VIDEO_ENCODER_ENABLE_ASYNC, &async);
+		ms_filter_call_method(encoders[i], MS_FILTER_SET_BITRATE, &bitrate);
+		ms_filter_call_method(encoders[i], MS_FILTER_SET_VIDEO_SIZE, &vsize);
+		ms_filter_call_method(encoders[i], MS_FILTER_SET_FPS, &fps);
+		ms_filter_link(sources[i], 0, encoders[i], 0);
+		ms_filter_link(encoders[i], 0, sinks[i], 0);
+		ms_ticker_attach(ticker, sources[i]);
+	}
+	ms_ticker_attach(ticker, probe);
+
+	for (i = 0; i < duration; i++) {
+		ms_sleep(1);
+		/* keyframe requests in the middle of the run, to get the worst case */
+		if (i % 5 == 2) ms_filter_call_method_noarg(encoders[0], MS_VIDEO_ENCODER_REQ_VFU);
+	}
+
+	ms_ticker_detach(ticker, probe);
+	mean = stats->count ? stats->sum / stats->count : 0;
+	printf("%-6s %4dx%-4d encoders=%-2d %-5s ticks=%-6llu jitter mean=%6.2fms max=%4dms late=%-5llu load=%5.1f%%\n",
+		mime, vsize.width, vsize.height, nb_encoders, async ? "async" : "sync", (unsigned long long)stats->count,
+		mean, stats->max_deviation, (unsigned long long)stats->late_ticks, ms_ticker_get_average_load(ticker));
+
+	for (i = 0; i < nb_encoders; i++) {
+		ms_ticker_detach(ticker, sources[i]);
+		ms_filter_unlink(sources[i], 0, encoders[i], 0);
+		ms_filter_unlink(encoders[i], 0, sinks[i], 0);
+		ms_filter_destroy(sources[i]);
+		ms_filter_destroy(encoders[i]);
+		ms_filter_destroy(sinks[i]);
+	}
+	ms_filter_destroy(probe);
+	ms_ticker_destroy(ticker);
+}
+
+int main(int argc, char *argv[]) {
+	const char *mime = "VP8";
+	MSVideoSize vsize;
+	int nb_encoders = 2;
+	int duration = 10;
+	int i;
+
+	MS_VIDEO_SIZE_ASSIGN(vsize, 720P);
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--mime") == 0 && i + 1 < argc) {
+			mime = argv[++i];
+		} else if (strcmp(argv[i], "--encoders") == 0 && i + 1 < argc) {
+			nb_encoders = MIN(atoi(argv[++i]), MAX_ENCODERS);
+		} else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+			duration = atoi(argv[++i]);
+		} else {
+			printf("Usage: videoencbench [--mime VP8] [--encoders 2] [--duration 10]\n");
+			return -1;
+		}
+	}
+
+	ms_init();
+	ortp_set_log_level_mask(ORTP_WARNING|ORTP_ERROR|ORTP_FATAL);
+	run_bench(mime, vsize, 2000000, nb_encoders, FALSE, duration);
+	run_bench(mime, vsize, 2000000, nb_encoders, TRUE, duration);
+	ms_exit();
+	return 0;
+}